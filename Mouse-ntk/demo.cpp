@@ -9,8 +9,11 @@
 #include <iostream>
 #include <math.h>
 #include <deque>
+#include <map>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <cstdlib>
 #include <sstream>
 #include <iomanip>
@@ -21,8 +24,18 @@
 #include <ntk/camera/kinect_grabber.h>
 
 #include <ntk/camera/rgbd_processor.h>
+#include <ntk/geometry/pointer_fusion.h>
+#include <ntk/image/color_model.h>
+#include <ntk/thread/pipeline.h>
 #include <ntk/utils/opencv_utils.h>
 
+#include "../kinect_metrics.h"
+#include "../kinect_push.h"
+#include "../kinect_clock.h"
+#include "../kinect_sched.h"
+#include "../kinect_track.h"
+#include "../kinect_rle.h"
+
 //X11 Includes (MUST link these libraries in compilation  -lX11 -lXtst) 
 #include <assert.h>
 #include <X11/Xlib.h>
@@ -38,8 +51,14 @@ float pointerx = 0, pointery = 0;
 float mousex = 0, mousey = 0;
 float tmousex = 0, tmousey = 0;
 int snstvty;
-int pauseTime = 0;
+double pauseTime = 0; // ms the pointer has been held still, negative while debouncing a click
+double mouseTime = -1; // frame time of the previous pointer update, -1 if there was no hand
+kinect_clock frame_clock; // frame time from the kinect depth timestamps
 int pusx = 0, pusy = 0;
+#define CLICK_DWELL 1 // hold the pointer still
+#define CLICK_PUSH 2 // push the hand towards the kinect and back
+int click_mode = CLICK_DWELL;
+kinect_push push;
 int allowMouse = 0;
 
 // use viewer for GUI and object detection
@@ -57,9 +76,133 @@ namespace opt {
   ntk::arg<const char*> image("--image", "Fake mode, use given still image", 0);
   ntk::arg<const char*> directory("--directory", "Fake mode, use all view???? images in dir.", 0);
   ntk::arg<int> camera_id("--camera-id", "Camera id for opencv", 0);
+  ntk::arg<int> device("--device", "Index of the Kinect, one demo per Kinect (with fakenect, the source in FAKENECT_PATH)", 0);
+  ntk::arg<int> devices("--devices", "Kinects 0 to N-1 whose near blobs move one mouse, merged by --fusion, instead of the fingertips", 1);
+  ntk::arg<const char*> fusion("--fusion", "Sensor poses and screen of the --devices (yml, as PointerFusion::saveToYaml)", 0);
   ntk::arg<bool> sync("--sync", "Synchronization mode", 0);
+  ntk::arg<const char*> metrics("--metrics", "Serve Prometheus metrics on PORT, tcp:PORT or unix:/path", 0);
+  ntk::arg<int> stats("--stats", "Print a stats json event every N seconds (0 = never)", 0);
+  ntk::arg<const char*> click("--click", "Click mode: dwell, push or both", "dwell");
+  ntk::arg<double> push_mm("--push-mm", "Travel of a push click towards the sensor in mm", 40);
+  ntk::arg<double> push_ms("--push-ms", "A push click must be back within this many ms", 500);
+  ntk::arg<double> click_ms("--click-ms", "Hold the pointer still this many ms for a dwell click", 500);
+  ntk::arg<double> smooth_ms("--smooth-ms", "Average the finger count over this many ms", 133);
+  ntk::arg<const char*> sched_grabber("--sched-grabber", "Scheduling of the grabber (usb) thread: fifo:PRIORITY or other, @CPUS to pin it", 0);
+  ntk::arg<const char*> sched_main("--sched-main", "Scheduling of the analysis and mouse output thread, as --sched-grabber", 0);
+  ntk::arg<bool> lock_memory("--mlockall", "Lock the process memory so that no page fault stalls the threads", 0);
+  ntk::arg<double> sched_probe_ms("--sched-probe-ms", "Measure the scheduling latency of the threads every N ms (0 = never, default 100 with --sched-grabber or --sched-main, else 0)", -1);
+  ntk::arg<const char*> skin_model("--skin-model", "Image of skin: the hand is the skin colored pixels of the depth band (needs --calibration)", 0);
+  ntk::arg<bool> serial("--serial", "Capture, process, detect and output one after the other on the main thread, instead of a pipeline", 0);
+  ntk::arg<int> skin_threshold("--skin-threshold", "Skin likelihood (0-255) a hand pixel needs with --skin-model", 32);
+  ntk::arg<bool> depth_only("--depth-only", "Grab each depth frame as soon as it arrives, without the color stream (no --skin-model)", 0);
+  ntk::arg<double> sync_ms("--sync-ms", "Largest timestamp difference in ms between the depth and the color of a frame", 1000.0 / 60);
 }
 
+// Feeds the grabber and pipeline statistics into the shared metrics registry
+kinect_metrics metrics;
+
+class GrabberMetrics : public RGBDGrabberStatsListener, public PipelineListener
+{
+public:
+  GrabberMetrics()
+  {
+    m_frames = kinect_metrics_counter(&metrics, "kmouse_frames_received_total", "stream=\"rgbd\"",
+                                      "Frames received from the sensor", "rx");
+    m_processed = kinect_metrics_counter(&metrics, "kmouse_frames_processed_total", 0,
+                                         "Frames fully analyzed", "proc");
+    m_dropped = kinect_metrics_counter(&metrics, "kmouse_frames_dropped_total", "stream=\"depth\"",
+                                       "Depth frames missing according to the sensor timestamps", "drop");
+    m_late = kinect_metrics_counter(&metrics, "kmouse_frames_late_total", "stream=\"depth\"",
+                                    "Depth frames that reached processing late according to the sensor timestamps", "late");
+    m_unpaired = kinect_metrics_counter(&metrics, "kmouse_frames_unpaired_total", 0,
+                                        "Depth and color frames without a partner in time, or behind a newer pair", "unpaired");
+    static const double skew_bounds[] = {0.5, 1, 2, 4, 8, 16, 33};
+    m_skew = kinect_metrics_histogram(&metrics, "kmouse_rgbd_skew_ms", 0,
+                                      "Timestamp difference between the depth and the color of a frame in ms", "skew_ms",
+                                      skew_bounds, sizeof(skew_bounds)/sizeof(skew_bounds[0]));
+    m_fps = kinect_metrics_gauge(&metrics, "kmouse_fps", 0, "Grabber frame rate", "fps");
+    static const double bounds[] = {1, 2, 4, 8, 16, 33, 66, 133, 250, 500};
+    m_frame_ms = kinect_metrics_histogram(&metrics, "kmouse_stage_latency_ms", "stage=\"frame\"",
+                                          "Processing time per stage in ms", "frame_ms",
+                                          bounds, sizeof(bounds)/sizeof(bounds[0]));
+    // The pipeline stages, by the name of the stage. Registered here, before the metrics are served
+    static const char* stage_names[] = {"capture", "process", "detect", "output"};
+    const int num_stages = sizeof(stage_names)/sizeof(stage_names[0]);
+    for (int i = 0; i < num_stages; i++)
+    {
+      std::string labels = cv::format("stage=\"%s\"", stage_names[i]);
+      m_stage_names[stage_names[i]].ms = kinect_metrics_histogram(&metrics, "kmouse_stage_latency_ms", strdup(labels.c_str()),
+                                                                  "Processing time per stage in ms", 0,
+                                                                  bounds, sizeof(bounds)/sizeof(bounds[0]));
+    }
+    static const double sched_bounds[] = {0.05, 0.1, 0.25, 0.5, 1, 2, 4, 8, 16, 33};
+    m_sched_grabber = kinect_metrics_histogram(&metrics, "kmouse_sched_latency_ms", "thread=\"grabber\"",
+                                               "Wake up delay of a probe thread scheduled as the thread, in ms", "sched_ms",
+                                               sched_bounds, sizeof(sched_bounds)/sizeof(sched_bounds[0]));
+    m_sched_main = kinect_metrics_histogram(&metrics, "kmouse_sched_latency_ms", "thread=\"main\"",
+                                            "Wake up delay of a probe thread scheduled as the thread, in ms", 0,
+                                            sched_bounds, sizeof(sched_bounds)/sizeof(sched_bounds[0]));
+    m_sched_fallback = kinect_metrics_counter(&metrics, "kmouse_sched_fallbacks_total", 0,
+                                              "Thread scheduling settings that could not be applied", "sched_fail");
+    // Bound by each thread once it runs: the output stage runs on the main thread
+    m_cpu_main = kinect_metrics_thread_cpu(&metrics, "main");
+    for (int i = 0; i < num_stages; i++)
+      m_stage_names[stage_names[i]].cpu = strcmp(stage_names[i], "output")
+          ? kinect_metrics_thread_cpu(&metrics, stage_names[i]) : 0;
+  }
+
+  virtual void onNewFrame(const RGBDGrabber& grabber) { kinect_metrics_inc(m_frames); }
+  virtual void onFrameRateUpdate(const RGBDGrabber& grabber, double framerate)
+  { kinect_metrics_set(m_fps, framerate); }
+
+  // Before the pipeline starts. A stage on a thread of its own binds its thread cpu time on its first frame,
+  // from that thread
+  void addStage(const PipelineStage* stage, bool own_thread)
+  {
+    std::map<std::string, StageMetrics>::const_iterator named = m_stage_names.find(stage->name());
+    ntk_ensure(named != m_stage_names.end(), "No metrics for this pipeline stage.");
+    StageMetrics& m = m_stages[stage];
+    m = named->second;
+    if (!own_thread)
+      m.cpu = 0;
+  }
+
+  virtual void onStageDone(const PipelineStage& stage, const PipelineFrame& frame, double busy_ms)
+  {
+    std::map<const PipelineStage*, StageMetrics>::iterator m = m_stages.find(&stage);
+    if (m == m_stages.end())
+      return;
+    if (m->second.cpu && frame.index == 0)
+      kinect_metrics_bind_thread(m->second.cpu);
+    kinect_metrics_observe(m->second.ms, busy_ms);
+  }
+
+  // From the grabbed frame to the mouse output
+  virtual void onFrameDone(const PipelineFrame& frame, double latency_ms)
+  {
+    kinect_metrics_observe(m_frame_ms, latency_ms);
+    kinect_metrics_inc(m_processed);
+  }
+
+  kinect_metric* m_frames;
+  kinect_metric* m_processed;
+  kinect_metric* m_dropped;
+  kinect_metric* m_late;
+  kinect_metric* m_unpaired;
+  kinect_metric* m_skew;
+  kinect_metric* m_fps;
+  kinect_metric* m_frame_ms;
+  kinect_metric* m_sched_grabber;
+  kinect_metric* m_sched_main;
+  kinect_metric* m_sched_fallback;
+  kinect_metric* m_cpu_main;
+
+private:
+  struct StageMetrics { StageMetrics() : ms(0), cpu(0) {} kinect_metric* ms; kinect_metric* cpu; };
+  std::map<std::string, StageMetrics> m_stage_names;
+  std::map<const PipelineStage*, StageMetrics> m_stages;
+};
+
 class hand {
 public:
   hand() {}
@@ -67,7 +210,7 @@ public:
   int isClicked;
   int isOn;
   vector<Point2i> fingerTips; // our fingertips output info
-  deque<int> avg;			// used for smoothing hand data
+  deque<pair<double, int> > avg;			// used for smoothing hand data: frame time and finger count
 
   hand (cv::Point c) {
      center = c;
@@ -89,27 +232,28 @@ public:
   }
   
 	/**
-	 * Here we average the number of fingers detection for every 5 frames
+	 * Here we average the number of fingers detected over the last smooth_ms
+	 * (4 frames at 30 fps), whatever the frame rate
 	 * Should yield smoother results
 	 */
-	int smoothData() {
+	int smoothData(double t_ms) {
 		int numFingers = fingerTips.size();
 		int sum = 0;
 	
 		// push the current number of fingers detected
-		avg.push_back(numFingers);
+		avg.push_back(make_pair(t_ms, numFingers));
 		
 		//cout << "\tpushed: " << numFingers << endl;
 	
-		// check the size of the queue
+		// forget the counts older than the window
 		//cout << "\tsize: " << avg.size() << endl;
-		if (avg.size() == 5) {
+		while (avg.front().first <= t_ms - opt::smooth_ms()) {
 			avg.pop_front();
 		}	
 	
 		// compute running average of fingers detected
 		for (int i = 0; i < avg.size(); i++) {
-			sum += avg[i];		
+			sum += avg[i].second;		
 		}
 		//cout << "\tsum: " << sum << endl;
 		//cout << "\tavg: " << (sum / avg.size()) << endl;
@@ -119,214 +263,613 @@ public:
 
 hand hand1, hand2;
 
-int whichHand (Point centerPoint, int deltaThreshold, Point previous) {
-  int d1, d2;
-  if (hand1.isOn) d1 = hand1.checkDistance(centerPoint);
-  else {
-    d1 = 9999;
+// Hand centres from frame to frame, see kinect_track.h; each confirmed track holds hand1 or hand2 in user
+kinect_tracker hand_tracker;
+
+// A dead track frees its hand, a confirmed one without a hand takes a free one and moves it
+void assignHands() {
+  for (int i=0; i<hand_tracker.count; i++) {
+    kinect_track* track = &hand_tracker.tracks[i];
+    if (track->state == KINECT_TRACK_DEAD && track->user) {
+      ((hand*) track->user)->isOn = 0;
+      track->user = 0;
+    }
+  }
+  for (int i=0; i<hand_tracker.count; i++) {
+    kinect_track* track = &hand_tracker.tracks[i];
+    if (track->state != KINECT_TRACK_CONFIRMED)
+      continue;
+    if (!track->user) {
+      if (!hand1.isOn) track->user = &hand1;
+      else if (!hand2.isOn) track->user = &hand2;
+      else continue; // a third hand
+      ((hand*) track->user)->isOn = 1;
+    }
+    if (track->point >= 0)
+      ((hand*) track->user)->update(Point(track->pos.x, track->pos.y));
+  }
+}
+
+// Skin color likelihoods of the quantized colors, built from --skin-model
+HSColorLookup skinLookup;
+
+// Around each hand the tracker follows, where the hands are looked for between full frame searches
+void handRois(std::vector<cv::Rect>& rois) {
+  rois.clear();
+  for (int i=0; i<hand_tracker.count; i++) {
+    kinect_track* track = &hand_tracker.tracks[i];
+    if (track->state != KINECT_TRACK_DEAD)
+      rois.push_back(cv::Rect(track->pos.x - 120, track->pos.y - 120, 240, 240));
+  }
+}
+
+// Runs of the hand pixels of the current mask and their contours (kinect_rle.h): the same tips as
+// findContours, approxPolyDP and convexHull give, without cloning the mask or copying the contours
+kinect_rle handRle;
+
+static cv::Point toPoint(const kinect_point& p) {
+  return cv::Point(p.x, p.y);
+}
+
+void detectFingertips(cv::Mat1b handMask, cv::Mat1f debugFrame, double frame_ms) {
+  //debugFrame=debugFrame*0;
+  debugFrame=handMask;
+  static vector<kinect_rle_blob> blobs(16);
+  static vector<kinect_point> contour(4096), tips(64);
+  // approximated contour and hull of each possible hand
+  static vector<vector<kinect_point> > approxCurves(KINECT_TRACK_MAX);
+  static vector<vector<int> > hulls(KINECT_TRACK_MAX);
+
+  if (handRle.w != handMask.cols || handRle.h != handMask.rows) {
+    kinect_rle_free(&handRle);
+    ntk_ensure(kinect_rle_init(&handRle, handMask.cols, handMask.rows) == 0, "Out of memory.");
   }
-  if (hand2.isOn) d2 = hand2.checkDistance(centerPoint);
-  else {
-    d2 = 9999;
+  kinect_rle_threshold8(&handRle, handMask.data, handMask.step, 0, 0, handMask.cols, handMask.rows, 1, 255);
+  int nblobs = kinect_rle_label(&handRle, &blobs[0], blobs.size());
+  if (nblobs > (int)blobs.size()) {
+    blobs.resize(nblobs * 2);
+    kinect_rle_label(&handRle, &blobs[0], blobs.size());
   }
-  if (d1<d2 && d1<deltaThreshold) {
-    hand1.update(centerPoint);
-    hand2.update(previous);
-    return 1;
+
+  // the centres of the possible hands go through the tracker, which tells the hand of each contour
+  int numHands = 0;
+  kinect_track_point centers[KINECT_TRACK_MAX];
+  for (int i=0; i<nblobs && numHands < KINECT_TRACK_MAX; i++) {
+    int n = kinect_rle_trace(&handRle, &blobs[i], &contour[0], contour.size());
+    if (n > (int)contour.size()) {
+      contour.resize(n * 2);
+      kinect_rle_trace(&handRle, &blobs[i], &contour[0], contour.size());
+    }
+    if (kinect_rle_area(&contour[0], n) > 3000) { // possible hand
+      double sx = 0, sy = 0;
+      for (int j=0; j<n; j++) {
+        sx += contour[j].x;
+        sy += contour[j].y;
+      }
+      centers[numHands].x = sx / n;
+      centers[numHands].y = sy / n;
+      centers[numHands].z = 0;
+      vector<kinect_point>& approxCurve = approxCurves[numHands];
+      approxCurve.resize(n);
+      approxCurve.resize(kinect_rle_approx(&contour[0], n, 20, &approxCurve[0]));
+      vector<int>& hull = hulls[numHands];
+      hull.resize(approxCurve.size());
+      hull.resize(approxCurve.size() < 3 ? 0 : kinect_rle_hull(&approxCurve[0], approxCurve.size(), &hull[0]));
+      numHands++;
+    }
   }
-  else if (d2<d1 && d2<deltaThreshold) {
-    hand2.update(centerPoint);
-    hand1.update(previous);
-    return 2;
+  kinect_track_update(&hand_tracker, frame_ms, centers, numHands);
+  assignHands();
+
+  for (int k=0; k<numHands; k++) {
+    int t = hand_tracker.track_of[k];
+    hand* h = t >= 0 ? (hand*) hand_tracker.tracks[t].user : 0;
+    if (!h) continue; // not a hand yet, or a third one
+    const vector<kinect_point>& approxCurve = approxCurves[k];
+    const vector<int>& hull = hulls[k];
+    if (hull.empty())
+      continue;
+
+    // low interior angle + within upper 90% of region -> we got a finger; lower vertices are not fingers
+    float cutoff;
+    if (tips.size() < hull.size())
+      tips.resize(hull.size());
+    int nt = kinect_rle_tips(&approxCurve[0], approxCurve.size(), &hull[0], hull.size(), 1, &cutoff, &tips[0], tips.size());
+    for (int j=0; j<nt; j++) {
+      h->fingerTips.push_back(Point2i(tips[j].x, tips[j].y));
+      if (debug) {
+        cv::circle(debugFrame, toPoint(tips[j]), 10, Scalar(1), -1);
+      }
+    }
+
+    if (debug) {
+      // draw cutoff threshold
+      cv::line(debugFrame, Point(centers[k].x-100, cutoff), Point(centers[k].x+100, cutoff), Scalar(1.0f));
+
+      // draw approxCurve
+      for (size_t j=0; j<approxCurve.size(); j++) {
+        cv::circle(debugFrame, toPoint(approxCurve[j]), 10, Scalar(1.0f));
+        if (j != 0) {
+          cv::line(debugFrame, toPoint(approxCurve[j]), toPoint(approxCurve[j-1]), Scalar(1.0f));
+        } else {
+          cv::line(debugFrame, toPoint(approxCurve[0]), toPoint(approxCurve[approxCurve.size()-1]), Scalar(1.0f));
+        }
+      }
+
+      // draw approxCurve hull
+      for (size_t j=0; j<hull.size(); j++) {
+        cv::circle(debugFrame, toPoint(approxCurve[hull[j]]), 10, Scalar(1.0f), 3);
+        if(j == 0) {
+          cv::line(debugFrame, toPoint(approxCurve[hull[j]]), toPoint(approxCurve[hull[hull.size()-1]]), Scalar(1.0f));
+        } else {
+          cv::line(debugFrame, toPoint(approxCurve[hull[j]]), toPoint(approxCurve[hull[j-1]]), Scalar(1.0f));
+        }
+      }
+    }
   }
-  else return 0;
 }
-int whichHand (Point centerPoint, int deltaThreshold) {
-  int d1, d2;
-  if (hand1.isOn) d1 = hand1.checkDistance(centerPoint);
-  else {
-    d1 = 9999;
+
+// A frame of the hand tracking pipeline (ntk/thread/pipeline.h): the grabbed image, then what each stage adds
+struct HandFrame : public PipelineFrame {
+  HandFrame() : ms(0), interval_ms(0), debugFrame(480, 640) { debugFrame = 0; }
+
+  RGBDImage image;
+  double ms; // sensor time of the frame
+  double interval_ms; // time between frames
+  Mat1b depthNormalized;
+  Mat1f debugFrame; // our frame to paint fingers and circles and lines
+  hand hands[2]; // hand1 and hand2 as this frame left them
+};
+
+// Waits for the next frame of the grabber, and puts it on the sensor clock
+class CaptureStage : public PipelineStage {
+public:
+  CaptureStage(KinectGrabber* grabber, GrabberMetrics* metrics)
+    : PipelineStage("capture"), m_grabber(grabber), m_metrics(metrics), m_scheduling_checked(false), m_unpaired(0) {}
+
+  virtual bool process(PipelineFrame& f) {
+    HandFrame& frame = static_cast<HandFrame&>(f);
+    m_grabber->waitForNextFrame();
+    m_grabber->copyImageTo(frame.image);
+    frame.start_ms = Pipeline::nowMs(); // the latency starts with the frame, not with the wait for it
+    double frame_start = kinect_metrics_now_ms();
+    // The grabber thread has applied its scheduling before delivering the first frame
+    if (!m_scheduling_checked)
+    {
+      if (!m_grabber->threadSchedulingApplied())
+        kinect_metrics_inc(m_metrics->m_sched_fallback);
+      m_scheduling_checked = true;
+    }
+
+    // The pairing of the depth and color frames, see RGBDSynchronizer
+    RGBDSynchronizerStats pairing = m_grabber->syncStats();
+    kinect_metrics_add(m_metrics->m_unpaired, pairing.depth_dropped + pairing.color_dropped - m_unpaired);
+    m_unpaired = pairing.depth_dropped + pairing.color_dropped;
+    if (frame.image.depthTimestamp() && frame.image.rgbTimestamp())
+      kinect_metrics_observe(m_metrics->m_skew,
+                             std::abs(RGBDSynchronizer::ticksBetween(frame.image.depthTimestamp(), frame.image.rgbTimestamp()))
+                             / RGBDSynchronizer::ticksPerMs());
+
+    // Gestures run on the sensor time of the frame; grabbers without timestamps use the host clock
+    if (frame.image.depthTimestamp()) {
+      kinect_metrics_add(m_metrics->m_dropped,
+                         kinect_clock_update(&frame_clock, frame.image.depthTimestamp(), frame_start));
+      if (frame_clock.late)
+        kinect_metrics_inc(m_metrics->m_late);
+      frame.ms = frame_clock.ms;
+    } else {
+      frame.ms = frame_start;
+    }
+    frame.interval_ms = kinect_clock_frame_ms(&frame_clock);
+    return true;
   }
-  if (hand2.isOn) d2 = hand2.checkDistance(centerPoint);
-  else {
-    d2 = 9999;
+
+private:
+  KinectGrabber* m_grabber;
+  GrabberMetrics* m_metrics;
+  bool m_scheduling_checked;
+  int m_unpaired;
+};
+
+// Depth in meters, normalized for the hand band
+class ProcessStage : public PipelineStage {
+public:
+  ProcessStage(RGBDProcessor* processor) : PipelineStage("process"), m_processor(processor) {}
+
+  virtual bool process(PipelineFrame& f) {
+    HandFrame& frame = static_cast<HandFrame&>(f);
+    /**
+     * This is where the RGB and depth are processed
+     * Take a look at RGBDProcessor.cpp to see whats going on
+     */
+    m_processor->processImage(frame.image);
+    normalize(frame.image.depth(), frame.depthNormalized, 0, 255, NORM_MINMAX, 0);
+    return true;
   }
-  if (d1<d2 && d1<deltaThreshold) {
-    hand1.update(centerPoint);
-    return 1;
+
+private:
+  RGBDProcessor* m_processor;
+};
+
+// The hand mask, the fingertips and the hands they belong to
+class DetectStage : public PipelineStage {
+public:
+  DetectStage() : PipelineStage("detect"), m_skinFrame(0) {}
+
+  virtual bool process(PipelineFrame& f) {
+    HandFrame& frame = static_cast<HandFrame&>(f);
+    const Mat1f& depth = frame.image.depth();
+    Mat1b handMask;
+    if (skinLookup.isBuilt() && frame.image.mappedRgb().data) {
+      // the band 1 to 45 of depthNormalized in meters, skin color looked up only there
+      double dmin = 0, dmax = 0;
+      minMaxLoc(depth, &dmin, &dmax);
+      handRois(m_skinRois);
+      if (m_skinRois.empty() || m_skinFrame++ % 10 == 0)
+        m_skinRois.assign(1, cv::Rect(0, 0, depth.cols, depth.rows)); // new hands show up
+      fuseDepthAndColor(depth, frame.image.mappedRgb(),
+                        dmin + (dmax - dmin) / 255, dmin + 45 * (dmax - dmin) / 255,
+                        skinLookup, m_skinRois, m_skinProbability);
+      handMask = m_skinProbability > opt::skin_threshold();
+    } else {
+      handMask = (frame.depthNormalized < 45) & (frame.depthNormalized > 1);
+    }
+    detectFingertips(handMask, frame.debugFrame, frame.ms);
+
+    // post smoothing
+    hand1.smoothData(frame.ms);
+    hand2.smoothData(frame.ms);
+
+    // the output stage works on what this frame found, while the next frame is detected
+    frame.hands[0] = hand1;
+    frame.hands[1] = hand2;
+    hand2.fingerTips.clear();
+    hand1.fingerTips.clear();
+    return true;
   }
-  else if (d2<d1 && d2<deltaThreshold) {
-    hand2.update(centerPoint);
-    return 2;
+
+private:
+  std::vector<cv::Rect> m_skinRois;
+  Mat1b m_skinProbability;
+  int m_skinFrame;
+};
+
+// Moves the X mouse towards (mx, my), in the screen enlarged by 200 pixels on the left and top, with
+// the dwell and push clicks; pz is the distance in m the push is towards (to the sensor, or to the screen), 0 when unknown
+void movePointer(int mx, int my, float pz, double frame_ms, double interval_ms) {
+  if(mx > tmousex) tmousex+= (mx - tmousex) / 7;
+  if(mx < tmousex) tmousex-= (tmousex - mx) / 7;
+  if(my > tmousey) tmousey+= (my - tmousey) / 7;
+  if(my < tmousey) tmousey-= (tmousey - my) / 7;
+
+  if((pusx <= (mx + 15))  && (pusx >= (mx - 15)) && (pusy <= (my + 15))  && (pusy >= (my - 15))) {
+    pauseTime += mouseTime >= 0 ? frame_ms - mouseTime : interval_ms;
+    printf("\n%.0f ms\n", pauseTime);
+  } else {
+    pusx = mx;
+    pusy = my;
+    pauseTime = 0;
+  }
+  mouseTime = frame_ms;
+
+  if((click_mode & CLICK_DWELL) && pauseTime > opt::click_ms()) {
+    pauseTime = -2 * opt::click_ms();
+    XTestFakeButtonEvent(display, 1, TRUE, CurrentTime);
+    XTestFakeButtonEvent(display, 1, FALSE, CurrentTime);
   }
-  else return 0;
+
+  // push click where the pointer was before the push
+  int cx = tmousex, cy = tmousey;
+  if((click_mode & CLICK_PUSH) && pz > 0 && kinect_push_update(&push, frame_ms, pz * 1000, &cx, &cy)) {
+    pauseTime = 0;
+    XTestFakeMotionEvent(display, -1, cx-200, cy-200, CurrentTime);
+    XTestFakeButtonEvent(display, 1, TRUE, CurrentTime);
+    XTestFakeButtonEvent(display, 1, FALSE, CurrentTime);
+  }
+
+  XTestFakeMotionEvent(display, -1, tmousex-200, tmousey-200, CurrentTime);
+  XSync(display, 0);
 }
 
-void detectFingertips(cv::Mat1f z, float zMin, float zMax, cv::Mat1f debugFrame) {
-  Mat handMask = (z < zMax) & (z > zMin);
-  //debugFrame=debugFrame*0;
-  debugFrame=handMask;
-  std::vector<std::vector<cv::Point> > contours;
-  Point previous;
-  vector<Point2i> previousFingerTips;
-  cv::findContours(handMask, contours, CV_RETR_LIST, CV_CHAIN_APPROX_SIMPLE);
-  int deltaThreshold = 50;
-  int delta = 20;//the looped deltathreshold increase factor IDEA: make this exponential
-  int numHands=0;//the number hands we have contours for
-  int handNumber=0;//either 0 1 or 2 depending on which hand we have the contour for
-  if (contours.size()) {
-    //cout << contours.size() << endl;
-    for (int i=0; i<contours.size(); i++) {
-      vector<Point> contour = contours[i];
-      Mat contourMat = Mat(contour);
-      double area = cv::contourArea(contourMat);
-      if (area > 3000)  { // possible hand
-	Scalar center = mean(contourMat);
-	
-	// here we compute the new center of the hand
-	Point centerPoint = Point(center.val[0], center.val[1]);
-	if ( i != contours.size()-1) { // if second hand
-	  numHands = 2;
-	  hand1.isOn=hand2.isOn=1;
-	  previous = centerPoint;
-	  }
-      	else if (numHands!=2) { // if only one hand
-	  numHands = 1;
-	  do {
-	    handNumber = whichHand(centerPoint, deltaThreshold);
-	    deltaThreshold+=delta;
-	    switch (whichHand(centerPoint, deltaThreshold,previous)) {
-	    case 1:
-	      hand2.isOn=0;
-	    case 2:
-	      hand1.isOn=0;
-	    case 0:
-	      hand1.isOn=hand2.isOn=1; //fix corner case
-	    }
-	    if (deltaThreshold >= 9999) break;
-	  } while (!handNumber);
-	}
-	//cout << i<< " # "<< centerPoint.x << "," << centerPoint.y << endl;
-	//which hand do we have centerPoint for?
-	//sees if the current point is closer to where hand1 was or hand2 was
-	if ((i == contours.size()-1) && (numHands==2)) {
-	  do {
-	    handNumber = whichHand(centerPoint, deltaThreshold,previous);
-	    deltaThreshold+=delta;
-	    if (deltaThreshold >= 9999) {
-	      if (hand1.isOn) {
-		//hand 2 must have appeared
-		hand2.isOn = 1;
-		//cout<<"two on"<<endl;
-		hand2.update(centerPoint);
-		hand1.update(previous);
-		circle (debugFrame, hand1.center, 10, CV_RGB(250,0,0), 4);
-	      }
-	      else if (hand2.isOn) {
-		//hand 1 must have appeared
-		hand1.isOn=1;
-		//cout<<"one on"<<endl;
-		hand1.update(centerPoint);
-		hand2.update(previous);
-		circle (debugFrame, hand2.center, 10, CV_RGB(250,0,0), 10); //the big circle is the one that is hand 1
-	      }
-	      else {
-		//cout<<"no hands?"<<endl;
-	      }
-	      //break;
-	    }
-	  } while (!handNumber);
-	}
-	
-       	vector<Point> approxCurve;
-	cv::approxPolyDP(contourMat, approxCurve, 20, true);
-
-	vector<int> hull;
-	cv::convexHull(Mat(approxCurve), hull);
-
-	// find upper and lower bounds of the hand and define cutoff threshold (don't consider lower vertices as fingers)
-	int upper = 640, lower = 0;
-	for (int j=0; j<hull.size(); j++) {
-	  int idx = hull[j]; // corner index
-	  if (approxCurve[idx].y < upper) upper = approxCurve[idx].y;
-	  if (approxCurve[idx].y > lower) lower = approxCurve[idx].y;
-	}
-	float cutoff = lower - (lower - upper) * 0.1f;
-
-	// find interior angles of hull corners
-	for (int j=0; j<hull.size(); j++) {
-	  int idx = hull[j]; // corner index
-	  int pdx = idx == 0 ? approxCurve.size() - 1 : idx - 1; //  predecessor of idx
-	  int sdx = idx == approxCurve.size() - 1 ? 0 : idx + 1; // successor of idx
-
-	  Point v1 = approxCurve[sdx] - approxCurve[idx];
-	  Point v2 = approxCurve[pdx] - approxCurve[idx];
-
-	  float angle = acos( (v1.x*v2.x + v1.y*v2.y) / (norm(v1) * norm(v2)) );
-
-	  // low interior angle + within upper 90% of region -> we got a finger
-	  if (angle < 1 && approxCurve[idx].y < cutoff) {
-	    int u = approxCurve[idx].x;
-	    int v = approxCurve[idx].y;
-
-	    //cout<<"ABOUT TO ADD A FINGER TO HAND " << handNumber<<endl;
-	    if (handNumber == 1) {
-	      hand1.fingerTips.push_back(Point2i(u,v));
-	      if (numHands == 2) hand2.fingerTips=previousFingerTips;
-	    }
-	    else if (handNumber == 2) {
-	      hand2.fingerTips.push_back(Point2i(u,v));
-	      if (numHands == 2) hand1.fingerTips=previousFingerTips;
-	    }
-	    else {
-	      previousFingerTips.push_back(Point2i(u,v));
-	    }
-	    	    
-	    if (debug) {
-	      cv::circle(debugFrame, approxCurve[idx], 10, Scalar(1), -1);
-	    }
-	  }
-	}
-
-	if (debug) {
-	  // draw cutoff threshold
-	  cv::line(debugFrame, Point(center.val[0]-100, cutoff), Point(center.val[0]+100, cutoff), Scalar(1.0f));
-
-	  // draw approxCurve
-	  for (int j=0; j<approxCurve.size(); j++) {
-	    cv::circle(debugFrame, approxCurve[j], 10, Scalar(1.0f));
-	    if (j != 0) {
-	      cv::line(debugFrame, approxCurve[j], approxCurve[j-1], Scalar(1.0f));
-	    } else {
-	      cv::line(debugFrame, approxCurve[0], approxCurve[approxCurve.size()-1], Scalar(1.0f));
-	    }
-	  }
-
-	  // draw approxCurve hull
-	  for (int j=0; j<hull.size(); j++) {
-	    cv::circle(debugFrame, approxCurve[hull[j]], 10, Scalar(1.0f), 3);
-	    if(j == 0) {
-	      cv::line(debugFrame, approxCurve[hull[j]], approxCurve[hull[hull.size()-1]], Scalar(1.0f));
-	    } else {
-	      cv::line(debugFrame, approxCurve[hull[j]], approxCurve[hull[j-1]], Scalar(1.0f));
-	    }
-	  }
-	}
+// Draws the hands, shows the windows and moves the X mouse; on the main thread for the windows
+class OutputStage : public PipelineStage {
+public:
+  OutputStage(RGBDGrabber* grabber, Pipeline* pipeline)
+    : PipelineStage("output"), m_grabber(grabber), m_pipeline(pipeline) {}
+
+  virtual bool process(PipelineFrame& f) {
+    HandFrame& frame = static_cast<HandFrame&>(f);
+    const hand& hand1 = frame.hands[0];
+    const hand& hand2 = frame.hands[1];
+    const Mat1f& depth = frame.image.depth();
+    Mat1f& debugFrame = frame.debugFrame;
+    double frame_ms = frame.ms;
+
+    // Without the color stream, the hands are drawn on the depth band
+    if (opt::depth_only())
+      cvtColor(frame.depthNormalized, frame.image.rgbRef(), CV_GRAY2BGR);
+
+    //Show the frames per second of the grabber
+    int fps = m_grabber->frameRate();
+    cv::putText(frame.image.rgbRef(),
+    		cv::format("%d fps", fps),
+    		Point(10,20), 0, 0.5, Scalar(255,0,0,255));
+
+    // update hand centers
+    if(hand1.isOn) circle (frame.image.rgbRef(), hand1.center, 10, CV_RGB(255,0,0), 10);
+    if(hand2.isOn) circle (frame.image.rgbRef(), hand2.center, 10, CV_RGB(0,255,0), 10);
+    
+    // draw fingertips
+    for(vector<Point2i>::const_iterator it = hand1.fingerTips.begin(); it != hand1.fingerTips.end(); it++) {
+      circle(debugFrame, (*it), 10, Scalar(1.0f), -1);
+      circle (frame.image.rgbRef(), (*it), 5, CV_RGB(255,0,0), 5);
+    }
+    for(vector<Point2i>::const_iterator it = hand2.fingerTips.begin(); it != hand2.fingerTips.end(); it++) {
+      circle(debugFrame, (*it), 10, Scalar(1.0f), -1);
+      circle (frame.image.rgbRef(), (*it), 5, CV_RGB(0,255,0), 5);
+    }
+    imshow("fingers", debugFrame);
+    
+    // Display the color image
+    imshow("color", frame.image.rgb());
+
+   //X11 Mouse Control Code
+    //Right now giving priority to hand 1
+    int px, py, isMouse=0;
+    if(hand1.isOn&&(hand1.center.x!=0 && hand1.center.y!=0)){
+      px = hand1.center.x; py = hand1.center.y;
+      isMouse=1;
+    }
+    else if((hand2.isOn&&!hand1.isOn&&(hand2.center.x!=0 && hand2.center.y!=0))||
+	    (hand2.isOn&&(hand1.center.x!=0 && hand1.center.y!=0))){
+	cout << "made it here" << endl;
+      px = hand2.center.x; py = hand2.center.y;
+      isMouse=1;
+    }
+    //cout << "x= " << hand1.center.x << "y = " hand1.center.y << endl;
+
+
+      if(isMouse&&allowMouse){
+	    pointerx = ((px-640.0f) / -1);
+	    pointery = (py);
+	    mousex = ((pointerx / 630.0f) * screenw);
+	    mousey = ((pointery / 470.0f) * screenh);
+	    movePointer(mousex, mousey, depth(py, px), frame_ms, frame.interval_ms);
       }
+      else
+        mouseTime = -1; // no hand: the time without it is no hold
+
+    unsigned char c = cv::waitKey(1) & 0xff; // the other stages have the next frame going meanwhile
+    if (c == 'q' || c == 27)
+      m_pipeline->stop();
+    else if (c == 'm'){
+      if(allowMouse==0)
+	allowMouse=1;
+      else
+	allowMouse=0;
+
     }
+    return true;
   }
-  if (numHands==0) {
-    hand1.isOn=hand2.isOn=0;
+
+private:
+  RGBDGrabber* m_grabber;
+  Pipeline* m_pipeline;
+};
+
+// --devices: the near blobs of each Kinect, merged into the pointers of one screen by a
+// PointerFusion (ntk/geometry/pointer_fusion.h), instead of the fingertips of one Kinect
+const float fusedBand = 0.08f; // depth of the hands behind the nearest point, in m
+const int fusedMinArea = 200; // smallest blob, in pixels
+const float fusedFollow = 0.2f; // the mouse follows its pointer when it moves less than this between frames, in m
+
+// The blobs of the band behind the nearest point of the depth image, their centroid and mean
+// depth from their runs; the id of a pointer is its index
+void detectPointers(const Mat1f& depth, std::vector<SensorPointer>& pointers) {
+  static kinect_rle rle;
+  static vector<kinect_rle_blob> blobs(16);
+  static vector<double> sums; // x, y and depth of the pixels of each blob
+  pointers.clear();
+  float nearest = 1e9f;
+  for_all_rc(depth)
+    if (depth(r,c) > 0.4f && depth(r,c) < nearest)
+      nearest = depth(r,c);
+  if (nearest > 4)
+    return;
+
+  Mat1b band = (depth > 0.4f) & (depth < nearest + fusedBand);
+  if (rle.w != band.cols || rle.h != band.rows) {
+    kinect_rle_free(&rle);
+    ntk_ensure(kinect_rle_init(&rle, band.cols, band.rows) == 0, "Out of memory.");
+  }
+  kinect_rle_threshold8(&rle, band.data, band.step, 0, 0, band.cols, band.rows, 1, 255);
+  int nblobs = kinect_rle_label(&rle, &blobs[0], blobs.size());
+  if (nblobs > (int)blobs.size()) {
+    blobs.resize(nblobs * 2);
+    kinect_rle_label(&rle, &blobs[0], blobs.size());
+  }
+
+  sums.assign(nblobs * 3, 0);
+  for (int i=0; i<rle.count; i++) {
+    const kinect_rle_run& run = rle.runs[i];
+    double* sum = &sums[run.label * 3];
+    for (int x=run.x0; x<run.x1; x++) {
+      sum[0] += x;
+      sum[1] += run.y;
+      sum[2] += depth(run.y, x);
+    }
+  }
+  for (int i=0; i<nblobs; i++) {
+    if (blobs[i].area < fusedMinArea)
+      continue;
+    const double* sum = &sums[blobs[i].label * 3];
+    Point2f center (sum[0] / blobs[i].area, sum[1] / blobs[i].area);
+    pointers.push_back(SensorPointer(center, sum[2] / blobs[i].area,
+                                     PointerFusion::borderWeight(center, depth.size()), pointers.size()));
   }
 }
 
+// Each grabber pumps its own Kinect on its own thread; the strongest fused pointer moves the mouse
+int runFusedPointers(const std::vector<KinectGrabber*>& grabbers, RGBDProcessor& processor,
+                     const PointerFusion& fusion, GrabberMetrics& grabber_metrics) {
+  RGBDImage image;
+  std::vector< std::vector<SensorPointer> > pointers (grabbers.size());
+  std::vector<FusedPointer> fused;
+  int driving = -1; // the fused pointer that moves the mouse
+  Point3f drivingWorld;
+  // the screen of the fusion, scaled down
+  const double scale = 480.0 / fusion.screenSize().width;
+  Mat3b view (std::max(1, int(fusion.screenSize().height * scale)), 480);
+  namedWindow("pointers");
+
+  for (;;) {
+    double frame_start = kinect_metrics_now_ms(), frame_ms = frame_start;
+    for (size_t i = 0; i < grabbers.size(); ++i) {
+      grabbers[i]->waitForNextFrame();
+      grabbers[i]->copyImageTo(image);
+      // gestures run on the sensor time of the first Kinect
+      if (i == 0 && image.depthTimestamp()) {
+        kinect_metrics_add(grabber_metrics.m_dropped,
+                           kinect_clock_update(&frame_clock, image.depthTimestamp(), frame_start));
+        frame_ms = frame_clock.ms;
+      }
+      processor.processImage(image);
+      detectPointers(image.depth(), pointers[i]);
+    }
+    fusion.fuse(pointers, fused);
+    kinect_metrics_inc(grabber_metrics.m_processed);
+
+    // The mouse stays with its pointer, the nearest one to where it was, instead of jumping to
+    // the strongest one of each frame; the strongest one takes over when it is lost
+    int previous = driving;
+    driving = fused.empty() ? -1 : 0;
+    if (previous >= 0) {
+      float nearest = fusedFollow * fusedFollow;
+      for (size_t k = 0; k < fused.size(); ++k) {
+        Point3f d = fused[k].world - drivingWorld;
+        if (d.dot(d) < nearest) {
+          nearest = d.dot(d);
+          driving = k;
+        }
+      }
+    }
+    if (driving >= 0)
+      drivingWorld = fused[driving].world;
+
+    // green when several Kinects see the pointer, the filled one moves the mouse
+    view = Vec3b(0, 0, 0);
+    for (size_t k = 0; k < fused.size(); ++k) {
+      bool several = (fused[k].sensors & (fused[k].sensors - 1)) != 0;
+      circle(view, Point(fused[k].screen.x * scale, fused[k].screen.y * scale), 8,
+             several ? CV_RGB(0,255,0) : CV_RGB(255,0,0), int(k) == driving ? -1 : 2);
+    }
+    cv::putText(view, cv::format("%d kinects, %.0f fps", int(grabbers.size()), grabbers[0]->frameRate()),
+                Point(10,20), 0, 0.5, Scalar(255,0,0,255));
+    imshow("pointers", view);
+
+    // The push depth is the distance of the fused point to the screen: the depth of one sensor
+    // would jump when another one takes over in the overlap
+    if (driving >= 0 && allowMouse) {
+      const FusedPointer& f = fused[driving];
+      movePointer(f.screen.x * (screenw - 200) / fusion.screenSize().width + 200,
+                  f.screen.y * (screenh - 200) / fusion.screenSize().height + 200,
+                  std::max(0.f, fusion.screenDistance(f.world)), frame_ms, kinect_clock_frame_ms(&frame_clock));
+    }
+    else
+      mouseTime = -1; // no pointer: the time without it is no hold
+
+    unsigned char c = cv::waitKey(1) & 0xff;
+    if (c == 'q' || c == 27)
+      break;
+    else if (c == 'm')
+      allowMouse = !allowMouse;
+  }
+
+  for (size_t i = 0; i < grabbers.size(); ++i) {
+    grabbers[i]->setShouldExit();
+    grabbers[i]->newEvent();
+    grabbers[i]->wait();
+  }
+  return 0;
+}
+
 int main(int argc, char** argv) {
   arg_base::set_help_option("-h");
   arg_parse(argc, argv);
   ntk_debug_level = 1;
   cv::setBreakOnError(true);
+  // Several Kinects: the poses of the sensors and the screen they share
+  PointerFusion fusion;
+  if (opt::devices() > 1) {
+    if (!opt::fusion())
+      fatal_error("--devices needs --fusion, the sensor poses and the screen");
+    fusion.loadFromFile(opt::fusion());
+    if (fusion.numSensors() != opt::devices())
+      fatal_error("--fusion must have one sensor pose per device");
+  }
   KinectGrabber * grabber = new KinectGrabber();
-  grabber->initialize(); 
+  grabber->initialize(opt::devices() > 1 ? 0 : opt::device()); 
+
+  kinect_metrics_init(&metrics);
+  GrabberMetrics grabber_metrics;
+  grabber->setStatsListener(&grabber_metrics);
+  kinect_metrics_bind_thread(grabber_metrics.m_cpu_main);
+  if (opt::metrics() && kinect_metrics_serve(&metrics, opt::metrics()) < 0)
+    ntk_dbg(0) << "[WARNING] Could not serve metrics on " << opt::metrics();
+  if (opt::stats() > 0)
+    kinect_metrics_start_stats(&metrics, opt::stats() * 1000, stdout);
+
+  if (!strcmp(opt::click(), "push"))
+    click_mode = CLICK_PUSH;
+  else if (!strcmp(opt::click(), "both"))
+    click_mode = CLICK_DWELL | CLICK_PUSH;
+  kinect_push_config push_config;
+  kinect_push_default_config(&push_config);
+  push_config.depth_mm = opt::push_mm();
+  push_config.max_ms = opt::push_ms();
+  kinect_push_init(&push, &push_config);
+  kinect_clock_init(&frame_clock);
+
+  // Hand centres move fast and jump with the contour: a wide gate, and a hand stays a while when it is not seen
+  kinect_track_config hand_track_config;
+  kinect_track_default_config(&hand_track_config);
+  hand_track_config.gate = 150;
+  hand_track_config.lost_ms = 200;
+  kinect_track_init(&hand_tracker, &hand_track_config);
+
+  // Thread scheduling, see kinect_sched.h. The grabber thread pumps the usb
+  // events, the analysis and the mouse output run on this thread
+  kinect_sched_config sched_grabber, sched_main;
+  kinect_sched_default_config(&sched_grabber);
+  kinect_sched_default_config(&sched_main);
+  if (opt::sched_grabber() && kinect_sched_parse(&sched_grabber, opt::sched_grabber()) < 0)
+    fatal_error("Bad --sched-grabber, expected fifo:PRIORITY or other, then @CPUS");
+  if (opt::sched_main() && kinect_sched_parse(&sched_main, opt::sched_main()) < 0)
+    fatal_error("Bad --sched-main, expected fifo:PRIORITY or other, then @CPUS");
+  if (opt::lock_memory() && kinect_sched_lock_memory() < 0)
+  {
+    ntk_dbg(0) << "[WARNING] Could not lock memory: " << strerror(errno) << ", continuing unlocked";
+    kinect_metrics_inc(grabber_metrics.m_sched_fallback);
+  }
+  ThreadScheduling grabber_scheduling;
+  grabber_scheduling.realtime = sched_grabber.policy == SCHED_FIFO;
+  grabber_scheduling.priority = sched_grabber.priority;
+  grabber_scheduling.cpu_mask = sched_grabber.cpus;
+  grabber->setThreadScheduling(grabber_scheduling);
+  // Frames are depth and color matched by their timestamps, or each depth frame as soon as it arrives
+  if (opt::depth_only() || opt::devices() > 1)
+    grabber->setSyncMode(RGBDSynchronizer::DepthOnly);
+  grabber->setSyncToleranceMs(opt::sync_ms());
+  // The probes wake up on their own: only when the scheduling is tuned, unless asked for
+  double sched_probe_ms = opt::sched_probe_ms();
+  if (sched_probe_ms < 0)
+    sched_probe_ms = opt::sched_grabber() || opt::sched_main() ? 100 : 0;
+  kinect_sched_probe grabber_probe, main_probe;
+  if (sched_probe_ms > 0)
+  {
+    kinect_sched_probe_start(&grabber_probe, &sched_grabber, sched_probe_ms, grabber_metrics.m_sched_grabber);
+    kinect_sched_probe_start(&main_probe, &sched_main, sched_probe_ms, grabber_metrics.m_sched_main);
+  }
 
   //Initialize X11 Stuff
 	display = XOpenDisplay(0);
@@ -361,12 +904,50 @@ int main(int argc, char** argv) {
   // Set camera tilt.
   grabber->setTiltAngle(25);
   grabber->start();
-
+  // After starting the grabber, whose thread would inherit it
+  if (kinect_sched_apply(pthread_self(), &sched_main))
+  {
+    ntk_dbg(0) << "[WARNING] Could not apply --sched-main " << opt::sched_main() << ": " << strerror(errno)
+               << ", keeping the default scheduling";
+    kinect_metrics_inc(grabber_metrics.m_sched_fallback);
+  }
   // Postprocess raw kinect data.
   // Tell the processor to transform raw depth into meters using baseline-offset technique.
   RGBDProcessor processor;
   processor.setFilterFlag(RGBDProcessor::ComputeKinectDepthBaseline, true);
 
+  // One grabber, freenect context and usb thread per Kinect, with the settings of the first one
+  if (opt::devices() > 1) {
+    std::vector<KinectGrabber*> grabbers (1, grabber);
+    for (int i = 1; i < opt::devices(); ++i) {
+      KinectGrabber* other = new KinectGrabber();
+      other->initialize(i);
+      other->setStatsListener(&grabber_metrics);
+      other->setThreadScheduling(grabber_scheduling);
+      other->setSyncMode(RGBDSynchronizer::DepthOnly);
+      if (calib_data)
+        other->setCalibrationData(*calib_data);
+      other->start();
+      grabbers.push_back(other);
+    }
+    return runFusedPointers(grabbers, processor, fusion, grabber_metrics);
+  }
+
+  // The hand is the skin colored part of the depth band: the color registered to the depth image is needed
+  if (opt::skin_model()) {
+    cv::Mat3b skin = imread(opt::skin_model());
+    if (opt::depth_only()) {
+      ntk_dbg(0) << "[WARNING] --skin-model needs the color stream, not --depth-only, using the depth band only";
+    } else if (!skin.data || !calib_data) {
+      ntk_dbg(0) << "[WARNING] --skin-model needs a readable image and the calibration, using the depth band only";
+    } else {
+      HSColorModel skinModel;
+      skinModel.build(skin, Mat1b() /* empty mask, use all image */);
+      skinLookup.build(skinModel);
+      processor.setFilterFlag(RGBDProcessor::ComputeMapping, true);
+    }
+  }
+
   // OpenCV windows.
   namedWindow("color");
   //namedWindow("depth_as_color");
@@ -374,161 +955,38 @@ int main(int argc, char** argv) {
   //namedWindow("depth_normalized");
   namedWindow("fingers");
 
-  // OpenCV variables
-  cv::Mat z(480, 640, CV_32FC1); //our matrix to mask with
-  Mat1f debugFrame(480, 640); //our frame to paint fingers and circles and lines
-  debugFrame = z * 0.1;//??
   hand1.center.x=300;
   hand1.center.y=200;
 
-  int counter;
-  // Current image. An RGBDImage stores rgb and depth data.
-  RGBDImage current_frame;
-  while (true) {
-    grabber->waitForNextFrame();
-    grabber->copyImageTo(current_frame);
-		
-    /**
-     * This is where the RGB and depth are processed
-     * Take a look at RGBDProcessor.cpp to see whats going on
-     */
-    processor.processImage(current_frame);
-		
-    //Show the frames per second of the grabber
-    int fps = grabber->frameRate();
-    cv::putText(current_frame.rgbRef(),
-    		cv::format("%d fps", fps),
-    		Point(10,20), 0, 0.5, Scalar(255,0,0,255));
-		
-    // Show the depth image as normalized gray scale
-    //imshow_normalized("depth", current_frame.depth());
-
-    // Compute color encoded depth.
-    //cv::Mat3b depth_as_color;
-    //compute_color_encoded_depth(current_frame.depth(), depth_as_color);
-    //imshow("depth_as_color", depth_as_color);
-		
-		
-    // get the depth channel and show it	
-    Mat1f depth = current_frame.depth();
-    //imshow("depth", depth);
-		
-    // normalize the depth channel and show it
-    Mat1b depth_normalized;
-    normalize(depth, depth_normalized, 0, 255, NORM_MINMAX, 0);
-    //imshow("depth_normalized", depth_normalized);
-
-    // failed attempt at thresholding
-    //Mat1f thresh;
-    //threshold(depth, thresh, 2, 2, THRESH_TOZERO);
-    //imshow("thresh", thresh);
-		
-    /*
-      for (int i = 0; i < d.rows; i++) {
-      for (int j = 0;j < d.cols; j++) {
-      if (d.at<float>(i, j) > 10) {
-      cout << d.at<float>(i, j) << " ";
-      }
-      }
-      cout << endl;
-      }
-    */
-    //cout << endl << endl;
-
-    // OpenCV Magic
-    std::vector<cv::Point2i> fingerTips; //our fingertips output info
-    detectFingertips(depth_normalized, 1, 45, debugFrame);
-    
-    // update hand centers
-    if(hand1.isOn) circle (current_frame.rgbRef(), hand1.center, 10, CV_RGB(255,0,0), 10);
-    if(hand2.isOn) circle (current_frame.rgbRef(), hand2.center, 10, CV_RGB(0,255,0), 10);
-    
-    // post smoothing
-    //cout << "for hand 1... " << endl;
-    hand1.smoothData();
-    //cout << "for hand 2... " << endl;
-    hand2.smoothData();
-    
-    // draw fingertips
-    for(vector<Point2i>::iterator it = hand1.fingerTips.begin(); it != hand1.fingerTips.end(); it++) {
-      circle(debugFrame, (*it), 10, Scalar(1.0f), -1);
-      circle (current_frame.rgbRef(), (*it), 5, CV_RGB(255,0,0), 5);
-    }
-    for(vector<Point2i>::iterator it = hand2.fingerTips.begin(); it != hand2.fingerTips.end(); it++) {
-      circle(debugFrame, (*it), 10, Scalar(1.0f), -1);
-      circle (current_frame.rgbRef(), (*it), 5, CV_RGB(0,255,0), 5);
-    }
-    imshow("fingers", debugFrame);
-    
-    // Display the color image
-    imshow("color", current_frame.rgb());
-    hand2.fingerTips.clear();
-    hand1.fingerTips.clear();
-
-   //X11 Mouse Control Code
-    //Right now giving priority to hand 1
-    int px, py, isMouse=0;
-    if(hand1.isOn&&(hand1.center.x!=0 && hand1.center.y!=0)){
-      px = hand1.center.x; py = hand1.center.y;
-      isMouse=1;
-    }
-    else if((hand2.isOn&&!hand1.isOn&&(hand2.center.x!=0 && hand2.center.y!=0))||
-	    (hand2.isOn&&(hand1.center.x!=0 && hand1.center.y!=0))){
-	cout << "made it here" << endl;
-      px = hand2.center.x; py = hand2.center.y;
-      isMouse=1;
-    }
-    //cout << "x= " << hand1.center.x << "y = " hand1.center.y << endl;
-
-
-      if(isMouse&&allowMouse){
-	    pointerx = ((px-640.0f) / -1);
-	    pointery = (py);
-	    mousex = ((pointerx / 630.0f) * screenw);
-	    mousey = ((pointery / 470.0f) * screenh);
-	    int mx , my;
-	    mx = mousex;
-	    my = mousey;
-
-		if(mx > tmousex) tmousex+= (mx - tmousex) / 7;
-		if(mx < tmousex) tmousex-= (tmousex - mx) / 7;
-		if(my > tmousey) tmousey+= (my - tmousey) / 7;
-		if(my < tmousey) tmousey-= (tmousey - my) / 7;			
-
-		if((pusx <= (mx + 15))  && (pusx >= (mx - 15)) && (pusy <= (my + 15))  && (pusy >= (my - 15))) {
-			pauseTime++;
-			printf("\n%d\n", pauseTime);
-		} else {
-			pusx = mx;
-			pusy = my;
-			pauseTime = 0;
-		}		
-
-		    if(pauseTime > 15) {
-				pauseTime = -30;
-				XTestFakeButtonEvent(display, 1, TRUE, CurrentTime);
-				XTestFakeButtonEvent(display, 1, FALSE, CurrentTime);
-			}
-
-			//printf("-- %d x %d -- \n", mx, my);
-
-			XTestFakeMotionEvent(display, -1, tmousex-200, tmousey-200, CurrentTime);
-			XSync(display, 0);
-
-			//printf("\n\n %d  -  %d \n\n", mx, my);
-      }
-    
-    unsigned char c = cv::waitKey(10) & 0xff;
-    if (c == 'q' || c == 27)
-      exit(0);
-    else if (c == 'm'){
-      if(allowMouse==0)
-	allowMouse=1;
-      else
-	allowMouse=0;
-
-    }
-  }
+  // Capture, depth processing, detection and output run on their own threads, on successive frames
+  Pipeline pipeline;
+  CaptureStage capture(grabber, &grabber_metrics);
+  ProcessStage process(&processor);
+  DetectStage detect;
+  OutputStage output(grabber, &pipeline);
+  pipeline.addStage(&capture);
+  pipeline.addStage(&process);
+  pipeline.addStage(&detect);
+  pipeline.addStage(&output);
+  for (int i = 0; i < pipeline.numStages(); i++)
+    pipeline.addFrame(new HandFrame());
+  pipeline.setListener(&grabber_metrics);
+  grabber_metrics.addStage(&capture, !opt::serial());
+  grabber_metrics.addStage(&process, !opt::serial());
+  grabber_metrics.addStage(&detect, !opt::serial());
+  grabber_metrics.addStage(&output, false); // on this thread
+  ThreadScheduling main_scheduling;
+  main_scheduling.realtime = sched_main.policy == SCHED_FIFO;
+  main_scheduling.priority = sched_main.priority;
+  main_scheduling.cpu_mask = sched_main.cpus;
+  capture.setThreadScheduling(main_scheduling);
+  process.setThreadScheduling(main_scheduling);
+  detect.setThreadScheduling(main_scheduling);
+
+  if (opt::serial())
+    pipeline.runSerial();
+  else
+    pipeline.run();
 
   return 0;
 }
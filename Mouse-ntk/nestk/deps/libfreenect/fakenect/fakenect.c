@@ -31,49 +31,117 @@
 #include <unistd.h>
 #include <time.h>
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "fakenect_file.h"
+#include "synth.h"
 
 #define GRAVITY 9.80665
 
-// The dev and ctx are just faked with these numbers
+// One fake device per source in FAKENECT_PATH (comma separated), each with
+// its own recording, callbacks and replay clock
+#define MAX_SOURCES 16
+
+// Part of a single file recording mapped at a time: recordings pass 2 GB in
+// a minute, more than a 32 bit process can map at once
+#define WINDOW_SIZE (64 << 20)
+
+struct _freenect_device {
+	freenect_context *ctx;
+	freenect_device *next;     // in its context
+	int index;
+	char *input_path;
+	freenect_depth_cb cur_depth_cb;
+	freenect_video_cb cur_rgb_cb;
+	freenect_depth_rows_cb cur_depth_rows_cb;
+	int depth_rows_per_band;
+	FILE *index_fp;
+	freenect_raw_tilt_state state;
+	void *depth_buffer;
+	void *rgb_buffer;
+	int depth_running;
+	int rgb_running;
+	freenect_video_format video_format;
+	uint8_t rgb_half_buffer[FREENECT_VIDEO_RGB_HALF_SIZE];
+	void *user_ptr;
+
+	// Single file recordings (source file.fkn): the index is read, the chunks
+	// are mapped read only a window at a time
+	int file_fd;               // -1 unless replaying a file
+	uint64_t file_size;
+	fakenect_index_entry *file_index;
+	uint32_t file_index_count;
+	uint32_t file_pos;
+	uint8_t *window;
+	uint64_t window_offset;
+	size_t window_size;
+	// Frames copied out of the window when no buffer was set, so that
+	// callbacks may write to them as to the frames of a Kinect
+	void *depth_copy;
+	void *rgb_copy;
+
+	// Synthetic scenes (source synth:script), see synth.h
+	synth_scene *synth;
+	uint16_t *synth_depth;
+	uint8_t *synth_rgb;
+
+	// Replay clock, see below
+	int loops_left;
+	double playback_start;     // host time of the first record played
+	double record_start;       // recorded time of that record
+	double loop_time_offset;   // added to recorded times after each loop
+	uint32_t loop_ts_offset;   // added to recorded timestamps after each loop
+	int pass;                  // loops completed
+	double first_time, last_time, last_time_step;
+	uint32_t first_ts, last_ts, last_ts_step;
+};
+
+struct _freenect_context {
+	freenect_device *devices;
+};
 
-static freenect_device *fake_dev = (freenect_device *)1234;
-static freenect_context *fake_ctx = (freenect_context *)5678;
-static freenect_depth_cb cur_depth_cb = NULL;
-static freenect_video_cb cur_rgb_cb = NULL;
-static char *input_path = NULL;
-static FILE *index_fp = NULL;
-static freenect_raw_tilt_state state = {};
 static int already_warned = 0;
-static double playback_prev_time = 0.;
-static double record_prev_time = 0.;
-static void *depth_buffer = NULL;
-static void *rgb_buffer = NULL;
-static int depth_running = 0;
-static int rgb_running = 0;
-static void *user_ptr = NULL;
+
+// Sources and replay settings, read once by the first freenect_init
+// FAKENECT_PATH=a,b: device 0 replays a, device 1 replays b
+// FAKENECT_TRUTH=a,b: ground truth of the synthetic scene of each device
+// FAKENECT_SPEED=N: play N times faster than recorded (default 1)
+// FAKENECT_CLOCK=virtual: no waiting at all, frames back to back
+// FAKENECT_LOOP=N: play the recording N times, 0 forever (default 1)
+static int settings_read = 0;
+static char *sources[MAX_SOURCES];
+static char *truths[MAX_SOURCES];
+static int num_sources = 0;
+static double replay_speed = 1.;
+static int virtual_clock = 0;
+static int loops = 1;
+static freenect_device *open_devices[MAX_SOURCES];
 
 static void sleep_highres(double tm)
 {
-	int sec = floor(tm);
-	int usec = (tm - sec) * 1000000;
-	if (tm > 0) {
-		sleep(sec);
-		usleep(usec);
-	}
+	struct timespec ts;
+	if (tm <= 0)
+		return;
+	ts.tv_sec = (time_t)tm;
+	ts.tv_nsec = (long)((tm - ts.tv_sec) * 1000000000);
+	while (nanosleep(&ts, &ts) && errno == EINTR)
+		;
 }
 
 static double get_time()
 {
-	struct timeval cur;
-	gettimeofday(&cur, NULL);
-	return cur.tv_sec + cur.tv_usec / 1000000.;
+	struct timespec cur;
+	clock_gettime(CLOCK_MONOTONIC, &cur);
+	return cur.tv_sec + cur.tv_nsec / 1000000000.;
 }
 
 static char *one_line(FILE *fp)
 {
 	int pos = 0;
 	char *out = NULL;
-	char c;
+	int c;
 	while ((c = fgetc(fp))) {
 		if (c == '\n' || c == EOF)
 			break;
@@ -87,25 +155,71 @@ static char *one_line(FILE *fp)
 	return out;
 }
 
-static int get_data_size(FILE *fp)
+static off_t get_data_size(FILE *fp)
 {
-	int orig = ftell(fp);
-	fseek(fp, 0L, SEEK_END);
-	int out = ftell(fp);
-	fseek(fp, orig, SEEK_SET);
+	off_t orig = ftello(fp);
+	fseeko(fp, 0, SEEK_END);
+	off_t out = ftello(fp);
+	fseeko(fp, orig, SEEK_SET);
 	return out;
 }
 
-static int parse_line(char *type, double *cur_time, unsigned int *timestamp, unsigned int *data_size, char **data)
+// Reads size bytes at offset, -1 when the file is shorter
+static int read_at(int fd, void *buf, size_t size, uint64_t offset)
 {
-	char *line = one_line(index_fp);
-	if (!line) {
-		printf("Warning: No more lines in [%s]\n", input_path);
-		return -1;
+	while (size) {
+		ssize_t n = pread(fd, buf, size, (off_t)offset);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		buf = (char *)buf + n;
+		size -= n;
+		offset += n;
+	}
+	return 0;
+}
+
+// Splits a comma separated list into at most MAX_SOURCES strings
+static int split_list(const char *list, char **out)
+{
+	int n = 0;
+	while (list && n < MAX_SOURCES) {
+		const char *end = strchr(list, ',');
+		size_t len = end ? (size_t)(end - list) : strlen(list);
+		out[n] = malloc(len + 1);
+		memcpy(out[n], list, len);
+		out[n][len] = '\0';
+		n++;
+		list = end ? end + 1 : NULL;
 	}
-	int file_path_size = strlen(input_path) + strlen(line) + 50;
+	return n;
+}
+
+static void read_settings()
+{
+	char *env;
+	if (settings_read)
+		return;
+	settings_read = 1;
+	num_sources = split_list(getenv("FAKENECT_PATH"), sources);
+	split_list(getenv("FAKENECT_TRUTH"), truths);
+	if ((env = getenv("FAKENECT_SPEED")) && atof(env) > 0)
+		replay_speed = atof(env);
+	if ((env = getenv("FAKENECT_CLOCK")) && !strcmp(env, "virtual"))
+		virtual_clock = 1;
+	if ((env = getenv("FAKENECT_LOOP")))
+		loops = atoi(env);
+}
+
+static int parse_line(freenect_device *dev, char *type, double *cur_time, unsigned int *timestamp, unsigned int *data_size, char **data)
+{
+	char *line = one_line(dev->index_fp);
+	if (!line)
+		return 1;
+	int file_path_size = strlen(dev->input_path) + strlen(line) + 50;
 	char *file_path = malloc(file_path_size);
-	snprintf(file_path, file_path_size, "%s/%s", input_path, line);
+	snprintf(file_path, file_path_size, "%s/%s", dev->input_path, line);
 	// Open file
 	FILE *cur_fp = fopen(file_path, "r");
 	if (!cur_fp) {
@@ -126,18 +240,125 @@ static int parse_line(char *type, double *cur_time, unsigned int *timestamp, uns
 	return 0;
 }
 
-static void open_index()
+static void open_file(freenect_device *dev, const char *path)
+{
+	fakenect_file_header header;
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		printf("Error: Cannot open file [%s]\n", path);
+		exit(1);
+	}
+	dev->file_fd = fd;
+	dev->file_size = st.st_size;
+	if (read_at(fd, &header, sizeof(header), 0) || header.magic != FAKENECT_FILE_MAGIC || header.version != FAKENECT_FILE_VERSION) {
+		printf("Error: [%s] is not a fakenect recording (version %d)\n", path, FAKENECT_FILE_VERSION);
+		exit(1);
+	}
+	if (header.index_offset && header.index_offset + (uint64_t)header.index_count * sizeof(fakenect_index_entry) <= dev->file_size) {
+		dev->file_index = malloc((header.index_count + 1) * sizeof(*dev->file_index));
+		if (!dev->file_index || read_at(fd, dev->file_index, header.index_count * sizeof(*dev->file_index), header.index_offset)) {
+			printf("Error: Cannot read the index of [%s]\n", path);
+			exit(1);
+		}
+		dev->file_index_count = header.index_count;
+		return;
+	}
+
+	// No index, the recording was interrupted: walk the chunks
+	printf("Warning: [%s] has no index, scanning it\n", path);
+	uint64_t pos = sizeof(header);
+	uint32_t alloc = 0;
+	fakenect_chunk_header chunk;
+	while (!read_at(fd, &chunk, sizeof(chunk), pos)) {
+		if (chunk.magic != FAKENECT_CHUNK_MAGIC || pos + sizeof(chunk) + chunk.size > dev->file_size)
+			break;
+		if (dev->file_index_count == alloc) {
+			alloc = alloc ? alloc * 2 : 1024;
+			dev->file_index = realloc(dev->file_index, alloc * sizeof(*dev->file_index));
+		}
+		fakenect_index_entry *entry = &dev->file_index[dev->file_index_count++];
+		memset(entry, 0, sizeof(*entry));
+		entry->offset = pos;
+		entry->time = chunk.time;
+		entry->timestamp = chunk.timestamp;
+		entry->size = chunk.size;
+		entry->type = chunk.type;
+		pos += sizeof(chunk) + chunk.size;
+		pos = (pos + FAKENECT_CHUNK_ALIGN - 1) & ~(uint64_t)(FAKENECT_CHUNK_ALIGN - 1);
+	}
+}
+
+// The size bytes at offset in a single file recording, read only. Moves the
+// window when they are not in it: the pointer is good until the next call
+static const uint8_t *map_range(freenect_device *dev, uint64_t offset, size_t size)
 {
-	input_path = getenv("FAKENECT_PATH");
+	if (offset + size > dev->file_size)
+		return NULL;
+	if (!dev->window || offset < dev->window_offset || offset + size > dev->window_offset + dev->window_size) {
+		uint64_t start = offset - offset % (uint64_t)sysconf(_SC_PAGESIZE);
+		uint64_t len = WINDOW_SIZE;
+		if (len < offset + size - start)
+			len = offset + size - start;
+		if (len > dev->file_size - start)
+			len = dev->file_size - start;
+		if (dev->window)
+			munmap(dev->window, dev->window_size);
+		dev->window = mmap(NULL, len, PROT_READ, MAP_SHARED, dev->file_fd, (off_t)start);
+		if (dev->window == MAP_FAILED) {
+			dev->window = NULL;
+			return NULL;
+		}
+		dev->window_offset = start;
+		dev->window_size = len;
+		madvise(dev->window, dev->window_size, MADV_SEQUENTIAL);
+	}
+	return dev->window + (offset - dev->window_offset);
+}
+
+// A frame of the window the callbacks may write to: the frame itself when it
+// goes to the buffer set by the application, a copy otherwise
+static void *writable_frame(freenect_device *dev, void **copy, size_t frame_size, int copied_anyway, void *data, unsigned int data_size)
+{
+	if (dev->file_fd < 0 || copied_anyway)
+		return data;
+	if (!*copy)
+		*copy = calloc(1, frame_size);
+	if (!*copy)
+		return data;
+	memcpy(*copy, data, data_size < frame_size ? data_size : frame_size);
+	return *copy;
+}
+
+static void open_index(freenect_device *dev)
+{
+	struct stat st;
+	const char *input_path = dev->input_path;
+
 	if (!input_path) {
 		printf("Error: Environmental variable FAKENECT_PATH is not set.  Set it to a path that was created using the 'record' utility.\n");
 		exit(1);
 	}
+
+	if (!strncmp(input_path, "synth:", 6)) {
+		// Ground truth only where FAKENECT_TRUTH asks for it, never next to the script in the source tree
+		char *truth = truths[dev->index];
+		dev->synth = synth_load(input_path + 6, truth && *truth ? truth : NULL);
+		if (!dev->synth)
+			exit(1);
+		dev->synth_depth = malloc(FREENECT_DEPTH_11BIT_SIZE);
+		dev->synth_rgb = malloc(FREENECT_VIDEO_RGB_SIZE);
+		return;
+	}
+	if (!stat(input_path, &st) && S_ISREG(st.st_mode)) {
+		open_file(dev, input_path);
+		return;
+	}
 	int index_path_size = strlen(input_path) + 50;
 	char *index_path = malloc(index_path_size);
 	snprintf(index_path, index_path_size, "%s/INDEX.txt", input_path);
-	index_fp = fopen(index_path, "r");
-	if (!index_fp) {
+	dev->index_fp = fopen(index_path, "r");
+	if (!dev->index_fp) {
 		printf("Error: Cannot open file [%s]\n", index_path);
 		exit(1);
 	}
@@ -154,55 +375,179 @@ static char *skip_line(char *str)
 	return out + 1;
 }
 
-int freenect_process_events(freenect_context *ctx)
+// Next record of the current pass. Returns 1 at the end of the recording.
+// *to_free is set when the payload was read into memory rather than mapped.
+static int next_record(freenect_device *dev, char *type, double *cur_time, unsigned int *timestamp, unsigned int *data_size, char **payload, char **to_free)
 {
-	/* This is where the magic happens. We read 1 update from the index
-	   per call, so this needs to be called in a loop like usual.  If the
-	   index line is a Depth/RGB image the provided callback is called.  If
-	   the index line is accelerometer data, then it is used to update our
-	   internal state.  If you query for the accelerometer data you get the
-	   last sensor reading that we have.  The time delays are compensated as
-	   best as we can to match those from the original data and current run
-	   conditions (e.g., if it takes longer to run this code then we wait less).
-	 */
-	if (!index_fp)
-		open_index();
+	*to_free = NULL;
+	if (dev->file_fd >= 0) {
+		if (dev->file_pos >= dev->file_index_count)
+			return 1;
+		const fakenect_index_entry *entry = &dev->file_index[dev->file_pos++];
+		*type = entry->type;
+		*cur_time = entry->time;
+		*timestamp = entry->timestamp;
+		*data_size = entry->size;
+		*payload = (char *)map_range(dev, entry->offset + sizeof(fakenect_chunk_header), entry->size);
+		if (!*payload) {
+			printf("Error: Cannot map the record at %llu in [%s]\n", (unsigned long long)entry->offset, dev->input_path);
+			return -1;
+		}
+		return 0;
+	}
+	int res = parse_line(dev, type, cur_time, timestamp, data_size, to_free);
+	if (res)
+		return res;
+	*payload = *to_free;
+	if (*type == 'd' || *type == 'r')
+		*payload = skip_line(*to_free);
+	return 0;
+}
+
+static void deliver_depth(freenect_device *dev, void *data, uint32_t timestamp)
+{
+	void *cur_depth = data;
+	if (dev->depth_buffer) {
+		memcpy(dev->depth_buffer, cur_depth, FREENECT_DEPTH_11BIT_SIZE);
+		cur_depth = dev->depth_buffer;
+	}
+	// The whole frame is there already, just replay the bands
+	if (dev->cur_depth_rows_cb) {
+		int row;
+		for (row = 0; row < FREENECT_FRAME_H; row += dev->depth_rows_per_band) {
+			int num = FREENECT_FRAME_H - row;
+			if (num > dev->depth_rows_per_band)
+				num = dev->depth_rows_per_band;
+			dev->cur_depth_rows_cb(dev, cur_depth, row, num, timestamp);
+		}
+	}
+	dev->cur_depth_cb(dev, cur_depth, timestamp);
+}
+
+static void deliver_rgb(freenect_device *dev, void *data, uint32_t timestamp)
+{
+	void *cur_rgb = data;
+	if (dev->video_format == FREENECT_VIDEO_RGB_HALF) {
+		// Recordings hold full resolution RGB, average each 2x2 block
+		uint8_t *src = cur_rgb;
+		uint8_t *dst = dev->rgb_buffer ? dev->rgb_buffer : dev->rgb_half_buffer;
+		int x, y, c;
+		for (y = 0; y < FREENECT_HALF_FRAME_H; y++)
+			for (x = 0; x < FREENECT_HALF_FRAME_W; x++)
+				for (c = 0; c < 3; c++) {
+					uint8_t *p = src + 3 * (2 * y * FREENECT_FRAME_W + 2 * x) + c;
+					*(dst++) = (p[0] + p[3] + p[3 * FREENECT_FRAME_W] + p[3 * FREENECT_FRAME_W + 3]) >> 2;
+				}
+		cur_rgb = dev->rgb_buffer ? dev->rgb_buffer : dev->rgb_half_buffer;
+	} else if (dev->rgb_buffer) {
+		memcpy(dev->rgb_buffer, cur_rgb, FREENECT_VIDEO_RGB_SIZE);
+		cur_rgb = dev->rgb_buffer;
+	}
+	dev->cur_rgb_cb(dev, cur_rgb, timestamp);
+}
+
+// One synthetic frame per call: depth, then rgb
+static int synth_process_events(freenect_device *dev)
+{
+	uint32_t timestamp;
+	double t;
+	uint8_t *rgb = (dev->cur_rgb_cb && dev->rgb_running) ? dev->synth_rgb : NULL;
+	int res = synth_next_frame(dev->synth, dev->synth_depth, rgb, &timestamp, &t);
+	if (res == 1 && (dev->loops_left <= 0 || --dev->loops_left > 0)) {
+		synth_rewind(dev->synth);
+		res = synth_next_frame(dev->synth, dev->synth_depth, rgb, &timestamp, &t);
+	}
+	if (res) {
+		printf("Warning: No more frames in [%s]\n", dev->input_path);
+		return -1;
+	}
+	if (!virtual_clock) {
+		if (dev->playback_start < 0) {
+			dev->playback_start = get_time();
+			dev->record_start = t;
+		}
+		sleep_highres((t - dev->record_start) / replay_speed - (get_time() - dev->playback_start));
+	}
+	if (dev->cur_depth_cb && dev->depth_running)
+		deliver_depth(dev, dev->synth_depth, timestamp);
+	if (rgb)
+		deliver_rgb(dev, rgb, timestamp);
+	return 0;
+}
+
+static void rewind_recording(freenect_device *dev)
+{
+	// Keep time and timestamps increasing across loops, one frame after the last one
+	dev->loop_time_offset += dev->last_time - dev->first_time + dev->last_time_step;
+	dev->loop_ts_offset += dev->last_ts - dev->first_ts + dev->last_ts_step;
+	dev->pass++;
+	if (dev->file_fd >= 0)
+		dev->file_pos = 0;
+	else
+		rewind(dev->index_fp);
+}
+
+static int process_device_events(freenect_device *dev)
+{
+	if (!dev->index_fp && dev->file_fd < 0 && !dev->synth)
+		open_index(dev);
+	if (dev->synth)
+		return synth_process_events(dev);
 	char type;
 	double record_cur_time;
 	unsigned int timestamp, data_size;
-	char *data = NULL;
-	if (parse_line(&type, &record_cur_time, &timestamp, &data_size, &data))
+	char *data = NULL, *to_free = NULL;
+	int res = next_record(dev, &type, &record_cur_time, &timestamp, &data_size, &data, &to_free);
+	if (res == 1 && dev->playback_start >= 0 && (dev->loops_left <= 0 || --dev->loops_left > 0)) {
+		rewind_recording(dev);
+		res = next_record(dev, &type, &record_cur_time, &timestamp, &data_size, &data, &to_free);
+	}
+	if (res) {
+		if (res == 1)
+			printf("Warning: No more records in [%s]\n", dev->input_path);
 		return -1;
-	// Sleep an amount that compensates for the original and current delays
-	// playback_ is w.r.t. the current time
-	// record_ is w.r.t. the original time period during the recording
-	if (record_prev_time != 0. && playback_prev_time != 0.)
-		sleep_highres((record_cur_time - record_prev_time) - (get_time() - playback_prev_time));
-	record_prev_time = record_cur_time;
+	}
+
+	// Track the span of the first pass, for looping
+	if (dev->playback_start < 0) {
+		dev->playback_start = get_time();
+		dev->record_start = dev->first_time = dev->last_time = record_cur_time;
+		dev->first_ts = dev->last_ts = timestamp;
+	} else if (dev->pass == 0) {
+		if (record_cur_time > dev->last_time) {
+			dev->last_time_step = record_cur_time - dev->last_time;
+			dev->last_time = record_cur_time;
+		}
+		if ((int32_t)(timestamp - dev->last_ts) > 0) {
+			dev->last_ts_step = timestamp - dev->last_ts;
+			dev->last_ts = timestamp;
+		}
+	}
+	record_cur_time += dev->loop_time_offset;
+	timestamp += dev->loop_ts_offset;
+
+	if (!virtual_clock) {
+		// Wait until the record is due, relative to the first one
+		sleep_highres((record_cur_time - dev->record_start) / replay_speed - (get_time() - dev->playback_start));
+	}
 	switch (type) {
 		case 'd':
-			if (cur_depth_cb && depth_running) {
-				void *cur_depth = skip_line(data);
-				if (depth_buffer) {
-					memcpy(depth_buffer, cur_depth, FREENECT_DEPTH_11BIT_SIZE);
-					cur_depth = depth_buffer;
-				}
-				cur_depth_cb(fake_dev, cur_depth, timestamp);
+			if (dev->cur_depth_cb && dev->depth_running) {
+				data = writable_frame(dev, &dev->depth_copy, FREENECT_DEPTH_11BIT_SIZE, dev->depth_buffer != NULL, data, data_size);
+				deliver_depth(dev, data, timestamp);
 			}
 			break;
 		case 'r':
-			if (cur_rgb_cb && rgb_running) {
-				void *cur_rgb = skip_line(data);
-				if (rgb_buffer) {
-					memcpy(rgb_buffer, cur_rgb, FREENECT_VIDEO_RGB_SIZE);
-					cur_rgb = rgb_buffer;
-				}
-				cur_rgb_cb(fake_dev, cur_rgb, timestamp);
+			if (dev->cur_rgb_cb && dev->rgb_running) {
+				// Half resolution is averaged into a buffer of its own
+				data = writable_frame(dev, &dev->rgb_copy, FREENECT_VIDEO_RGB_SIZE,
+				                      dev->rgb_buffer || dev->video_format == FREENECT_VIDEO_RGB_HALF, data, data_size);
+				deliver_rgb(dev, data, timestamp);
 			}
 			break;
 		case 'a':
-			if (data_size == sizeof(state)) {
-				memcpy(&state, data, sizeof(state));
+			if (data_size == sizeof(dev->state)) {
+				memcpy(&dev->state, data, sizeof(dev->state));
 			} else if (!already_warned) {
 				already_warned = 1;
 				printf("\n\nWarning: Accelerometer data has an unexpected"
@@ -211,15 +556,38 @@ int freenect_process_events(freenect_context *ctx)
 				       "values.  This data was probably made with an "
 				       "older version of record (the upstream interface "
 				       "changed).\n\n",
-				       data_size, (unsigned int)sizeof state);
+				       data_size, (unsigned int)sizeof dev->state);
 			}
 			break;
 	}
-	free(data);
-	playback_prev_time = get_time();
+	free(to_free);
 	return 0;
 }
 
+int freenect_process_events(freenect_context *ctx)
+{
+	/* This is where the magic happens. We read 1 update from the index
+	   per call, so this needs to be called in a loop like usual.  If the
+	   index line is a Depth/RGB image the provided callback is called.  If
+	   the index line is accelerometer data, then it is used to update our
+	   internal state.  If you query for the accelerometer data you get the
+	   last sensor reading that we have.  Records are played on a schedule
+	   anchored at the first one, at FAKENECT_SPEED times the recorded pace
+	   (if it takes longer to run this code then we wait less), or back to
+	   back with FAKENECT_CLOCK=virtual. Either way the callbacks get the
+	   recorded timestamps, so timestamp based timing is reproducible.
+	   Each device of the context gets one update per call, on its own
+	   schedule: with a context per device, as with one pump thread per
+	   Kinect, the devices do not wait for each other.
+	 */
+	freenect_device *dev;
+	int res = 0;
+	for (dev = ctx->devices; dev; dev = dev->next)
+		if (process_device_events(dev) < 0)
+			res = -1;
+	return res;
+}
+
 double freenect_get_tilt_degs(freenect_raw_tilt_state *state)
 {
 	// NOTE: This is duped from tilt.c, this is the only function we need from there
@@ -228,7 +596,7 @@ double freenect_get_tilt_degs(freenect_raw_tilt_state *state)
 
 freenect_raw_tilt_state* freenect_get_tilt_state(freenect_device *dev)
 {
-	return &state;
+	return &dev->state;
 }
 
 void freenect_get_mks_accel(freenect_raw_tilt_state *state, double* x, double* y, double* z)
@@ -242,82 +610,112 @@ void freenect_get_mks_accel(freenect_raw_tilt_state *state, double* x, double* y
 
 void freenect_set_depth_callback(freenect_device *dev, freenect_depth_cb cb)
 {
-	cur_depth_cb = cb;
+	dev->cur_depth_cb = cb;
+}
+
+int freenect_set_depth_streaming(freenect_device *dev, int enable)
+{
+	return 0;
+}
+
+int freenect_set_depth_rows_callback(freenect_device *dev, freenect_depth_rows_cb cb, int rows_per_band)
+{
+	if (cb && (rows_per_band < 1 || rows_per_band > FREENECT_FRAME_H))
+		return -1;
+	dev->cur_depth_rows_cb = cb;
+	dev->depth_rows_per_band = rows_per_band;
+	return 0;
 }
 
 void freenect_set_video_callback(freenect_device *dev, freenect_video_cb cb)
 {
-	cur_rgb_cb = cb;
+	dev->cur_rgb_cb = cb;
 }
 
 int freenect_num_devices(freenect_context *ctx)
 {
-	// Always 1 device
-	return 1;
+	// One per source, and one to report the missing FAKENECT_PATH when opened
+	read_settings();
+	return num_sources ? num_sources : 1;
 }
 
 int freenect_open_device(freenect_context *ctx, freenect_device **dev, int index)
 {
-	// Set it to some number to allow for NULL checks
-	*dev = fake_dev;
+	read_settings();
+	if (index < 0 || index >= (num_sources ? num_sources : 1) || open_devices[index])
+		return -1;
+	freenect_device *d = calloc(1, sizeof(*d));
+	d->ctx = ctx;
+	d->index = index;
+	d->input_path = sources[index];
+	d->file_fd = -1;
+	d->video_format = FREENECT_VIDEO_RGB;
+	d->loops_left = loops;
+	d->playback_start = -1.;
+	d->next = ctx->devices;
+	ctx->devices = d;
+	open_devices[index] = d;
+	*dev = d;
 	return 0;
 }
 
 int freenect_init(freenect_context **ctx, freenect_usb_context *usb_ctx)
 {
-	*ctx = fake_ctx;
+	read_settings();
+	*ctx = calloc(1, sizeof(**ctx));
 	return 0;
 }
 
 int freenect_set_depth_buffer(freenect_device *dev, void *buf)
 {
-	depth_buffer = buf;
+	dev->depth_buffer = buf;
 	return 0;
 }
 
 int freenect_set_video_buffer(freenect_device *dev, void *buf)
 {
-	rgb_buffer = buf;
+	dev->rgb_buffer = buf;
 	return 0;
 }
 
 void freenect_set_user(freenect_device *dev, void *user)
 {
-	user_ptr = user;
+	dev->user_ptr = user;
 }
 
 void *freenect_get_user(freenect_device *dev)
 {
-	return user_ptr;
+	return dev->user_ptr;
 }
 
 int freenect_start_depth(freenect_device *dev)
 {
-	depth_running = 1;
+	dev->depth_running = 1;
 	return 0;
 }
 
 int freenect_start_video(freenect_device *dev)
 {
-	rgb_running = 1;
+	dev->rgb_running = 1;
 	return 0;
 }
 
 int freenect_stop_depth(freenect_device *dev)
 {
-	depth_running = 0;
+	dev->depth_running = 0;
 	return 0;
 }
 
 int freenect_stop_video(freenect_device *dev)
 {
-	rgb_running = 0;
+	dev->rgb_running = 0;
 	return 0;
 }
 
 int freenect_set_video_format(freenect_device *dev, freenect_video_format fmt)
 {
-	assert(fmt == FREENECT_VIDEO_RGB);
+	assert(fmt == FREENECT_VIDEO_RGB || fmt == FREENECT_VIDEO_RGB_HALF);
+	dev->video_format = fmt;
 	return 0;
 }
 int freenect_set_depth_format(freenect_device *dev, freenect_depth_format fmt)
@@ -330,10 +728,32 @@ void freenect_set_log_callback(freenect_context *ctx, freenect_log_cb cb) {}
 void freenect_set_log_level(freenect_context *ctx, freenect_loglevel level) {}
 int freenect_shutdown(freenect_context *ctx)
 {
+	while (ctx->devices)
+		freenect_close_device(ctx->devices);
+	free(ctx);
 	return 0;
 }
 int freenect_close_device(freenect_device *dev)
 {
+	freenect_device **link = &dev->ctx->devices;
+	while (*link != dev)
+		link = &(*link)->next;
+	*link = dev->next;
+	open_devices[dev->index] = NULL;
+	if (dev->window)
+		munmap(dev->window, dev->window_size);
+	if (dev->file_fd >= 0)
+		close(dev->file_fd);
+	free(dev->file_index);
+	free(dev->depth_copy);
+	free(dev->rgb_copy);
+	if (dev->index_fp)
+		fclose(dev->index_fp);
+	if (dev->synth)
+		synth_free(dev->synth);
+	free(dev->synth_depth);
+	free(dev->synth_rgb);
+	free(dev);
 	return 0;
 }
 int freenect_set_tilt_degs(freenect_device *dev, double angle)
@@ -0,0 +1,82 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 Brandyn White (bwhite@dappervision.com)
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#ifndef FAKENECT_FILE_H
+#define FAKENECT_FILE_H
+
+#include <stdint.h>
+
+/*  Single file recording format (.fkn)
+
+    [file header][chunk][chunk]...[chunk][index]
+
+    Every chunk is a chunk header followed by the raw frame: 11 bit depth
+    (uint16_t, FREENECT_DEPTH_11BIT_SIZE bytes), RGB (FREENECT_VIDEO_RGB_SIZE
+    bytes) or a freenect_raw_tilt_state. Chunks start on a
+    FAKENECT_CHUNK_ALIGN boundary so that the player can hand out pointers
+    straight into the mapped file.
+
+    The index, one entry per chunk, is appended when the recording is closed
+    and the file header is then updated to point at it. A file without index
+    (recorder killed) is still readable: the player rebuilds the index by
+    walking the chunks.
+
+    All values are stored in host byte order.
+*/
+
+#define FAKENECT_FILE_MAGIC 0x544e4b46 /* "FKNT" */
+#define FAKENECT_CHUNK_MAGIC 0x48434b46 /* "FKCH" */
+#define FAKENECT_FILE_VERSION 1
+#define FAKENECT_CHUNK_ALIGN 16
+#define FAKENECT_FILE_EXT ".fkn"
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t index_offset;  /* 0 until the recording is closed */
+	uint32_t index_count;
+	uint32_t reserved[3];
+} fakenect_file_header;
+
+typedef struct {
+	uint32_t magic;
+	uint8_t type;           /* 'd'epth, 'r'gb or 'a'ccel, as in INDEX.txt */
+	uint8_t pad[3];
+	uint32_t timestamp;     /* Kinect timestamp (last one seen for accel) */
+	uint32_t size;          /* Payload bytes, not counting the padding */
+	double time;            /* Wall clock time of the recording, in seconds */
+	uint64_t reserved;
+} fakenect_chunk_header;
+
+typedef struct {
+	uint64_t offset;        /* File offset of the chunk header */
+	double time;
+	uint32_t timestamp;
+	uint32_t size;
+	uint8_t type;
+	uint8_t pad[7];
+} fakenect_index_entry;
+
+#endif
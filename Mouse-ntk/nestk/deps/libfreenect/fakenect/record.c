@@ -31,12 +31,18 @@
 #include <string.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include "fakenect_file.h"
 
 char *out_dir;
 volatile sig_atomic_t running = 1;
 uint32_t last_timestamp = 0;
 FILE *index_fp = NULL;
 
+// Single file recording (-f), see fakenect_file.h
+FILE *out_fp = NULL;
+fakenect_index_entry *out_index = NULL;
+uint32_t out_count = 0, out_alloc = 0;
+
 
 double get_time()
 {
@@ -73,12 +79,98 @@ FILE *open_dump(char type, double cur_time, uint32_t timestamp, int data_size, c
 	return fp;
 }
 
+static void write_padding(FILE *fp)
+{
+	static const char zeros[FAKENECT_CHUNK_ALIGN] = {0};
+	off_t pos = ftello(fp);
+	if (pos % FAKENECT_CHUNK_ALIGN)
+		fwrite(zeros, FAKENECT_CHUNK_ALIGN - pos % FAKENECT_CHUNK_ALIGN, 1, fp);
+}
+
+void write_chunk(char type, double cur_time, uint32_t timestamp, const void *data, int data_size)
+{
+	fakenect_chunk_header chunk;
+	fakenect_index_entry *entry;
+
+	if (out_count == out_alloc) {
+		out_alloc = out_alloc ? out_alloc * 2 : 1024;
+		out_index = realloc(out_index, out_alloc * sizeof(*out_index));
+		if (!out_index) {
+			printf("Error: Out of memory for the index\n");
+			exit(1);
+		}
+	}
+	memset(&chunk, 0, sizeof(chunk));
+	chunk.magic = FAKENECT_CHUNK_MAGIC;
+	chunk.type = type;
+	chunk.timestamp = timestamp;
+	chunk.size = data_size;
+	chunk.time = cur_time;
+
+	entry = &out_index[out_count++];
+	memset(entry, 0, sizeof(*entry));
+	entry->offset = ftello(out_fp);
+	entry->time = cur_time;
+	entry->timestamp = timestamp;
+	entry->size = data_size;
+	entry->type = type;
+
+	if (fwrite(&chunk, sizeof(chunk), 1, out_fp) != 1 || fwrite(data, data_size, 1, out_fp) != 1) {
+		printf("Error: Cannot write chunk\n");
+		exit(1);
+	}
+	write_padding(out_fp);
+}
+
+FILE *open_single(const char *fn)
+{
+	fakenect_file_header header;
+	FILE *fp = fopen(fn, "r");
+	if (fp) {
+		printf("Error: [%s] already exists, to avoid overwriting use a different file name.\n", fn);
+		exit(1);
+	}
+	fp = fopen(fn, "wb");
+	if (!fp) {
+		printf("Error: Cannot open file [%s]\n", fn);
+		exit(1);
+	}
+	memset(&header, 0, sizeof(header));
+	header.magic = FAKENECT_FILE_MAGIC;
+	header.version = FAKENECT_FILE_VERSION;
+	fwrite(&header, sizeof(header), 1, fp);
+	return fp;
+}
+
+void close_single(FILE *fp)
+{
+	fakenect_file_header header;
+
+	// Append the index and point the header at it
+	write_padding(fp);
+	memset(&header, 0, sizeof(header));
+	header.magic = FAKENECT_FILE_MAGIC;
+	header.version = FAKENECT_FILE_VERSION;
+	header.index_offset = ftello(fp);
+	header.index_count = out_count;
+	if (out_count)
+		fwrite(out_index, sizeof(*out_index), out_count, fp);
+	fseeko(fp, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, fp);
+	fclose(fp);
+	printf("Wrote %u chunks\n", out_count);
+}
+
 void dump(char type, uint32_t timestamp, void *data, int data_size)
 {
 	// timestamp can be at most 10 characters, we have a few extra
 	double cur_time = get_time();
 	FILE *fp;
 	last_timestamp = timestamp;
+	if (out_fp) {
+		write_chunk(type, cur_time, timestamp, data, data_size);
+		return;
+	}
 	switch (type) {
 		case 'd':
 			fp = open_dump(type, cur_time, timestamp, data_size, "pgm");
@@ -154,10 +246,80 @@ void signal_cleanup(int num)
 	signal(SIGINT, signal_cleanup);
 }
 
+// Converts a recording directory to a single file
+int convert(const char *in_dir, const char *out_file)
+{
+	char line[256];
+	char *fn = malloc(strlen(in_dir) + 300);
+	FILE *in;
+
+	sprintf(fn, "%s/INDEX.txt", in_dir);
+	index_fp = fopen(fn, "r");
+	if (!index_fp) {
+		printf("Error: Cannot open file [%s]\n", fn);
+		return 1;
+	}
+	out_fp = open_single(out_file);
+	while (fgets(line, sizeof(line), index_fp)) {
+		char type;
+		double cur_time;
+		unsigned int timestamp;
+		off_t size;
+		char *data, *payload;
+
+		line[strcspn(line, "\r\n")] = '\0';
+		if (sscanf(line, "%c-%lf-%u-%*s", &type, &cur_time, &timestamp) != 3)
+			continue;
+		sprintf(fn, "%s/%s", in_dir, line);
+		in = fopen(fn, "rb");
+		if (!in) {
+			printf("Error: Cannot open file [%s]\n", fn);
+			return 1;
+		}
+		fseeko(in, 0, SEEK_END);
+		size = ftello(in);
+		fseeko(in, 0, SEEK_SET);
+		data = malloc(size);
+		if (fread(data, size, 1, in) != 1) {
+			printf("Error: Couldn't read entire file [%s]\n", fn);
+			return 1;
+		}
+		fclose(in);
+		payload = data;
+		if (type == 'd' || type == 'r') {
+			// Drop the PGM/PPM header line
+			payload = memchr(data, '\n', size);
+			if (!payload) {
+				printf("Error: PGM/PPM has incorrect formatting [%s]\n", fn);
+				return 1;
+			}
+			payload++;
+		}
+		write_chunk(type, cur_time, timestamp, payload, size - (payload - data));
+		free(data);
+	}
+	fclose(index_fp);
+	close_single(out_fp);
+	free(fn);
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
+	if (argc == 4 && !strcmp(argv[1], "-c"))
+		return convert(argv[2], argv[3]);
+	if (argc == 3 && !strcmp(argv[1], "-f")) {
+		out_fp = open_single(argv[2]);
+		signal(SIGINT, signal_cleanup);
+		init();
+		close_single(out_fp);
+		return 0;
+	}
 	if (argc != 2) {
-		printf("Records the Kinect sensor data to a directory\nResult can be used as input to Fakenect\nUsage: ./record <out_dir>\n");
+		printf("Records the Kinect sensor data to a directory or a single file\nResult can be used as input to Fakenect\n"
+		       "Usage: ./record <out_dir>\n"
+		       "       ./record -f <out_file" FAKENECT_FILE_EXT ">\n"
+		       "       ./record -c <in_dir> <out_file" FAKENECT_FILE_EXT ">   (convert a recording directory)\n");
 		return 1;
 	}
 	out_dir = argv[1];
@@ -0,0 +1,484 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 Brandyn White (bwhite@dappervision.com)
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <libfreenect.h>
+#include "synth.h"
+
+#define FOCAL 580.0        // Depth camera focal length in pixels
+#define CENTER_X 320.0
+#define CENTER_Y 240.0
+#define MIN_DEPTH 0.4      // Closer than this the Kinect reports nothing
+#define NO_DEPTH 2047
+#define GAUSS_TABLE 4096   // Precomputed normal samples for the sensor noise
+
+typedef struct {
+	double x, y, z;
+} vec3;
+
+typedef enum {
+	STEP_IDLE,
+	STEP_MOVE,
+	STEP_SWIPE,
+	STEP_CLICK,
+	STEP_PUSH,
+	STEP_AWAY,
+} step_type;
+
+typedef struct {
+	step_type type;
+	double duration;
+	vec3 target;              // MOVE: position, SWIPE: displacement
+	double amount;            // PUSH: depth
+	char dir[8];              // SWIPE: direction, for the ground truth
+} step;
+
+struct synth_scene {
+	// Sensor
+	double fps;
+	double noise, dropout, framedrop;
+	uint64_t rng;
+	float gauss[GAUSS_TABLE];
+
+	// Scene
+	double wall_z;
+	double body_x, body_z;
+	vec3 shoulder;
+	vec3 hand_start;
+	step *steps;
+	int nsteps;
+	float *background;        // Wall and body, rendered once
+	float *zbuf;
+
+	FILE *truth;
+
+	// Playback
+	uint32_t frame;           // Next frame number
+	double script_t0;         // Time the current pass of the script started
+	int cur;                  // Current step
+	double step_t0;
+	vec3 from, to, hand;
+};
+
+static uint64_t next_rand(synth_scene *s)
+{
+	// xorshift64*
+	s->rng ^= s->rng >> 12;
+	s->rng ^= s->rng << 25;
+	s->rng ^= s->rng >> 27;
+	return s->rng * 2685821657736338717ULL;
+}
+
+static double uniform(synth_scene *s)
+{
+	return (next_rand(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static vec3 v3(double x, double y, double z)
+{
+	vec3 v = { x, y, z };
+	return v;
+}
+
+static vec3 add(vec3 a, vec3 b) { return v3(a.x + b.x, a.y + b.y, a.z + b.z); }
+static vec3 sub(vec3 a, vec3 b) { return v3(a.x - b.x, a.y - b.y, a.z - b.z); }
+static vec3 scale(vec3 a, double k) { return v3(a.x * k, a.y * k, a.z * k); }
+static double dot(vec3 a, vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+static void project(vec3 p, double *u, double *v)
+{
+	*u = CENTER_X + FOCAL * p.x / p.z;
+	*v = CENTER_Y - FOCAL * p.y / p.z;
+}
+
+// Ray from the sensor through pixel u,v, normalized
+static vec3 pixel_ray(int u, int v)
+{
+	vec3 rd = v3((u - CENTER_X) / FOCAL, -(v - CENTER_Y) / FOCAL, 1.0);
+	return scale(rd, 1.0 / sqrt(dot(rd, rd)));
+}
+
+// Distance along rd to a sphere, -1 if missed
+static double hit_sphere(vec3 rd, vec3 c, double r)
+{
+	double b = -dot(rd, c);
+	double h = b * b - (dot(c, c) - r * r);
+	if (h < 0)
+		return -1;
+	return -b - sqrt(h);
+}
+
+// Distance along rd to a capsule from pa to pb, -1 if missed
+static double hit_capsule(vec3 rd, vec3 pa, vec3 pb, double r)
+{
+	vec3 ba = sub(pb, pa);
+	vec3 oa = scale(pa, -1);
+	double baba = dot(ba, ba), bard = dot(ba, rd), baoa = dot(ba, oa);
+	double rdoa = dot(rd, oa), oaoa = dot(oa, oa);
+	double a = baba - bard * bard;
+	double b = baba * rdoa - baoa * bard;
+	double c = baba * oaoa - baoa * baoa - r * r * baba;
+	double h = b * b - a * c;
+
+	if (h < 0 || a <= 0)
+		return hit_sphere(rd, pa, r);
+	double t = (-b - sqrt(h)) / a;
+	double y = baoa + t * bard;
+	if (y > 0 && y < baba)
+		return t;
+	// Hit one of the caps
+	return hit_sphere(rd, y <= 0 ? pa : pb, r);
+}
+
+// z-buffer a capsule (pa == pb for a sphere), only over its bounding box in the image
+static void draw_capsule(float *zbuf, vec3 pa, vec3 pb, double r)
+{
+	double ua, va, ub, vb, zmin, margin;
+	int u, v, u0, u1, v0, v1;
+
+	zmin = (pa.z < pb.z ? pa.z : pb.z) - r;
+	if (zmin < 0.05)
+		return;
+	project(pa, &ua, &va);
+	project(pb, &ub, &vb);
+	margin = FOCAL * r / zmin + 2;
+	u0 = (int)((ua < ub ? ua : ub) - margin);
+	u1 = (int)((ua > ub ? ua : ub) + margin);
+	v0 = (int)((va < vb ? va : vb) - margin);
+	v1 = (int)((va > vb ? va : vb) + margin);
+	if (u0 < 0) u0 = 0;
+	if (v0 < 0) v0 = 0;
+	if (u1 > FREENECT_FRAME_W - 1) u1 = FREENECT_FRAME_W - 1;
+	if (v1 > FREENECT_FRAME_H - 1) v1 = FREENECT_FRAME_H - 1;
+
+	for (v = v0; v <= v1; v++) {
+		for (u = u0; u <= u1; u++) {
+			vec3 rd = pixel_ray(u, v);
+			double t = hit_capsule(rd, pa, pb, r);
+			if (t > 0) {
+				// The Kinect measures z, not the distance along the ray
+				float z = t * rd.z;
+				if (z < zbuf[v * FREENECT_FRAME_W + u])
+					zbuf[v * FREENECT_FRAME_W + u] = z;
+			}
+		}
+	}
+}
+
+static double smoothstep(double u)
+{
+	if (u <= 0)
+		return 0;
+	if (u >= 1)
+		return 1;
+	return u * u * (3 - 2 * u);
+}
+
+static void begin_step(synth_scene *s)
+{
+	const step *st = &s->steps[s->cur];
+	s->from = s->hand;
+	switch (st->type) {
+		case STEP_MOVE:
+			s->to = st->target;
+			break;
+		case STEP_SWIPE:
+			s->to = add(s->hand, st->target);
+			break;
+		default:
+			s->to = s->hand;
+			break;
+	}
+}
+
+static void write_truth(synth_scene *s, const step *st, double t0, double t1)
+{
+	static const char *names[] = { NULL, NULL, "swipe", "click", "push", NULL };
+	double u, v;
+	uint32_t f0, f1, ticks;
+
+	if (!s->truth || !names[st->type])
+		return;
+	// First and last frame inside the gesture
+	f0 = (uint32_t)ceil(t0 * s->fps - 1e-6);
+	f1 = (uint32_t)ceil(t1 * s->fps - 1e-6) - 1;
+	ticks = SYNTH_TIMESTAMP_HZ / s->fps;
+	project(s->hand, &u, &v);
+	fprintf(s->truth, "{ \"truth\" : \"%s\", ", names[st->type]);
+	if (st->type == STEP_SWIPE)
+		fprintf(s->truth, "\"dir\" : \"%s\", ", st->dir);
+	fprintf(s->truth, "\"start_frame\" : %u, \"end_frame\" : %u, \"start_ms\" : %.1f, \"end_ms\" : %.1f, "
+	        "\"start_ts\" : %u, \"end_ts\" : %u, \"xy\" : [ %d, %d ] }\n",
+	        f0, f1, t0 * 1000, t1 * 1000, f0 * ticks, f1 * ticks, (int)u, (int)v);
+	fflush(s->truth);
+}
+
+// Moves the script to time t. Returns 1 past the last step
+static int advance(synth_scene *s, double t)
+{
+	while (s->cur < s->nsteps && t >= s->step_t0 + s->steps[s->cur].duration) {
+		const step *st = &s->steps[s->cur];
+		double t1 = s->step_t0 + st->duration;
+		s->hand = s->to;
+		write_truth(s, st, s->step_t0, t1);
+		s->step_t0 = t1;
+		if (++s->cur < s->nsteps)
+			begin_step(s);
+	}
+	if (s->cur >= s->nsteps)
+		return 1;
+
+	const step *st = &s->steps[s->cur];
+	double u = st->duration > 0 ? (t - s->step_t0) / st->duration : 1;
+	s->hand = add(s->from, scale(sub(s->to, s->from), smoothstep(u)));
+	if (st->type == STEP_PUSH)
+		s->hand.z -= st->amount * sin(M_PI * u);
+	return 0;
+}
+
+static void render(synth_scene *s, uint16_t *depth, uint8_t *rgb)
+{
+	const step *st = &s->steps[s->cur];
+	float *zbuf = s->zbuf;
+	vec3 elbow, hand = s->hand;
+	int i;
+
+	memcpy(zbuf, s->background, FREENECT_FRAME_PIX * sizeof(float));
+	if (st->type == STEP_AWAY) {
+		// Arm hanging along the body, behind the pointing range
+		elbow = v3(s->shoulder.x + 0.05, s->shoulder.y - 0.3, s->shoulder.z);
+		hand = v3(s->shoulder.x + 0.07, s->shoulder.y - 0.6, s->shoulder.z - 0.05);
+	} else {
+		// Elbow half way to the shoulder, sagging a bit
+		elbow = add(scale(add(hand, s->shoulder), 0.5), v3(0, -0.12, 0));
+	}
+	draw_capsule(zbuf, s->shoulder, elbow, 0.05);
+	draw_capsule(zbuf, elbow, hand, 0.04);
+	draw_capsule(zbuf, hand, hand, 0.07);
+
+	for (i = 0; i < FREENECT_FRAME_PIX; i++) {
+		double z = zbuf[i];
+		int raw;
+		if (s->noise > 0)
+			z += s->noise * z * z * s->gauss[next_rand(s) % GAUSS_TABLE];
+		if (z < MIN_DEPTH || (s->dropout > 0 && uniform(s) < s->dropout)) {
+			raw = NO_DEPTH;
+		} else {
+			// Inverse of the usual raw to meters conversion
+			raw = (int)((1.0 / z - 3.3309495161) / -0.0030711016 + 0.5);
+			if (raw < 0 || raw >= NO_DEPTH)
+				raw = NO_DEPTH;
+		}
+		depth[i] = raw;
+		if (rgb) {
+			int grey = (raw == NO_DEPTH) ? 0 : 255 - (int)(200 * (zbuf[i] - MIN_DEPTH) / s->wall_z);
+			if (grey < 0)
+				grey = 0;
+			rgb[3 * i] = rgb[3 * i + 1] = rgb[3 * i + 2] = grey;
+		}
+	}
+}
+
+int synth_next_frame(synth_scene *s, uint16_t *depth, uint8_t *rgb, uint32_t *timestamp, double *time)
+{
+	for (;;) {
+		uint32_t frame = s->frame++;
+		double t = frame / s->fps;
+		if (advance(s, t - s->script_t0)) {
+			s->frame--;
+			return 1;
+		}
+		if (s->framedrop > 0 && uniform(s) < s->framedrop)
+			continue;
+		render(s, depth, rgb);
+		*timestamp = frame * (uint32_t)(SYNTH_TIMESTAMP_HZ / s->fps);
+		*time = t;
+		return 0;
+	}
+}
+
+void synth_rewind(synth_scene *s)
+{
+	s->script_t0 = s->frame / s->fps;
+	s->cur = 0;
+	s->step_t0 = 0;
+	s->hand = s->hand_start;
+	if (s->nsteps)
+		begin_step(s);
+}
+
+static void render_background(synth_scene *s)
+{
+	int i;
+	vec3 hip = v3(s->body_x, -0.7, s->body_z);
+	vec3 neck = v3(s->body_x, 0.25, s->body_z);
+
+	for (i = 0; i < FREENECT_FRAME_PIX; i++)
+		s->background[i] = s->wall_z;
+	draw_capsule(s->background, hip, neck, 0.2);
+	draw_capsule(s->background, v3(s->body_x, 0.5, s->body_z), v3(s->body_x, 0.5, s->body_z), 0.11);
+}
+
+static int parse_step(synth_scene *s, const char *cmd, const char *args, step *st)
+{
+	memset(st, 0, sizeof(*st));
+	if (!strcmp(cmd, "idle")) {
+		st->type = STEP_IDLE;
+		return sscanf(args, "%lf", &st->duration) == 1 ? 0 : -1;
+	}
+	if (!strcmp(cmd, "click")) {
+		st->type = STEP_CLICK;
+		return sscanf(args, "%lf", &st->duration) == 1 ? 0 : -1;
+	}
+	if (!strcmp(cmd, "away")) {
+		st->type = STEP_AWAY;
+		return sscanf(args, "%lf", &st->duration) == 1 ? 0 : -1;
+	}
+	if (!strcmp(cmd, "move")) {
+		st->type = STEP_MOVE;
+		return sscanf(args, "%lf %lf %lf %lf", &st->target.x, &st->target.y, &st->target.z, &st->duration) == 4 ? 0 : -1;
+	}
+	if (!strcmp(cmd, "push")) {
+		st->type = STEP_PUSH;
+		return sscanf(args, "%lf %lf", &st->amount, &st->duration) == 2 ? 0 : -1;
+	}
+	if (!strcmp(cmd, "swipe")) {
+		double dist;
+		st->type = STEP_SWIPE;
+		if (sscanf(args, "%7s %lf %lf", st->dir, &dist, &st->duration) != 3)
+			return -1;
+		// Left and right of the user facing the sensor, like the swipes kinect_mouse_mm reports
+		if (!strcmp(st->dir, "left"))
+			st->target = v3(dist, 0, 0);
+		else if (!strcmp(st->dir, "right"))
+			st->target = v3(-dist, 0, 0);
+		else if (!strcmp(st->dir, "up"))
+			st->target = v3(0, dist, 0);
+		else if (!strcmp(st->dir, "down"))
+			st->target = v3(0, -dist, 0);
+		else
+			return -1;
+		return 0;
+	}
+	return -2;
+}
+
+synth_scene *synth_load(const char *script, const char *truth_path)
+{
+	char line[256], cmd[32];
+	int n, lineno = 0, alloc = 0, i;
+	FILE *fp = fopen(script, "r");
+	synth_scene *s;
+
+	if (!fp) {
+		printf("Error: Cannot open scene script [%s]\n", script);
+		return NULL;
+	}
+	s = calloc(1, sizeof(*s));
+	s->fps = 30;
+	s->rng = 1;
+	s->wall_z = 3.0;
+	s->body_z = 1.6;
+	s->hand_start = v3(0, 0, 0.9);
+
+	while (fgets(line, sizeof(line), fp)) {
+		char *args, *comment = strchr(line, '#');
+		int res = 0;
+		lineno++;
+		if (comment)
+			*comment = '\0';
+		if (sscanf(line, "%31s%n", cmd, &n) != 1)
+			continue;
+		args = line + n;
+		if (!strcmp(cmd, "fps"))
+			res = sscanf(args, "%lf", &s->fps) == 1 && s->fps > 0 ? 0 : -1;
+		else if (!strcmp(cmd, "seed")) {
+			unsigned long seed;
+			res = sscanf(args, "%lu", &seed) == 1 ? 0 : -1;
+			s->rng = seed ? seed : 1;
+		} else if (!strcmp(cmd, "noise"))
+			res = sscanf(args, "%lf", &s->noise) == 1 ? 0 : -1;
+		else if (!strcmp(cmd, "dropout"))
+			res = sscanf(args, "%lf", &s->dropout) == 1 ? 0 : -1;
+		else if (!strcmp(cmd, "framedrop"))
+			res = sscanf(args, "%lf", &s->framedrop) == 1 ? 0 : -1;
+		else if (!strcmp(cmd, "wall"))
+			res = sscanf(args, "%lf", &s->wall_z) == 1 ? 0 : -1;
+		else if (!strcmp(cmd, "body"))
+			res = sscanf(args, "%lf %lf", &s->body_x, &s->body_z) == 2 ? 0 : -1;
+		else if (!strcmp(cmd, "hand"))
+			res = sscanf(args, "%lf %lf %lf", &s->hand_start.x, &s->hand_start.y, &s->hand_start.z) == 3 ? 0 : -1;
+		else {
+			if (s->nsteps == alloc) {
+				alloc = alloc ? alloc * 2 : 32;
+				s->steps = realloc(s->steps, alloc * sizeof(step));
+			}
+			res = parse_step(s, cmd, args, &s->steps[s->nsteps]);
+			if (!res)
+				s->nsteps++;
+		}
+		if (res) {
+			printf("Error: %s:%d: %s '%s'\n", script, lineno, res == -2 ? "unknown statement" : "bad arguments for", cmd);
+			fclose(fp);
+			synth_free(s);
+			return NULL;
+		}
+	}
+	fclose(fp);
+
+	// Box-Muller, once
+	for (i = 0; i < GAUSS_TABLE; i += 2) {
+		double u1 = uniform(s), u2 = uniform(s);
+		double r = sqrt(-2 * log(u1 > 0 ? u1 : 1e-12));
+		s->gauss[i] = r * cos(2 * M_PI * u2);
+		s->gauss[i + 1] = r * sin(2 * M_PI * u2);
+	}
+	s->shoulder = v3(s->body_x + 0.2, 0.3, s->body_z - 0.05);
+	s->background = malloc(FREENECT_FRAME_PIX * sizeof(float));
+	s->zbuf = malloc(FREENECT_FRAME_PIX * sizeof(float));
+	render_background(s);
+	if (truth_path) {
+		s->truth = fopen(truth_path, "w");
+		if (!s->truth)
+			printf("Warning: Cannot write ground truth to [%s]\n", truth_path);
+	}
+	synth_rewind(s);
+	return s;
+}
+
+void synth_free(synth_scene *s)
+{
+	if (!s)
+		return;
+	if (s->truth)
+		fclose(s->truth);
+	free(s->steps);
+	free(s->background);
+	free(s->zbuf);
+	free(s);
+}
@@ -0,0 +1,96 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 Brandyn White (bwhite@dappervision.com)
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#ifndef FAKENECT_SYNTH_H
+#define FAKENECT_SYNTH_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*  Synthetic depth scenes
+
+    Renders a parametric scene into 11 bit Kinect depth: a background wall,
+    a body (torso, head, upper arm) and a forearm/hand capsule that follows a
+    scripted trajectory. fakenect plays it when FAKENECT_PATH is
+    synth:<script>, honouring FAKENECT_SPEED, FAKENECT_CLOCK and FAKENECT_LOOP
+    like a recording.
+
+    Each scripted gesture is also written as one JSON line to a ground truth
+    file (FAKENECT_TRUTH, none without it), so a run gives both what should have been detected and when:
+
+      { "truth" : "swipe", "dir" : "left", "start_frame" : 30, "end_frame" : 45,
+        "start_ms" : 1000.0, "end_ms" : 1500.0, "start_ts" : ..., "end_ts" : ...,
+        "xy" : [ 320, 240 ] }
+
+    Script, one statement per line, '#' starts a comment. Distances are in
+    meters in camera coordinates (x right, y up, z away from the sensor),
+    durations in seconds:
+
+      fps 30                sensor frame rate
+      seed 1                random seed of the noise
+      noise 0.003           depth noise standard deviation at 1m (grows with z^2)
+      dropout 0.01          fraction of pixels reported as invalid (2047)
+      framedrop 0.0         fraction of frames never delivered
+      wall 3.0              distance of the background wall
+      body 0.0 1.6          torso x and z
+      hand 0.0 0.0 0.9      hand position at the start
+      idle 1.0              keep still
+      move x y z 0.5        move the hand to x y z
+      swipe left 0.5 0.4    move 0.5m left|right|up|down in 0.4s (left and
+                            right of the user facing the sensor: left is +x)
+      click 1.5             dwell click: keep still 1.5s
+      push 0.15 0.4         push 0.15m towards the sensor and back in 0.4s
+      away 1.0              drop the hand along the body for 1s (no pointer)
+*/
+
+#define SYNTH_TIMESTAMP_HZ 60000000 /* Kinect camera clock, timestamp ticks per second */
+
+typedef struct synth_scene synth_scene;
+
+synth_scene *synth_load(const char *script, const char *truth_path);
+/*  Parses a scene script. Ground truth is written to truth_path (NULL for
+    none).
+
+    Returns:
+        NULL if the script cannot be read or has errors (reported on stdout).
+*/
+
+int synth_next_frame(synth_scene *s, uint16_t *depth, uint8_t *rgb, uint32_t *timestamp, double *time);
+/*  Renders the next delivered frame. Frames lost to framedrop are skipped,
+    their timestamps are not. rgb (640x480x3) may be NULL, it is a grey
+    shading of the depth.
+
+    Returns:
+        0 on success, 1 at the end of the script.
+*/
+
+void synth_rewind(synth_scene *s);
+/*  Restarts the script from the beginning. Time, timestamps and frame
+    numbers keep increasing.
+*/
+
+void synth_free(synth_scene *s);
+
+#endif
@@ -37,11 +37,16 @@ extern "C" {
 #define FREENECT_FRAME_H 480 /**< Default video frame height */
 #define FREENECT_FRAME_PIX (FREENECT_FRAME_H*FREENECT_FRAME_W) /**< Pixel count for default video frame */
 
+#define FREENECT_HALF_FRAME_W 320 /**< Half resolution video frame width */
+#define FREENECT_HALF_FRAME_H 240 /**< Half resolution video frame height */
+#define FREENECT_HALF_FRAME_PIX (FREENECT_HALF_FRAME_H*FREENECT_HALF_FRAME_W) /**< Pixel count for half resolution video frame */
+
 #define FREENECT_IR_FRAME_W 640 /**< Default depth frame width */
 #define FREENECT_IR_FRAME_H 488	/**< Default depth frame height */
 #define FREENECT_IR_FRAME_PIX (FREENECT_IR_FRAME_H*FREENECT_IR_FRAME_W)	/**< Pixel count for default depth frame */
 
 #define FREENECT_VIDEO_RGB_SIZE (FREENECT_FRAME_PIX*3) /**< Size of the decompressed rgb frame */
+#define FREENECT_VIDEO_RGB_HALF_SIZE (FREENECT_HALF_FRAME_PIX*3) /**< Size of the half resolution rgb frame */
 #define FREENECT_VIDEO_BAYER_SIZE (FREENECT_FRAME_PIX) /**< Size of the bayer frame */
 #define FREENECT_VIDEO_YUV_RGB_SIZE (FREENECT_VIDEO_RGB_SIZE) /**< Size of the rgb YUV frame */
 #define FREENECT_VIDEO_YUV_RAW_SIZE (FREENECT_FRAME_PIX*2) /**< Size of the raw YUV frame */
@@ -66,6 +71,7 @@ typedef enum {
 	FREENECT_VIDEO_IR_10BIT_PACKED = 4, /**< 10-bit packed IR mode */
 	FREENECT_VIDEO_YUV_RGB         = 5, /**< YUV RGB mode */
 	FREENECT_VIDEO_YUV_RAW         = 6, /**< YUV Raw mode */
+	FREENECT_VIDEO_RGB_HALF        = 7, /**< 320x240 RGB, one pixel per 2x2 Bayer quad (a quarter of the demosaicing work) */
 } freenect_video_format;
 
 /// Enumeration of LED states
@@ -251,6 +257,9 @@ FREENECTAPI void *freenect_get_user(freenect_device *dev);
 typedef void (*freenect_depth_cb)(freenect_device *dev, void *depth, uint32_t timestamp);
 /// Typedef for video image received event callbacks
 typedef void (*freenect_video_cb)(freenect_device *dev, void *video, uint32_t timestamp);
+/// Typedef for depth row band received event callbacks. depth is the whole
+/// frame buffer, rows [first_row, first_row+num_rows) of it are complete.
+typedef void (*freenect_depth_rows_cb)(freenect_device *dev, void *depth, int first_row, int num_rows, uint32_t timestamp);
 
 /**
  * Set callback for depth information received event
@@ -260,6 +269,34 @@ typedef void (*freenect_video_cb)(freenect_device *dev, void *video, uint32_t ti
  */
 FREENECTAPI void freenect_set_depth_callback(freenect_device *dev, freenect_depth_cb cb);
 
+/**
+ * Enable streaming depth unpacking: each isochronous packet is unpacked
+ * into the depth buffer as soon as it arrives instead of the whole frame
+ * after the last packet, which spreads the unpacking cost over the frame
+ * transfer. Only applies to FREENECT_DEPTH_11BIT and FREENECT_DEPTH_10BIT.
+ *
+ * @param dev Device to set streaming mode for
+ * @param enable Nonzero to unpack per packet
+ *
+ * @return 0 on success, < 0 on error
+ */
+FREENECTAPI int freenect_set_depth_streaming(freenect_device *dev, int enable);
+
+/**
+ * Set callback for depth row bands. With streaming enabled, the callback
+ * fires each time rows_per_band more rows of the current frame are
+ * unpacked, so consumers can overlap their work with the USB transfer.
+ * The last band of a frame may be shorter; the depth callback still fires
+ * once the whole frame is complete. Setting a callback enables streaming.
+ *
+ * @param dev Device to set callback for
+ * @param cb Function pointer for processing row bands, NULL to disable
+ * @param rows_per_band Number of rows per band (1-480)
+ *
+ * @return 0 on success, < 0 on error
+ */
+FREENECTAPI int freenect_set_depth_rows_callback(freenect_device *dev, freenect_depth_rows_cb cb, int rows_per_band);
+
 /**
  * Set callback for video information received event
  *
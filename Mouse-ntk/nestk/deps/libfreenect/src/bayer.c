@@ -0,0 +1,435 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#include <stdint.h>
+#include "bayer.h"
+
+#ifdef BAYER_HAVE_SSSE3
+#include <tmmintrin.h>
+#endif
+#ifdef BAYER_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+void convert_bayer_to_rgb_ref(const uint8_t *raw_buf, uint8_t *proc_buf)
+{
+	int x,y;
+	/* Pixel arrangement:
+	 * G R G R G R G R
+	 * B G B G B G B G
+	 * G R G R G R G R
+	 * B G B G B G B G
+	 * G R G R G R G R
+	 * B G B G B G B G
+	 *
+	 * To convert a Bayer-pattern into RGB you have to handle four pattern
+	 * configurations:
+	 * 1)         2)         3)         4)
+	 *      B1      B1 G1 B2   R1 G1 R2      R1       <- previous line
+	 *   R1 G1 R2   G2 R1 G3   G2 B1 G3   B1 G1 B2    <- current line
+	 *      B2      B3 G4 B4   R3 G4 R4      R2       <- next line
+	 *   ^  ^  ^
+	 *   |  |  next pixel
+	 *   |  current pixel
+	 *   previous pixel
+	 *
+	 * The RGB values (r,g,b) for each configuration are calculated as
+	 * follows:
+	 *
+	 * 1) r = (R1 + R2) / 2
+	 *    g =  G1
+	 *    b = (B1 + B2) / 2
+	 *
+	 * 2) r =  R1
+	 *    g = (G1 + G2 + G3 + G4) / 4
+	 *    b = (B1 + B2 + B3 + B4) / 4
+	 *
+	 * 3) r = (R1 + R2 + R3 + R4) / 4
+	 *    g = (G1 + G2 + G3 + G4) / 4
+	 *    b =  B1
+	 *
+	 * 4) r = (R1 + R2) / 2
+	 *    g =  G1
+	 *    b = (B1 + B2) / 2
+	 *
+	 * To efficiently calculate these values, two 32bit integers are used
+	 * as "shift-buffers". One integer to store the 3 horizontal bayer pixel
+	 * values (previous, current, next) of the current line. The other
+	 * integer to store the vertical average value of the bayer pixels
+	 * (previous, current, next) of the previous and next line.
+	 *
+	 * The boundary conditions for the first and last line and the first
+	 * and last column are solved via mirroring the second and second last
+	 * line and the second and second last column.
+	 *
+	 * To reduce slow memory access, the values of a rgb pixel are packet
+	 * into a 32bit variable and transfered together.
+	 */
+
+	uint8_t *dst = proc_buf; // pointer to destination
+
+	const uint8_t *prevLine;  // pointer to previous, current and next line
+	const uint8_t *curLine;   // of the source bayer pattern
+	const uint8_t *nextLine;
+
+	// storing horizontal values in hVals:
+	// previous << 16, current << 8, next
+	uint32_t hVals;
+	// storing vertical averages in vSums:
+	// previous << 16, current << 8, next
+	uint32_t vSums;
+
+	// init curLine and nextLine pointers
+	curLine  = raw_buf;
+	nextLine = curLine + 640;
+	for (y = 0; y < 480; ++y) {
+
+		if ((y > 0) && (y < 479))
+			prevLine = curLine - 640; // normal case
+		else if (y == 0)
+			prevLine = nextLine;      // top boundary case
+		else
+			nextLine = prevLine;      // bottom boundary case
+
+		// init horizontal shift-buffer with current value
+		hVals  = (*(curLine++) << 8);
+		// handle left column boundary case
+		hVals |= (*curLine << 16);
+		// init vertical average shift-buffer with current values average
+		vSums = ((*(prevLine++) + *(nextLine++)) << 7) & 0xFF00;
+		// handle left column boundary case
+		vSums |= ((*prevLine + *nextLine) << 15) & 0xFF0000;
+
+		// store if line is odd or not
+		uint8_t yOdd = y & 1;
+		// the right column boundary case is not handled inside this loop
+		// thus the "639"
+		for (x = 0; x < 639; ++x) {
+			// place next value in shift buffers
+			hVals |= *(curLine++);
+			vSums |= (*(prevLine++) + *(nextLine++)) >> 1;
+
+			// calculate the horizontal sum as this sum is needed in
+			// any configuration
+			uint8_t hSum = ((uint8_t)(hVals >> 16) + (uint8_t)(hVals)) >> 1;
+
+			if (yOdd == 0) {
+				if ((x & 1) == 0) {
+					// Configuration 1
+					*(dst++) = hSum;		// r
+					*(dst++) = hVals >> 8;	// g
+					*(dst++) = vSums >> 8;	// b
+				} else {
+					// Configuration 2
+					*(dst++) = hVals >> 8;
+					*(dst++) = (hSum + (uint8_t)(vSums >> 8)) >> 1;
+					*(dst++) = ((uint8_t)(vSums >> 16) + (uint8_t)(vSums)) >> 1;
+				}
+			} else {
+				if ((x & 1) == 0) {
+					// Configuration 3
+					*(dst++) = ((uint8_t)(vSums >> 16) + (uint8_t)(vSums)) >> 1;
+					*(dst++) = (hSum + (uint8_t)(vSums >> 8)) >> 1;
+					*(dst++) = hVals >> 8;
+				} else {
+					// Configuration 4
+					*(dst++) = vSums >> 8;
+					*(dst++) = hVals >> 8;
+					*(dst++) = hSum;
+				}
+			}
+
+			// shift the shift-buffers
+			hVals <<= 8;
+			vSums <<= 8;
+		} // end of for x loop
+		// right column boundary case, mirroring second last column
+		hVals |= (uint8_t)(hVals >> 16);
+		vSums |= (uint8_t)(vSums >> 16);
+
+		// the horizontal sum simplifies to the second last column value
+		uint8_t hSum = (uint8_t)(hVals);
+
+		if (yOdd == 0) {
+			if ((x & 1) == 0) {
+				*(dst++) = hSum;
+				*(dst++) = hVals >> 8;
+				*(dst++) = vSums >> 8;
+			} else {
+				*(dst++) = hVals >> 8;
+				*(dst++) = (hSum + (uint8_t)(vSums >> 8)) >> 1;
+				*(dst++) = vSums;
+			}
+		} else {
+			if ((x & 1) == 0) {
+				*(dst++) = vSums;
+				*(dst++) = (hSum + (uint8_t)(vSums >> 8)) >> 1;
+				*(dst++) = hVals >> 8;
+			} else {
+				*(dst++) = vSums >> 8;
+				*(dst++) = hVals >> 8;
+				*(dst++) = hSum;
+			}
+		}
+
+	} // end of for y loop
+}
+
+/* The vectorized versions compute the same configurations directly from the
+ * neighbours of 16 pixels at once instead of using shift-buffers:
+ *
+ *   h  = (cur[x-1] + cur[x+1]) / 2     horizontal average
+ *   v  = (prev[x] + next[x]) / 2       vertical average
+ *   vs = (v[x-1] + v[x+1]) / 2         average of the 4 diagonal neighbours
+ *   g  = (h + v) / 2                   average of the 4 direct neighbours
+ *
+ * Every division truncates, as in the scalar version, so the results match to
+ * the bit. Even and odd columns use different configurations and are merged
+ * with a blend. The first and last columns, which need mirroring, are handled
+ * by bayer_pixel().
+ */
+
+#define BAYER_SIMD_FIRST 2   // First column of the vector loop (must be even)
+#define BAYER_SIMD_WIDTH 16  // Pixels per iteration
+
+static inline void bayer_rows(const uint8_t *raw_buf, int y, const uint8_t **prev, const uint8_t **cur, const uint8_t **next)
+{
+	*cur = raw_buf + y * 640;
+	// top and bottom boundary cases, mirroring second and second last line
+	if (y == 0)
+		*prev = *next = *cur + 640;
+	else if (y == 479)
+		*prev = *next = *cur - 640;
+	else {
+		*prev = *cur - 640;
+		*next = *cur + 640;
+	}
+}
+
+static inline void bayer_pixel(const uint8_t *prev, const uint8_t *cur, const uint8_t *next, int x, int yOdd, uint8_t *dst)
+{
+	// left and right boundary cases, mirroring second and second last column
+	int xl = (x > 0) ? x - 1 : 1;
+	int xr = (x < 639) ? x + 1 : 638;
+	uint8_t h = (cur[xl] + cur[xr]) >> 1;
+	uint8_t v = (prev[x] + next[x]) >> 1;
+	uint8_t vs = ((uint8_t)((prev[xl] + next[xl]) >> 1) + (uint8_t)((prev[xr] + next[xr]) >> 1)) >> 1;
+	uint8_t g = (h + v) >> 1;
+
+	if (yOdd == 0) {
+		if ((x & 1) == 0) {
+			dst[0] = h;      dst[1] = cur[x]; dst[2] = v;
+		} else {
+			dst[0] = cur[x]; dst[1] = g;      dst[2] = vs;
+		}
+	} else {
+		if ((x & 1) == 0) {
+			dst[0] = vs;     dst[1] = g;      dst[2] = cur[x];
+		} else {
+			dst[0] = v;      dst[1] = cur[x]; dst[2] = h;
+		}
+	}
+}
+
+#ifdef BAYER_HAVE_SSSE3
+
+// (a + b) >> 1 without the rounding of pavgb
+__attribute__((target("ssse3")))
+static inline __m128i avg_floor_ssse3(__m128i a, __m128i b)
+{
+	return _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+}
+
+// Even columns from a, odd columns from b
+__attribute__((target("ssse3")))
+static inline __m128i blend_ssse3(__m128i even, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(even, a), _mm_andnot_si128(even, b));
+}
+
+__attribute__((target("ssse3")))
+void convert_bayer_to_rgb_ssse3(const uint8_t *raw_buf, uint8_t *proc_buf)
+{
+	int x,y;
+	const __m128i even = _mm_set1_epi16(0x00ff);
+	// pshufb masks interleaving 16 r, g and b values into 48 bytes
+	const __m128i r0 = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5);
+	const __m128i g0 = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1);
+	const __m128i b0 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+	const __m128i r1 = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1);
+	const __m128i g1 = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10);
+	const __m128i b1 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1);
+	const __m128i r2 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+	const __m128i g2 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+	const __m128i b2 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+
+	for (y = 0; y < 480; ++y) {
+		const uint8_t *prevLine, *curLine, *nextLine;
+		uint8_t *dst = proc_buf + y * 640 * 3;
+		uint8_t yOdd = y & 1;
+
+		bayer_rows(raw_buf, y, &prevLine, &curLine, &nextLine);
+		for (x = 0; x < BAYER_SIMD_FIRST; ++x)
+			bayer_pixel(prevLine, curLine, nextLine, x, yOdd, dst + 3 * x);
+
+		// the last vector reads up to column x + 16
+		for (; x + BAYER_SIMD_WIDTH < 640; x += BAYER_SIMD_WIDTH) {
+			__m128i c  = _mm_loadu_si128((const __m128i *)(curLine + x));
+			__m128i h  = avg_floor_ssse3(_mm_loadu_si128((const __m128i *)(curLine + x - 1)),
+			                             _mm_loadu_si128((const __m128i *)(curLine + x + 1)));
+			__m128i v  = avg_floor_ssse3(_mm_loadu_si128((const __m128i *)(prevLine + x)),
+			                             _mm_loadu_si128((const __m128i *)(nextLine + x)));
+			__m128i vl = avg_floor_ssse3(_mm_loadu_si128((const __m128i *)(prevLine + x - 1)),
+			                             _mm_loadu_si128((const __m128i *)(nextLine + x - 1)));
+			__m128i vr = avg_floor_ssse3(_mm_loadu_si128((const __m128i *)(prevLine + x + 1)),
+			                             _mm_loadu_si128((const __m128i *)(nextLine + x + 1)));
+			__m128i vs = avg_floor_ssse3(vl, vr);
+			__m128i g  = avg_floor_ssse3(h, v);
+			__m128i r, gg, b;
+
+			if (yOdd == 0) {
+				r  = blend_ssse3(even, h, c);   // Configurations 1 and 2
+				gg = blend_ssse3(even, c, g);
+				b  = blend_ssse3(even, v, vs);
+			} else {
+				r  = blend_ssse3(even, vs, v);  // Configurations 3 and 4
+				gg = blend_ssse3(even, g, c);
+				b  = blend_ssse3(even, c, h);
+			}
+
+			__m128i *out = (__m128i *)(dst + 3 * x);
+			_mm_storeu_si128(out + 0, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r0), _mm_shuffle_epi8(gg, g0)), _mm_shuffle_epi8(b, b0)));
+			_mm_storeu_si128(out + 1, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r1), _mm_shuffle_epi8(gg, g1)), _mm_shuffle_epi8(b, b1)));
+			_mm_storeu_si128(out + 2, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r2), _mm_shuffle_epi8(gg, g2)), _mm_shuffle_epi8(b, b2)));
+		}
+
+		for (; x < 640; ++x)
+			bayer_pixel(prevLine, curLine, nextLine, x, yOdd, dst + 3 * x);
+	}
+}
+
+#endif // BAYER_HAVE_SSSE3
+
+#ifdef BAYER_HAVE_NEON
+
+void convert_bayer_to_rgb_neon(const uint8_t *raw_buf, uint8_t *proc_buf)
+{
+	int x,y;
+	const uint8x16_t even = vreinterpretq_u8_u16(vdupq_n_u16(0x00ff));
+
+	for (y = 0; y < 480; ++y) {
+		const uint8_t *prevLine, *curLine, *nextLine;
+		uint8_t *dst = proc_buf + y * 640 * 3;
+		uint8_t yOdd = y & 1;
+
+		bayer_rows(raw_buf, y, &prevLine, &curLine, &nextLine);
+		for (x = 0; x < BAYER_SIMD_FIRST; ++x)
+			bayer_pixel(prevLine, curLine, nextLine, x, yOdd, dst + 3 * x);
+
+		// the last vector reads up to column x + 16
+		for (; x + BAYER_SIMD_WIDTH < 640; x += BAYER_SIMD_WIDTH) {
+			// vhaddq_u8 truncates like the scalar version
+			uint8x16_t c  = vld1q_u8(curLine + x);
+			uint8x16_t h  = vhaddq_u8(vld1q_u8(curLine + x - 1), vld1q_u8(curLine + x + 1));
+			uint8x16_t v  = vhaddq_u8(vld1q_u8(prevLine + x), vld1q_u8(nextLine + x));
+			uint8x16_t vl = vhaddq_u8(vld1q_u8(prevLine + x - 1), vld1q_u8(nextLine + x - 1));
+			uint8x16_t vr = vhaddq_u8(vld1q_u8(prevLine + x + 1), vld1q_u8(nextLine + x + 1));
+			uint8x16_t vs = vhaddq_u8(vl, vr);
+			uint8x16_t g  = vhaddq_u8(h, v);
+			uint8x16x3_t rgb;
+
+			if (yOdd == 0) {
+				rgb.val[0] = vbslq_u8(even, h, c);   // Configurations 1 and 2
+				rgb.val[1] = vbslq_u8(even, c, g);
+				rgb.val[2] = vbslq_u8(even, v, vs);
+			} else {
+				rgb.val[0] = vbslq_u8(even, vs, v);  // Configurations 3 and 4
+				rgb.val[1] = vbslq_u8(even, g, c);
+				rgb.val[2] = vbslq_u8(even, c, h);
+			}
+			vst3q_u8(dst + 3 * x, rgb);
+		}
+
+		for (; x < 640; ++x)
+			bayer_pixel(prevLine, curLine, nextLine, x, yOdd, dst + 3 * x);
+	}
+}
+
+#endif // BAYER_HAVE_NEON
+
+convert_bayer_fn convert_bayer_select(const char **name)
+{
+	convert_bayer_fn fn = convert_bayer_to_rgb_ref;
+	const char *fn_name = "scalar";
+
+#if defined(BAYER_HAVE_SSSE3)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("ssse3")) {
+		fn = convert_bayer_to_rgb_ssse3;
+		fn_name = "ssse3";
+	}
+#elif defined(BAYER_HAVE_NEON)
+	// Only compiled in when the target has NEON (always the case on aarch64)
+	fn = convert_bayer_to_rgb_neon;
+	fn_name = "neon";
+#endif
+	if (name)
+		*name = fn_name;
+	return fn;
+}
+
+void convert_bayer_to_rgb(const uint8_t *raw_buf, uint8_t *proc_buf)
+{
+	// Picked on first use; racing threads would store the same pointer
+	static convert_bayer_fn impl = NULL;
+
+	if (!impl)
+		impl = convert_bayer_select(NULL);
+	impl(raw_buf, proc_buf);
+}
+
+void convert_bayer_to_rgb_half(const uint8_t *raw_buf, uint8_t *proc_buf)
+{
+	int x,y;
+	uint8_t *dst = proc_buf;
+
+	/* Each 2x2 quad
+	 *   G1 R
+	 *   B  G2
+	 * gives one pixel: r = R, g = (G1 + G2) / 2, b = B
+	 */
+	for (y = 0; y < 240; ++y) {
+		const uint8_t *gr = raw_buf + 2 * y * 640;
+		const uint8_t *bg = gr + 640;
+		for (x = 0; x < 320; ++x) {
+			*(dst++) = gr[1];
+			*(dst++) = (gr[0] + bg[1]) >> 1;
+			*(dst++) = bg[0];
+			gr += 2;
+			bg += 2;
+		}
+	}
+}
@@ -0,0 +1,65 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#ifndef BAYER_H
+#define BAYER_H
+
+#include <stdint.h>
+
+/* Bayer (GRBG, 640x480) to RGB conversions used for the video stream.
+ *
+ * convert_bayer_to_rgb() is the bilinear demosaic behind FREENECT_VIDEO_RGB.
+ * It runs the fastest implementation the CPU supports, picked once at run
+ * time. All implementations produce exactly the same bytes as the scalar
+ * reference convert_bayer_to_rgb_ref().
+ */
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define BAYER_HAVE_SSSE3
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define BAYER_HAVE_NEON
+#endif
+
+typedef void (*convert_bayer_fn)(const uint8_t *raw_buf, uint8_t *proc_buf);
+
+void convert_bayer_to_rgb(const uint8_t *raw_buf, uint8_t *proc_buf);
+
+void convert_bayer_to_rgb_ref(const uint8_t *raw_buf, uint8_t *proc_buf);
+#ifdef BAYER_HAVE_SSSE3
+void convert_bayer_to_rgb_ssse3(const uint8_t *raw_buf, uint8_t *proc_buf);
+#endif
+#ifdef BAYER_HAVE_NEON
+void convert_bayer_to_rgb_neon(const uint8_t *raw_buf, uint8_t *proc_buf);
+#endif
+
+// Implementation used by convert_bayer_to_rgb(), name is set to its name if not NULL
+convert_bayer_fn convert_bayer_select(const char **name);
+
+// 320x240 RGB, one pixel per 2x2 Bayer quad (FREENECT_VIDEO_RGB_HALF)
+void convert_bayer_to_rgb_half(const uint8_t *raw_buf, uint8_t *proc_buf);
+
+#endif
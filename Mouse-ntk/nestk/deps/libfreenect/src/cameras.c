@@ -30,6 +30,7 @@
 #include <unistd.h>
 
 #include "freenect_internal.h"
+#include "bayer.h"
 
 struct pkt_hdr {
 	uint8_t magic[2];
@@ -271,6 +272,46 @@ static inline void convert_packed_to_8bit(uint8_t *raw, uint8_t *frame, int vw,
 	}
 }
 
+// Unpack the depth pixels whose bits are all in raw_buf[0, avail_bytes) and
+// report the newly completed row bands. Unpacking starts on 8 pixel groups,
+// which are byte aligned for both 10 and 11 bit depth.
+static void depth_stream_unpack(freenect_device *dev, int avail_bytes, int frame_done)
+{
+	int vw = (dev->depth_format == FREENECT_DEPTH_10BIT) ? 10 : 11;
+	int start = dev->depth_unpacked_pix;
+	int end;
+
+	if (frame_done)
+		end = FREENECT_FRAME_PIX;
+	else
+		end = ((avail_bytes * 8 / vw) & ~7);
+	if (end < start || (!frame_done && dev->depth.pkt_num == 1)) {
+		// A new frame started (or the stream resynced), start over
+		start = dev->depth_unpacked_pix = 0;
+		dev->depth_rows_reported = 0;
+	}
+	if (end > FREENECT_FRAME_PIX)
+		end = FREENECT_FRAME_PIX;
+	if (end > start) {
+		convert_packed_to_16bit(dev->depth.raw_buf + start * vw / 8,
+		                        (uint16_t*)dev->depth.proc_buf + start, vw, end - start);
+		dev->depth_unpacked_pix = end;
+	}
+
+	if (!dev->depth_rows_cb)
+		return;
+	int rows = dev->depth_unpacked_pix / FREENECT_FRAME_W;
+	while (rows - dev->depth_rows_reported >= dev->depth_rows_per_band ||
+	       (frame_done && rows > dev->depth_rows_reported)) {
+		int first = dev->depth_rows_reported;
+		int num = rows - first;
+		if (num > dev->depth_rows_per_band)
+			num = dev->depth_rows_per_band;
+		dev->depth_rows_reported += num;
+		dev->depth_rows_cb(dev, dev->depth.proc_buf, first, num, dev->depth.last_timestamp);
+	}
+}
+
 static void depth_process(freenect_device *dev, uint8_t *pkt, int len)
 {
 	freenect_context *ctx = dev->parent;
@@ -281,14 +322,32 @@ static void depth_process(freenect_device *dev, uint8_t *pkt, int len)
 	if (!dev->depth.running)
 		return;
 
+	int streaming = dev->depth_streaming &&
+		(dev->depth_format == FREENECT_DEPTH_11BIT || dev->depth_format == FREENECT_DEPTH_10BIT);
 	int got_frame_size = stream_process(ctx, &dev->depth, pkt, len);
 
+	if (streaming && !got_frame_size) {
+		if (dev->depth.synced)
+			depth_stream_unpack(dev, dev->depth.pkt_num * dev->depth.pkt_size, 0);
+		return;
+	}
+
 	if (!got_frame_size)
 		return;
 
 	FN_SPEW("Got depth frame of size %d/%d, %d/%d packets arrived, TS %08x\n", got_frame_size,
 	        dev->depth.frame_size, dev->depth.valid_pkts, dev->depth.pkts_per_frame, dev->depth.timestamp);
 
+	if (streaming) {
+		// Only the tail of the frame is left to unpack
+		depth_stream_unpack(dev, dev->depth.frame_size, 1);
+		dev->depth_unpacked_pix = 0;
+		dev->depth_rows_reported = 0;
+		if (dev->depth_cb)
+			dev->depth_cb(dev, dev->depth.proc_buf, dev->depth.timestamp);
+		return;
+	}
+
 	switch (dev->depth_format) {
 		case FREENECT_DEPTH_11BIT:
 			convert_packed_to_16bit(dev->depth.raw_buf, (uint16_t*)dev->depth.proc_buf, 11, FREENECT_FRAME_PIX);
@@ -338,170 +397,6 @@ static void convert_uyvy_to_rgb(uint8_t *raw_buf, uint8_t *proc_buf)
 }
 #undef CLAMP
 
-static void convert_bayer_to_rgb(uint8_t *raw_buf, uint8_t *proc_buf)
-{
-	int x,y;
-	/* Pixel arrangement:
-	 * G R G R G R G R
-	 * B G B G B G B G
-	 * G R G R G R G R
-	 * B G B G B G B G
-	 * G R G R G R G R
-	 * B G B G B G B G
-	 *
-	 * To convert a Bayer-pattern into RGB you have to handle four pattern
-	 * configurations:
-	 * 1)         2)         3)         4)
-	 *      B1      B1 G1 B2   R1 G1 R2      R1       <- previous line
-	 *   R1 G1 R2   G2 R1 G3   G2 B1 G3   B1 G1 B2    <- current line
-	 *      B2      B3 G4 B4   R3 G4 R4      R2       <- next line
-	 *   ^  ^  ^
-	 *   |  |  next pixel
-	 *   |  current pixel
-	 *   previous pixel
-	 *
-	 * The RGB values (r,g,b) for each configuration are calculated as
-	 * follows:
-	 *
-	 * 1) r = (R1 + R2) / 2
-	 *    g =  G1
-	 *    b = (B1 + B2) / 2
-	 *
-	 * 2) r =  R1
-	 *    g = (G1 + G2 + G3 + G4) / 4
-	 *    b = (B1 + B2 + B3 + B4) / 4
-	 *
-	 * 3) r = (R1 + R2 + R3 + R4) / 4
-	 *    g = (G1 + G2 + G3 + G4) / 4
-	 *    b =  B1
-	 *
-	 * 4) r = (R1 + R2) / 2
-	 *    g =  G1
-	 *    b = (B1 + B2) / 2
-	 *
-	 * To efficiently calculate these values, two 32bit integers are used
-	 * as "shift-buffers". One integer to store the 3 horizontal bayer pixel
-	 * values (previous, current, next) of the current line. The other
-	 * integer to store the vertical average value of the bayer pixels
-	 * (previous, current, next) of the previous and next line.
-	 *
-	 * The boundary conditions for the first and last line and the first
-	 * and last column are solved via mirroring the second and second last
-	 * line and the second and second last column.
-	 *
-	 * To reduce slow memory access, the values of a rgb pixel are packet
-	 * into a 32bit variable and transfered together.
-	 */
-
-	uint8_t *dst = proc_buf; // pointer to destination
-
-	uint8_t *prevLine;        // pointer to previous, current and next line
-	uint8_t *curLine;         // of the source bayer pattern
-	uint8_t *nextLine;
-
-	// storing horizontal values in hVals:
-	// previous << 16, current << 8, next
-	uint32_t hVals;
-	// storing vertical averages in vSums:
-	// previous << 16, current << 8, next
-	uint32_t vSums;
-
-	// init curLine and nextLine pointers
-	curLine  = raw_buf;
-	nextLine = curLine + 640;
-	for (y = 0; y < 480; ++y) {
-
-		if ((y > 0) && (y < 479))
-			prevLine = curLine - 640; // normal case
-		else if (y == 0)
-			prevLine = nextLine;      // top boundary case
-		else
-			nextLine = prevLine;      // bottom boundary case
-
-		// init horizontal shift-buffer with current value
-		hVals  = (*(curLine++) << 8);
-		// handle left column boundary case
-		hVals |= (*curLine << 16);
-		// init vertical average shift-buffer with current values average
-		vSums = ((*(prevLine++) + *(nextLine++)) << 7) & 0xFF00;
-		// handle left column boundary case
-		vSums |= ((*prevLine + *nextLine) << 15) & 0xFF0000;
-
-		// store if line is odd or not
-		uint8_t yOdd = y & 1;
-		// the right column boundary case is not handled inside this loop
-		// thus the "639"
-		for (x = 0; x < 639; ++x) {
-			// place next value in shift buffers
-			hVals |= *(curLine++);
-			vSums |= (*(prevLine++) + *(nextLine++)) >> 1;
-
-			// calculate the horizontal sum as this sum is needed in
-			// any configuration
-			uint8_t hSum = ((uint8_t)(hVals >> 16) + (uint8_t)(hVals)) >> 1;
-
-			if (yOdd == 0) {
-				if ((x & 1) == 0) {
-					// Configuration 1
-					*(dst++) = hSum;		// r
-					*(dst++) = hVals >> 8;	// g
-					*(dst++) = vSums >> 8;	// b
-				} else {
-					// Configuration 2
-					*(dst++) = hVals >> 8;
-					*(dst++) = (hSum + (uint8_t)(vSums >> 8)) >> 1;
-					*(dst++) = ((uint8_t)(vSums >> 16) + (uint8_t)(vSums)) >> 1;
-				}
-			} else {
-				if ((x & 1) == 0) {
-					// Configuration 3
-					*(dst++) = ((uint8_t)(vSums >> 16) + (uint8_t)(vSums)) >> 1;
-					*(dst++) = (hSum + (uint8_t)(vSums >> 8)) >> 1;
-					*(dst++) = hVals >> 8;
-				} else {
-					// Configuration 4
-					*(dst++) = vSums >> 8;
-					*(dst++) = hVals >> 8;
-					*(dst++) = hSum;
-				}
-			}
-
-			// shift the shift-buffers
-			hVals <<= 8;
-			vSums <<= 8;
-		} // end of for x loop
-		// right column boundary case, mirroring second last column
-		hVals |= (uint8_t)(hVals >> 16);
-		vSums |= (uint8_t)(vSums >> 16);
-
-		// the horizontal sum simplifies to the second last column value
-		uint8_t hSum = (uint8_t)(hVals);
-
-		if (yOdd == 0) {
-			if ((x & 1) == 0) {
-				*(dst++) = hSum;
-				*(dst++) = hVals >> 8;
-				*(dst++) = vSums >> 8;
-			} else {
-				*(dst++) = hVals >> 8;
-				*(dst++) = (hSum + (uint8_t)(vSums >> 8)) >> 1;
-				*(dst++) = vSums;
-			}
-		} else {
-			if ((x & 1) == 0) {
-				*(dst++) = vSums;
-				*(dst++) = (hSum + (uint8_t)(vSums >> 8)) >> 1;
-				*(dst++) = hVals >> 8;
-			} else {
-				*(dst++) = vSums >> 8;
-				*(dst++) = hVals >> 8;
-				*(dst++) = hSum;
-			}
-		}
-
-	} // end of for y loop
-}
-
 static void video_process(freenect_device *dev, uint8_t *pkt, int len)
 {
 	freenect_context *ctx = dev->parent;
@@ -524,6 +419,9 @@ static void video_process(freenect_device *dev, uint8_t *pkt, int len)
 		case FREENECT_VIDEO_RGB:
 			convert_bayer_to_rgb(dev->video.raw_buf, (uint8_t*)dev->video.proc_buf);
 			break;
+		case FREENECT_VIDEO_RGB_HALF:
+			convert_bayer_to_rgb_half(dev->video.raw_buf, (uint8_t*)dev->video.proc_buf);
+			break;
 		case FREENECT_VIDEO_BAYER:
 			break;
 		case FREENECT_VIDEO_IR_10BIT:
@@ -707,6 +605,9 @@ int freenect_start_video(freenect_device *dev)
 		case FREENECT_VIDEO_RGB:
 			stream_init(ctx, &dev->video, FREENECT_VIDEO_BAYER_SIZE, FREENECT_VIDEO_RGB_SIZE);
 			break;
+		case FREENECT_VIDEO_RGB_HALF:
+			stream_init(ctx, &dev->video, FREENECT_VIDEO_BAYER_SIZE, FREENECT_VIDEO_RGB_HALF_SIZE);
+			break;
 		case FREENECT_VIDEO_BAYER:
 			stream_init(ctx, &dev->video, 0, FREENECT_VIDEO_BAYER_SIZE);
 			break;
@@ -743,6 +644,7 @@ int freenect_start_video(freenect_device *dev)
 	}
 	switch (dev->video_format) {
 		case FREENECT_VIDEO_RGB:
+		case FREENECT_VIDEO_RGB_HALF:
 		case FREENECT_VIDEO_BAYER:
 		case FREENECT_VIDEO_YUV_RGB:
 		case FREENECT_VIDEO_YUV_RAW:
@@ -808,6 +710,29 @@ void freenect_set_depth_callback(freenect_device *dev, freenect_depth_cb cb)
 	dev->depth_cb = cb;
 }
 
+int freenect_set_depth_streaming(freenect_device *dev, int enable)
+{
+	dev->depth_streaming = enable ? 1 : 0;
+	dev->depth_unpacked_pix = 0;
+	dev->depth_rows_reported = 0;
+	return 0;
+}
+
+int freenect_set_depth_rows_callback(freenect_device *dev, freenect_depth_rows_cb cb, int rows_per_band)
+{
+	freenect_context *ctx = dev->parent;
+
+	if (cb && (rows_per_band < 1 || rows_per_band > FREENECT_FRAME_H)) {
+		FN_ERROR("Invalid depth rows per band %d\n", rows_per_band);
+		return -1;
+	}
+	dev->depth_rows_cb = cb;
+	dev->depth_rows_per_band = rows_per_band;
+	if (cb)
+		freenect_set_depth_streaming(dev, 1);
+	return 0;
+}
+
 void freenect_set_video_callback(freenect_device *dev, freenect_video_cb cb)
 {
 	dev->video_cb = cb;
@@ -829,6 +754,7 @@ int freenect_set_video_format(freenect_device *dev, freenect_video_format fmt)
 		case FREENECT_VIDEO_IR_10BIT_PACKED:
 		case FREENECT_VIDEO_YUV_RGB:
 		case FREENECT_VIDEO_YUV_RAW:
+		case FREENECT_VIDEO_RGB_HALF:
 			dev->video_format = fmt;
 			return 0;
 		default:
@@ -134,6 +134,11 @@ struct _freenect_device {
 
 	freenect_depth_cb depth_cb;
 	freenect_video_cb video_cb;
+	freenect_depth_rows_cb depth_rows_cb;
+	int depth_rows_per_band;
+	int depth_streaming;      // Unpack depth packets as they arrive
+	int depth_unpacked_pix;   // Pixels of the current frame already unpacked
+	int depth_rows_reported;  // Rows of the current frame passed to depth_rows_cb
 	freenect_video_format video_format;
 	freenect_depth_format depth_format;
 
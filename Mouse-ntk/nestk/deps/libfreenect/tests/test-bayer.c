@@ -0,0 +1,163 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/* Checks that the vectorized demosaic gives exactly the output of the scalar
+ * one, and that the half resolution output matches the full one on flat
+ * colour areas. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bayer.h"
+
+#define W 640
+#define H 480
+
+static uint8_t raw[W*H];
+static uint8_t ref[W*H*3];
+static uint8_t out[W*H*3];
+
+static int failures = 0;
+
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void compare(const char *impl, const char *pattern)
+{
+	int i;
+	for (i = 0; i < W*H*3; i++) {
+		if (out[i] != ref[i]) {
+			printf("FAIL %s on %s: pixel %d,%d channel %d is %d, expected %d\n", impl, pattern,
+			       (i / 3) % W, (i / 3) / W, i % 3, out[i], ref[i]);
+			failures++;
+			return;
+		}
+	}
+}
+
+static void check_impl(const char *impl, convert_bayer_fn fn)
+{
+	int i, seed;
+
+	// Random frames exercise every configuration with every value
+	for (seed = 1; seed <= 8; seed++) {
+		srand(seed);
+		for (i = 0; i < W*H; i++)
+			raw[i] = rand() & 0xff;
+		convert_bayer_to_rgb_ref(raw, ref);
+		fn(raw, out);
+		compare(impl, "random");
+	}
+
+	// Saturated values, where a rounding average would differ
+	memset(raw, 0xff, sizeof(raw));
+	convert_bayer_to_rgb_ref(raw, ref);
+	fn(raw, out);
+	compare(impl, "white");
+
+	for (i = 0; i < W*H; i++)
+		raw[i] = ((i % W) + (i / W)) & 1 ? 0xff : 0x00;
+	convert_bayer_to_rgb_ref(raw, ref);
+	fn(raw, out);
+	compare(impl, "checkerboard");
+
+	for (i = 0; i < W*H; i++)
+		raw[i] = (i % W) & 1 ? 0xfe : 0x01;
+	convert_bayer_to_rgb_ref(raw, ref);
+	fn(raw, out);
+	compare(impl, "stripes");
+}
+
+static void check_half(void)
+{
+	const uint8_t r = 200, g = 91, b = 17;
+	int x, y;
+
+	// A flat colour: full resolution demosaic gives the colour everywhere
+	for (y = 0; y < H; y++) {
+		for (x = 0; x < W; x++) {
+			if ((y & 1) == 0)
+				raw[y*W+x] = (x & 1) ? r : g;
+			else
+				raw[y*W+x] = (x & 1) ? g : b;
+		}
+	}
+	convert_bayer_to_rgb_ref(raw, ref);
+	convert_bayer_to_rgb_half(raw, out);
+	for (y = 0; y < H/2; y++) {
+		for (x = 0; x < W/2; x++) {
+			const uint8_t *h = out + 3 * (y*W/2 + x);
+			const uint8_t *f = ref + 3 * (2*y*W + 2*x);
+			if (memcmp(h, f, 3) || h[0] != r || h[1] != g || h[2] != b) {
+				printf("FAIL half on flat colour: pixel %d,%d is %d %d %d, expected %d %d %d\n",
+				       x, y, h[0], h[1], h[2], f[0], f[1], f[2]);
+				failures++;
+				return;
+			}
+		}
+	}
+}
+
+static void bench(const char *impl, convert_bayer_fn fn)
+{
+	const int runs = 50;
+	double t0;
+	int i;
+
+	t0 = now_ms();
+	for (i = 0; i < runs; i++)
+		fn(raw, out);
+	printf("%-8s %.3f ms/frame\n", impl, (now_ms() - t0) / runs);
+}
+
+int main(int argc, char **argv)
+{
+	const char *name;
+	convert_bayer_fn best = convert_bayer_select(&name);
+
+#ifdef BAYER_HAVE_SSSE3
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("ssse3"))
+		check_impl("ssse3", convert_bayer_to_rgb_ssse3);
+#endif
+#ifdef BAYER_HAVE_NEON
+	check_impl("neon", convert_bayer_to_rgb_neon);
+#endif
+	check_impl("dispatch", convert_bayer_to_rgb);
+	check_half();
+
+	bench("scalar", convert_bayer_to_rgb_ref);
+	bench(name, best);
+	bench("half", convert_bayer_to_rgb_half);
+
+	printf("%s\n", failures ? "FAILED" : "OK");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/* Shared memory reader used to check freenect-shmd, typically against
+   freenect-shmd-fake replaying a recording. Run several at once, with
+   different -d delays, to check slow readers never hold back fast ones. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "libfreenect_shm.h"
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int main(int argc, char **argv)
+{
+	const char *name = FREENECT_SHM_DEFAULT_NAME;
+	freenect_shm_stream stream = FREENECT_SHM_DEPTH;
+	freenect_shm_read_mode mode = FREENECT_SHM_SEQUENTIAL;
+	int count = 100, delay_ms = 0, copy = 0, opt;
+
+	while ((opt = getopt(argc, argv, "n:c:d:rlkh")) != -1) {
+		switch (opt) {
+			case 'n': name = optarg; break;
+			case 'c': count = atoi(optarg); break;
+			case 'd': delay_ms = atoi(optarg); break;
+			case 'r': stream = FREENECT_SHM_VIDEO; break;
+			case 'l': mode = FREENECT_SHM_LATEST; break;
+			case 'k': copy = 1; break;
+			default:
+				printf("Usage: %s [-n name] [-c frames] [-d delay_ms] [-r] [-l] [-k]\n", argv[0]);
+				printf("  -r read rgb instead of depth, -l latest frame only, -k copy frames out\n");
+				return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	freenect_shm_reader *reader = freenect_shm_open(name, stream);
+	if (!reader) {
+		printf("Error: no %s stream published under %s, is freenect-shmd running?\n",
+		       stream == FREENECT_SHM_DEPTH ? "depth" : "rgb", name);
+		return 1;
+	}
+	freenect_shm_set_mode(reader, mode);
+	const freenect_shm_header *info = freenect_shm_info(reader);
+	printf("%u slots of %u bytes, producer pid %u\n", info->nslots, info->frame_size, info->producer_pid);
+
+	void *buf = copy ? malloc(info->frame_size) : NULL;
+	freenect_shm_frame frame;
+	uint64_t last_frame = 0, latency_sum = 0, torn = 0;
+	uint32_t last_timestamp = 0;
+	int got = 0, errors = 0;
+
+	while (got < count) {
+		int res = freenect_shm_wait(reader, &frame, 2000);
+		if (res < 0) {
+			printf("Producer went away\n");
+			break;
+		}
+		if (res > 0) {
+			printf("Timeout waiting for a frame\n");
+			errors++;
+			break;
+		}
+		latency_sum += now_us() - frame.publish_time_us;
+		if (got && frame.frame <= last_frame) {
+			printf("Error: frame %llu after %llu\n", (unsigned long long)frame.frame, (unsigned long long)last_frame);
+			errors++;
+		}
+		if (got && frame.timestamp < last_timestamp)
+			printf("Warning: timestamp went back from %u to %u\n", last_timestamp, frame.timestamp);
+		// Touch the whole frame like a real consumer would
+		uint32_t sum = 0, i;
+		if (copy) {
+			if (freenect_shm_copy(reader, &frame, buf) < 0)
+				torn++;
+		} else {
+			for (i = 0; i < frame.size / 4; i++)
+				sum += ((const uint32_t *)frame.data)[i];
+			if (!freenect_shm_frame_valid(reader, &frame))
+				torn++;
+		}
+		if (delay_ms)
+			usleep(delay_ms * 1000);
+		last_frame = frame.frame;
+		last_timestamp = frame.timestamp;
+		got++;
+	}
+
+	printf("%d frames, %llu dropped, %llu overwritten while reading, mean latency %.1f us\n",
+	       got, (unsigned long long)freenect_shm_dropped(reader), (unsigned long long)torn,
+	       got ? (double)latency_sum / got : 0.);
+	free(buf);
+	freenect_shm_close(reader);
+	return errors ? 1 : 0;
+}
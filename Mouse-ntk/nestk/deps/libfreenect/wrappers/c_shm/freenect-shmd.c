@@ -0,0 +1,161 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/* Sensor daemon: owns the Kinect and publishes its frames to shared memory so
+   that several local programs can use the sensor at the same time. Linked
+   against fakenect (freenect-shmd-fake) it replays a recording instead. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <libfreenect.h>
+#include "libfreenect_shm.h"
+
+static volatile sig_atomic_t die = 0;
+static freenect_shm_ring *depth_ring = NULL;
+static freenect_shm_ring *video_ring = NULL;
+static unsigned long depth_frames = 0, video_frames = 0;
+
+static void signal_cleanup(int num)
+{
+	die = 1;
+}
+
+static void depth_cb(freenect_device *dev, void *depth, uint32_t timestamp)
+{
+	freenect_shm_commit(depth_ring, depth, timestamp);
+	// Next frame is unpacked straight into the next slot
+	freenect_set_depth_buffer(dev, freenect_shm_begin_write(depth_ring));
+	depth_frames++;
+}
+
+static void video_cb(freenect_device *dev, void *rgb, uint32_t timestamp)
+{
+	freenect_shm_commit(video_ring, rgb, timestamp);
+	freenect_set_video_buffer(dev, freenect_shm_begin_write(video_ring));
+	video_frames++;
+}
+
+static void usage(const char *argv0)
+{
+	printf("Usage: %s [-n name] [-i index] [-s slots] [-r] [-l loglevel] [-v]\n", argv0);
+	printf("  -n name   Shared memory name, segments are /freenect-<name>-depth|video (default %s)\n", FREENECT_SHM_DEFAULT_NAME);
+	printf("  -i index  Kinect device index (default 0)\n");
+	printf("  -s slots  Frames kept in each ring (default %d)\n", FREENECT_SHM_DEFAULT_SLOTS);
+	printf("  -r        Publish RGB frames as well\n");
+	printf("  -l level  libfreenect log level (0-7)\n");
+	printf("  -v        Print frame counts every second\n");
+}
+
+int main(int argc, char **argv)
+{
+	freenect_context *f_ctx;
+	freenect_device *f_dev;
+	const char *name = FREENECT_SHM_DEFAULT_NAME;
+	int index = 0, slots = FREENECT_SHM_DEFAULT_SLOTS, rgb = 0, verbose = 0;
+	int log_level = FREENECT_LOG_WARNING;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:i:s:rl:vh")) != -1) {
+		switch (opt) {
+			case 'n': name = optarg; break;
+			case 'i': index = atoi(optarg); break;
+			case 's': slots = atoi(optarg); break;
+			case 'r': rgb = 1; break;
+			case 'l': log_level = atoi(optarg); break;
+			case 'v': verbose = 1; break;
+			default:
+				usage(argv[0]);
+				return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (slots < 2) {
+		printf("Error: at least 2 slots are needed\n");
+		return 1;
+	}
+
+	if (freenect_init(&f_ctx, NULL) < 0) {
+		printf("Error: freenect_init() failed\n");
+		return 1;
+	}
+	freenect_set_log_level(f_ctx, log_level);
+	if (freenect_open_device(f_ctx, &f_dev, index) < 0) {
+		printf("Error: could not open device %d\n", index);
+		freenect_shutdown(f_ctx);
+		return 1;
+	}
+
+	depth_ring = freenect_shm_create(name, FREENECT_SHM_DEPTH, FREENECT_DEPTH_11BIT, FREENECT_DEPTH_11BIT_SIZE, slots);
+	if (!depth_ring)
+		goto fail;
+	freenect_set_depth_callback(f_dev, depth_cb);
+	freenect_set_depth_format(f_dev, FREENECT_DEPTH_11BIT);
+	freenect_set_depth_buffer(f_dev, freenect_shm_begin_write(depth_ring));
+	if (rgb) {
+		video_ring = freenect_shm_create(name, FREENECT_SHM_VIDEO, FREENECT_VIDEO_RGB, FREENECT_VIDEO_RGB_SIZE, slots);
+		if (!video_ring)
+			goto fail;
+		freenect_set_video_callback(f_dev, video_cb);
+		freenect_set_video_format(f_dev, FREENECT_VIDEO_RGB);
+		freenect_set_video_buffer(f_dev, freenect_shm_begin_write(video_ring));
+	}
+
+	signal(SIGINT, signal_cleanup);
+	signal(SIGTERM, signal_cleanup);
+
+	freenect_start_depth(f_dev);
+	if (rgb)
+		freenect_start_video(f_dev);
+	printf("Publishing %s on /freenect-%s-*\n", rgb ? "depth and rgb" : "depth", name);
+
+	time_t last = time(NULL);
+	while (!die && freenect_process_events(f_ctx) >= 0) {
+		if (verbose && time(NULL) != last) {
+			last = time(NULL);
+			printf("depth %lu rgb %lu\n", depth_frames, video_frames);
+			fflush(stdout);
+		}
+	}
+
+	printf("Shutting down after %lu depth and %lu rgb frames\n", depth_frames, video_frames);
+	freenect_stop_depth(f_dev);
+	if (rgb)
+		freenect_stop_video(f_dev);
+	freenect_close_device(f_dev);
+	freenect_shutdown(f_ctx);
+	freenect_shm_destroy(depth_ring);
+	freenect_shm_destroy(video_ring);
+	return 0;
+
+fail:
+	freenect_close_device(f_dev);
+	freenect_shutdown(f_ctx);
+	freenect_shm_destroy(depth_ring);
+	return 1;
+}
@@ -0,0 +1,323 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#include "libfreenect_shm.h"
+
+#define SHM_HEADER_SIZE 128
+#define SHM_PAGE 4096
+
+struct freenect_shm_ring {
+	char path[64];
+	uint8_t *base;
+	size_t size;
+	freenect_shm_header *hdr;
+	uint64_t writing; // Frame number of the slot handed out by begin_write
+};
+
+struct freenect_shm_reader {
+	uint8_t *base;
+	size_t size;
+	const freenect_shm_header *hdr;
+	freenect_shm_read_mode mode;
+	uint64_t next;    // First frame number not returned yet
+	uint64_t dropped;
+};
+
+static void shm_path(char *path, size_t len, const char *name, freenect_shm_stream stream)
+{
+	snprintf(path, len, "/freenect-%s-%s", name ? name : FREENECT_SHM_DEFAULT_NAME,
+	         stream == FREENECT_SHM_DEPTH ? "depth" : "video");
+}
+
+static uint64_t monotonic_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static freenect_shm_slot *slot_at(uint8_t *base, const freenect_shm_header *hdr, uint64_t frame)
+{
+	return (freenect_shm_slot *)(base + SHM_HEADER_SIZE + (size_t)(frame % hdr->nslots) * hdr->slot_stride);
+}
+
+static void futex_wake_all(uint32_t *word)
+{
+#ifdef __linux__
+	syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+static void futex_wait(const uint32_t *word, uint32_t value, int timeout_ms)
+{
+#ifdef __linux__
+	struct timespec ts, *tsp = NULL;
+	if (timeout_ms >= 0) {
+		ts.tv_sec = timeout_ms / 1000;
+		ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+		tsp = &ts;
+	}
+	syscall(SYS_futex, word, FUTEX_WAIT, value, tsp, NULL, 0);
+#else
+	// No futex, poll at the producer frame rate granularity
+	(void)word; (void)value;
+	usleep(timeout_ms >= 0 && timeout_ms < 2 ? timeout_ms * 1000 : 2000);
+#endif
+}
+
+freenect_shm_ring *freenect_shm_create(const char *name, freenect_shm_stream stream, int format, uint32_t frame_size, uint32_t nslots)
+{
+	freenect_shm_ring *ring;
+	int fd;
+
+	if (nslots < 2 || !frame_size)
+		return NULL;
+	ring = calloc(1, sizeof(*ring));
+	if (!ring)
+		return NULL;
+	shm_path(ring->path, sizeof(ring->path), name, stream);
+	uint32_t stride = (sizeof(freenect_shm_slot) + frame_size + SHM_PAGE - 1) & ~(SHM_PAGE - 1);
+	ring->size = SHM_HEADER_SIZE + (size_t)stride * nslots;
+
+	// Start from a fresh segment so readers of a previous run notice the change
+	shm_unlink(ring->path);
+	fd = shm_open(ring->path, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0) {
+		printf("Error: cannot create shared memory %s: %s\n", ring->path, strerror(errno));
+		free(ring);
+		return NULL;
+	}
+	if (ftruncate(fd, ring->size) < 0) {
+		printf("Error: cannot size shared memory %s: %s\n", ring->path, strerror(errno));
+		close(fd);
+		shm_unlink(ring->path);
+		free(ring);
+		return NULL;
+	}
+	ring->base = mmap(NULL, ring->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ring->base == MAP_FAILED) {
+		shm_unlink(ring->path);
+		free(ring);
+		return NULL;
+	}
+
+	ring->hdr = (freenect_shm_header *)ring->base;
+	ring->hdr->version = FREENECT_SHM_VERSION;
+	ring->hdr->stream = stream;
+	ring->hdr->format = format;
+	ring->hdr->frame_size = frame_size;
+	ring->hdr->slot_stride = stride;
+	ring->hdr->nslots = nslots;
+	ring->hdr->producer_pid = getpid();
+	// Readers check the magic last
+	__atomic_store_n(&ring->hdr->magic, FREENECT_SHM_MAGIC, __ATOMIC_RELEASE);
+	return ring;
+}
+
+void *freenect_shm_begin_write(freenect_shm_ring *ring)
+{
+	uint64_t frame = __atomic_load_n(&ring->hdr->published, __ATOMIC_RELAXED);
+	freenect_shm_slot *slot = slot_at(ring->base, ring->hdr, frame);
+
+	ring->writing = frame;
+	// Odd sequence first, then the payload: readers seeing the old even value
+	// after touching the payload know it may be torn
+	__atomic_store_n(&slot->seq, 2 * frame + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	return (uint8_t *)slot + sizeof(freenect_shm_slot);
+}
+
+void freenect_shm_commit(freenect_shm_ring *ring, const void *data, uint32_t timestamp)
+{
+	uint64_t frame = ring->writing;
+	freenect_shm_slot *slot = slot_at(ring->base, ring->hdr, frame);
+	uint8_t *payload = (uint8_t *)slot + sizeof(freenect_shm_slot);
+	uint64_t now = monotonic_us();
+
+	if (data && data != payload)
+		memcpy(payload, data, ring->hdr->frame_size);
+	slot->timestamp = timestamp;
+	slot->publish_time_us = now;
+	__atomic_store_n(&slot->seq, 2 * frame + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->hdr->published, frame + 1, __ATOMIC_RELEASE);
+	ring->hdr->producer_time_us = now;
+
+	// Readers cannot write to the segment to say they are sleeping: one wake per frame
+	__atomic_store_n(&ring->hdr->futex, (uint32_t)(frame + 1), __ATOMIC_SEQ_CST);
+	futex_wake_all(&ring->hdr->futex);
+}
+
+void freenect_shm_destroy(freenect_shm_ring *ring)
+{
+	if (!ring)
+		return;
+	// Wake readers so they notice the producer is gone
+	__atomic_store_n(&ring->hdr->magic, 0, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&ring->hdr->futex, 1, __ATOMIC_SEQ_CST);
+	futex_wake_all(&ring->hdr->futex);
+	munmap(ring->base, ring->size);
+	shm_unlink(ring->path);
+	free(ring);
+}
+
+freenect_shm_reader *freenect_shm_open(const char *name, freenect_shm_stream stream)
+{
+	char path[64];
+	struct stat st;
+	freenect_shm_reader *reader;
+	int fd;
+
+	shm_path(path, sizeof(path), name, stream);
+	fd = shm_open(path, O_RDONLY, 0);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) < 0 || st.st_size < SHM_HEADER_SIZE) {
+		close(fd);
+		return NULL;
+	}
+	reader = calloc(1, sizeof(*reader));
+	if (!reader) {
+		close(fd);
+		return NULL;
+	}
+	reader->size = st.st_size;
+	reader->base = mmap(NULL, reader->size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (reader->base == MAP_FAILED) {
+		free(reader);
+		return NULL;
+	}
+	reader->hdr = (const freenect_shm_header *)reader->base;
+	if (__atomic_load_n(&reader->hdr->magic, __ATOMIC_ACQUIRE) != FREENECT_SHM_MAGIC ||
+	    reader->hdr->version != FREENECT_SHM_VERSION ||
+	    reader->hdr->stream != (uint32_t)stream ||
+	    SHM_HEADER_SIZE + (size_t)reader->hdr->slot_stride * reader->hdr->nslots > reader->size) {
+		freenect_shm_close(reader);
+		return NULL;
+	}
+	reader->mode = FREENECT_SHM_LATEST;
+	reader->next = __atomic_load_n(&reader->hdr->published, __ATOMIC_ACQUIRE);
+	return reader;
+}
+
+void freenect_shm_set_mode(freenect_shm_reader *reader, freenect_shm_read_mode mode)
+{
+	reader->mode = mode;
+}
+
+int freenect_shm_wait(freenect_shm_reader *reader, freenect_shm_frame *frame, int timeout_ms)
+{
+	const freenect_shm_header *hdr = reader->hdr;
+	uint64_t deadline = timeout_ms >= 0 ? monotonic_us() + (uint64_t)timeout_ms * 1000 : 0;
+
+	for (;;) {
+		if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != FREENECT_SHM_MAGIC)
+			return -1;
+		uint64_t published = __atomic_load_n(&hdr->published, __ATOMIC_ACQUIRE);
+		if (published > reader->next) {
+			uint64_t want = reader->next;
+			// The producer may be writing the oldest slot right now, keep clear of it
+			uint64_t oldest = published > hdr->nslots - 1 ? published - (hdr->nslots - 1) : 0;
+			if (reader->mode == FREENECT_SHM_LATEST)
+				want = published - 1;
+			else if (want < oldest)
+				want = oldest;
+			freenect_shm_slot *slot = slot_at(reader->base, hdr, want);
+			uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+			reader->dropped += want - reader->next;
+			reader->next = want + 1;
+			if (seq != 2 * want + 2)
+				continue; // Overwritten before we got there, try a newer one
+			frame->data = (const uint8_t *)slot + sizeof(freenect_shm_slot);
+			frame->size = hdr->frame_size;
+			frame->timestamp = slot->timestamp;
+			frame->publish_time_us = slot->publish_time_us;
+			frame->frame = want;
+			frame->seq = seq;
+			// The header fields above could be torn as well
+			if (!freenect_shm_frame_valid(reader, frame))
+				continue;
+			return 0;
+		}
+
+		int wait_ms = -1;
+		if (timeout_ms >= 0) {
+			uint64_t now = monotonic_us();
+			if (now >= deadline)
+				return 1;
+			wait_ms = (deadline - now + 999) / 1000;
+		}
+		// A frame published after this load changes the futex word: the wait returns at once
+		uint32_t seen = __atomic_load_n(&hdr->futex, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&hdr->published, __ATOMIC_SEQ_CST) <= reader->next)
+			futex_wait(&hdr->futex, seen, wait_ms);
+	}
+}
+
+int freenect_shm_frame_valid(freenect_shm_reader *reader, const freenect_shm_frame *frame)
+{
+	const freenect_shm_slot *slot = (const freenect_shm_slot *)((const uint8_t *)frame->data - sizeof(freenect_shm_slot));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == frame->seq;
+}
+
+int freenect_shm_copy(freenect_shm_reader *reader, const freenect_shm_frame *frame, void *dst)
+{
+	memcpy(dst, frame->data, frame->size);
+	return freenect_shm_frame_valid(reader, frame) ? 0 : -1;
+}
+
+const freenect_shm_header *freenect_shm_info(freenect_shm_reader *reader)
+{
+	return reader->hdr;
+}
+
+uint64_t freenect_shm_dropped(freenect_shm_reader *reader)
+{
+	return reader->dropped;
+}
+
+void freenect_shm_close(freenect_shm_reader *reader)
+{
+	if (!reader)
+		return;
+	munmap(reader->base, reader->size);
+	free(reader);
+}
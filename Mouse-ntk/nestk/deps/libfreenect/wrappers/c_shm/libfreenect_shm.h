@@ -0,0 +1,180 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#ifndef FREENECT_SHM_H
+#define FREENECT_SHM_H
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*  Shared memory frame ring
+
+    One POSIX shared memory segment per stream (/freenect-<name>-depth and
+    /freenect-<name>-video) holding a header followed by nslots frame slots.
+    There is a single producer (freenect-shmd) and any number of readers.
+
+    Every slot starts with a seqlock word: 2*frame+1 while the producer writes
+    the slot, 2*frame+2 once the frame is complete. Readers never take a lock
+    and never block the producer: a reader that falls behind simply finds its
+    slot overwritten (the sequence changed) and skips ahead.
+
+    The producer creates the segments with mode 0644 and readers map them read
+    only, so readers may run as any user. They sleep on the futex word without
+    writing to the segment; the producer wakes them on every frame.
+
+    Readers get a pointer straight into the segment (zero copy). After using
+    the data, call freenect_shm_frame_valid() to make sure the producer did
+    not reuse the slot meanwhile, or use freenect_shm_copy() to get a
+    consistent private copy.
+*/
+
+#define FREENECT_SHM_MAGIC 0x4d48534e /* "NSHM" */
+#define FREENECT_SHM_VERSION 1
+#define FREENECT_SHM_DEFAULT_SLOTS 8
+#define FREENECT_SHM_DEFAULT_NAME "kinect"
+
+typedef enum {
+	FREENECT_SHM_DEPTH = 0,
+	FREENECT_SHM_VIDEO = 1,
+} freenect_shm_stream;
+
+typedef enum {
+	FREENECT_SHM_LATEST = 0,     /* Always jump to the newest frame (lowest latency) */
+	FREENECT_SHM_SEQUENTIAL = 1, /* Deliver every frame still held in the ring */
+} freenect_shm_read_mode;
+
+/* Segment header, at offset 0 */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t stream;        /* freenect_shm_stream */
+	uint32_t format;        /* freenect_depth_format or freenect_video_format */
+	uint32_t frame_size;    /* Payload bytes per frame */
+	uint32_t slot_stride;   /* Bytes from one slot to the next */
+	uint32_t nslots;
+	uint32_t producer_pid;
+	uint64_t published;     /* Number of frames published, the newest is published-1 */
+	uint32_t futex;         /* Low 32 bits of published, readers sleep on it */
+	uint32_t reserved;      /* Zero */
+	uint64_t producer_time_us;
+	uint8_t pad[64];
+} freenect_shm_header;
+
+/* Slot header, followed by the frame payload */
+typedef struct {
+	uint64_t seq;           /* Seqlock: odd while written, 2*frame+2 when valid */
+	uint32_t timestamp;     /* Kinect timestamp of the frame */
+	uint32_t pad0;
+	uint64_t publish_time_us;
+	uint8_t pad[40];
+} freenect_shm_slot;
+
+typedef struct {
+	const void *data;       /* Points into the shared segment */
+	uint32_t size;
+	uint32_t timestamp;
+	uint64_t frame;         /* Frame number since the producer started */
+	uint64_t publish_time_us; /* CLOCK_MONOTONIC time the frame was published */
+	uint64_t seq;           /* Used by freenect_shm_frame_valid() */
+} freenect_shm_frame;
+
+typedef struct freenect_shm_ring freenect_shm_ring;
+typedef struct freenect_shm_reader freenect_shm_reader;
+
+/* Producer side, used by freenect-shmd */
+
+freenect_shm_ring *freenect_shm_create(const char *name, freenect_shm_stream stream, int format, uint32_t frame_size, uint32_t nslots);
+/*  Creates (or replaces) the segment for a stream.
+
+    Returns:
+        NULL on error.
+*/
+
+void *freenect_shm_begin_write(freenect_shm_ring *ring);
+/*  Marks the next slot as being written and returns its payload. The pointer
+    can be handed to freenect_set_depth_buffer/freenect_set_video_buffer so
+    that libfreenect unpacks straight into shared memory.
+*/
+
+void freenect_shm_commit(freenect_shm_ring *ring, const void *data, uint32_t timestamp);
+/*  Publishes the slot returned by the last freenect_shm_begin_write(). If data
+    is not that slot's payload it is copied in first. Wakes sleeping readers.
+*/
+
+void freenect_shm_destroy(freenect_shm_ring *ring);
+/*  Unmaps and unlinks the segment. Readers still mapping it keep their view. */
+
+/* Reader side */
+
+freenect_shm_reader *freenect_shm_open(const char *name, freenect_shm_stream stream);
+/*  Maps an existing segment read only: the reader needs read permission on
+    it, nothing more.
+
+    Returns:
+        NULL if the producer is not running or the segment is incompatible.
+*/
+
+void freenect_shm_set_mode(freenect_shm_reader *reader, freenect_shm_read_mode mode);
+
+int freenect_shm_wait(freenect_shm_reader *reader, freenect_shm_frame *frame, int timeout_ms);
+/*  Waits for a frame newer than the last one returned.
+
+    Args:
+        frame: Populated with a zero copy view of the frame
+        timeout_ms: Maximum time to wait, negative waits forever
+
+    Returns:
+        0 on success, 1 on timeout, -1 on error.
+*/
+
+int freenect_shm_frame_valid(freenect_shm_reader *reader, const freenect_shm_frame *frame);
+/*  Returns nonzero if the frame data was not overwritten since
+    freenect_shm_wait() returned it, i.e. whatever was read from it is consistent.
+*/
+
+int freenect_shm_copy(freenect_shm_reader *reader, const freenect_shm_frame *frame, void *dst);
+/*  Copies the frame to dst (frame->size bytes).
+
+    Returns:
+        0 on success, -1 if the producer overwrote the slot during the copy.
+*/
+
+const freenect_shm_header *freenect_shm_info(freenect_shm_reader *reader);
+
+uint64_t freenect_shm_dropped(freenect_shm_reader *reader);
+/*  Number of frames this reader skipped because it fell behind or asked for
+    the latest frame only.
+*/
+
+void freenect_shm_close(freenect_shm_reader *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
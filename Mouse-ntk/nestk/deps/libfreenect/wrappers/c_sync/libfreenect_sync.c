@@ -74,6 +74,9 @@ static int alloc_buffer_ring_video(freenect_video_format fmt, buffer_ring_t *buf
 		case FREENECT_VIDEO_RGB:
 			sz = FREENECT_VIDEO_RGB_SIZE;
 			break;
+		case FREENECT_VIDEO_RGB_HALF:
+			sz = FREENECT_VIDEO_RGB_HALF_SIZE;
+			break;
 		case FREENECT_VIDEO_BAYER:
 			sz = FREENECT_VIDEO_BAYER_SIZE;
 			break;
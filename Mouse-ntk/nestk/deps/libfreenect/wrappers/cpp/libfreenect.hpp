@@ -125,6 +125,7 @@ namespace Freenect {
 	  protected:
 		int getVideoBufferSize(){
 			if(m_video_format == FREENECT_VIDEO_RGB) return FREENECT_VIDEO_RGB_SIZE;
+			if(m_video_format == FREENECT_VIDEO_RGB_HALF) return FREENECT_VIDEO_RGB_HALF_SIZE;
 			if(m_video_format == FREENECT_VIDEO_BAYER) return FREENECT_VIDEO_BAYER_SIZE;
 			if(m_video_format == FREENECT_VIDEO_IR_8BIT) return FREENECT_VIDEO_IR_8BIT_SIZE;
 			if(m_video_format == FREENECT_VIDEO_IR_10BIT) return FREENECT_VIDEO_IR_10BIT_SIZE;
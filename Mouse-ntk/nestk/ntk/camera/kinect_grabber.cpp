@@ -35,7 +35,7 @@ namespace ntk
   {
     KinectGrabber* grabber = reinterpret_cast<KinectGrabber*>(freenect_get_user(dev));
     uint16_t *depth = reinterpret_cast<uint16_t*>(v_depth);
-    grabber->depthCallBack(depth, FREENECT_FRAME_W, FREENECT_FRAME_H);
+    grabber->depthCallBack(depth, FREENECT_FRAME_W, FREENECT_FRAME_H, timestamp);
   }
 
   static void kinect_video_db(freenect_device *dev, void *rgb, uint32_t timestamp)
@@ -43,40 +43,45 @@ namespace ntk
 	  KinectGrabber* grabber = reinterpret_cast<KinectGrabber*>(freenect_get_user(dev));
     if (grabber->irModeEnabled()) { // ir mode
 		uint8_t *ir_cast = reinterpret_cast<uint8_t*>(rgb);
-		grabber->irCallBack(ir_cast, FREENECT_FRAME_W, FREENECT_FRAME_H);
+		grabber->irCallBack(ir_cast, FREENECT_FRAME_W, FREENECT_FRAME_H, timestamp);
 	  } else { // rgb mode
 	    uint8_t *rgb_cast = reinterpret_cast<uint8_t*>(rgb);
-	    grabber->rgbCallBack(rgb_cast, FREENECT_FRAME_W, FREENECT_FRAME_H);
+	    grabber->rgbCallBack(rgb_cast, FREENECT_FRAME_W, FREENECT_FRAME_H, timestamp);
 	  }
     }
 
-  void KinectGrabber :: irCallBack(uint8_t *buf, int width, int height)
+  void KinectGrabber :: irCallBack(uint8_t *buf, int width, int height, uint32_t timestamp)
   {
-    ntk_assert(width == m_current_image.rawIntensity().cols, "Bad width");
-    ntk_assert(height == m_current_image.rawIntensity().rows, "Bad height");
-    float* intensity_buf = m_current_image.rawIntensityRef().ptr<float>();
+    int slot = m_synchronizer.colorSlot();
+    ntk_assert(width == m_ir_slots[slot].cols, "Bad width");
+    ntk_assert(height == m_ir_slots[slot].rows, "Bad height");
+    float* intensity_buf = m_ir_slots[slot].ptr<float>();
     for (int i = 0; i < width*height; ++i)
       *intensity_buf++ = *buf++;
-    m_rgb_transmitted = false;
+    m_slot_is_ir[slot] = true;
+    m_synchronizer.addColor(slot, timestamp);
   }
 
-  void KinectGrabber :: depthCallBack(uint16_t *buf, int width, int height)
+  void KinectGrabber :: depthCallBack(uint16_t *buf, int width, int height, uint32_t timestamp)
   {
-    ntk_assert(width == m_current_image.rawDepth().cols, "Bad width");
-    ntk_assert(height == m_current_image.rawDepth().rows, "Bad height");
-    float* depth_buf = m_current_image.rawDepthRef().ptr<float>();
+    int slot = m_synchronizer.depthSlot();
+    ntk_assert(width == m_depth_slots[slot].cols, "Bad width");
+    ntk_assert(height == m_depth_slots[slot].rows, "Bad height");
+    float* depth_buf = m_depth_slots[slot].ptr<float>();
     for (int i = 0; i < width*height; ++i)
       *depth_buf++ = *buf++;
-    m_depth_transmitted = false;
+    m_synchronizer.addDepth(slot, timestamp);
   }
 
-  void KinectGrabber :: rgbCallBack(uint8_t *buf, int width, int height)
+  void KinectGrabber :: rgbCallBack(uint8_t *buf, int width, int height, uint32_t timestamp)
   {
-    ntk_assert(width == m_current_image.rawRgb().cols, "Bad width");
-    ntk_assert(height == m_current_image.rawRgb().rows, "Bad height");
-    std::copy(buf, buf+3*width*height, (uint8_t*)m_current_image.rawRgbRef().ptr());
-    cvtColor(m_current_image.rawRgb(), m_current_image.rawRgbRef(), CV_RGB2BGR);
-    m_rgb_transmitted = false;
+    int slot = m_synchronizer.colorSlot();
+    ntk_assert(width == m_rgb_slots[slot].cols, "Bad width");
+    ntk_assert(height == m_rgb_slots[slot].rows, "Bad height");
+    // straight from the libfreenect buffer, which stays valid during the callback
+    cvtColor(Mat3b(height, width, reinterpret_cast<Vec3b*>(buf)), m_rgb_slots[slot], CV_RGB2BGR);
+    m_slot_is_ir[slot] = false;
+    m_synchronizer.addColor(slot, timestamp);
   }
 
   void KinectGrabber :: setTiltAngle(int angle)
@@ -98,21 +103,25 @@ namespace ntk
       freenect_set_video_format(f_dev, FREENECT_VIDEO_RGB);
     else
       freenect_set_video_format(f_dev, FREENECT_VIDEO_IR_8BIT);
-    freenect_start_video(f_dev);
+    // a depth only grabber saves the usb bandwidth and the conversions of the video stream
+    if (m_synchronizer.usesColor())
+      freenect_start_video(f_dev);
   }
 
   void KinectGrabber :: startKinect()
   {
-    freenect_start_depth(f_dev);
+    if (m_synchronizer.usesDepth())
+      freenect_start_depth(f_dev);
     setIRMode(m_ir_mode);
   }
 
-  void KinectGrabber :: initialize()  
+  void KinectGrabber :: initialize(int device_index)
   {
+    m_device_index = device_index;
     if (freenect_init(&f_ctx, NULL) < 0)
       fatal_error("freenect_init() failed\n");
 
-    if (freenect_open_device(f_ctx, &f_dev, 0) < 0)
+    if (freenect_open_device(f_ctx, &f_dev, device_index) < 0)
       fatal_error("freenect_open_device() failed\n");
 
     freenect_set_user(f_dev, this);
@@ -126,16 +135,25 @@ namespace ntk
   void KinectGrabber :: run()
   {
     m_should_exit = false;
-    m_current_image.setCalibration(m_calib_data);
+    if (m_scheduling.isSet())
+      m_scheduling_applied = setCurrentThreadScheduling(m_scheduling);
     m_rgbd_image.setCalibration(m_calib_data);
 
-    m_rgbd_image.rawRgbRef() = Mat3b(FREENECT_FRAME_H, FREENECT_FRAME_W);
+    m_rgbd_image.rawRgbRef() = Mat3b(FREENECT_FRAME_H, FREENECT_FRAME_W, Vec3b(0,0,0)); // black until the first color frame
     m_rgbd_image.rawDepthRef() = Mat1f(FREENECT_FRAME_H, FREENECT_FRAME_W);
     m_rgbd_image.rawIntensityRef() = Mat1f(FREENECT_FRAME_H, FREENECT_FRAME_W);
 
-    m_current_image.rawRgbRef() = Mat3b(FREENECT_FRAME_H, FREENECT_FRAME_W);
-    m_current_image.rawDepthRef() = Mat1f(FREENECT_FRAME_H, FREENECT_FRAME_W);
-    m_current_image.rawIntensityRef() = Mat1f(FREENECT_FRAME_H, FREENECT_FRAME_W);
+    m_synchronizer.reset();
+    m_depth_slots.resize(m_synchronizer.numSlots());
+    m_rgb_slots.resize(m_synchronizer.numSlots());
+    m_ir_slots.resize(m_synchronizer.numSlots());
+    m_slot_is_ir.assign(m_synchronizer.numSlots(), false);
+    for (int i = 0; i < m_synchronizer.numSlots(); ++i)
+    {
+      m_depth_slots[i] = Mat1f(FREENECT_FRAME_H, FREENECT_FRAME_W);
+      m_rgb_slots[i] = Mat3b(FREENECT_FRAME_H, FREENECT_FRAME_W);
+      m_ir_slots[i] = Mat1f(FREENECT_FRAME_H, FREENECT_FRAME_W);
+    }
 
     startKinect();
     int64 last_grab_time = 0;
@@ -143,7 +161,8 @@ namespace ntk
     while (!m_should_exit)
     {
       waitForNewEvent();
-      while (m_depth_transmitted || m_rgb_transmitted)
+      int depth_slot = -1, color_slot = -1;
+      while (!m_synchronizer.nextFrame(depth_slot, color_slot))
         freenect_process_events(f_ctx);
 
       // m_current_image.rawDepth().copyTo(m_current_image.rawAmplitudeRef());
@@ -154,14 +173,22 @@ namespace ntk
         ntk_dbg_print(grab_time - last_grab_time, 2);
         last_grab_time = grab_time;
         QWriteLocker locker(&m_lock);
-        // FIXME: ugly hack to handle the possible time
-        // gaps between rgb and IR frames in dual mode.
-        if (m_dual_ir_rgb)
-          m_current_image.copyTo(m_rgbd_image);
-        else
-          m_current_image.swap(m_rgbd_image);
-        m_rgb_transmitted = true;
-        m_depth_transmitted = true;
+        // Only the streams of the frame change: in dual mode the image
+        // keeps the last rgb frame along with the new IR one, and back.
+        if (depth_slot >= 0)
+        {
+          cv::swap(m_rgbd_image.rawDepthRef(), m_depth_slots[depth_slot]);
+          m_rgbd_image.setDepthTimestamp(m_synchronizer.depthTimestamp(depth_slot));
+        }
+        if (color_slot >= 0)
+        {
+          if (m_slot_is_ir[color_slot])
+            cv::swap(m_rgbd_image.rawIntensityRef(), m_ir_slots[color_slot]);
+          else
+            cv::swap(m_rgbd_image.rawRgbRef(), m_rgb_slots[color_slot]);
+          m_rgbd_image.setRgbTimestamp(m_synchronizer.colorTimestamp(color_slot));
+        }
+        m_sync_stats = m_synchronizer.stats();
       }
 
       if (m_dual_ir_rgb)
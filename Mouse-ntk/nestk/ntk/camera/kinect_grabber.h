@@ -25,7 +25,9 @@
 #include <ntk/core.h>
 #include <ntk/utils/qt_utils.h>
 #include <ntk/camera/calibration.h>
+#include <ntk/camera/rgbd_synchronizer.h>
 #include <ntk/thread/event.h>
+#include <ntk/thread/utils.h>
 
 extern "C" {
 #include <libfreenect.h>
@@ -43,15 +45,19 @@ class KinectGrabber : public RGBDGrabber
 {
 public:
   KinectGrabber()
-    : m_depth_transmitted(0),
-      m_rgb_transmitted(0),
-      f_ctx(0), f_dev(0),
+    : f_ctx(0), f_dev(0), m_device_index(0),
       m_ir_mode(0),
-      m_dual_ir_rgb(0)
+      m_dual_ir_rgb(0),
+      m_scheduling_applied(true)
   {}
 
-  /*! Connect with the Kinect device. */
-  void initialize();
+  /*!
+   * Connect with the Kinect device of the given index. Each grabber has
+   * its own freenect context and thread, so that several Kinects are
+   * pumped in parallel.
+   */
+  void initialize(int device_index = 0);
+  int deviceIndex() const { return m_device_index; }
 
   /*! Set the Kinect motor angle using degress. */
   virtual void setTiltAngle(int angle);
@@ -63,10 +69,34 @@ public:
   /*! Special mode switching between IR and RGB after each frame. */
   void setDualRgbIR(bool enable);
 
+  /*!
+   * Scheduling of the grabbing thread, which pumps the USB events.
+   * Applied when the thread starts.
+   */
+  void setThreadScheduling(const ThreadScheduling& scheduling) { m_scheduling = scheduling; }
+
+  /*! False when the scheduling could not be applied, e.g. without real-time permissions. */
+  bool threadSchedulingApplied() const { return m_scheduling_applied; }
+
+  /*!
+   * Publish pairs of depth and color frames matched by their timestamps (the
+   * default), or each depth (or color) frame as soon as it arrives, without
+   * streaming the other one. Set it before starting the grabber.
+   */
+  void setSyncMode(RGBDSynchronizer::Mode mode) { m_synchronizer.setMode(mode); }
+  RGBDSynchronizer::Mode syncMode() const { return m_synchronizer.mode(); }
+
+  /*! Largest timestamp difference between the depth and the color of a frame. */
+  void setSyncToleranceMs(double ms) { m_synchronizer.setToleranceMs(ms); }
+
+  /*! Thread safe copy of the pairing statistics. */
+  RGBDSynchronizerStats syncStats() const
+  { QReadLocker locker(&m_lock); return m_sync_stats; }
+
 public:
-  void depthCallBack(uint16_t *buf, int width, int height);
-  void rgbCallBack(uint8_t *buf, int width, int height);
-  void irCallBack(uint8_t *buf, int width, int height);
+  void depthCallBack(uint16_t *buf, int width, int height, uint32_t timestamp = 0);
+  void rgbCallBack(uint8_t *buf, int width, int height, uint32_t timestamp = 0);
+  void irCallBack(uint8_t *buf, int width, int height, uint32_t timestamp = 0);
 
 protected:
   virtual void run();
@@ -74,13 +104,20 @@ protected:
 
 private:
   QReadWriteLock m_kinect_lock;
-  RGBDImage m_current_image;
-  bool m_depth_transmitted;
-  bool m_rgb_transmitted;
+  // Frames waiting for the other stream, in the slots of the synchronizer
+  RGBDSynchronizer m_synchronizer;
+  RGBDSynchronizerStats m_sync_stats;
+  std::vector<cv::Mat1f> m_depth_slots;
+  std::vector<cv::Mat3b> m_rgb_slots;
+  std::vector<cv::Mat1f> m_ir_slots;
+  std::vector<bool> m_slot_is_ir;
   freenect_context *f_ctx;
   freenect_device *f_dev;
+  int m_device_index;
   bool m_ir_mode;
   bool m_dual_ir_rgb;
+  ThreadScheduling m_scheduling;
+  bool m_scheduling_applied;
 };
 
 } // ntk
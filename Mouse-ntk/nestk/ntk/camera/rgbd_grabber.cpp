@@ -40,8 +40,13 @@ namespace ntk
       m_framerate = (1000.f * m_frame_count) / (delta_tick);
       m_last_frame_tick = tick;
       m_frame_count = 0;
+      if (m_stats_listener)
+        m_stats_listener->onFrameRateUpdate(*this, m_framerate);
     }
 
+    if (m_stats_listener)
+      m_stats_listener->onNewFrame(*this);
+
     m_condition.wakeAll();
     broadcastEvent();
   }
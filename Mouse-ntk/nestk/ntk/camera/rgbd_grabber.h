@@ -30,6 +30,24 @@
 namespace ntk
 {
 
+class RGBDGrabber;
+
+/*!
+ * Receives grabber statistics, e.g. to feed an external metrics registry.
+ * Callbacks are called from the grabber thread.
+ */
+class RGBDGrabberStatsListener
+{
+public:
+  virtual ~RGBDGrabberStatsListener() {}
+
+  /*! Called once per advertised frame. */
+  virtual void onNewFrame(const RGBDGrabber& grabber) {}
+
+  /*! Called each time the framerate estimate is updated (about once per second). */
+  virtual void onFrameRateUpdate(const RGBDGrabber& grabber, double framerate) = 0;
+};
+
 /*!
  * Abstract RGB-D image grabber.
  * The grabber works in its own QT thread.
@@ -42,7 +60,8 @@ public:
       m_should_exit(0),
       m_last_frame_tick(0),
       m_framerate(0),
-      m_frame_count(0)
+      m_frame_count(0),
+      m_stats_listener(0)
   {
     setSynchronous(false);
   }
@@ -61,6 +80,9 @@ public:
   /*! Return the current framerate. */
   virtual double frameRate() const { return m_framerate; }
 
+  /*! Set a listener notified of new frames and framerate updates. Not owned. */
+  void setStatsListener(RGBDGrabberStatsListener* listener) { m_stats_listener = listener; }
+
   /*! Set the calibration data that will be included in each image. */
   void setCalibrationData(const ntk::RGBDCalibration& data)
   { m_calib_data = &data; m_rgbd_image.setCalibration(&data); }
@@ -104,6 +126,7 @@ protected:
   uint64 m_last_frame_tick;
   double m_framerate;
   int m_frame_count;
+  RGBDGrabberStatsListener* m_stats_listener;
 };
 
 } // ntk
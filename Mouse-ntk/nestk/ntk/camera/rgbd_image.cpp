@@ -100,6 +100,8 @@ namespace ntk
     m_raw_depth.copyTo(other.m_raw_depth);
     other.m_calibration = m_calibration;
     other.m_directory = m_directory;
+    other.m_depth_timestamp = m_depth_timestamp;
+    other.m_rgb_timestamp = m_rgb_timestamp;
   }
 
   void RGBDImage :: swap(RGBDImage& other)
@@ -119,6 +121,8 @@ namespace ntk
     cv::swap(m_raw_depth, other.m_raw_depth);
     std::swap(m_calibration, other.m_calibration);
     std::swap(m_directory, other.m_directory);
+    std::swap(m_depth_timestamp, other.m_depth_timestamp);
+    std::swap(m_rgb_timestamp, other.m_rgb_timestamp);
   }
 
 } // ntk
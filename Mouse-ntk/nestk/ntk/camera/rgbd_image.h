@@ -22,6 +22,8 @@
 
 #include <ntk/camera/calibration.h>
 
+#include <stdint.h>
+
 namespace ntk
 {
 
@@ -40,12 +42,13 @@ namespace ntk
 class CV_EXPORTS RGBDImage
 {
 public:
-  RGBDImage() : m_calibration(0) {}
+  RGBDImage() : m_calibration(0), m_depth_timestamp(0), m_rgb_timestamp(0) {}
 
   /*! Initialize from an viewXXXX directory. */
   RGBDImage(const std::string& dir,
             const RGBDCalibration* calib = 0,
             RGBDProcessor* processor = 0)
+    : m_depth_timestamp(0), m_rgb_timestamp(0)
   { loadFromDir(dir, calib, processor); }
 
   /*! Directory path if loaded from disk. */
@@ -72,6 +75,18 @@ public:
   /*! Set an associated viewXXXX directory. */
   void setDirectory(const std::string& dir) { m_directory = dir; }
 
+  /*! Sensor timestamp of the depth data, 0 if unknown (e.g. loaded from disk). */
+  uint32_t depthTimestamp() const { return m_depth_timestamp; }
+
+  /*! Set the sensor timestamp of the depth data. */
+  void setDepthTimestamp(uint32_t timestamp) { m_depth_timestamp = timestamp; }
+
+  /*! Sensor timestamp of the color (or IR) data, 0 if unknown. */
+  uint32_t rgbTimestamp() const { return m_rgb_timestamp; }
+
+  /*! Set the sensor timestamp of the color data. */
+  void setRgbTimestamp(uint32_t timestamp) { m_rgb_timestamp = timestamp; }
+
   /*! Swap content with another image. */
   void swap(RGBDImage& other);
 
@@ -170,6 +185,8 @@ private:
   cv::Mat1f m_raw_depth;
   const RGBDCalibration* m_calibration;
   std::string m_directory;
+  uint32_t m_depth_timestamp;
+  uint32_t m_rgb_timestamp;
 };
 
 } // ntk
@@ -0,0 +1,200 @@
+/**
+ * This file is part of the nestk library.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rgbd_synchronizer.h"
+
+#include <ntk/utils/debug.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace ntk
+{
+
+  RGBDSynchronizer :: RGBDSynchronizer(int slots)
+    : m_slots(slots), m_mode(DepthAndColor), m_tolerance(uint32_t(1000.0 / 60 * ticksPerMs()))
+  {
+    ntk_ensure(slots > 0, "A synchronizer needs at least one slot per stream.");
+    reset();
+  }
+
+  void RGBDSynchronizer :: resetStream(Stream& stream)
+  {
+    stream.timestamps.assign(m_slots, 0);
+    stream.queued.clear();
+    stream.free.clear();
+    for (int i = m_slots - 1; i >= 0; --i)
+      stream.free.push_back(i);
+    stream.interval = 0;
+    stream.has_last = false;
+    stream.last = 0;
+  }
+
+  void RGBDSynchronizer :: reset()
+  {
+    resetStream(m_depth);
+    resetStream(m_color);
+    m_stats = RGBDSynchronizerStats();
+  }
+
+  int RGBDSynchronizer :: takeSlot(Stream& stream, int& dropped)
+  {
+    if (stream.free.empty())
+    {
+      // the other stream is late or gone, the oldest frame makes room
+      int slot = stream.queued.front();
+      stream.queued.pop_front();
+      ++dropped;
+      return slot;
+    }
+    int slot = stream.free.back();
+    stream.free.pop_back();
+    return slot;
+  }
+
+  void RGBDSynchronizer :: addFrame(Stream& stream, int slot, uint32_t timestamp)
+  {
+    ntk_assert(slot >= 0 && slot < m_slots, "Bad slot");
+    stream.timestamps[slot] = timestamp;
+    stream.queued.push_back(slot);
+    if (stream.has_last)
+    {
+      int32_t interval = ticksBetween(stream.last, timestamp);
+      if (interval > 0 && interval < 60 * 60000) // not across a restart of the stream
+        stream.interval = interval;
+    }
+    stream.last = timestamp;
+    stream.has_last = true;
+  }
+
+  void RGBDSynchronizer :: release(Stream& stream, int& dropped, bool keep_newest)
+  {
+    while (stream.queued.size() > (keep_newest ? 1u : 0u))
+    {
+      stream.free.push_back(stream.queued.front());
+      stream.queued.pop_front();
+      ++dropped;
+    }
+  }
+
+  bool RGBDSynchronizer :: nextFrame(int& depth_slot, int& color_slot)
+  {
+    depth_slot = -1;
+    color_slot = -1;
+
+    if (m_mode == DepthAndColor)
+      return nextPair(depth_slot, color_slot);
+
+    Stream& used = m_mode == DepthOnly ? m_depth : m_color;
+    Stream& ignored = m_mode == DepthOnly ? m_color : m_depth;
+    release(ignored, m_mode == DepthOnly ? m_stats.color_dropped : m_stats.depth_dropped, false);
+    if (used.queued.empty())
+      return false;
+    release(used, m_mode == DepthOnly ? m_stats.depth_dropped : m_stats.color_dropped, true);
+    int slot = used.queued.front();
+    used.queued.pop_front();
+    used.free.push_back(slot);
+    (m_mode == DepthOnly ? depth_slot : color_slot) = slot;
+    ++m_stats.frames;
+    return true;
+  }
+
+  bool RGBDSynchronizer :: nextPair(int& depth_slot, int& color_slot)
+  {
+    const int32_t tolerance = m_tolerance;
+    int32_t skew = 0;
+    while (!m_depth.queued.empty())
+    {
+      const int d = m_depth.queued.front();
+      const uint32_t depth_time = m_depth.timestamps[d];
+
+      // color frames too old for this depth frame are too old for the next ones
+      while (!m_color.queued.empty()
+             && ticksBetween(m_color.timestamps[m_color.queued.front()], depth_time) > tolerance)
+      {
+        m_color.free.push_back(m_color.queued.front());
+        m_color.queued.pop_front();
+        ++m_stats.color_dropped;
+      }
+
+      int best = -1;
+      int32_t best_skew = 0;
+      for (size_t i = 0; i < m_color.queued.size(); ++i)
+      {
+        int32_t s = ticksBetween(depth_time, m_color.timestamps[m_color.queued[i]]);
+        if (best < 0 || std::abs(s) < std::abs(best_skew))
+        {
+          best = i;
+          best_skew = s;
+        }
+      }
+
+      // The color frames to come are after the last one: once it is after the
+      // depth frame, or the next one is expected farther than the best one,
+      // the best one is the nearest.
+      bool decided = false;
+      if (best >= 0)
+      {
+        int32_t last_skew = ticksBetween(depth_time, m_color.timestamps[m_color.queued.back()]);
+        int32_t next_skew = last_skew + int32_t(m_color.interval);
+        decided = last_skew >= 0 || (m_color.interval > 0 && next_skew >= std::abs(best_skew));
+      }
+      // without room for more depth frames, this one cannot wait any longer
+      if (!decided && int(m_depth.queued.size()) < m_slots)
+        break;
+
+      m_depth.queued.pop_front();
+      m_depth.free.push_back(d);
+      if (best < 0 || std::abs(best_skew) > tolerance)
+      {
+        ++m_stats.depth_dropped;
+        continue;
+      }
+
+      for (int i = 0; i < best; ++i)
+      {
+        m_color.free.push_back(m_color.queued.front());
+        m_color.queued.pop_front();
+        ++m_stats.color_dropped;
+      }
+      const int c = m_color.queued.front();
+      m_color.queued.pop_front();
+      m_color.free.push_back(c);
+
+      // a newer pair replaces the one found before
+      if (depth_slot >= 0)
+      {
+        ++m_stats.depth_dropped;
+        ++m_stats.color_dropped;
+      }
+      depth_slot = d;
+      color_slot = c;
+      skew = best_skew;
+    }
+
+    if (depth_slot < 0)
+      return false;
+    const double skew_ms = skew / ticksPerMs();
+    ++m_stats.frames;
+    ++m_stats.paired;
+    m_stats.skew_ms += std::abs(skew_ms);
+    m_stats.max_skew_ms = std::max(m_stats.max_skew_ms, std::abs(skew_ms));
+    m_stats.last_skew_ms = skew_ms;
+    return true;
+  }
+
+} // ntk
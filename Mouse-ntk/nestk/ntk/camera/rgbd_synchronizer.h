@@ -0,0 +1,142 @@
+/**
+ * This file is part of the nestk library.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NTK_CAMERA_RGBD_SYNCHRONIZER_H
+#define NTK_CAMERA_RGBD_SYNCHRONIZER_H
+
+#include <ntk/core.h>
+
+#include <deque>
+#include <vector>
+
+namespace ntk
+{
+
+/*! Frames released by a RGBDSynchronizer since it was reset. */
+struct RGBDSynchronizerStats
+{
+  RGBDSynchronizerStats()
+    : frames(0), paired(0), depth_dropped(0), color_dropped(0),
+      skew_ms(0), max_skew_ms(0), last_skew_ms(0)
+  {}
+
+  double meanSkewMs() const { return paired ? skew_ms / paired : 0; }
+
+  int frames;
+  int paired; //!< Frames with both depth and color.
+  int depth_dropped; //!< Depth frames without a color frame close enough, or behind a newer frame.
+  int color_dropped; //!< Color frames no depth frame took.
+  double skew_ms; //!< Sum of the absolute timestamp differences of the pairs.
+  double max_skew_ms;
+  double last_skew_ms; //!< Color minus depth timestamp of the last pair.
+};
+
+/*!
+ * Pairs the depth and color frames of a sensor by their timestamps.
+ * The frames are written into slots, a few per stream, whose buffers
+ * belong to the caller: take a slot, fill it, add it with its timestamp,
+ * then ask for the next frame. Each depth frame gets the color frame
+ * nearest in time, if it is within the tolerance; it is released as soon
+ * as no color frame still to come can be nearer. The timestamps tick at
+ * 60 MHz and wrap around, as those of libfreenect. Not thread safe.
+ */
+class RGBDSynchronizer
+{
+public:
+  enum Mode
+  {
+    DepthAndColor, //!< Pairs of depth and color frames.
+    DepthOnly, //!< Each depth frame as soon as it is there, the color stream is ignored.
+    ColorOnly //!< Each color frame as soon as it is there, the depth stream is ignored.
+  };
+
+public:
+  /*! Slots per stream, the frames waiting for the other stream. */
+  RGBDSynchronizer(int slots = 3);
+
+public:
+  void setMode(Mode mode) { m_mode = mode; reset(); }
+  Mode mode() const { return m_mode; }
+
+  bool usesDepth() const { return m_mode != ColorOnly; }
+  bool usesColor() const { return m_mode != DepthOnly; }
+
+  /*! Largest timestamp difference of a pair, half a frame at 30 fps by default. */
+  void setToleranceMs(double ms) { m_tolerance = uint32_t(ms * ticksPerMs()); }
+  double toleranceMs() const { return m_tolerance / ticksPerMs(); }
+
+  int numSlots() const { return m_slots; }
+
+  /*! Forget the buffered frames and the stats. */
+  void reset();
+
+  /*!
+   * Slot to write the next depth frame into, then give it to addDepth().
+   * When every slot is taken, the oldest frame is dropped for it.
+   */
+  int depthSlot() { return takeSlot(m_depth, m_stats.depth_dropped); }
+  void addDepth(int slot, uint32_t timestamp) { addFrame(m_depth, slot, timestamp); }
+  uint32_t depthTimestamp(int slot) const { return m_depth.timestamps[slot]; }
+
+  int colorSlot() { return takeSlot(m_color, m_stats.color_dropped); }
+  void addColor(int slot, uint32_t timestamp) { addFrame(m_color, slot, timestamp); }
+  uint32_t colorTimestamp(int slot) const { return m_color.timestamps[slot]; }
+
+  /*!
+   * The newest frame ready, false if there is none yet. A stream the mode
+   * does not use gets slot -1. The slots are free again after the call:
+   * use their content before taking new ones.
+   */
+  bool nextFrame(int& depth_slot, int& color_slot);
+
+  const RGBDSynchronizerStats& stats() const { return m_stats; }
+
+  /*! Timestamp ticks per millisecond. */
+  static double ticksPerMs() { return 60000.0; }
+
+  /*! Signed difference of two timestamps, robust to the wrap around. */
+  static int32_t ticksBetween(uint32_t from, uint32_t to) { return int32_t(to - from); }
+
+private:
+  struct Stream
+  {
+    std::vector<uint32_t> timestamps;
+    std::deque<int> queued; // in arrival order
+    std::vector<int> free;
+    uint32_t interval; // between the last two frames, 0 if unknown
+    bool has_last;
+    uint32_t last;
+  };
+
+  void resetStream(Stream& stream);
+  int takeSlot(Stream& stream, int& dropped);
+  void addFrame(Stream& stream, int slot, uint32_t timestamp);
+  void release(Stream& stream, int& dropped, bool keep_newest);
+  bool nextPair(int& depth_slot, int& color_slot);
+
+private:
+  int m_slots;
+  Mode m_mode;
+  uint32_t m_tolerance;
+  Stream m_depth;
+  Stream m_color;
+  RGBDSynchronizerStats m_stats;
+};
+
+} // ntk
+
+#endif // NTK_CAMERA_RGBD_SYNCHRONIZER_H
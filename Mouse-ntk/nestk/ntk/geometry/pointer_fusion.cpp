@@ -0,0 +1,235 @@
+/**
+ * This file is part of the nestk library.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pointer_fusion.h"
+
+#include <ntk/utils/debug.h>
+#include <ntk/utils/opencv_utils.h>
+
+#include <QFileInfo>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+using namespace cv;
+
+namespace
+{
+
+  float dot(const cv::Point3f& a, const cv::Point3f& b)
+  { return a.x*b.x + a.y*b.y + a.z*b.z; }
+
+  float squaredDistance(const cv::Point3f& a, const cv::Point3f& b)
+  { cv::Point3f d = a - b; return dot(d, d); }
+
+  bool strongerPointer(const ntk::FusedPointer& a, const ntk::FusedPointer& b)
+  { return a.weight > b.weight; }
+
+  std::string sensorKey(int sensor)
+  {
+    char key[32];
+    sprintf(key, "sensor_%d", sensor);
+    return key;
+  }
+
+}
+
+namespace ntk
+{
+
+  PointerFusion :: PointerFusion()
+    : m_screen_x(1, 0, 0), m_screen_y(0, -1, 0), m_screen_size(1, 1), m_merge_distance(0.1f)
+  {}
+
+  int PointerFusion :: addSensor(const Pose3D& pose)
+  {
+    ntk_ensure(m_sensors.size() < 32, "Too many sensors.");
+    m_sensors.push_back(pose);
+    return m_sensors.size() - 1;
+  }
+
+  void PointerFusion :: setScreen(const cv::Point3f& top_left, const cv::Point3f& top_right,
+                                  const cv::Point3f& bottom_left, const cv::Size& pixels)
+  {
+    m_screen_origin = top_left;
+    m_screen_x = top_right - top_left;
+    m_screen_y = bottom_left - top_left;
+    m_screen_size = pixels;
+    ntk_ensure(dot(m_screen_x, m_screen_x) > 0 && dot(m_screen_y, m_screen_y) > 0, "Empty screen.");
+  }
+
+  cv::Point3f PointerFusion :: toWorld(int sensor, const SensorPointer& pointer) const
+  {
+    return m_sensors[sensor].unprojectFromImage(pointer.image_point, pointer.depth);
+  }
+
+  cv::Point2f PointerFusion :: toScreen(const cv::Point3f& world) const
+  {
+    cv::Point3f d = world - m_screen_origin;
+    return cv::Point2f(dot(d, m_screen_x) / dot(m_screen_x, m_screen_x) * m_screen_size.width,
+                       dot(d, m_screen_y) / dot(m_screen_y, m_screen_y) * m_screen_size.height);
+  }
+
+  float PointerFusion :: screenDistance(const cv::Point3f& world) const
+  {
+    // x right and y down: their cross product points behind the screen
+    cv::Point3f n = m_screen_x.cross(m_screen_y);
+    return -dot(world - m_screen_origin, n) / std::sqrt(dot(n, n));
+  }
+
+  float PointerFusion :: borderWeight(const cv::Point2f& p, const cv::Size& image, float margin)
+  {
+    float d = std::min(std::min(p.x, image.width - 1 - p.x), std::min(p.y, image.height - 1 - p.y));
+    return std::max(0.f, std::min(1.f, d / margin));
+  }
+
+  void PointerFusion :: fuse(const std::vector< std::vector<SensorPointer> >& pointers,
+                             std::vector<FusedPointer>& fused) const
+  {
+    ntk_assert(int(pointers.size()) <= numSensors(), "More pointer lists than sensors.");
+    fused.clear();
+
+    m_candidates.clear();
+    for (size_t s = 0; s < pointers.size(); ++s)
+      for (size_t i = 0; i < pointers[s].size(); ++i)
+      {
+        const SensorPointer& p = pointers[s][i];
+        if (p.depth <= 0)
+          continue;
+        Candidate c;
+        c.world = toWorld(s, p);
+        // a pointer on the border still counts when no other sensor sees it
+        c.weight = std::max(p.weight, 1e-3f);
+        c.sensor = s;
+        c.id = p.id;
+        c.used = false;
+        m_candidates.push_back(c);
+      }
+
+    // The strongest pointer left takes, from each other sensor, its nearest
+    // pointer within the merge distance.
+    const float max_d2 = m_merge_distance * m_merge_distance;
+    m_order.resize(m_candidates.size());
+    for (size_t i = 0; i < m_order.size(); ++i)
+      m_order[i] = i;
+    for (size_t i = 1; i < m_order.size(); ++i)
+      for (size_t j = i; j > 0 && m_candidates[m_order[j]].weight > m_candidates[m_order[j-1]].weight; --j)
+        std::swap(m_order[j], m_order[j-1]);
+
+    for (size_t k = 0; k < m_order.size(); ++k)
+    {
+      Candidate& seed = m_candidates[m_order[k]];
+      if (seed.used)
+        continue;
+      seed.used = true;
+
+      FusedPointer f;
+      f.sensors = 1u << seed.sensor;
+      f.weight = seed.weight;
+      f.sensor = seed.sensor;
+      f.id = seed.id;
+      cv::Point3f sum = seed.world * seed.weight;
+
+      for (int s = 0; s < int(pointers.size()); ++s)
+      {
+        if (s == seed.sensor)
+          continue;
+        int best = -1;
+        float best_d2 = max_d2;
+        for (size_t i = 0; i < m_candidates.size(); ++i)
+        {
+          const Candidate& c = m_candidates[i];
+          if (c.used || c.sensor != s)
+            continue;
+          float d2 = squaredDistance(c.world, seed.world);
+          if (d2 <= best_d2)
+          {
+            best = i;
+            best_d2 = d2;
+          }
+        }
+        if (best < 0)
+          continue;
+        Candidate& c = m_candidates[best];
+        c.used = true;
+        f.sensors |= 1u << s;
+        f.weight += c.weight;
+        sum += c.world * c.weight;
+      }
+
+      f.world = sum * (1.f / f.weight);
+      f.screen = toScreen(f.world);
+      fused.push_back(f);
+    }
+
+    std::stable_sort(fused.begin(), fused.end(), strongerPointer);
+  }
+
+  void PointerFusion :: saveToYaml(cv::FileStorage& yaml) const
+  {
+    write_to_yaml(yaml, "num_sensors", numSensors());
+    for (int i = 0; i < numSensors(); ++i)
+    {
+      yaml << sensorKey(i) << "{";
+      m_sensors[i].saveToYaml(yaml);
+      yaml << "}";
+    }
+    write_to_yaml(yaml, "screen_top_left", Vec3f(m_screen_origin));
+    write_to_yaml(yaml, "screen_top_right", Vec3f(m_screen_origin + m_screen_x));
+    write_to_yaml(yaml, "screen_bottom_left", Vec3f(m_screen_origin + m_screen_y));
+    write_to_yaml(yaml, "screen_width", m_screen_size.width);
+    write_to_yaml(yaml, "screen_height", m_screen_size.height);
+    write_to_yaml(yaml, "merge_distance", double(m_merge_distance));
+  }
+
+  void PointerFusion :: loadFromYaml(cv::FileNode yaml)
+  {
+    int num_sensors = 0;
+    read_from_yaml(yaml["num_sensors"], num_sensors);
+    m_sensors.clear();
+    for (int i = 0; i < num_sensors; ++i)
+    {
+      Pose3D pose;
+      pose.loadFromYaml(yaml[sensorKey(i)]);
+      addSensor(pose);
+    }
+
+    Vec3f top_left, top_right, bottom_left;
+    read_from_yaml(yaml["screen_top_left"], top_left);
+    read_from_yaml(yaml["screen_top_right"], top_right);
+    read_from_yaml(yaml["screen_bottom_left"], bottom_left);
+    cv::Size pixels;
+    read_from_yaml(yaml["screen_width"], pixels.width);
+    read_from_yaml(yaml["screen_height"], pixels.height);
+    setScreen(Point3f(top_left), Point3f(top_right), Point3f(bottom_left), pixels);
+
+    double merge_distance = m_merge_distance;
+    read_from_yaml(yaml["merge_distance"], merge_distance);
+    m_merge_distance = merge_distance;
+  }
+
+  void PointerFusion :: loadFromFile(const char* filename)
+  {
+    QFileInfo f (filename);
+    ntk_throw_exception_if(!f.exists(), "Could not find sensor calibration file.");
+    cv::FileStorage yaml (filename, CV_STORAGE_READ);
+    loadFromYaml(yaml.root());
+    yaml.release();
+  }
+
+} // ntk
@@ -0,0 +1,132 @@
+/**
+ * This file is part of the nestk library.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NTK_GEOMETRY_POINTER_FUSION_H
+#define NTK_GEOMETRY_POINTER_FUSION_H
+
+#include <ntk/core.h>
+#include <ntk/geometry/pose_3d.h>
+
+#include <vector>
+
+namespace ntk
+{
+
+/*! A pointer (hand, fingertip, touch blob) in the depth image of one sensor. */
+struct SensorPointer
+{
+  SensorPointer() : depth(0), weight(1), id(-1) {}
+  SensorPointer(const cv::Point2f& image_point, float depth, float weight = 1, int id = -1)
+    : image_point(image_point), depth(depth), weight(weight), id(id)
+  {}
+
+  cv::Point2f image_point;
+  float depth; //!< In meters.
+  float weight; //!< Confidence, e.g. PointerFusion::borderWeight.
+  int id; //!< Identifier for the sensor, e.g. its track.
+};
+
+/*! A pointer in the interaction space shared by the sensors. */
+struct FusedPointer
+{
+  FusedPointer() : sensors(0), weight(0), sensor(-1), id(-1) {}
+
+  cv::Point3f world;
+  cv::Point2f screen; //!< In screen pixels.
+  unsigned sensors; //!< Bit i is set when sensor i saw the pointer.
+  float weight; //!< Sum of the weights of the sensor pointers.
+  int sensor; //!< The sensor with the highest weight, and its identifier.
+  int id;
+};
+
+/*!
+ * Merges the pointers seen by several sensors into one screen space.
+ * Each sensor has a Pose3D: the intrinsics of its depth camera and, as
+ * camera transform, its extrinsic calibration from the shared world frame.
+ * The screen is a rectangle of that frame; a pointer maps to the screen
+ * pixel it faces, along the screen normal. Where the fields of view
+ * overlap, the pointers of different sensors closer than the merge
+ * distance are one pointer, at the weighted mean of their positions. Two
+ * pointers of the same sensor are never merged.
+ */
+class PointerFusion
+{
+public:
+  PointerFusion();
+
+public:
+  /*! Returns the index of the new sensor. At most 32 sensors. */
+  int addSensor(const Pose3D& pose);
+  int numSensors() const { return m_sensors.size(); }
+  const Pose3D& sensorPose(int sensor) const { return m_sensors[sensor]; }
+  void setSensorPose(int sensor, const Pose3D& pose) { m_sensors[sensor] = pose; }
+
+  /*! Screen corners in the world frame, and its size in pixels. */
+  void setScreen(const cv::Point3f& top_left, const cv::Point3f& top_right,
+                 const cv::Point3f& bottom_left, const cv::Size& pixels);
+  const cv::Size& screenSize() const { return m_screen_size; }
+
+  /*! Pointers of different sensors closer than this, in meters, are merged. Default is 0.1. */
+  void setMergeDistance(float meters) { m_merge_distance = meters; }
+  float mergeDistance() const { return m_merge_distance; }
+
+  cv::Point3f toWorld(int sensor, const SensorPointer& pointer) const;
+  cv::Point2f toScreen(const cv::Point3f& world) const;
+  /*! Distance in meters from the screen plane, along its normal: positive in front of it. */
+  float screenDistance(const cv::Point3f& world) const;
+
+  /*!
+   * pointers[i] holds the pointers of sensor i in its last frame. The
+   * strongest pointers come first in fused.
+   */
+  void fuse(const std::vector< std::vector<SensorPointer> >& pointers,
+            std::vector<FusedPointer>& fused) const;
+
+  /*!
+   * 1 for a point at least margin pixels inside the image, down to 0 on
+   * its border: a blob cut by the border has its center pulled inwards.
+   */
+  static float borderWeight(const cv::Point2f& p, const cv::Size& image, float margin = 40);
+
+  /*! Sensors, screen and merge distance. */
+  void saveToYaml(cv::FileStorage& yaml) const;
+  void loadFromYaml(cv::FileNode yaml);
+  void loadFromFile(const char* filename);
+
+private:
+  struct Candidate
+  {
+    cv::Point3f world;
+    float weight;
+    int sensor;
+    int id;
+    bool used;
+  };
+
+  std::vector<Pose3D> m_sensors;
+  cv::Point3f m_screen_origin;
+  cv::Point3f m_screen_x; // top left to top right
+  cv::Point3f m_screen_y; // top left to bottom left
+  cv::Size m_screen_size;
+  float m_merge_distance;
+  mutable std::vector<Candidate> m_candidates;
+  mutable std::vector<int> m_order; // candidates by decreasing weight
+};
+
+} // ntk
+
+#endif // NTK_GEOMETRY_POINTER_FUSION_H
@@ -20,6 +20,13 @@
 #include "color_model.h"
 #include <ntk/utils/debug.h>
 #include <opencv/highgui.h>
+#include <cfloat>
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+# include <arm_neon.h>
+#endif
 
 using namespace cv;
 
@@ -100,3 +107,132 @@ void HSColorModel :: backProject(const cv::Mat3b& bgr_image, cv::Mat1f& likeliho
 
   calcBackProject(&hsv, 1, channels, m_histogram, likelihood_image, ranges, 1, true);
 }
+
+void HSColorLookup :: build(const HSColorModel& model, int bits)
+{
+  const cv::Mat_<float>& histogram = model.histogram();
+  ntk_assert(histogram.data, "Model was not build.");
+  ntk_assert(bits == 15 || bits == 16, "Lookup tables are 15 or 16 bits.");
+
+  double min_value = 0, max_value = 0;
+  minMaxLoc(histogram, &min_value, &max_value, 0, 0);
+  const int hbins = histogram.rows, sbins = histogram.cols;
+  const int g_bits = bits == 16 ? 6 : 5;
+
+  m_bits = bits;
+  m_table.resize(1 << bits);
+  for (int r5 = 0; r5 < 32; ++r5)
+  for (int g6 = 0; g6 < (1 << g_bits); ++g6)
+  for (int b5 = 0; b5 < 32; ++b5)
+  {
+    // the mean likelihood of the colors of the cell, sampled every 2 levels
+    double l = 0;
+    int samples = 0;
+    for (int r = r5 << 3; r < (r5 + 1) << 3; r += 2)
+    for (int g = g6 << (8 - g_bits); g < (g6 + 1) << (8 - g_bits); g += 2)
+    for (int b = b5 << 3; b < (b5 + 1) << 3; b += 2, ++samples)
+    {
+      // converted as cvtColor does on float images
+      float v = (float)std::max(r, std::max(g, b)), vmin = (float)std::min(r, std::min(g, b));
+      float diff = v - vmin;
+      float s = diff / (float)(fabs(v) + FLT_EPSILON);
+      float h;
+      diff = (float)(60. / (diff + FLT_EPSILON));
+      if (v == r)
+        h = (g - b) * diff;
+      else if (v == g)
+        h = (b - r) * diff + 120.f;
+      else
+        h = (r - g) * diff + 240.f;
+      if (h < 0)
+        h += 360.f;
+
+      // bins as calcBackProject finds them: out of the ranges is 0
+      int h_bin = cvFloor(h * (hbins / 360.f));
+      int s_bin = cvFloor(s * (float)sbins);
+      if ((unsigned)h_bin < (unsigned)hbins && (unsigned)s_bin < (unsigned)sbins)
+        l += histogram(h_bin, s_bin);
+    }
+    l = max_value > 0 ? l / (samples * max_value) : 0;
+    m_table[index(b5 << 3, g6 << (8 - g_bits), r5 << 3)] = cv::saturate_cast<uchar>(l * 255);
+  }
+}
+
+void HSColorLookup :: backProject(const cv::Mat3b& bgr_image, cv::Mat1b& likelihood_image) const
+{
+  ntk_assert(isBuilt(), "Lookup table was not build.");
+  likelihood_image.create(bgr_image.size());
+  for (int r = 0; r < bgr_image.rows; ++r)
+  {
+    const cv::Vec3b* bgr = bgr_image.ptr<cv::Vec3b>(r);
+    uchar* l = likelihood_image.ptr<uchar>(r);
+    for (int c = 0; c < bgr_image.cols; ++c)
+      l[c] = likelihood(bgr[c]);
+  }
+}
+
+int fuseDepthAndColor(const cv::Mat1f& depth, const cv::Mat3b& mapped_rgb,
+                      float min_depth, float max_depth,
+                      const HSColorLookup& lookup,
+                      const std::vector<cv::Rect>& rois,
+                      cv::Mat1b& probability)
+{
+  ntk_assert(lookup.isBuilt(), "Lookup table was not build.");
+  ntk_assert(mapped_rgb.size() == depth.size(), "The color must be mapped to the depth image.");
+
+  probability.create(depth.size());
+  probability = 0;
+  int in_band = 0;
+  for (size_t i = 0; i < rois.size(); ++i)
+  {
+    cv::Rect roi = rois[i] & cv::Rect(0, 0, depth.cols, depth.rows);
+    for (int r = roi.y; r < roi.y + roi.height; ++r)
+    {
+      const float* z = depth.ptr<float>(r);
+      const cv::Vec3b* bgr = mapped_rgb.ptr<cv::Vec3b>(r);
+      uchar* p = probability.ptr<uchar>(r);
+      int c = roi.x;
+      const int end = roi.x + roi.width;
+
+      // 8 depths compared at once, colors looked up for the ones in the band only
+#if defined(__SSE2__)
+      const __m128 lo = _mm_set1_ps(min_depth), hi = _mm_set1_ps(max_depth);
+      for (; c + 8 <= end; c += 8)
+      {
+        __m128 z0 = _mm_loadu_ps(z + c), z1 = _mm_loadu_ps(z + c + 4);
+        int band = _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(z0, lo), _mm_cmple_ps(z0, hi)))
+                 | _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(z1, lo), _mm_cmple_ps(z1, hi))) << 4;
+        for (int k = 0; band; ++k, band >>= 1)
+          if (band & 1)
+          {
+            p[c + k] = lookup.likelihood(bgr[c + k]);
+            ++in_band;
+          }
+      }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+      const float32x4_t lo = vdupq_n_f32(min_depth), hi = vdupq_n_f32(max_depth);
+      for (; c + 8 <= end; c += 8)
+      {
+        float32x4_t z0 = vld1q_f32(z + c), z1 = vld1q_f32(z + c + 4);
+        uint32x4_t b0 = vandq_u32(vcgeq_f32(z0, lo), vcleq_f32(z0, hi));
+        uint32x4_t b1 = vandq_u32(vcgeq_f32(z1, lo), vcleq_f32(z1, hi));
+        if (!vmaxvq_u32(vorrq_u32(b0, b1)))
+          continue;
+        for (int k = 0; k < 8; ++k)
+          if (z[c + k] >= min_depth && z[c + k] <= max_depth)
+          {
+            p[c + k] = lookup.likelihood(bgr[c + k]);
+            ++in_band;
+          }
+      }
+#endif
+      for (; c < end; ++c)
+        if (z[c] >= min_depth && z[c] <= max_depth)
+        {
+          p[c] = lookup.likelihood(bgr[c]);
+          ++in_band;
+        }
+    }
+  }
+  return in_band;
+}
@@ -22,6 +22,7 @@
 
 # include <ntk/core.h>
 # include <opencv/cv.h>
+# include <vector>
 
 // TODO: use mixture of gaussians?
 class HSColorModel
@@ -35,9 +36,58 @@ public:
   void build(const cv::Mat3b& model_image, const cv::Mat1b& mask);
   double likelihood(int h_value, int s_value) const;
   void backProject(const cv::Mat3b& bgr_image, cv::Mat1f& likelihood_image) const;
+  const cv::Mat_<float>& histogram() const { return m_histogram; }
 
 private:
   cv::Mat_<float> m_histogram;
 };
 
+/*!
+ * HSColorModel likelihoods looked up from quantized BGR colors.
+ * Each channel keeps its 5 high bits (6 for green with 16 bits), so the
+ * table has 32K or 64K one byte entries: the mean likelihood of the colors
+ * of each cell, 255 for the most likely H-S bin, which is smoother than the
+ * histogram at the bin borders. A pixel costs a few shifts and a load
+ * instead of a float HSV conversion.
+ */
+class HSColorLookup
+{
+public:
+  HSColorLookup() : m_bits(0) {}
+
+public:
+  /*! bits is 15 (5:5:5) or 16 (5:6:5). */
+  void build(const HSColorModel& model, int bits = 16);
+  bool isBuilt() const { return m_bits != 0; }
+  int bits() const { return m_bits; }
+
+  int index(int b, int g, int r) const
+  {
+    return m_bits == 16 ? ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3)
+                        : ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+  }
+  uchar likelihood(const cv::Vec3b& bgr) const { return m_table[index(bgr[0], bgr[1], bgr[2])]; }
+
+  /*! Likelihood image, 0 to 255. */
+  void backProject(const cv::Mat3b& bgr_image, cv::Mat1b& likelihood_image) const;
+
+private:
+  std::vector<uchar> m_table;
+  int m_bits;
+};
+
+/*!
+ * Hand probability (0 to 255) of a depth image: the color likelihood of the
+ * pixels whose depth is within [min_depth, max_depth], 0 for the others and
+ * outside the rois. mapped_rgb is the color registered to the depth image
+ * (RGBDProcessor::computeMappings), and only the pixels in the depth band
+ * are looked up. Returns the number of pixels in the band, in each roi they
+ * are in.
+ */
+int fuseDepthAndColor(const cv::Mat1f& depth, const cv::Mat3b& mapped_rgb,
+                      float min_depth, float max_depth,
+                      const HSColorLookup& lookup,
+                      const std::vector<cv::Rect>& rois,
+                      cv::Mat1b& probability);
+
 #endif // ndef NTK_COLORMODEL_H_
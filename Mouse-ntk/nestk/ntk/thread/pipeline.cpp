@@ -0,0 +1,267 @@
+/**
+ * This file is part of the nestk library.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pipeline.h"
+
+#include <ntk/utils/debug.h>
+
+#include <QMutexLocker>
+#include <QThread>
+
+namespace ntk
+{
+
+  PipelineStageStats PipelineStage :: stats() const
+  {
+    QMutexLocker locker(&m_stats_lock);
+    return m_stats;
+  }
+
+  bool PipelineQueue :: push(PipelineFrame* frame)
+  {
+    QMutexLocker locker(&m_lock);
+    while (!m_closed && int(m_frames.size()) >= m_capacity)
+      m_not_full.wait(&m_lock);
+    if (m_closed)
+      return false;
+    m_frames.push_back(frame);
+    m_not_empty.wakeOne();
+    return true;
+  }
+
+  PipelineFrame* PipelineQueue :: pop()
+  {
+    QMutexLocker locker(&m_lock);
+    while (!m_closed && m_frames.empty())
+      m_not_empty.wait(&m_lock);
+    if (m_frames.empty())
+      return 0;
+    PipelineFrame* frame = m_frames.front();
+    m_frames.pop_front();
+    m_not_full.wakeOne();
+    return frame;
+  }
+
+  void PipelineQueue :: close()
+  {
+    QMutexLocker locker(&m_lock);
+    m_closed = true;
+    m_not_empty.wakeAll();
+    m_not_full.wakeAll();
+  }
+
+  void PipelineQueue :: reset(int capacity)
+  {
+    QMutexLocker locker(&m_lock);
+    m_frames.clear();
+    m_capacity = capacity;
+    m_closed = false;
+  }
+
+  int PipelineQueue :: size() const
+  {
+    QMutexLocker locker(&m_lock);
+    return m_frames.size();
+  }
+
+  class Pipeline::Worker : public QThread
+  {
+  public:
+    Worker(Pipeline* pipeline, int stage) : m_pipeline(pipeline), m_stage(stage) {}
+
+    virtual void run() { m_pipeline->runStage(m_stage); }
+
+  private:
+    Pipeline* m_pipeline;
+    int m_stage;
+  };
+
+  Pipeline :: ~Pipeline()
+  {
+    stop();
+    wait();
+    for (size_t i = 0; i < m_queues.size(); ++i)
+      delete m_queues[i];
+    for (size_t i = 0; i < m_frames.size(); ++i)
+      delete m_frames[i];
+  }
+
+  double Pipeline :: nowMs()
+  {
+    return 1000.0 * cv::getTickCount() / cv::getTickFrequency();
+  }
+
+  void Pipeline :: reset()
+  {
+    ntk_ensure(!m_stages.empty() && !m_frames.empty(), "A pipeline needs stages and frames.");
+    ntk_ensure(m_workers.empty(), "The pipeline is already running.");
+
+    while (m_queues.size() < m_stages.size())
+      m_queues.push_back(new PipelineQueue());
+    // any queue can hold all the frames, so only the free frames hold back the first stage
+    for (size_t i = 0; i < m_queues.size(); ++i)
+      m_queues[i]->reset(m_frames.size());
+    for (size_t i = 0; i < m_frames.size(); ++i)
+      m_queues[0]->push(m_frames[i]);
+
+    for (size_t i = 0; i < m_stages.size(); ++i)
+    {
+      QMutexLocker locker(&m_stages[i]->m_stats_lock);
+      m_stages[i]->m_stats = PipelineStageStats();
+    }
+    {
+      QMutexLocker locker(&m_stats_lock);
+      m_stats = PipelineStats();
+    }
+    m_stop = false;
+    m_next_index = 0;
+    m_start_ms = nowMs();
+  }
+
+  void Pipeline :: start()
+  {
+    reset();
+    for (size_t i = 0; i < m_stages.size(); ++i)
+    {
+      m_workers.push_back(new Worker(this, i));
+      m_workers.back()->start();
+    }
+  }
+
+  void Pipeline :: run()
+  {
+    reset();
+    for (size_t i = 0; i + 1 < m_stages.size(); ++i)
+    {
+      m_workers.push_back(new Worker(this, i));
+      m_workers.back()->start();
+    }
+    runStage(m_stages.size() - 1);
+    wait();
+  }
+
+  void Pipeline :: runSerial()
+  {
+    reset();
+    PipelineFrame* frame = m_queues[0]->pop();
+    while (!m_stop)
+    {
+      for (size_t i = 0; i < m_stages.size(); ++i)
+      {
+        double start_ms = nowMs();
+        if (i == 0)
+        {
+          frame->index = m_next_index++;
+          frame->start_ms = start_ms;
+        }
+        bool more = m_stages[i]->process(*frame);
+        stageDone(*m_stages[i], *frame, 0, nowMs() - start_ms);
+        if (i == 0 && !more)
+          return;
+      }
+      frameDone(*frame, nowMs());
+    }
+  }
+
+  void Pipeline :: stop()
+  {
+    m_stop = true;
+    if (!m_queues.empty())
+      m_queues[0]->close(); // wakes up the first stage waiting for a free frame
+  }
+
+  void Pipeline :: wait()
+  {
+    for (size_t i = 0; i < m_workers.size(); ++i)
+    {
+      m_workers[i]->wait();
+      delete m_workers[i];
+    }
+    m_workers.clear();
+  }
+
+  PipelineStats Pipeline :: stats() const
+  {
+    QMutexLocker locker(&m_stats_lock);
+    return m_stats;
+  }
+
+  void Pipeline :: runStage(int i)
+  {
+    PipelineStage* stage = m_stages[i];
+    if (stage->m_scheduling.isSet())
+      stage->m_scheduling_applied = setCurrentThreadScheduling(stage->m_scheduling);
+
+    const bool last = i + 1 == int(m_stages.size());
+    PipelineQueue* input = m_queues[i];
+    PipelineQueue* output = m_queues[last ? 0 : i + 1];
+    while (true)
+    {
+      double wait_start_ms = nowMs();
+      PipelineFrame* frame = input->pop();
+      if (!frame || (i == 0 && m_stop))
+        break;
+
+      double start_ms = nowMs();
+      if (i == 0)
+      {
+        frame->index = m_next_index++;
+        frame->start_ms = start_ms;
+      }
+      bool more = stage->process(*frame);
+      double end_ms = nowMs();
+      stageDone(*stage, *frame, start_ms - wait_start_ms, end_ms - start_ms);
+      if (i == 0 && !more)
+        break; // the end of the stream
+      if (last)
+        frameDone(*frame, end_ms);
+      output->push(frame); // fails once the free frames are closed, they are owned by m_frames anyway
+    }
+
+    // the next stages finish the frames in flight, then stop as well
+    if (!last)
+      m_queues[i + 1]->close();
+  }
+
+  void Pipeline :: stageDone(PipelineStage& stage, PipelineFrame& frame, double wait_ms, double busy_ms)
+  {
+    {
+      QMutexLocker locker(&stage.m_stats_lock);
+      ++stage.m_stats.frames;
+      stage.m_stats.busy_ms += busy_ms;
+      stage.m_stats.max_busy_ms = std::max(stage.m_stats.max_busy_ms, busy_ms);
+      stage.m_stats.wait_ms += wait_ms;
+    }
+    if (m_listener)
+      m_listener->onStageDone(stage, frame, busy_ms);
+  }
+
+  void Pipeline :: frameDone(PipelineFrame& frame, double end_ms)
+  {
+    double latency_ms = end_ms - frame.start_ms;
+    {
+      QMutexLocker locker(&m_stats_lock);
+      ++m_stats.frames;
+      m_stats.latency_ms += latency_ms;
+      m_stats.max_latency_ms = std::max(m_stats.max_latency_ms, latency_ms);
+      m_stats.elapsed_ms = end_ms - m_start_ms;
+    }
+    if (m_listener)
+      m_listener->onFrameDone(frame, latency_ms);
+  }
+
+} // ntk
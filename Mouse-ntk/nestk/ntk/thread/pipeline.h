@@ -0,0 +1,244 @@
+/**
+ * This file is part of the nestk library.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NTK_THREAD_PIPELINE_H
+#define NTK_THREAD_PIPELINE_H
+
+#include <ntk/core.h>
+#include <ntk/thread/utils.h>
+
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace ntk
+{
+
+/*!
+ * A frame going through a Pipeline. Subclass it with the images and
+ * results the stages hand to each other. Frames are allocated once and
+ * recycled, so stages should reuse their buffers.
+ */
+class PipelineFrame
+{
+public:
+  PipelineFrame() : index(-1), start_ms(0) {}
+  virtual ~PipelineFrame() {}
+
+public:
+  int index; //!< Sequence number, set before the first stage.
+  double start_ms; //!< When the first stage got the frame (Pipeline::nowMs), it may move it to when the data came in.
+};
+
+/*! Timing of a stage since the pipeline started. */
+struct PipelineStageStats
+{
+  PipelineStageStats() : frames(0), busy_ms(0), max_busy_ms(0), wait_ms(0) {}
+
+  double meanBusyMs() const { return frames ? busy_ms / frames : 0; }
+
+  int frames;
+  double busy_ms; //!< Time spent in process().
+  double max_busy_ms;
+  double wait_ms; //!< Time waiting for a frame from the previous stage (a free frame for the first one).
+};
+
+/*! Frames through the last stage since the pipeline started. */
+struct PipelineStats
+{
+  PipelineStats() : frames(0), latency_ms(0), max_latency_ms(0), elapsed_ms(0) {}
+
+  double meanLatencyMs() const { return frames ? latency_ms / frames : 0; }
+  double framesPerSecond() const { return elapsed_ms > 0 ? 1000.0 * frames / elapsed_ms : 0; }
+
+  int frames;
+  double latency_ms; //!< Sum of the times from the start of the first stage to the end of the last.
+  double max_latency_ms;
+  double elapsed_ms; //!< From the start to the last frame done.
+};
+
+/*!
+ * One step of a Pipeline, running on its own thread.
+ */
+class PipelineStage
+{
+public:
+  PipelineStage(const std::string& name)
+    : m_name(name), m_scheduling_applied(true)
+  {}
+
+  virtual ~PipelineStage() {}
+
+public:
+  const std::string& name() const { return m_name; }
+
+  /*!
+   * Work on a frame, from the stage thread. The first stage fills it and
+   * returns false at the end of the stream; the result of the others is ignored.
+   */
+  virtual bool process(PipelineFrame& frame) = 0;
+
+  /*! Scheduling of the stage thread, applied when it starts. */
+  void setThreadScheduling(const ThreadScheduling& scheduling) { m_scheduling = scheduling; }
+
+  /*! False when the scheduling could not be applied, e.g. without real-time permissions. */
+  bool threadSchedulingApplied() const { return m_scheduling_applied; }
+
+  /*! Thread safe copy. */
+  PipelineStageStats stats() const;
+
+private:
+  friend class Pipeline;
+  std::string m_name;
+  ThreadScheduling m_scheduling;
+  bool m_scheduling_applied;
+  mutable QMutex m_stats_lock;
+  PipelineStageStats m_stats;
+};
+
+/*!
+ * Receives the timings of a Pipeline, e.g. to feed an external metrics registry.
+ * Callbacks are called from the stage threads.
+ */
+class PipelineListener
+{
+public:
+  virtual ~PipelineListener() {}
+
+  /*! After each process() call. */
+  virtual void onStageDone(const PipelineStage& stage, const PipelineFrame& frame, double busy_ms) {}
+
+  /*! After the last stage, with the time since the frame start_ms. */
+  virtual void onFrameDone(const PipelineFrame& frame, double latency_ms) {}
+};
+
+/*!
+ * Blocking FIFO of at most capacity frames between two stages.
+ */
+class PipelineQueue
+{
+public:
+  PipelineQueue(int capacity = 1) : m_capacity(capacity), m_closed(false) {}
+
+public:
+  /*! Blocks while the queue is full. Returns false when it is closed. */
+  bool push(PipelineFrame* frame);
+
+  /*! Blocks while the queue is empty. Returns 0 once it is closed and empty. */
+  PipelineFrame* pop();
+
+  /*! Wake up the threads waiting on the queue, and refuse new frames. */
+  void close();
+
+  /*! Empty and open again, with a new capacity. */
+  void reset(int capacity);
+
+  int size() const;
+
+private:
+  int m_capacity;
+  bool m_closed;
+  std::deque<PipelineFrame*> m_frames;
+  mutable QMutex m_lock;
+  QWaitCondition m_not_empty;
+  QWaitCondition m_not_full;
+};
+
+/*!
+ * Stages connected by bounded queues, each on its own thread, so that
+ * e.g. grabbing, depth processing, detection and display of successive
+ * frames overlap on different cores. The frames circulate: the first stage
+ * takes a free one, each stage passes it on to the next one, and the last
+ * one frees it. With as many frames as stages, each stage works on a frame
+ * of its own and a frame never waits behind another: the slowest stage sets
+ * the frame rate and the latency stays the sum of the stages. More frames
+ * only queue up in front of the slowest stage.
+ */
+class Pipeline
+{
+public:
+  Pipeline() : m_listener(0), m_stop(false), m_next_index(0), m_start_ms(0) {}
+
+  /*! Stops the threads and deletes the frames. */
+  ~Pipeline();
+
+public:
+  /*! Stages run in the order they are added, the first one is the source. Not owned. */
+  void addStage(PipelineStage* stage) { m_stages.push_back(stage); }
+
+  /*! A frame to circulate, owned by the pipeline. At least one before starting. */
+  void addFrame(PipelineFrame* frame) { m_frames.push_back(frame); }
+
+  /*! Set a listener notified of the stage and frame timings. Not owned. */
+  void setListener(PipelineListener* listener) { m_listener = listener; }
+
+  int numStages() const { return m_stages.size(); }
+  const PipelineStage& stage(int i) const { return *m_stages[i]; }
+
+  /*! Every stage on its own thread. Returns immediately. */
+  void start();
+
+  /*!
+   * The last stage on the calling thread, the others on their own, until
+   * the stream ends or stop() is called. For a last stage that must run on
+   * the main thread, e.g. one showing windows.
+   */
+  void run();
+
+  /*! The stages one after the other on the calling thread, one frame at a time. */
+  void runSerial();
+
+  /*! The first stage takes no new frame; the frames in flight go through. Thread safe. */
+  void stop();
+
+  /*! Until every stage is done. */
+  void wait();
+
+  /*! Thread safe copy. */
+  PipelineStats stats() const;
+
+  /*! The clock of the timings, in ms. */
+  static double nowMs();
+
+private:
+  class Worker;
+  friend class Worker;
+
+  void reset();
+  void runStage(int i);
+  void stageDone(PipelineStage& stage, PipelineFrame& frame, double wait_ms, double busy_ms);
+  void frameDone(PipelineFrame& frame, double end_ms);
+
+private:
+  std::vector<PipelineStage*> m_stages;
+  std::vector<PipelineFrame*> m_frames;
+  std::vector<PipelineQueue*> m_queues; // m_queues[i] feeds stage i, m_queues[0] holds the free frames
+  std::vector<Worker*> m_workers;
+  PipelineListener* m_listener;
+  volatile bool m_stop;
+  int m_next_index;
+  double m_start_ms;
+  mutable QMutex m_stats_lock;
+  PipelineStats m_stats;
+};
+
+} // ntk
+
+#endif // NTK_THREAD_PIPELINE_H
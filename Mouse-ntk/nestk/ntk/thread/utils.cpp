@@ -19,11 +19,60 @@
 
 #include "utils.h"
 
+#include <ntk/utils/debug.h>
+
 #include <iostream>
 
+#ifdef __linux__
+# include <pthread.h>
+# include <sched.h>
+# include <string.h>
+#endif
+
 namespace ntk
 {
 
+  bool setCurrentThreadScheduling(const ThreadScheduling& scheduling)
+  {
+    bool ok = true;
+#ifdef __linux__
+    if (scheduling.cpu_mask)
+    {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      for (int cpu = 0; cpu < int(8*sizeof(scheduling.cpu_mask)); ++cpu)
+        if (scheduling.cpu_mask & (1UL << cpu))
+          CPU_SET(cpu, &set);
+      int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+      if (err)
+      {
+        ntk_dbg(0) << "[WARNING] Could not set the thread cpu affinity: " << strerror(err);
+        ok = false;
+      }
+    }
+    if (scheduling.realtime)
+    {
+      sched_param param;
+      memset(&param, 0, sizeof(param));
+      param.sched_priority = scheduling.priority;
+      int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+      if (err)
+      {
+        ntk_dbg(0) << "[WARNING] Could not set SCHED_FIFO priority " << scheduling.priority
+                   << ": " << strerror(err) << ", keeping the default scheduling";
+        ok = false;
+      }
+    }
+#else
+    if (scheduling.isSet())
+    {
+      ntk_dbg(0) << "[WARNING] Thread scheduling is only supported on Linux";
+      ok = false;
+    }
+#endif
+    return ok;
+  }
+
   void Thread :: waitForNotification(int timeout_msecs)
   {
     m_mutex.lock();
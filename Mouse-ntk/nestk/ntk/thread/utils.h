@@ -43,6 +43,27 @@ public:
 namespace ntk
 {
 
+/*!
+ * Real-time policy and cpu affinity of a thread.
+ * SCHED_FIFO needs CAP_SYS_NICE or a large enough RLIMIT_RTPRIO.
+ */
+struct ThreadScheduling
+{
+  ThreadScheduling() : realtime(false), priority(0), cpu_mask(0) {}
+
+  bool isSet() const { return realtime || cpu_mask; }
+
+  bool realtime; //!< SCHED_FIFO instead of the inherited policy.
+  int priority; //!< SCHED_FIFO priority, 1 to 99.
+  unsigned long cpu_mask; //!< Bit n allows cpu n, 0 for any cpu.
+};
+
+/*!
+ * Apply to the calling thread. Returns false when some of it could
+ * not be applied, the thread then keeps its previous scheduling for that part.
+ */
+bool setCurrentThreadScheduling(const ThreadScheduling& scheduling);
+
 class Thread : public QThread
 {
 public:
@@ -0,0 +1,156 @@
+/**
+ * This file is part of the nestk library.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ntk/image/color_model.h>
+#include <iostream>
+#include <cstdio>
+
+using namespace cv;
+
+namespace
+{
+
+  const int width = 640, height = 480, frames = 50;
+
+  // A hand of skin at 0.8 m with its arm in a sleeve, a skin colored
+  // wooden wall at 2 m behind it, and sensor noise on both images.
+  void makeScene(Mat1f& depth, Mat3b& rgb, Mat1b& hand, RNG& rng, int frame)
+  {
+    depth.create(height, width);
+    rgb.create(height, width);
+    hand.create(height, width);
+    const int cx = 260 + frame * 2, cy = 200;
+    for (int r = 0; r < height; ++r)
+    for (int c = 0; c < width; ++c)
+    {
+      float z = 2.0f;
+      Vec3b color(90, 140, 190); // wood
+      bool is_hand = false;
+      if ((c - cx) * (c - cx) / 3600.0 + (r - cy) * (r - cy) / 6400.0 <= 1)
+      {
+        z = 0.8f;
+        color = Vec3b(110, 150, 215); // skin
+        is_hand = true;
+      }
+      else if (c > cx - 40 && c < cx + 40 && r > cy + 70)
+      {
+        z = 0.85f;
+        color = Vec3b(160, 60, 40); // blue sleeve
+      }
+      z += (float)rng.gaussian(0.005);
+      if (rng.uniform(0, 50) == 0)
+        z = 0; // no depth
+      for (int k = 0; k < 3; ++k)
+        color[k] = saturate_cast<uchar>(color[k] + rng.gaussian(6));
+      depth(r, c) = z;
+      rgb(r, c) = color;
+      hand(r, c) = is_hand ? 255 : 0;
+    }
+  }
+
+  double now() { return (double)getTickCount() / getTickFrequency(); }
+
+}
+
+int main()
+{
+  RNG rng(42);
+
+  Mat3b skin(64, 64);
+  for (int r = 0; r < skin.rows; ++r)
+  for (int c = 0; c < skin.cols; ++c)
+    for (int k = 0; k < 3; ++k)
+      skin(r, c)[k] = saturate_cast<uchar>(Vec3b(110, 150, 215)[k] + rng.gaussian(8));
+
+  HSColorModel model;
+  model.build(skin, Mat1b() /* empty mask, use all image */);
+
+  HSColorLookup lookup;
+  lookup.build(model);
+
+  double max_value = 0;
+  minMaxLoc(model.histogram(), 0, &max_value);
+  const float threshold = 0.2f;
+  const uchar byte_threshold = saturate_cast<uchar>(threshold * 255);
+
+  double float_time = 0, lookup_time = 0, fused_time = 0, roi_time = 0;
+  double abs_diff = 0;
+  long decision_mismatches = 0, fused_mismatches = 0, hand_pixels = 0;
+  long float_found = 0, lookup_found = 0, found_pixels = 0, false_pixels = 0;
+
+  Mat1f depth, likelihood;
+  Mat3b rgb;
+  Mat1b hand, lookup_likelihood, probability, roi_probability;
+  for (int frame = 0; frame < frames; ++frame)
+  {
+    makeScene(depth, rgb, hand, rng, frame);
+
+    double t = now();
+    model.backProject(rgb, likelihood);
+    float_time += now() - t;
+
+    t = now();
+    lookup.backProject(rgb, lookup_likelihood);
+    lookup_time += now() - t;
+
+    std::vector<cv::Rect> rois(1, cv::Rect(0, 0, width, height));
+    t = now();
+    fuseDepthAndColor(depth, rgb, 0.6f, 1.0f, lookup, rois, probability);
+    fused_time += now() - t;
+
+    rois[0] = cv::Rect(260 + frame * 2 - 120, 200 - 120, 240, 240);
+    t = now();
+    fuseDepthAndColor(depth, rgb, 0.6f, 1.0f, lookup, rois, roi_probability);
+    roi_time += now() - t;
+
+    for (int r = 0; r < height; ++r)
+    for (int c = 0; c < width; ++c)
+    {
+      float l = likelihood(r, c) / max_value;
+      abs_diff += std::abs(l * 255 - lookup_likelihood(r, c));
+      if ((l > threshold) != (lookup_likelihood(r, c) > byte_threshold))
+        ++decision_mismatches;
+      if (probability(r, c) != roi_probability(r, c))
+        ++fused_mismatches;
+      hand_pixels += hand(r, c) != 0;
+      float_found += hand(r, c) && l > threshold;
+      lookup_found += hand(r, c) && lookup_likelihood(r, c) > byte_threshold;
+      found_pixels += hand(r, c) && probability(r, c) > byte_threshold;
+      false_pixels += !hand(r, c) && probability(r, c) > byte_threshold;
+    }
+  }
+
+  const double pixels = (double)width * height * frames;
+  printf("float back projection: %.2f ms/frame\n", float_time * 1000 / frames);
+  printf("lookup back projection: %.2f ms/frame, %.2f mean abs difference, %.3f%% threshold decisions differ\n",
+         lookup_time * 1000 / frames, abs_diff / pixels, 100 * decision_mismatches / pixels);
+  printf("hand found by the float model %.1f%%, by the lookup table %.1f%%\n",
+         100.0 * float_found / hand_pixels, 100.0 * lookup_found / hand_pixels);
+  printf("depth and color: %.2f ms/frame, in a 240x240 roi %.2f ms/frame, %.1f%% of the hand found, %.1f false pixels/frame\n",
+         fused_time * 1000 / frames, roi_time * 1000 / frames, 100.0 * found_pixels / hand_pixels,
+         (double)false_pixels / frames);
+
+  // The decisions differ near the borders of the histogram bins, most of
+  // them on the wall; what matters is that the hand is found as well.
+  if (lookup_found < float_found * 0.98 || found_pixels < hand_pixels * 0.9
+      || false_pixels > frames * 10 || fused_mismatches > 0)
+  {
+    std::cerr << "The lookup table does not agree with the color model." << std::endl;
+    return 1;
+  }
+  return 0;
+}
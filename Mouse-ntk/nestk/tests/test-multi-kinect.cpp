@@ -0,0 +1,170 @@
+/**
+ * This file is part of the nestk library.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Several Kinects, each grabber pumping its own device on its own thread.
+// The near blobs of each depth image are merged into the pointers of one
+// screen by a PointerFusion, and the throughput is printed. Without
+// hardware, replay one recording per device with fakenect:
+//
+//   FAKENECT_PATH=left.fkn,right.fkn FAKENECT_CLOCK=virtual FAKENECT_LOOP=0 \
+//     LD_LIBRARY_PATH=lib/fakenect test-multi-kinect --fusion fusion.yml
+//
+// Without --fusion the sensors all sit at the origin, in front of a 1 m
+// wide screen: the same scene replayed on each device is one pointer.
+
+#include <ntk/camera/kinect_grabber.h>
+#include <ntk/camera/rgbd_processor.h>
+#include <ntk/geometry/pointer_fusion.h>
+#include <ntk/utils/arg.h>
+#include <ntk/utils/opencv_utils.h>
+
+#include <QApplication>
+
+#include <cstdio>
+
+using namespace ntk;
+using namespace cv;
+
+namespace opt
+{
+  ntk::arg<int> devices("--devices", "Number of Kinects (with fakenect, the sources in FAKENECT_PATH)", 2);
+  ntk::arg<const char*> fusion_file("--fusion", "Sensor poses and screen (yml, as PointerFusion::saveToYaml)", 0);
+  ntk::arg<int> frames("--frames", "Stop after this many fused frames", 600);
+  ntk::arg<double> band("--band", "Depth of the hands behind the nearest point, in m", 0.08);
+  ntk::arg<int> min_area("--min-area", "Smallest blob, in pixels", 200);
+}
+
+namespace
+{
+
+  // The blobs within the band behind the nearest point of the depth image
+  void detectPointers(const Mat1f& depth, std::vector<SensorPointer>& pointers)
+  {
+    pointers.clear();
+    double nearest = 1e9;
+    for_all_rc(depth)
+      if (depth(r,c) > 0.4f && depth(r,c) < nearest)
+        nearest = depth(r,c);
+    if (nearest > 4)
+      return;
+
+    Mat1b mask = (depth > 0.4f) & (depth < nearest + opt::band());
+    std::vector< std::vector<Point> > contours;
+    findContours(mask, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE);
+    for (size_t i = 0; i < contours.size(); ++i)
+    {
+      Moments m = moments(Mat(contours[i]));
+      if (m.m00 < opt::min_area())
+        continue;
+      Point2f center (m.m10 / m.m00, m.m01 / m.m00);
+      // the mean depth of the band in the bounding box of the blob
+      Rect box = boundingRect(Mat(contours[i]));
+      double depth_sum = 0;
+      int n = 0;
+      for (int r = box.y; r < box.y + box.height; ++r)
+        for (int c = box.x; c < box.x + box.width; ++c)
+          if (mask(r,c))
+          {
+            depth_sum += depth(r,c);
+            ++n;
+          }
+      pointers.push_back(SensorPointer(center, depth_sum / n,
+                                       PointerFusion::borderWeight(center, depth.size()), i));
+    }
+  }
+
+}
+
+int main(int argc, char** argv)
+{
+  arg_base::set_help_option("-h");
+  arg_parse(argc, argv);
+  QApplication app(argc, argv);
+
+  PointerFusion fusion;
+  if (opt::fusion_file())
+    fusion.loadFromFile(opt::fusion_file());
+  else
+  {
+    Pose3D kinect;
+    kinect.setCameraParameters(580, 580, 320, 240);
+    for (int i = 0; i < opt::devices(); ++i)
+      fusion.addSensor(kinect);
+    fusion.setScreen(Point3f(-0.5, 0.28, -1), Point3f(0.5, 0.28, -1), Point3f(-0.5, -0.28, -1), Size(1920, 1080));
+  }
+  ntk_ensure(fusion.numSensors() == opt::devices(), "One sensor pose per device.");
+
+  // One grabber, freenect context and usb thread per device
+  std::vector<KinectGrabber*> grabbers;
+  for (int i = 0; i < opt::devices(); ++i)
+  {
+    KinectGrabber* grabber = new KinectGrabber();
+    grabber->initialize(i);
+    grabber->setSyncMode(RGBDSynchronizer::DepthOnly);
+    grabber->start();
+    grabbers.push_back(grabber);
+  }
+
+  KinectProcessor processor;
+  RGBDImage image;
+  std::vector< std::vector<SensorPointer> > pointers (grabbers.size());
+  std::vector<FusedPointer> fused;
+  int sensor_pointers = 0, fused_pointers = 0, merged = 0;
+  double fuse_ms = 0;
+  const double start_ms = 1000.0 * getTickCount() / getTickFrequency();
+
+  for (int frame = 0; frame < opt::frames(); ++frame)
+  {
+    for (size_t i = 0; i < grabbers.size(); ++i)
+    {
+      grabbers[i]->waitForNextFrame();
+      grabbers[i]->copyImageTo(image);
+      processor.processImage(image);
+      detectPointers(image.depth(), pointers[i]);
+      sensor_pointers += pointers[i].size();
+    }
+
+    double t = 1000.0 * getTickCount() / getTickFrequency();
+    fusion.fuse(pointers, fused);
+    fuse_ms += 1000.0 * getTickCount() / getTickFrequency() - t;
+
+    fused_pointers += fused.size();
+    for (size_t k = 0; k < fused.size(); ++k)
+      merged += (fused[k].sensors & (fused[k].sensors - 1)) != 0;
+    if (!fused.empty())
+      ntk_dbg(1) << cv::format("frame %d: %d pointers, first at (%.0f, %.0f) from sensors %x",
+                               frame, int(fused.size()), fused[0].screen.x, fused[0].screen.y, fused[0].sensors);
+  }
+
+  const double elapsed_ms = 1000.0 * getTickCount() / getTickFrequency() - start_ms;
+  printf("%d devices, %d fused frames in %.0f ms: %.1f fps\n", opt::devices(), opt::frames(), elapsed_ms,
+         1000.0 * opt::frames() / elapsed_ms);
+  printf("  %d sensor pointers, %d fused pointers, %d of them seen by several sensors\n",
+         sensor_pointers, fused_pointers, merged);
+  printf("  fusion %.2f us per frame\n", 1000 * fuse_ms / opt::frames());
+  for (size_t i = 0; i < grabbers.size(); ++i)
+    printf("  device %d grabbing at %.1f fps\n", int(i), grabbers[i]->frameRate());
+
+  for (size_t i = 0; i < grabbers.size(); ++i)
+  {
+    grabbers[i]->setShouldExit();
+    grabbers[i]->newEvent();
+    grabbers[i]->wait();
+    delete grabbers[i];
+  }
+  return 0;
+}
@@ -0,0 +1,258 @@
+/**
+ * This file is part of the nestk library.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Replays a recorded hand through the stages of the Mouse-ntk demo, one
+// after the other and as a pipeline, and compares their frame rate, their
+// latency and the fingertips they find: as fast as possible, then at the 30
+// fps of the Kinect.
+//
+//   test-pipeline [FRAMES]
+
+#include <ntk/thread/pipeline.h>
+#include <ntk/utils/time.h>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace ntk;
+using namespace cv;
+
+namespace
+{
+
+  const int width = 640, height = 480, recorded = 60;
+
+  struct HandFrame : public PipelineFrame
+  {
+    HandFrame() : raw(height, width), rgb(height, width), depth(height, width), display(height, width), tips(0) {}
+
+    Mat1w raw;
+    Mat3b rgb;
+    Mat1f depth;
+    Mat1b normalized, mask;
+    Mat3b display;
+    int tips;
+  };
+
+  // Raw 11 bit kinect depths of a hand with 5 fingers moving across a room
+  void record(std::vector<Mat1w>& raw, std::vector<Mat3b>& rgb)
+  {
+    RNG rng(1);
+    for (int f = 0; f < recorded; ++f)
+    {
+      Mat1w d(height, width);
+      Mat3b c(height, width);
+      for (int r = 0; r < height; ++r)
+      for (int k = 0; k < width; ++k)
+      {
+        d(r, k) = 1000 + r / 8 + rng.uniform(0, 3);
+        c(r, k) = Vec3b(r / 2, k / 3, 100);
+      }
+      Point center(200 + 4 * f, 260);
+      ellipse(d, center, Size(60, 70), 0, 0, 360, Scalar(700), -1);
+      for (int i = 0; i < 5; ++i)
+      {
+        Point base = center + Point(-48 + 24 * i, -50);
+        rectangle(d, base + Point(-7, -60 + (i == 0 || i == 4 ? 25 : 0)), base + Point(7, 0), Scalar(700), -1);
+      }
+      raw.push_back(d);
+      rgb.push_back(c);
+    }
+  }
+
+  class Replay : public PipelineStage
+  {
+  public:
+    Replay(const std::vector<Mat1w>& raw, const std::vector<Mat3b>& rgb, int frames, double fps)
+      : PipelineStage("capture"), m_raw(raw), m_rgb(rgb), m_frames(frames), m_fps(fps), m_start_ms(0)
+    {}
+
+    virtual bool process(PipelineFrame& f)
+    {
+      HandFrame& frame = static_cast<HandFrame&>(f);
+      if (frame.index >= m_frames)
+        return false;
+      if (frame.index == 0)
+        m_start_ms = Pipeline::nowMs();
+      // waits for the frame as for the sensor
+      double due_ms = m_fps > 0 ? m_start_ms + frame.index * 1000.0 / m_fps : 0;
+      if (Pipeline::nowMs() < due_ms)
+      {
+        ntk::sleep(int(due_ms - Pipeline::nowMs()) + 1);
+        frame.start_ms = Pipeline::nowMs();
+      }
+      m_raw[frame.index % recorded].copyTo(frame.raw);
+      m_rgb[frame.index % recorded].copyTo(frame.rgb);
+      return true;
+    }
+
+  private:
+    const std::vector<Mat1w>& m_raw;
+    const std::vector<Mat3b>& m_rgb;
+    int m_frames;
+    double m_fps;
+    double m_start_ms;
+  };
+
+  // Raw depths to meters as RGBDProcessor::ComputeKinectDepthBaseline, then normalized
+  class Process : public PipelineStage
+  {
+  public:
+    Process() : PipelineStage("process") {}
+
+    virtual bool process(PipelineFrame& f)
+    {
+      HandFrame& frame = static_cast<HandFrame&>(f);
+      for (int r = 0; r < height; ++r)
+      {
+        const ushort* raw = frame.raw.ptr<ushort>(r);
+        float* depth = frame.depth.ptr<float>(r);
+        for (int c = 0; c < width; ++c)
+          depth[c] = raw[c] < 2047 ? 1.0f / (raw[c] * -0.0030711016f + 3.3309495161f) : 0;
+      }
+      GaussianBlur(frame.depth, frame.depth, Size(5, 5), 0);
+      normalize(frame.depth, frame.normalized, 0, 255, NORM_MINMAX, 0);
+      return true;
+    }
+  };
+
+  // The hand band, its contours and the sharp corners of their convex hulls
+  class Detect : public PipelineStage
+  {
+  public:
+    Detect() : PipelineStage("detect") {}
+
+    virtual bool process(PipelineFrame& f)
+    {
+      HandFrame& frame = static_cast<HandFrame&>(f);
+      frame.mask = (frame.normalized < 45) & (frame.normalized > 1);
+      std::vector<std::vector<Point> > contours;
+      findContours(frame.mask, contours, CV_RETR_LIST, CV_CHAIN_APPROX_SIMPLE);
+      frame.tips = 0;
+      for (size_t i = 0; i < contours.size(); ++i)
+      {
+        if (contourArea(Mat(contours[i])) < 3000)
+          continue;
+        std::vector<Point> curve;
+        approxPolyDP(Mat(contours[i]), curve, 20, true);
+        std::vector<int> hull;
+        convexHull(Mat(curve), hull);
+        for (size_t j = 0; j < hull.size(); ++j)
+        {
+          int idx = hull[j];
+          Point v1 = curve[(idx + 1) % curve.size()] - curve[idx];
+          Point v2 = curve[(idx + curve.size() - 1) % curve.size()] - curve[idx];
+          if (acos((v1.x*v2.x + v1.y*v2.y) / (norm(v1) * norm(v2))) < 1)
+            ++frame.tips;
+        }
+      }
+      return true;
+    }
+  };
+
+  // Draws on the color image and converts it as a window would show it
+  class Output : public PipelineStage
+  {
+  public:
+    Output(std::vector<int>& tips) : PipelineStage("output"), m_tips(tips) {}
+
+    virtual bool process(PipelineFrame& f)
+    {
+      HandFrame& frame = static_cast<HandFrame&>(f);
+      m_tips[frame.index] = frame.tips;
+      frame.display = frame.rgb * 0.5;
+      frame.display.setTo(Scalar(255, 255, 255), frame.mask);
+      cvtColor(frame.display, frame.display, CV_BGR2RGB);
+      return true;
+    }
+
+  private:
+    std::vector<int>& m_tips;
+  };
+
+  void report(const char* name, const Pipeline& pipeline)
+  {
+    PipelineStats stats = pipeline.stats();
+    printf("%s: %.1f fps, latency %.2f ms mean, %.2f ms max\n",
+           name, stats.framesPerSecond(), stats.meanLatencyMs(), stats.max_latency_ms);
+    for (int i = 0; i < pipeline.numStages(); ++i)
+    {
+      PipelineStageStats s = pipeline.stage(i).stats();
+      printf("  %-8s %6.2f ms/frame, %6.2f ms max, waiting %6.2f ms/frame\n",
+             pipeline.stage(i).name().c_str(), s.meanBusyMs(), s.max_busy_ms, s.frames ? s.wait_ms / s.frames : 0);
+    }
+  }
+
+  // The fingertips of each frame, and the stats of the run
+  PipelineStats replay(const std::vector<Mat1w>& raw, const std::vector<Mat3b>& rgb,
+                       int frames, double fps, bool pipelined, std::vector<int>& tips)
+  {
+    Pipeline pipeline;
+    Replay replay(raw, rgb, frames, fps);
+    Process process;
+    Detect detect;
+    Output output(tips);
+    pipeline.addStage(&replay);
+    pipeline.addStage(&process);
+    pipeline.addStage(&detect);
+    pipeline.addStage(&output);
+    tips.assign(frames, -1);
+    if (pipelined)
+    {
+      for (int i = 0; i < pipeline.numStages(); ++i)
+        pipeline.addFrame(new HandFrame());
+      pipeline.run();
+    }
+    else
+    {
+      pipeline.addFrame(new HandFrame());
+      pipeline.runSerial();
+    }
+    report(pipelined ? "pipelined" : "serial", pipeline);
+    return pipeline.stats();
+  }
+
+}
+
+int main(int argc, char** argv)
+{
+  const int frames = argc > 1 ? atoi(argv[1]) : 300;
+  std::vector<Mat1w> raw;
+  std::vector<Mat3b> rgb;
+  record(raw, rgb);
+
+  std::vector<int> serial_tips, pipelined_tips;
+  bool ok = true;
+  replay(raw, rgb, recorded, 0, false, serial_tips); // warms up the caches and the allocator
+  printf("\nAs fast as possible, %d frames\n", frames);
+  PipelineStats serial = replay(raw, rgb, frames, 0, false, serial_tips);
+  PipelineStats pipelined = replay(raw, rgb, frames, 0, true, pipelined_tips);
+  printf("%.2fx the frame rate of the serial loop\n", pipelined.framesPerSecond() / serial.framesPerSecond());
+  ok = ok && serial_tips == pipelined_tips && serial_tips[0] >= 5 && pipelined.frames == frames;
+
+  printf("\nAt 30 fps, %d frames\n", recorded);
+  serial = replay(raw, rgb, recorded, 30, false, serial_tips);
+  pipelined = replay(raw, rgb, recorded, 30, true, pipelined_tips);
+  ok = ok && serial_tips == pipelined_tips && pipelined.frames == recorded;
+
+  if (!ok)
+  {
+    std::cerr << "The pipeline did not find the same fingertips in every frame." << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,176 @@
+/**
+ * This file is part of the nestk library.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Two Kinects 1.5 m in front of a 2 m wide display, one per half, turned
+// a little towards its middle, where their fields of view overlap. Two
+// hands move over the whole display; each sensor sees those in its field
+// of view, with the noise of the Kinect depth. Checks that each hand is one
+// pointer on the screen, in the overlap too, and that it lands where the
+// hand is.
+
+#include <ntk/geometry/pointer_fusion.h>
+#include <ntk/numeric/utils.h>
+#include <iostream>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace ntk;
+using namespace cv;
+
+namespace
+{
+
+  const Size image_size (640, 480);
+  const Size screen_pixels (3840, 1080);
+  const int frames = 2000;
+  const int hands = 2;
+
+  double gaussian(double sigma)
+  {
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0), v = (rand() + 1.0) / (RAND_MAX + 2.0);
+    return sigma * std::sqrt(-2 * std::log(u)) * std::cos(2 * M_PI * v);
+  }
+
+  // Kinect depth intrinsics, at camera_position, turned by yaw around the vertical
+  Pose3D kinectPose(const Point3f& camera_position, double yaw)
+  {
+    Pose3D pose;
+    pose.setCameraParameters(580, 580, 320, 240);
+    pose.applyTransformBefore(Vec3f(0, 0, 0), Vec3f(0, yaw, 0));
+    pose.applyTransformBefore(Vec3f(-camera_position), Vec3f(0, 0, 0));
+    return pose;
+  }
+
+  // Where the sensor sees the hand, false out of its field of view
+  bool observe(const Pose3D& pose, const Point3f& hand, SensorPointer& pointer)
+  {
+    Point3f p = pose.projectToImage(hand);
+    if (p.x < 0 || p.y < 0 || p.x >= image_size.width || p.y >= image_size.height)
+      return false;
+    float depth = -pose.cameraTransform(hand).z;
+    // Kinect noise grows with the square of the depth
+    depth += gaussian(0.00285 * depth * depth);
+    Point2f image_point (p.x + gaussian(1), p.y + gaussian(1));
+    pointer = SensorPointer(image_point, depth, PointerFusion::borderWeight(image_point, image_size));
+    return true;
+  }
+
+  double nowMs() { return 1000.0 * getTickCount() / getTickFrequency(); }
+
+  Point3f handPosition(int hand, int frame)
+  {
+    // one hand sweeps the display, the other one goes back and forth over the middle
+    double t = frame / double(frames);
+    if (hand == 0)
+      return Point3f(-0.95 + 1.9 * t, 0.2 * std::sin(6 * M_PI * t), 0.05);
+    return Point3f(0.5 * std::sin(8 * M_PI * t), -0.2 + 0.1 * std::cos(4 * M_PI * t), 0.08);
+  }
+
+}
+
+int main()
+{
+  srand(3);
+
+  PointerFusion fusion;
+  fusion.addSensor(kinectPose(Point3f(-0.5, 0, 1.5), deg_to_rad(4)));
+  fusion.addSensor(kinectPose(Point3f(0.5, 0, 1.5), deg_to_rad(-4)));
+  fusion.setScreen(Point3f(-1, 0.3, 0), Point3f(1, 0.3, 0), Point3f(-1, -0.3, 0), screen_pixels);
+
+  std::vector< std::vector<SensorPointer> > pointers (fusion.numSensors());
+  std::vector<FusedPointer> fused;
+  int observed = 0, both = 0, expected = 0, found = 0, duplicates = 0, naive_duplicates = 0;
+  double error_px = 0, max_error_px = 0, fuse_ms = 0, distance_error = 0;
+
+  for (int frame = 0; frame < frames; ++frame)
+  {
+    std::vector<Point3f> positions;
+    for (int h = 0; h < hands; ++h)
+      positions.push_back(handPosition(h, frame));
+    // hands closer than the merge distance are one pointer
+    if (norm(positions[0] - positions[1]) < 2 * fusion.mergeDistance())
+      positions.pop_back();
+
+    for (int s = 0; s < fusion.numSensors(); ++s)
+    {
+      pointers[s].clear();
+      for (size_t h = 0; h < positions.size(); ++h)
+      {
+        SensorPointer p;
+        if (observe(fusion.sensorPose(s), positions[h], p))
+          pointers[s].push_back(p);
+      }
+    }
+
+    double start_ms = nowMs();
+    fusion.fuse(pointers, fused);
+    fuse_ms += nowMs() - start_ms;
+
+    // each sensor on its own would give one pointer per hand it sees
+    int seen = pointers[0].size() + pointers[1].size();
+    observed += seen;
+    expected += positions.size();
+    naive_duplicates += seen - positions.size();
+
+    std::vector<bool> taken (fused.size(), false);
+    for (size_t h = 0; h < positions.size(); ++h)
+    {
+      Point2f truth = fusion.toScreen(positions[h]);
+      int best = -1;
+      double best_px = 1e9;
+      for (size_t i = 0; i < fused.size(); ++i)
+      {
+        double d = norm(fused[i].screen - truth);
+        if (!taken[i] && d < best_px)
+        {
+          best = i;
+          best_px = d;
+        }
+      }
+      if (best < 0 || best_px > 50)
+        continue;
+      taken[best] = true;
+      ++found;
+      both += fused[best].sensors == 3;
+      error_px += best_px;
+      // the hands are in front of the screen, at their z
+      distance_error += std::abs(fusion.screenDistance(fused[best].world) - positions[h].z);
+      max_error_px = std::max(max_error_px, best_px);
+    }
+    for (size_t i = 0; i < taken.size(); ++i)
+      duplicates += !taken[i];
+  }
+
+  error_px /= std::max(found, 1);
+  distance_error /= std::max(found, 1);
+  printf("%d hands over %d frames, %d sensor pointers\n", expected, frames, observed);
+  printf("  without fusion           %5d duplicated pointers\n", naive_duplicates);
+  printf("  fused                    %5d found, %d seen by both sensors, %d duplicated, error %.1f px mean %.1f px max\n",
+         found, both, duplicates, error_px, max_error_px);
+  printf("  distance to the screen   %.1f mm mean error\n", 1000 * distance_error);
+  printf("  fusion                   %.2f us per frame\n", 1000 * fuse_ms / frames);
+
+  bool ok = found == expected && duplicates == 0 && naive_duplicates > frames / 4
+      && both > frames / 4 && error_px < 15 && distance_error < 0.02;
+  if (!ok)
+  {
+    std::cerr << "The fusion did not give one pointer per hand at its place on the screen." << std::endl;
+    return 1;
+  }
+  return 0;
+}
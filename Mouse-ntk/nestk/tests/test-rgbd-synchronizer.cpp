@@ -0,0 +1,225 @@
+/**
+ * This file is part of the nestk library.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Feeds the synchronizer with the depth and color streams of a Kinect, as
+// libfreenect delivers them: 30 fps with timestamp jitter, the color frames
+// a few ms off the depth ones and arriving later, at times after the next
+// depth frame, some of them lost, and the timestamps wrapping around.
+// Compares the pairs with those of the former grabber loop, which waited
+// for both streams and took the last frame of each.
+
+#include <ntk/camera/rgbd_synchronizer.h>
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace ntk;
+
+namespace
+{
+
+  const int frames = 600;
+  const double frame_ms = 1000.0 / 30;
+
+  struct Arrival
+  {
+    double host_ms;
+    bool depth;
+    uint32_t timestamp;
+    int index;
+    bool operator<(const Arrival& other) const { return host_ms < other.host_ms; }
+  };
+
+  uint32_t ticks(double ms) { return uint32_t(int64_t(ms * RGBDSynchronizer::ticksPerMs())); }
+
+  double skewMs(uint32_t depth, uint32_t color)
+  { return RGBDSynchronizer::ticksBetween(depth, color) / RGBDSynchronizer::ticksPerMs(); }
+
+  // Depth and color frames, in the order they reach the host
+  std::vector<Arrival> record(double color_offset_ms, unsigned seed)
+  {
+    srand(seed);
+    // the clock wraps around a few seconds in
+    const double start_ms = (4294967296.0 - 5000 * RGBDSynchronizer::ticksPerMs()) / RGBDSynchronizer::ticksPerMs();
+    std::vector<Arrival> arrivals;
+    for (int i = 0; i < frames; ++i)
+    {
+      double jitter = (rand() % 1000) / 1000.0 - 0.5;
+      double depth_ms = i * frame_ms + jitter;
+      Arrival depth = { depth_ms + 5 + (rand() % 3000) / 1000.0, true, ticks(start_ms + depth_ms), i };
+      arrivals.push_back(depth);
+      if (i % 17 == 5 || (i >= 300 && i < 303))
+        continue; // lost color frames
+      double color_ms = i * frame_ms + color_offset_ms + (rand() % 1000) / 1000.0 - 0.5;
+      // the bigger color frames take longer over usb, sometimes more than a frame
+      Arrival color = { color_ms + 12 + (rand() % 30000) / 1000.0, false, ticks(start_ms + color_ms), i };
+      arrivals.push_back(color);
+    }
+    std::stable_sort(arrivals.begin(), arrivals.end());
+    return arrivals;
+  }
+
+  struct Result
+  {
+    Result() : pairs(0), wrong(0), mean_skew_ms(0), max_skew_ms(0), mean_wait_ms(0) {}
+    int pairs;
+    int wrong; // pairs that are not a depth frame and its nearest color frame
+    double mean_skew_ms, max_skew_ms;
+    double mean_wait_ms; // from the arrival of the depth frame to its release
+  };
+
+  void print(const char* name, const Result& r)
+  {
+    printf("  %-26s %4d frames, skew %5.2f ms mean %5.2f ms max, released %5.2f ms after the depth, %d wrong pairs\n",
+           name, r.pairs, r.mean_skew_ms, r.max_skew_ms, r.mean_wait_ms, r.wrong);
+  }
+
+  Result synchronized(const std::vector<Arrival>& arrivals, RGBDSynchronizer::Mode mode, RGBDSynchronizerStats& stats)
+  {
+    // the nearest color frame of each depth frame, within the tolerance
+    RGBDSynchronizer sync;
+    sync.setMode(mode);
+    const double tolerance_ms = sync.toleranceMs();
+    std::vector<int> nearest(frames, -1);
+    std::vector<uint32_t> depth_time(frames), color_time(frames);
+    std::vector<double> depth_arrival(frames);
+    for (size_t i = 0; i < arrivals.size(); ++i)
+      (arrivals[i].depth ? depth_time : color_time)[arrivals[i].index] = arrivals[i].timestamp;
+    for (size_t i = 0; i < arrivals.size(); ++i)
+    {
+      if (!arrivals[i].depth)
+        continue;
+      depth_arrival[arrivals[i].index] = arrivals[i].host_ms;
+      double best = tolerance_ms;
+      for (size_t j = 0; j < arrivals.size(); ++j)
+        if (!arrivals[j].depth && std::abs(skewMs(arrivals[i].timestamp, arrivals[j].timestamp)) <= best)
+        {
+          best = std::abs(skewMs(arrivals[i].timestamp, arrivals[j].timestamp));
+          nearest[arrivals[i].index] = arrivals[j].index;
+        }
+    }
+
+    // what the slots hold, as the grabber buffers
+    std::vector<int> depth_slots(sync.numSlots()), color_slots(sync.numSlots());
+    Result r;
+    for (size_t i = 0; i < arrivals.size(); ++i)
+    {
+      const Arrival& a = arrivals[i];
+      if (a.depth && sync.usesDepth())
+      {
+        int slot = sync.depthSlot();
+        depth_slots[slot] = a.index;
+        sync.addDepth(slot, a.timestamp);
+      }
+      else if (!a.depth && sync.usesColor())
+      {
+        int slot = sync.colorSlot();
+        color_slots[slot] = a.index;
+        sync.addColor(slot, a.timestamp);
+      }
+
+      int depth_slot, color_slot;
+      if (!sync.nextFrame(depth_slot, color_slot))
+        continue;
+      ++r.pairs;
+      int d = depth_slots[depth_slot];
+      r.mean_wait_ms += a.host_ms - depth_arrival[d];
+      if (color_slot < 0)
+        continue;
+      int c = color_slots[color_slot];
+      double skew = std::abs(skewMs(depth_time[d], color_time[c]));
+      r.mean_skew_ms += skew;
+      r.max_skew_ms = std::max(r.max_skew_ms, skew);
+      r.wrong += nearest[d] != c;
+    }
+    if (r.pairs)
+    {
+      r.mean_skew_ms /= r.pairs;
+      r.mean_wait_ms /= r.pairs;
+    }
+    stats = sync.stats();
+    return r;
+  }
+
+  // The former loop: both streams overwrite their frame, it goes out once both came
+  Result waitForBoth(const std::vector<Arrival>& arrivals)
+  {
+    Result r;
+    bool has_depth = false, has_color = false;
+    Arrival depth = arrivals[0], color = arrivals[0];
+    for (size_t i = 0; i < arrivals.size(); ++i)
+    {
+      const Arrival& a = arrivals[i];
+      (a.depth ? depth : color) = a;
+      (a.depth ? has_depth : has_color) = true;
+      if (!has_depth || !has_color)
+        continue;
+      has_depth = has_color = false;
+      ++r.pairs;
+      double skew = std::abs(skewMs(depth.timestamp, color.timestamp));
+      r.mean_skew_ms += skew;
+      r.max_skew_ms = std::max(r.max_skew_ms, skew);
+      r.mean_wait_ms += a.host_ms - depth.host_ms;
+      r.wrong += depth.index != color.index;
+    }
+    r.mean_skew_ms /= r.pairs;
+    r.mean_wait_ms /= r.pairs;
+    return r;
+  }
+
+}
+
+int main()
+{
+  bool ok = true;
+  const double offsets[] = { 3, -3 };
+  for (int k = 0; k < 2; ++k)
+  {
+    std::vector<Arrival> arrivals = record(offsets[k], 7 + k);
+    printf("Color %+.0f ms from the depth, %d frames, %d color frames lost\n",
+           offsets[k], frames, frames - int(arrivals.size()) + frames);
+
+    Result old_loop = waitForBoth(arrivals);
+    print("waiting for both streams", old_loop);
+
+    RGBDSynchronizerStats stats, depth_only_stats;
+    Result paired = synchronized(arrivals, RGBDSynchronizer::DepthAndColor, stats);
+    print("nearest timestamps", paired);
+    printf("  %-26s %d paired, %d depth and %d color frames dropped, skew %.2f ms mean %.2f ms max\n",
+           "synchronizer stats", stats.paired, stats.depth_dropped, stats.color_dropped,
+           stats.meanSkewMs(), stats.max_skew_ms);
+
+    Result depth_only = synchronized(arrivals, RGBDSynchronizer::DepthOnly, depth_only_stats);
+    print("depth only", depth_only);
+
+    // Every depth frame with a color frame in the tolerance goes out with
+    // that color frame, but for one that may be overtaken by the next one
+    // while the interval of the color stream is not known yet.
+    const int lost = frames / 17 + (frames % 17 > 5) + 3;
+    ok = ok && paired.wrong == 0 && paired.pairs >= frames - lost - 1
+        && paired.max_skew_ms <= 1000.0 / 60 && stats.paired == paired.pairs
+        && depth_only.pairs == frames && depth_only.mean_wait_ms == 0 && depth_only_stats.depth_dropped == 0;
+  }
+
+  if (!ok)
+  {
+    std::cerr << "The synchronizer did not pair each depth frame with its nearest color frame." << std::endl;
+    return 1;
+  }
+  return 0;
+}
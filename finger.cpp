@@ -42,6 +42,7 @@
 #include <opencv/cv.h>
 
 #include <pthread.h>
+#include <time.h>
 
 //kinect
 //#include <CLNUIDevice.h>
@@ -57,6 +58,10 @@
 #include <evemu.h>//utouch multi-touch event emulation
 
 #include <libfreenect.h>//kinect driver by openkinect
+#include "kinect_motor.h"//tilt, led and accelerometer thread
+#include "kinect_push.h"//push to click
+#include "kinect_clock.h"//frame time from the kinect timestamps
+#include "kinect_rle.h"//run-length encoded hand masks and their contours
 
 #define SCREEN (DefaultScreen(display))
 int depth;
@@ -69,17 +74,26 @@ Window root_window;
 freenect_context *f_ctx;
 freenect_usb_context *usb_ctx;
 freenect_device *f_dev;
+kinect_motor motor;
+#define TILT_POLL_HZ 1
 int freenect_angle = 17;
 int freenect_led;
 
 int snstvty = 0;
-int hold = 0;
+#define CLICK_MS 500 // hold the pointer still this long for a dwell click
+double hold_ms = 0; // time the pointer has been held still, negative while debouncing a click
+double mouse_ms = -1; // frame time of the previous pointer update
+#define CLICK_DWELL 1 // hold the pointer still
+#define CLICK_PUSH 2 // push the hand towards the kinect and back
+int click_mode = CLICK_DWELL;
+kinect_push push;
+kinect_clock depth_clock; // time of the last depth frame, from the kinect timestamps
+kinect_clock frame_clock; // depth_clock of the frame being analysed
 float pointerx = 0, pointery = 0;
 float mousex = 0, mousey = 0;
 float tmousex = 0, tmousey = 0;
 int screenw = 0, screenh = 0;
 int pusx = 0, pusy = 0; //got to change this sometime
-IplImage *win1=0;
 int key;
 
 uint8_t gl_depth_front[640*480*4];
@@ -90,18 +104,33 @@ uint8_t gl_rgb_back[640*480*4];
 
 uint16_t t_gamma[2048];
 
+// Raw depth handed from depth_cb to the analysis loop in main, which takes the latest frame
+uint16_t depth_back[640*480];
+uint16_t depth_front[640*480];
+int depth_frames = 0; // frames received since the analysis loop took the last one
+long frames_skipped = 0; // frames replaced by a newer one before they were analysed
+volatile int die = 0;
+
+// Unprojection: z from the raw depth through a table. Only z is needed, for the push clicks and the
+// debug view: the fingertips are found on the raw depth and the pointer works in pixels
+const float zMin = 0.0f;
+const float zMax = 0.75f;
+#define HAND_MARGIN 8 // pixels kept around the hand pixels for the contour
+float z_lut[2048]; // raw depth to z in m, 0 where the sensor has no depth
+uint16_t hand_raw_min, hand_raw_max; // raw depths with zMin < z < zMax
+kinect_rle hand_rle; // runs of the hand pixels of the current frame, there is no mask image
+
 std::vector<cv::Point2i> fingerTips;
-cv::Mat x(480, 640, CV_32FC1);
-cv::Mat y(480, 640, CV_32FC1);
 cv::Mat z(480, 640, CV_32FC1);
 cv::Mat debugFrame(480, 640, CV_32FC1);
 cv::Scalar center;
+cv::Rect handRoi; // part of z unprojected for the current frame
 
 pthread_t freenect_thread;
 pthread_mutex_t gl_backbuf_mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t gl_frame_cond = PTHREAD_COND_INITIALIZER;
 
-int mouse(int px, int py){ 
+void mouse(int px, int py){ 
   pointerx = ((px-640.0f) / -1);
   pointery = (py);
   mousex = ((pointerx / 630.0f) * screenw);
@@ -116,16 +145,27 @@ int mouse(int px, int py){
   if(my < tmousey) tmousey-= (tmousey - my) / 7;			
 			
   if((pusx <= (mx + 15))  && (pusx >= (mx - 15)) && (pusy <= (my + 15))  && (pusy >= (my - 15))) {
-    hold++;
-    printf("\n%d\n", hold);
+    hold_ms += mouse_ms >= 0 ? frame_clock.ms - mouse_ms : kinect_clock_frame_ms(&frame_clock);
+    printf("\n%.0f ms\n", hold_ms);
   } else {
     pusx = mx;
     pusy = my;
-    hold = 0;
+    hold_ms = 0;
   }		
+  mouse_ms = frame_clock.ms;
 			
-  if(hold > 15) {
-    hold = -30;
+  if((click_mode & CLICK_DWELL) && hold_ms > CLICK_MS) {
+    hold_ms = -2 * CLICK_MS;
+    XTestFakeButtonEvent(display, 1, 1, CurrentTime);
+    XTestFakeButtonEvent(display, 1, 0, CurrentTime);
+  }
+
+  // push click at the place the pointer was before the push
+  float pz = z.at<float>(py, px);
+  int cx = tmousex, cy = tmousey;
+  if((click_mode & CLICK_PUSH) && pz > 0 && kinect_push_update(&push, frame_clock.ms, pz * 1000, &cx, &cy)) {
+    hold_ms = 0;
+    XTestFakeMotionEvent(display, -1, cx-200, cy-200, CurrentTime);
     XTestFakeButtonEvent(display, 1, 1, CurrentTime);
     XTestFakeButtonEvent(display, 1, 0, CurrentTime);
   }
@@ -138,100 +178,96 @@ int mouse(int px, int py){
   printf("\n\n %d  -  %d \n\n", mx, my);
 }
 
+static cv::Point toPoint(const kinect_point& p) {
+  return cv::Point(p.x, p.y);
+}
+
+// Fingertips of the hands in handRoi of depth_front. The hand pixels are thresholded into runs and
+// their contours traced on the runs (kinect_rle.h): the same tips as findContours, approxPolyDP and
+// convexHull on a mask image would give, without the image
 std::vector<cv::Point2i> detectFingertips() {
   using namespace cv;
   using namespace std;
   bool debug = 1;
+  static vector<kinect_rle_blob> blobs(16);
+  static vector<kinect_point> contour(4096), approxCurve(4096), tips(64);
+  static vector<int> hull(4096);
 
-  float zMin = 0.0f;
-  float zMax = 0.75f;
-  
   vector<Point2i> fingerTips;
 
-  Mat handMask = z < zMax & z > zMin;
-
-  std::vector<std::vector<cv::Point> > contours;
-  findContours(handMask.clone(), contours, CV_RETR_LIST, CV_CHAIN_APPROX_SIMPLE); // we are cloning here since method will destruct the image
-
-  if (contours.size()) {
-    for (int i=0; i<contours.size(); i++) {
-      vector<Point> contour = contours[i];
-      Mat contourMat = Mat(contour);
-      double area = cv::contourArea(contourMat);
-
-      if (area > 3000)  { // possible hand
-	center = mean(contourMat);
-	Point centerPoint = Point(center.val[0], center.val[1]);
-
-	vector<Point> approxCurve;
-	cv::approxPolyDP(contourMat, approxCurve, 20, true);
+  debugFrame.setTo(Scalar(0));
+  if (handRoi.area() == 0)
+    return fingerTips;
+  z(handRoi).copyTo(debugFrame(handRoi));
+  // zMin < z < zMax is hand_raw_min <= raw <= hand_raw_max
+  kinect_rle_threshold(&hand_rle, depth_front, 640, handRoi.x, handRoi.y, handRoi.width, handRoi.height, hand_raw_min, hand_raw_max);
+  int nblobs = kinect_rle_label(&hand_rle, &blobs[0], blobs.size());
+  if (nblobs > (int)blobs.size()) {
+    blobs.resize(nblobs * 2);
+    kinect_rle_label(&hand_rle, &blobs[0], blobs.size());
+  }
 
-	vector<int> hull;
-	cv::convexHull(Mat(approxCurve), hull);
+  for (int i=0; i<nblobs; i++) {
+    int n = kinect_rle_trace(&hand_rle, &blobs[i], &contour[0], contour.size());
+    if (n > (int)contour.size()) {
+      contour.resize(n * 2);
+      approxCurve.resize(n * 2);
+      hull.resize(n * 2);
+      kinect_rle_trace(&hand_rle, &blobs[i], &contour[0], contour.size());
+    }
+    double area = kinect_rle_area(&contour[0], n);
 
-	// find upper and lower bounds of the hand and define cutoff threshold (don't consider lower vertices as fingers)
-	int upper = 640, lower = 0;
-	for (int j=0; j<hull.size(); j++) {
-	  int idx = hull[j]; // corner index
-	  if (approxCurve[idx].y < upper) upper = approxCurve[idx].y;
-	  if (approxCurve[idx].y > lower) lower = approxCurve[idx].y;
+    if (area > 3000)  { // possible hand
+      double sx = 0, sy = 0;
+      for (int j=0; j<n; j++) {
+	sx += contour[j].x;
+	sy += contour[j].y;
+      }
+      center = Scalar(sx / n, sy / n);
+
+      int na = kinect_rle_approx(&contour[0], n, 20, &approxCurve[0]);
+      if (na < 3)
+	continue;
+      int nh = kinect_rle_hull(&approxCurve[0], na, &hull[0]);
+
+      // low interior angle + within upper 90% of region -> we got a finger
+      float cutoff;
+      if ((int)tips.size() < nh)
+	tips.resize(nh);
+      int nt = kinect_rle_tips(&approxCurve[0], na, &hull[0], nh, 1, &cutoff, &tips[0], nh);
+      for (int j=0; j<nt; j++) {
+	fingerTips.push_back(Point2i(tips[j].x, tips[j].y));
+	if (debug) {
+	  cv::circle(debugFrame, toPoint(tips[j]), 10, Scalar(1), -1);
 	}
-	float cutoff = lower - (lower - upper) * 0.1f;
-
-	// find interior angles of hull corners
-	for (int j=0; j<hull.size(); j++) {
-	  int idx = hull[j]; // corner index
-	  int pdx = idx == 0 ? approxCurve.size() - 1 : idx - 1; //  predecessor of idx
-	  int sdx = idx == approxCurve.size() - 1 ? 0 : idx + 1; // successor of idx
-
-	  Point v1 = approxCurve[sdx] - approxCurve[idx];
-	  Point v2 = approxCurve[pdx] - approxCurve[idx];
-
-	  float angle = acos( (v1.x*v2.x + v1.y*v2.y) / (norm(v1) * norm(v2)) );
-
-	  // low interior angle + within upper 90% of region -> we got a finger
-	  if (angle < 1 && approxCurve[idx].y < cutoff) {
-	    int u = approxCurve[idx].x;
-	    int v = approxCurve[idx].y;
+      }
 
-	    fingerTips.push_back(Point2i(u,v));
-						
-	    if (debug) {
-	      cv::circle(debugFrame, approxCurve[idx], 10, Scalar(1), -1);
-	    }
+      if (debug) {
+	// draw cutoff threshold
+	cv::line(debugFrame, Point(center.val[0]-100, cutoff), Point(center.val[0]+100, cutoff), Scalar(1.0f));
+
+	// draw approxCurve
+	for (int j=0; j<na; j++) {
+	  cv::circle(debugFrame, toPoint(approxCurve[j]), 10, Scalar(1.0f));
+	  if (j != 0) {
+	    cv::line(debugFrame, toPoint(approxCurve[j]), toPoint(approxCurve[j-1]), Scalar(1.0f));
+	  } else {
+	    cv::line(debugFrame, toPoint(approxCurve[0]), toPoint(approxCurve[na-1]), Scalar(1.0f));
 	  }
 	}
 
-	if (debug) {
-	  // draw cutoff threshold
-	  cv::line(debugFrame, Point(center.val[0]-100, cutoff), Point(center.val[0]+100, cutoff), Scalar(1.0f));
-
-	  // draw approxCurve
-	  for (int j=0; j<approxCurve.size(); j++) {
-	    cv::circle(debugFrame, approxCurve[j], 10, Scalar(1.0f));
-	    if (j != 0) {
-	      cv::line(debugFrame, approxCurve[j], approxCurve[j-1], Scalar(1.0f));
-	    } else {
-	      cv::line(debugFrame, approxCurve[0], approxCurve[approxCurve.size()-1], Scalar(1.0f));
-	    }
-	  }
-
-	  // draw approxCurve hull
-	  for (int j=0; j<hull.size(); j++) {
-	    cv::circle(debugFrame, approxCurve[hull[j]], 10, Scalar(1.0f), 3);
-	    if(j == 0) {
-	      cv::line(debugFrame, approxCurve[hull[j]], approxCurve[hull[hull.size()-1]], Scalar(1.0f));
-	    } else {
-	      cv::line(debugFrame, approxCurve[hull[j]], approxCurve[hull[j-1]], Scalar(1.0f));
-	    }
+	// draw approxCurve hull
+	for (int j=0; j<nh; j++) {
+	  cv::circle(debugFrame, toPoint(approxCurve[hull[j]]), 10, Scalar(1.0f), 3);
+	  if(j == 0) {
+	    cv::line(debugFrame, toPoint(approxCurve[hull[j]]), toPoint(approxCurve[hull[nh-1]]), Scalar(1.0f));
+	  } else {
+	    cv::line(debugFrame, toPoint(approxCurve[hull[j]]), toPoint(approxCurve[hull[j-1]]), Scalar(1.0f));
 	  }
 	}
       }
     }
   }
-  IplImage tmp_img = debugFrame;
-printf("debug");
-  win1 = &tmp_img;
   return fingerTips;
 }
 
@@ -245,6 +281,14 @@ void depth_cb(freenect_device *dev, void *v_depth, uint32_t timestamp)
   uint16_t *depth = (uint16_t*)v_depth;
 	
   pthread_mutex_lock(&gl_backbuf_mutex);
+  memcpy(depth_back, depth, sizeof(depth_back)); // analysed by the loop in main
+  depth_frames++;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (kinect_clock_update(&depth_clock, timestamp, now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0))
+    printf("\n%d frames dropped\n", depth_clock.lost);
+  if (depth_clock.late)
+    printf("\nlate frame\n");
   for (i=0; i<FREENECT_FRAME_PIX; i++) {
     int pval = t_gamma[depth[i]];
     int lb = pval & 0xff;
@@ -286,28 +330,53 @@ void depth_cb(freenect_device *dev, void *v_depth, uint32_t timestamp)
   pthread_cond_signal(&gl_frame_cond);
   pthread_mutex_unlock(&gl_backbuf_mutex);
 }
-void unproject(unsigned short* depth, float* x, float* y, float* z) {
-  int u,v;
-  const float f = 500.0f;
-  const float u0 = 320.0f;
-  const float v0 = 240.0f;
-  float zCurrent;
-
-  // TODO calibration
-
-  for (int i=0; i<640*480; i++) {
-    u = i % 640;
-    v = i / 640;
-    zCurrent = 1.0f / (-0.00307110156374373f * depth[i] + 3.33094951605675f);
-    if (z != NULL) {
-      z[i] = zCurrent;
-    }
-    if (x != NULL) {
-      x[i] = (u - u0) * zCurrent / f;
+// Raw depth to z table, and the raw depths of the hand band
+void initUnproject() {
+  hand_raw_min = 2048;
+  hand_raw_max = 0;
+  for (int i=0; i<2048; i++) {
+    float d = -0.00307110156374373f * i + 3.33094951605675f;
+    z_lut[i] = d > 0 && i < 2047 ? 1.0f / d : 0.0f; // 2047: no depth
+    if (z_lut[i] > zMin && z_lut[i] < zMax) {
+      if (i < hand_raw_min) hand_raw_min = i;
+      hand_raw_max = i;
     }
-    if (y != NULL) {
-      y[i] = (v - v0) * zCurrent / f;
+  }
+}
+
+// Bounding box of the pixels between zMin and zMax, on the raw depth: no unprojection needed
+cv::Rect findHandRoi(const uint16_t* depth) {
+  int u0 = 640, u1 = -1, v0 = 480, v1 = -1;
+
+  for (int v=0; v<480; v++) {
+    const uint16_t* row = depth + v*640;
+    int first = -1, last = -1;
+    for (int u=0; u<640; u++) {
+      if (row[u] >= hand_raw_min && row[u] <= hand_raw_max) {
+	if (first < 0) first = u;
+	last = u;
+      }
     }
+    if (first < 0)
+      continue;
+    if (v0 == 480) v0 = v;
+    v1 = v;
+    if (first < u0) u0 = first;
+    if (last > u1) u1 = last;
+  }
+  if (v1 < 0)
+    return cv::Rect();
+  return cv::Rect(cv::Point(std::max(u0 - HAND_MARGIN, 0), std::max(v0 - HAND_MARGIN, 0)),
+		  cv::Point(std::min(u1 + HAND_MARGIN + 1, 640), std::min(v1 + HAND_MARGIN + 1, 480)));
+}
+
+// z in m of the pixels in roi: a table lookup per pixel
+void unproject(const uint16_t* depth, cv::Rect roi, float* z) {
+  for (int v=roi.y; v<roi.y+roi.height; v++) {
+    const uint16_t* d = depth + v*640;
+    float* zr = z + v*640;
+    for (int u=roi.x; u<roi.x+roi.width; u++)
+      zr[u] = z_lut[d[u]];
   }
 }
 
@@ -323,40 +392,34 @@ void rgb_cb(freenect_device *dev, void *rgb, uint32_t timestamp)
 void printUsage() {
   printf("\n=====Kinect Mouse=====\n\n"
 	 "Synopsis:\n"
-	 "\tkmouse [sensitivity (1-32767)]\n"
+	 "\tkmouse [sensitivity (1-32767)] [dwell|push|both (click mode)]\n"
 	 "'W'-Tilt Up\n'S'-Level\n'X'-Tilt Down\n'0'-'6'-LED Mode\n");
 }
 
 void *freenect_threadfunc(void *arg) {
   printf("freenect_thread started!\n");
-  freenect_set_tilt_degs(f_dev,freenect_angle);
-  freenect_set_led(f_dev,LED_GREEN);
+  kinect_motor_start(&motor, f_dev, TILT_POLL_HZ);
+  kinect_motor_set_tilt(&motor,freenect_angle);
+  kinect_motor_set_led(&motor,LED_GREEN);
   freenect_set_depth_callback(f_dev, depth_cb);
   freenect_set_video_callback(f_dev, rgb_cb);
   freenect_set_video_format(f_dev, FREENECT_VIDEO_RGB);
   freenect_set_depth_format(f_dev, FREENECT_DEPTH_11BIT);
   freenect_start_depth(f_dev);
   freenect_start_video(f_dev);
-  
-  win1= cvCreateImage(cvSize(640,480), 8, 3 );
-  
-  while ( (key = cvWaitKey(500)) != 27) { //while escape key is not pressed	
-  	printf("%d\n",key);
-    freenect_raw_tilt_state* state;
-    freenect_update_tilt_state(f_dev);
-    state = freenect_get_tilt_state(f_dev);;
-    double dx,dy,dz;
-    freenect_get_mks_accel(state, &dx, &dy, &dz);
-	//Ready to pass gl_deapth_back to openCV processing. 1st convert matrix
-  fingerTips = detectFingertips();
-    //printf("\r raw acceleration: %4d %4d %4d  mks acceleration: %4f %4f %4f\r", ax, ay, az, dx, dy, dz);
-    fflush(stdout);
-	cvShowImage( "Kmouse", win1);
-  }
+
+  // The frames are analysed by the loop in main, this thread only pumps the usb events
+  while (!die && freenect_process_events(f_ctx) >= 0)
+    ;
+  pthread_mutex_lock(&gl_backbuf_mutex);
+  die = 1; // the stream ended: stop the analysis loop too
+  pthread_cond_signal(&gl_frame_cond);
+  pthread_mutex_unlock(&gl_backbuf_mutex);
   printf("\nShutting Down Streams...\n");
 
   freenect_stop_depth(f_dev);
   freenect_stop_video(f_dev);
+  kinect_motor_stop(&motor);
 
   freenect_close_device(f_dev);
   freenect_shutdown(f_ctx);
@@ -372,11 +435,22 @@ int main(int argc, char **argv) {
 
   //Initializing Mouse Stuff
   printUsage();
-  if (argc == 2) {
+  if (argc >= 2) {
     snstvty = atoi(argv[1]);
   } else {
     snstvty = 20000;
   }
+  if (argc >= 3) {
+    if (!strcmp(argv[2], "push")) click_mode = CLICK_PUSH;
+    else if (!strcmp(argv[2], "both")) click_mode = CLICK_DWELL | CLICK_PUSH;
+  }
+  kinect_push_init(&push, NULL);
+  kinect_clock_init(&depth_clock);
+  initUnproject();
+  if (kinect_rle_init(&hand_rle, 640, 480) < 0) {
+    printf("Out of memory\n");
+    return 1;
+  }
 
   //mousemask(ALL_MOUSE_EVENTS, NULL); //What does this do? Where is it?
 
@@ -407,9 +481,6 @@ int main(int argc, char **argv) {
 
   bool debug = true;
 
-  float zMin = 0.0f;
-  float zMax = 0.75f;
-
   if (freenect_init(&f_ctx, NULL)!=0) {
     printf("freenect_init() failed - %d\n",freenect_init(&f_ctx, NULL));
     return 1;
@@ -434,6 +505,40 @@ int main(int argc, char **argv) {
     printf("Could Not Create Thread\n");
     return 1;
   }
+
+  // Analysis loop: every depth frame, the latest one when the analysis falls behind
+  cvNamedWindow("Kmouse");
+  while (!die) {
+    pthread_mutex_lock(&gl_backbuf_mutex);
+    while (!depth_frames && !die)
+      pthread_cond_wait(&gl_frame_cond, &gl_backbuf_mutex);
+    if (die) {
+      pthread_mutex_unlock(&gl_backbuf_mutex);
+      break;
+    }
+    frames_skipped += depth_frames - 1;
+    depth_frames = 0;
+    memcpy(depth_front, depth_back, sizeof(depth_front));
+    frame_clock = depth_clock;
+    pthread_mutex_unlock(&gl_backbuf_mutex);
+
+    handRoi = findHandRoi(depth_front);
+    unproject(depth_front, handRoi, (float*)z.data);
+    fingerTips = detectFingertips();
+    // the topmost fingertip drives the pointer
+    if (fingerTips.size()) {
+      Point2i tip = fingerTips[0];
+      for (size_t i=1; i<fingerTips.size(); i++)
+	if (fingerTips[i].y < tip.y) tip = fingerTips[i];
+      mouse(tip.x, tip.y);
+    }
+    fflush(stdout);
+    if (debug)
+      imshow("Kmouse", debugFrame);
+    if ((key = cvWaitKey(1)) == 27) //escape key pressed
+      die = 1;
+  }
+  printf("\n%ld frames not analysed\n", frames_skipped);
   pthread_join(freenect_thread,NULL);
 /* 
     std::vector<cv::Point2i> fingerTips;
@@ -0,0 +1,245 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "kinect_bg.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define FIX 8                      // Fraction bits of mean and var
+#define MAX_DIFF (50 << FIX)       // Larger moves count as this much in the variance (its square fits 32 bits)
+
+void kinect_bg_default_config(kinect_bg_config *cfg)
+{
+	cfg->train_frames = 30;
+	cfg->learn_shift = 6;
+	cfg->absorb_frames = 300;
+	cfg->reveal_frames = 15;
+	cfg->touch_min_mm = 10;
+	cfg->touch_band_mm = 10;
+	cfg->noise_k = 3;
+}
+
+int kinect_bg_init(kinect_bg *b, int w, int h, const kinect_bg_config *cfg)
+{
+	int i;
+
+	memset(b, 0, sizeof(*b));
+	if (cfg)
+		b->cfg = *cfg;
+	else
+		kinect_bg_default_config(&b->cfg);
+	b->w = w;
+	b->h = h;
+	b->mean = calloc(w * h, sizeof(*b->mean));
+	b->var = calloc(w * h, sizeof(*b->var));
+	b->count = calloc(w * h, sizeof(*b->count));
+	b->off = calloc(w * h, sizeof(*b->off));
+	b->near = malloc(w * h * sizeof(*b->near));
+	b->far = calloc(w * h, sizeof(*b->far));
+	if (!b->mean || !b->var || !b->count || !b->off || !b->near || !b->far) {
+		kinect_bg_free(b);
+		return -1;
+	}
+	for (i = 0; i < w * h; i++)
+		b->near[i] = 0xffff;
+	kinect_bg_set_roi(b, 0, 0, w, h);
+	return 0;
+}
+
+void kinect_bg_free(kinect_bg *b)
+{
+	free(b->mean);
+	free(b->var);
+	free(b->count);
+	free(b->off);
+	free(b->near);
+	free(b->far);
+	b->mean = b->var = NULL;
+	b->count = b->near = b->far = NULL;
+	b->off = NULL;
+}
+
+void kinect_bg_set_roi(kinect_bg *b, int x, int y, int w, int h)
+{
+	b->x0 = x < 0 ? 0 : x > b->w ? b->w : x;
+	b->y0 = y < 0 ? 0 : y > b->h ? b->h : y;
+	b->x1 = x + w > b->w ? b->w : x + w < b->x0 ? b->x0 : x + w;
+	b->y1 = y + h > b->h ? b->h : y + h < b->y0 ? b->y0 : y + h;
+}
+
+double kinect_bg_depth(const kinect_bg *b, int x, int y)
+{
+	return b->count[y * b->w + x] ? b->mean[y * b->w + x] / (double)(1 << FIX) : 0;
+}
+
+// The rows above and below the ROI and the columns left and right of it are no touch
+static void clear_outside(const kinect_bg *b, uint8_t *mask)
+{
+	int y;
+
+	memset(mask, 0, b->y0 * b->w);
+	for (y = b->y0; y < b->y1; y++) {
+		memset(mask + y * b->w, 0, b->x0);
+		memset(mask + y * b->w + b->x1, 0, b->w - b->x1);
+	}
+	memset(mask + b->y1 * b->w, 0, (b->h - b->y1) * b->w);
+}
+
+int kinect_bg_touch_ref(const kinect_bg *b, const uint16_t *depth, uint8_t *mask)
+{
+	int x, y, touches = 0;
+
+	clear_outside(b, mask);
+	for (y = b->y0; y < b->y1; y++)
+		for (x = b->x0; x < b->x1; x++) {
+			int i = y * b->w + x;
+			int touch = depth[i] >= b->near[i] && depth[i] <= b->far[i];
+			mask[i] = touch ? 255 : 0;
+			touches += touch;
+		}
+	return touches;
+}
+
+int kinect_bg_touch(const kinect_bg *b, const uint16_t *depth, uint8_t *mask)
+{
+	int x, y, touches = 0;
+
+	clear_outside(b, mask);
+	for (y = b->y0; y < b->y1; y++) {
+		const uint16_t *d = depth + y * b->w, *lo = b->near + y * b->w, *hi = b->far + y * b->w;
+		uint8_t *m = mask + y * b->w;
+		x = b->x0;
+#if defined(__SSE2__)
+		{
+			// SSE2 has no unsigned 16 bit compare: a - b saturates to 0 exactly when a <= b
+			const __m128i zero = _mm_setzero_si128();
+			__m128i count = _mm_setzero_si128();
+			for (; x + 16 <= b->x1; x += 16) {
+				__m128i d0 = _mm_loadu_si128((const __m128i*)(d + x));
+				__m128i d1 = _mm_loadu_si128((const __m128i*)(d + x + 8));
+				__m128i t0 = _mm_and_si128(
+					_mm_cmpeq_epi16(_mm_subs_epu16(_mm_loadu_si128((const __m128i*)(lo + x)), d0), zero),
+					_mm_cmpeq_epi16(_mm_subs_epu16(d0, _mm_loadu_si128((const __m128i*)(hi + x))), zero));
+				__m128i t1 = _mm_and_si128(
+					_mm_cmpeq_epi16(_mm_subs_epu16(_mm_loadu_si128((const __m128i*)(lo + x + 8)), d1), zero),
+					_mm_cmpeq_epi16(_mm_subs_epu16(d1, _mm_loadu_si128((const __m128i*)(hi + x + 8))), zero));
+				__m128i t = _mm_packs_epi16(t0, t1); // 0 or -1 per pixel
+				_mm_storeu_si128((__m128i*)(m + x), t);
+				count = _mm_sub_epi8(count, t);
+				if ((x - b->x0) % (16 * 255) == 16 * 254) { // before a byte can wrap
+					__m128i s = _mm_sad_epu8(count, zero);
+					touches += _mm_cvtsi128_si32(s) + _mm_cvtsi128_si32(_mm_srli_si128(s, 8));
+					count = zero;
+				}
+			}
+			{
+				__m128i s = _mm_sad_epu8(count, zero);
+				touches += _mm_cvtsi128_si32(s) + _mm_cvtsi128_si32(_mm_srli_si128(s, 8));
+			}
+		}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+		for (; x + 16 <= b->x1; x += 16) {
+			uint16x8_t d0 = vld1q_u16(d + x), d1 = vld1q_u16(d + x + 8);
+			uint16x8_t t0 = vandq_u16(vcgeq_u16(d0, vld1q_u16(lo + x)), vcleq_u16(d0, vld1q_u16(hi + x)));
+			uint16x8_t t1 = vandq_u16(vcgeq_u16(d1, vld1q_u16(lo + x + 8)), vcleq_u16(d1, vld1q_u16(hi + x + 8)));
+			uint8x16_t t = vcombine_u8(vmovn_u16(t0), vmovn_u16(t1));
+			vst1q_u8(m + x, t);
+			touches += vaddvq_u8(vshrq_n_u8(t, 7)); // 16 at most, no wrap
+		}
+#endif
+		for (; x < b->x1; x++) {
+			int touch = d[x] >= lo[x] && d[x] <= hi[x];
+			m[x] = touch ? 255 : 0;
+			touches += touch;
+		}
+	}
+	return touches;
+}
+
+// The touch band of a pixel from its mean and variance, all in 24.8 fixed point
+static void band(kinect_bg *b, int i, float k, int32_t lo_min, int32_t width)
+{
+	// sqrt(var) is the standard deviation in 28.4 fixed point
+	int32_t lo = (int32_t)(k * sqrtf((float)b->var[i])) << (FIX - FIX / 2);
+	int32_t near, far;
+
+	if (lo < lo_min)
+		lo = lo_min;
+	near = (b->mean[i] - lo - width + (1 << FIX) - 1) >> FIX;
+	far = (b->mean[i] - lo) >> FIX;
+	if (near < 1)
+		near = 1; // never a missing depth
+	if (far < near) {
+		b->near[i] = 0xffff;
+		b->far[i] = 0;
+	} else {
+		b->near[i] = near;
+		b->far[i] = far;
+	}
+}
+
+void kinect_bg_update(kinect_bg *b, const uint16_t *depth, const uint8_t *mask)
+{
+	const int train = b->cfg.train_frames > 0 ? b->cfg.train_frames : 1;
+	const float k = (float)b->cfg.noise_k;
+	const int32_t lo_min = (int32_t)(b->cfg.touch_min_mm * (1 << FIX));
+	const int32_t width = (int32_t)(b->cfg.touch_band_mm * (1 << FIX));
+	int x, y;
+
+	for (y = b->y0; y < b->y1; y++)
+		for (x = b->x0; x < b->x1; x++) {
+			int i = y * b->w + x;
+			int32_t diff, d2, sq, reach;
+
+			if (!depth[i] || (mask && mask[i]))
+				continue;
+			diff = ((int32_t)depth[i] << FIX) - b->mean[i];
+			reach = b->mean[i] - ((int32_t)b->near[i] << FIX); // front of the touch band
+			if (b->count[i] >= train && (diff < -reach || diff > reach)) {
+				// something on or over the surface, or the surface behind something taken away
+				if (diff < 0)
+					b->off[i] = b->off[i] <= 0 ? 1 : b->off[i] < INT16_MAX ? b->off[i] + 1 : INT16_MAX;
+				else
+					b->off[i] = b->off[i] >= 0 ? -1 : b->off[i] > -INT16_MAX ? b->off[i] - 1 : -INT16_MAX;
+				if (b->off[i] >= b->cfg.absorb_frames || -b->off[i] >= b->cfg.reveal_frames) {
+					b->count[i] = 0;
+					b->off[i] = 0;
+					b->near[i] = 0xffff;
+					b->far[i] = 0;
+				}
+				continue;
+			}
+			b->off[i] = 0;
+			if (b->count[i] < train) {
+				// average of the first depths
+				int n = ++b->count[i];
+				b->mean[i] += diff / n;
+				d2 = diff > MAX_DIFF ? MAX_DIFF : diff < -MAX_DIFF ? -MAX_DIFF : diff;
+				sq = (d2 * d2) >> FIX;
+				b->var[i] += (sq / n * (n - 1) - b->var[i]) / n;
+				if (n < train)
+					continue;
+			} else {
+				int shift = b->cfg.learn_shift;
+				b->mean[i] += (diff + (1 << (shift - 1))) >> shift;
+				d2 = diff > MAX_DIFF ? MAX_DIFF : diff < -MAX_DIFF ? -MAX_DIFF : diff;
+				sq = (d2 * d2) >> FIX;
+				b->var[i] += (sq - b->var[i] + (1 << (shift - 1))) >> shift;
+			}
+			band(b, i, k, lo_min, width);
+		}
+	b->frames++;
+}
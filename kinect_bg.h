@@ -0,0 +1,89 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+ /* Background model of a touch surface
+ A finger touching the surface is a few mm nearer to the sensor than the
+ surface itself. Each pixel of the surface keeps a running mean and variance
+ of its depth, in integers (mm in 24.8 fixed point), and a touch is a depth
+ in a band just in front of the mean: from the larger of touch_min_mm and
+ noise_k standard deviations, touch_band_mm deep. Noisy pixels (far away,
+ at an edge) get a band further out, steady ones keep the thin band.
+
+ The first train_frames valid depths of a pixel are averaged, then the model
+ follows the depths around the mean slowly (weight 1/2^learn_shift), so the
+ sensor warming up does not drift into touches. Touch pixels are not learnt,
+ nor are depths in front of the touch band (a hand over the surface) or as far
+ behind the mean: they would sweep the touch band across the pixel. Instead a
+ pixel that stays in front for absorb_frames in a row (an object left on the
+ surface), or behind for reveal_frames (an object taken away), trains again
+ from its current depth.
+
+ Everything works on the surface ROI only. The touch band of each pixel is
+ kept as the two depths it lies between, so the touch mask of a frame is two
+ compares per pixel, 16 pixels at a time with SSE2 or NEON (AArch64).
+
+ Depths are uint16 mm, 0 for no reading (OpenNI depth maps).
+ */
+
+#ifndef KINECT_BG_H
+#define KINECT_BG_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	int train_frames;      // Valid depths averaged before a pixel can detect touches (default 30)
+	int learn_shift;       // From 1: weight 1/2^learn_shift of a depth around the mean (default 6, about 2 s at 30 fps)
+	int absorb_frames;     // Frames in a row in front of the touch band before a pixel trains again (default 300)
+	int reveal_frames;     // Frames in a row behind the mean before a pixel trains again (default 15)
+	double touch_min_mm;   // Nearest a touch starts in front of the mean (default 10)
+	double touch_band_mm;  // Depth of the touch band (default 10)
+	double noise_k;        // The band starts at least this many standard deviations in front (default 3)
+} kinect_bg_config;
+
+typedef struct {
+	kinect_bg_config cfg;
+	int w, h;
+	int x0, y0, x1, y1;    // ROI, x1 and y1 excluded
+	int32_t *mean;         // Per pixel, mm in 24.8 fixed point
+	int32_t *var;          // mm^2 in 24.8 fixed point
+	uint16_t *count;       // Valid depths learnt, up to train_frames
+	int16_t *off;          // Frames in a row in front of the touch band (> 0) or behind the mean (< 0)
+	uint16_t *near, *far;  // A touch when near <= depth <= far (near > far until trained)
+	long frames;
+} kinect_bg;
+
+// Returns -1 when out of memory; cfg NULL uses the defaults. The ROI is the whole frame
+int kinect_bg_init(kinect_bg *b, int w, int h, const kinect_bg_config *cfg);
+void kinect_bg_free(kinect_bg *b);
+void kinect_bg_default_config(kinect_bg_config *cfg);
+
+// Clipped to the frame. Pixels that enter the ROI train from their next depths on
+void kinect_bg_set_roi(kinect_bg *b, int x, int y, int w, int h);
+
+// Touch mask of a w x h depth frame: 255 for touch pixels, 0 elsewhere (outside the ROI too).
+// Returns the number of touch pixels
+int kinect_bg_touch(const kinect_bg *b, const uint16_t *depth, uint8_t *mask);
+
+// The same, one pixel at a time: the reference of the vectorized version
+int kinect_bg_touch_ref(const kinect_bg *b, const uint16_t *depth, uint8_t *mask);
+
+// Learn the depth frame, except its touch pixels (mask 255, mask NULL for none)
+void kinect_bg_update(kinect_bg *b, const uint16_t *depth, const uint8_t *mask);
+
+// Background depth of a pixel in mm, 0 if it has not seen a valid depth
+double kinect_bg_depth(const kinect_bg *b, int x, int y);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KINECT_BG_H
@@ -0,0 +1,212 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+ /* Background model against the fixed background of kinect_touch.cpp
+ A 640x480 depth stream of a tilted table 1 to 1.3 m away, its noise growing
+ from 1 mm to 4 mm with the distance, 2% of the pixels without a depth. Over
+ FRAMES frames (default 3000, 100 s at 30 fps) the whole table drifts 12 mm
+ towards the sensor, as it does while the Kinect warms up. Five fingertips
+ touch the table 16 mm in front of it, a hand hovers 150 mm above it in one
+ frame of three, a book 30 mm thick is put down at a third of the run and
+ taken away at two thirds.
+
+ The touch mask of the ROI of kinect_touch.cpp comes from kinect_bg and from
+ the fixed background: the mean of the first 30 frames, touch between 10 and
+ 20 mm in front of it, each frame a full frame difference and two full frame
+ thresholds, as the Mat expressions did. For both it reports the touch pixels
+ that are not on a finger and the finger pixels missed, per frame, and the
+ time per frame. The vectorized mask of kinect_bg is checked against its
+ scalar version on every frame.
+
+   bg_bench.out [FRAMES [SEED]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "kinect_bg.h"
+
+#define W 640
+#define H 480
+#define ROI_X 110
+#define ROI_Y 120
+#define ROI_W 450
+#define ROI_H 200
+#define TRAIN 30
+#define NOISE 65536
+#define FINGERS 5
+#define FINGER_R 6
+#define FINGER_MM 16
+
+static unsigned seed;
+
+static unsigned next(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static double uniform(double a, double b)
+{
+	return a + (b - a) * (next() & 0xffffff) / 16777216.0;
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static double noise[NOISE]; // Standard normal
+
+static void make_noise(void)
+{
+	int i;
+	for (i = 0; i < NOISE; i++) {
+		double u = uniform(1e-9, 1), v = uniform(0, 1);
+		noise[i] = sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+	}
+}
+
+static double table(int x, int y, int f, int frames)
+{
+	return 1000 + 0.6 * y + 0.05 * x - 12.0 * f / frames;
+}
+
+// Depth frame f; finger[i] set to 1 on the pixels a finger touches
+static void scene(uint16_t *depth, uint8_t *finger, int f, int frames, const double *fx, const double *fy)
+{
+	int x, y, k;
+	int hover = f % 3 == 0, book = f >= frames / 3 && f < 2 * frames / 3;
+
+	for (y = 0; y < H; y++)
+		for (x = 0; x < W; x++) {
+			int i = y * W + x;
+			double d = table(x, y, f, frames), sigma = 1 + 3.0 * y / H;
+			finger[i] = 0;
+			if (book && x >= 300 && x < 420 && y >= 160 && y < 260)
+				d -= 30;
+			for (k = 0; k < FINGERS; k++)
+				if ((x - fx[k]) * (x - fx[k]) + (y - fy[k]) * (y - fy[k]) <= FINGER_R * FINGER_R) {
+					d -= FINGER_MM;
+					finger[i] = 1;
+				}
+			if (hover && (x - 480) * (x - 480) / 3600.0 + (y - 260) * (y - 260) / 1600.0 <= 1)
+				d -= 150;
+			d += sigma * noise[next() % NOISE];
+			depth[i] = next() % 50 == 0 ? 0 : (uint16_t)(d + 0.5);
+		}
+}
+
+typedef struct {
+	long false_pixels, missed_pixels;
+	double us;
+} score;
+
+static void count(score *s, const uint8_t *mask, const uint8_t *finger)
+{
+	int x, y;
+	for (y = ROI_Y; y < ROI_Y + ROI_H; y++)
+		for (x = ROI_X; x < ROI_X + ROI_W; x++) {
+			int i = y * W + x;
+			if (mask[i] && !finger[i])
+				s->false_pixels++;
+			else if (!mask[i] && finger[i])
+				s->missed_pixels++;
+		}
+}
+
+int main(int argc, char **argv)
+{
+	int frames = argc > 1 ? atoi(argv[1]) : 3000;
+	uint16_t *depth = malloc(W * H * sizeof(*depth));
+	int16_t *foreground = malloc(W * H * sizeof(*foreground));
+	uint8_t *finger = malloc(W * H), *mask = malloc(W * H), *ref = malloc(W * H);
+	uint8_t *above = malloc(W * H), *below = malloc(W * H), *fixed = malloc(W * H);
+	double *sum = calloc(W * H, sizeof(*sum)), fx[FINGERS], fy[FINGERS];
+	uint16_t *background = malloc(W * H * sizeof(*background));
+	score adaptive = {0, 0, 0}, old = {0, 0, 0};
+	double ref_us = 0, update_us = 0, t0;
+	long mismatches = 0, finger_pixels = 0;
+	kinect_bg bg;
+	int f, i, k;
+
+	seed = argc > 2 ? atoi(argv[2]) : 1;
+	if (frames <= TRAIN || !depth || !foreground || !finger || !mask || !ref || !above || !below || !fixed ||
+	    !sum || !background || kinect_bg_init(&bg, W, H, NULL) < 0) {
+		fprintf(stderr, "usage: %s [FRAMES>%d [SEED]]\n", argv[0], TRAIN);
+		return 2;
+	}
+	make_noise();
+	kinect_bg_set_roi(&bg, ROI_X, ROI_Y, ROI_W, ROI_H);
+
+	for (f = 0; f < frames; f++) {
+		// fingers touch after the training, in the ROI and off the book
+		for (k = 0; k < FINGERS; k++) {
+			double a = 2 * M_PI * (k / (double)FINGERS + f / 400.0);
+			fx[k] = f < TRAIN ? -100 : 160 + 60 * k + 20 * cos(a);
+			fy[k] = f < TRAIN ? -100 : 140 + 5 * k + 10 * sin(a);
+		}
+		scene(depth, finger, f, frames, fx, fy);
+
+		if (f < TRAIN) {
+			for (i = 0; i < W * H; i++)
+				sum[i] += depth[i];
+			if (f == TRAIN - 1)
+				for (i = 0; i < W * H; i++)
+					background[i] = (uint16_t)(sum[i] / TRAIN);
+			kinect_bg_update(&bg, depth, NULL);
+			continue;
+		}
+
+		// the fixed background: foreground = background - depth, (foreground > 10) & (foreground < 20), then the ROI
+		t0 = now_us();
+		for (i = 0; i < W * H; i++) {
+			int d = background[i] - depth[i];
+			foreground[i] = d < -32768 ? -32768 : d > 32767 ? 32767 : d;
+		}
+		for (i = 0; i < W * H; i++)
+			above[i] = foreground[i] > 10 ? 255 : 0;
+		for (i = 0; i < W * H; i++)
+			below[i] = foreground[i] < 20 ? 255 : 0;
+		for (i = 0; i < W * H; i++)
+			fixed[i] = above[i] & below[i];
+		old.us += now_us() - t0;
+		count(&old, fixed, finger);
+
+		t0 = now_us();
+		kinect_bg_touch(&bg, depth, mask);
+		adaptive.us += now_us() - t0;
+		t0 = now_us();
+		kinect_bg_touch_ref(&bg, depth, ref);
+		ref_us += now_us() - t0;
+		t0 = now_us();
+		kinect_bg_update(&bg, depth, mask);
+		update_us += now_us() - t0;
+		if (memcmp(mask, ref, W * H))
+			mismatches++;
+		count(&adaptive, mask, finger);
+		for (i = 0; i < W * H; i++)
+			finger_pixels += finger[i];
+	}
+
+	frames -= TRAIN;
+	printf("%d frames, ROI %dx%d, %.0f finger pixels/frame\n", frames, ROI_W, ROI_H, (double)finger_pixels / frames);
+	printf("fixed:     %8.1f false, %6.1f missed touch pixels/frame, %6.1f us/frame\n",
+	       (double)old.false_pixels / frames, (double)old.missed_pixels / frames, old.us / frames);
+	printf("kinect_bg: %8.1f false, %6.1f missed touch pixels/frame, %6.1f us/frame (scalar %.1f), update %.1f us\n",
+	       (double)adaptive.false_pixels / frames, (double)adaptive.missed_pixels / frames, adaptive.us / frames,
+	       ref_us / frames, update_us / frames);
+	printf("vectorized mask differs from the scalar one in %ld frames\n", mismatches);
+	kinect_bg_free(&bg);
+	return mismatches ? 1 : 0;
+}
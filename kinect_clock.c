@@ -0,0 +1,57 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+#include <string.h>
+
+#include "kinect_clock.h"
+
+#define DELAY_DRIFT_MS 0.01 // Creep of delay_min per frame, follows a 300 ppm drift between the clocks
+
+void kinect_clock_init(kinect_clock *c)
+{
+	double late_ms = c->late_ms;
+	memset(c, 0, sizeof(*c));
+	c->late_ms = late_ms;
+	c->index = -1;
+}
+
+double kinect_clock_frame_ms(const kinect_clock *c)
+{
+	return c->step ? c->step * 1000.0 / KINECT_TIMESTAMP_HZ : KINECT_FRAME_MS;
+}
+
+int kinect_clock_update(kinect_clock *c, uint32_t timestamp, double host_ms)
+{
+	double delay, late_ms;
+
+	c->lost = 0;
+	if (c->index >= 0) {
+		uint32_t step = timestamp - c->timestamp; // unsigned difference survives the wrap
+		if (step && (!c->step || step < c->step))
+			c->step = step;
+		if (c->step && step > c->step + c->step/2)
+			c->lost = (step + c->step/2) / c->step - 1;
+		c->index += 1 + c->lost;
+		c->ms += step * 1000.0 / KINECT_TIMESTAMP_HZ;
+		c->lost_total += c->lost;
+	} else {
+		c->index = 0;
+	}
+	c->timestamp = timestamp;
+
+	delay = host_ms - c->ms;
+	if (c->index == 0 || delay < c->delay_min)
+		c->delay_min = delay;
+	else
+		c->delay_min += DELAY_DRIFT_MS;
+	late_ms = c->late_ms > 0 ? c->late_ms : 2 * kinect_clock_frame_ms(c);
+	c->late = delay - c->delay_min > late_ms;
+	if (c->late)
+		c->late_total++;
+	return c->lost;
+}
@@ -0,0 +1,60 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+ /* Frame clock
+ Gesture timing runs on the timestamps libfreenect passes to the frame
+ callbacks, not on frame counts, so dwell, debounce and stroke durations stay
+ the same when frames are dropped, shed under load or the sensor runs at
+ another rate.
+
+ The timestamps tick at 60 MHz and wrap every 71 s. The clock turns them into
+ a monotonic time in ms. The smallest gap seen is taken as the nominal frame
+ interval: a larger gap means frames were lost on the way. A frame is late
+ when it reaches the host late_ms later than the earliest frames did, compared
+ to its timestamp: it waited in the USB buffers or behind a slow frame.
+ */
+
+#ifndef KINECT_CLOCK_H
+#define KINECT_CLOCK_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KINECT_TIMESTAMP_HZ 60000000.0 // Clock of the libfreenect frame timestamps
+#define KINECT_FRAME_MS (1000.0 / 30)  // Nominal frame interval, until the timestamps tell
+
+typedef struct {
+	double late_ms;        // Arrival delay that makes a frame late, 0 = two frame intervals (default)
+
+	uint32_t timestamp;    // Timestamp of the current frame
+	uint32_t step;         // Nominal frame interval in timestamp ticks, 0 until two frames were seen
+	long index;            // Index of the current frame, lost frames included (-1 before the first)
+	double ms;             // Time of the current frame in ms, 0 at the first frame
+	double delay_min;      // Smallest arrival delay seen, host ms - frame ms, drifting up slowly
+	int lost;              // Frames lost just before the current one
+	int late;              // The current frame arrived late
+	unsigned long lost_total, late_total;
+} kinect_clock;
+
+void kinect_clock_init(kinect_clock *c);
+
+// Account a frame: its libfreenect timestamp and the host time in ms it reached the callback.
+// Returns the number of frames lost since the previous one
+int kinect_clock_update(kinect_clock *c, uint32_t timestamp, double host_ms);
+
+// Nominal frame interval in ms
+double kinect_clock_frame_ms(const kinect_clock *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KINECT_CLOCK_H
@@ -0,0 +1,783 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "kinect_gesture.h"
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#define MAX(a,b) (((a)>(b))?(a):(b))
+
+#define FRAME_W KINECT_GESTURE_FRAME_W
+#define FRAME_H KINECT_GESTURE_FRAME_H
+#define ROI_MARGIN 48	// pixels around the near pixels of the previous frame scanned at load level roi
+
+const char *kinect_gesture_status_names[KINECT_GESTURE_STATUSES] = { "toofar", "somepixels", "tooclose", "inrange" };
+
+static uint16_t t_gamma[2048]; // depth to gamma, the scale of near_threshold and far_threshold
+
+//Median Calculation Functions
+
+//Customize for your data Item type
+typedef int Item;
+#define ItemLess(a,b)  ((a)<(b))
+#define ItemMean(a,b)  (((a)+(b))/2)
+
+typedef struct kinect_gesture_median
+{
+   Item* data;  //circular queue of values
+   int*  pos;   //index into `heap` for each value
+   int*  heap;  //max/median/min heap holding indexes into `data`.
+   int   N;     //allocated size.
+   int   idx;   //position in circular queue
+   int   ct;    //count of items in queue
+} Mediator;
+
+/*--- Helper Functions ---*/
+
+#define minCt(m) (((m)->ct-1)/2) //count of items in minheap
+#define maxCt(m) (((m)->ct)/2)   //count of items in maxheap
+
+//returns 1 if heap[i] < heap[j]
+static int mmless(Mediator* m, int i, int j)
+{
+   return ItemLess(m->data[m->heap[i]],m->data[m->heap[j]]);
+}
+
+//swaps items i&j in heap, maintains indexes
+static int mmexchange(Mediator* m, int i, int j)
+{
+   int t = m->heap[i];
+   m->heap[i]=m->heap[j];
+   m->heap[j]=t;
+   m->pos[m->heap[i]]=i;
+   m->pos[m->heap[j]]=j;
+   return 1;
+}
+
+//swaps items i&j if i<j;  returns true if swapped
+static int mmCmpExch(Mediator* m, int i, int j)
+{
+   return (mmless(m,i,j) && mmexchange(m,i,j));
+}
+
+//maintains minheap property for all items below i/2.
+static void minSortDown(Mediator* m, int i)
+{
+   for (; i <= minCt(m); i*=2)
+   {  if (i>1 && i < minCt(m) && mmless(m, i+1, i)) { ++i; }
+      if (!mmCmpExch(m,i,i/2)) { break; }
+   }
+}
+
+//maintains maxheap property for all items below i/2. (negative indexes)
+static void maxSortDown(Mediator* m, int i)
+{
+   for (; i >= -maxCt(m); i*=2)
+   {  if (i<-1 && i > -maxCt(m) && mmless(m, i, i-1)) { --i; }
+      if (!mmCmpExch(m,i/2,i)) { break; }
+   }
+}
+
+//maintains minheap property for all items above i, including median
+//returns true if median changed
+static int minSortUp(Mediator* m, int i)
+{
+   while (i>0 && mmCmpExch(m,i,i/2)) i/=2;
+   return (i==0);
+}
+
+//maintains maxheap property for all items above i, including median
+//returns true if median changed
+static int maxSortUp(Mediator* m, int i)
+{
+   while (i<0 && mmCmpExch(m,i/2,i))  i/=2;
+   return (i==0);
+}
+
+//creates new Mediator: to calculate `nItems` running median.
+//mallocs single block of memory, caller must free.
+static Mediator* MediatorNew(int nItems)
+{
+   int size = sizeof(Mediator)+nItems*(sizeof(Item)+sizeof(int)*2);
+   Mediator* m=  malloc(size);
+   if (!m)
+      return NULL;
+   m->data= (Item*)(m+1);
+   m->pos = (int*) (m->data+nItems);
+   m->heap = m->pos+nItems + (nItems/2); //points to middle of storage.
+   m->N=nItems;
+   m->ct = m->idx = 0;
+   while (nItems--)  //set up initial heap fill pattern: median,max,min,max,...
+   {  m->pos[nItems]= ((nItems+1)/2) * ((nItems&1)?-1:1);
+      m->heap[m->pos[nItems]]=nItems;
+   }
+   return m;
+}
+
+//Inserts item, maintains median in O(lg nItems)
+static void MediatorInsert(Mediator* m, Item v)
+{
+   int isNew=(m->ct<m->N);
+   int p = m->pos[m->idx];
+   Item old = m->data[m->idx];
+   m->data[m->idx]=v;
+   m->idx = (m->idx+1) % m->N;
+   m->ct+=isNew;
+   if (p>0)         //new item is in minHeap
+   {  if (!isNew && ItemLess(old,v)) { minSortDown(m,p*2);  }
+      else if (minSortUp(m,p)) { maxSortDown(m,-1); }
+   }
+   else if (p<0)   //new item is in maxheap
+   {  if (!isNew && ItemLess(v,old)) { maxSortDown(m,p*2); }
+      else if (maxSortUp(m,p)) { minSortDown(m, 1); }
+   }
+   else            //new item is at median
+   {  if (maxCt(m)) { maxSortDown(m,-1); }
+      if (minCt(m)) { minSortDown(m, 1); }
+   }
+}
+
+//returns median item (or average of 2 when item count is even)
+static Item MediatorMedian(Mediator* m)
+{
+   Item v= m->data[m->heap[0]];
+   if ((m->ct&1)==0) { v= ItemMean(v,m->data[m->heap[-1]]); }
+   return v;
+}
+
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+double kinect_gesture_gamma_to_mm(int pval)
+{
+	double raw = 2048.0 * cbrt(pval / (6.0*6*256));
+	double d = raw * -0.0030711016 + 3.3309495161;
+	return d > 0 ? 1000.0 / d : 10000.0;
+}
+
+void kinect_gesture_default_config(kinect_gesture_config *cfg)
+{
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->near_threshold = 550;
+	cfg->far_threshold = 800;
+	cfg->too_close = 10000;
+	cfg->too_far_or_noise = 1500;
+	cfg->screen_w = 1920;
+	cfg->screen_h = 1080;
+	cfg->click_mode = KINECT_GESTURE_CLICK_DWELL;
+	cfg->click_area = 15;
+	cfg->click_ms = 500;
+	cfg->stroke_min_ms = 15.5 * KINECT_FRAME_MS;
+	cfg->stroke_max_ms = 999.5 * KINECT_FRAME_MS;
+	cfg->h_varmax = 100;
+	cfg->v_varmax = 100;
+	cfg->idle_s = 10;
+	cfg->idle_every = 5;
+	cfg->idle_grid = 8;
+	kinect_push_default_config(&cfg->push);
+	kinect_load_default_config(&cfg->load);
+}
+
+// Start scanning a new frame. How much of it depends on the load level (see kinect_load.h)
+static void scan_reset(kinect_gesture *g)
+{
+	kinect_gesture_scan *s = &g->scan;
+
+	s->next_row = 1;
+	s->count = 0;
+	s->x_sum = 0;
+	s->y_sum = 0;
+	s->x = 0;
+	s->y = 0;
+	s->max_x = -2000;
+	s->max_y = -2000;
+	s->min_x = 2000;
+	s->min_y = 2000;
+	s->pmax = 0;
+	s->pmin = 100000;
+	s->x0 = 1; s->x1 = FRAME_W-1;
+	s->y0 = 1; s->y1 = FRAME_H-1;
+	if (g->load.level >= KINECT_LOAD_ROI && g->roi_x1 > g->roi_x0) {
+		s->x0 = MAX(g->roi_x0 - ROI_MARGIN, 1); s->x1 = MIN(g->roi_x1 + ROI_MARGIN, FRAME_W-1);
+		s->y0 = MAX(g->roi_y0 - ROI_MARGIN, 1); s->y1 = MIN(g->roi_y1 + ROI_MARGIN, FRAME_H-1);
+	}
+	s->step = g->load.level >= KINECT_LOAD_DECIMATE ? 2 : 1;
+}
+
+int kinect_gesture_init(kinect_gesture *g, const kinect_gesture_config *cfg, const kinect_gesture_callbacks *cb)
+{
+	int i;
+
+	memset(g, 0, sizeof(*g));
+	if (cfg)
+		g->cfg = *cfg;
+	else
+		kinect_gesture_default_config(&g->cfg);
+	if (cb)
+		g->cb = *cb;
+	g->cfg.idle_every = MAX(g->cfg.idle_every, 1);
+	g->cfg.idle_grid = MAX(g->cfg.idle_grid, 1);
+
+	for (i=0; i<2048; i++) {
+		float v = i/2048.0;
+		v = powf(v, 3)* 6;
+		t_gamma[i] = v*6*256;
+	}
+	g->median = MediatorNew(9);
+	if (!g->median)
+		return -1;
+	kinect_clock_init(&g->clock);
+	g->clock.late_ms = g->cfg.late_ms;
+	kinect_push_init(&g->push, &g->cfg.push);
+	kinect_load_init(&g->load, &g->cfg.load);
+	g->toofar_since_ms = -1;
+	g->pointer_ms = -1;
+	scan_reset(g);
+	return 0;
+}
+
+void kinect_gesture_destroy(kinect_gesture *g)
+{
+	free(g->median);
+	g->median = NULL;
+}
+
+static void paint(kinect_gesture *g, int i, uint8_t r, uint8_t gr, uint8_t b)
+{
+	g->preview[3*i+0] = r;
+	g->preview[3*i+1] = gr;
+	g->preview[3*i+2] = b;
+}
+
+//
+//Loop the pixels of rows [scan.next_row, row_end) and search for near pixels
+// Rows 0 and 479 and columns 0 and 639 are skipped: each pixel needs its 8 neighbours
+// Under load only the area and the one pixel in step x step chosen by scan_reset are looked at
+// pixel 0,0		_____________
+// pixel 1,0		|0,0|0,1|0,2|
+// pixel 2,0		|___|___|___|
+// pixel 0,1		|1,0|1,1|1,2|
+// pixel 1,1		|___|CUR|___|
+// pixel 2,1		|2,0|2,1|2,2|
+// pixel 0,2		|___|___|___|
+// pixel 1,2
+// pixel 2,2
+// The median structure holds 9 items: after the 9 inserts of a pixel it only contains that pixel's neighbourhood
+static void scan_rows(kinect_gesture *g, const uint16_t *depth, int row_end)
+{
+	kinect_gesture_scan *s = &g->scan;
+	Mediator *kmedian = g->median;
+	int near_threshold = g->cfg.near_threshold, far_threshold = g->cfg.far_threshold;
+	int preview = g->preview && g->load.level < KINECT_LOAD_NO_PREVIEW;
+	int i, tx, ty;
+	int pval; // pval is current pixel depth according to kinect sensor
+
+	if (row_end > s->y1)
+		row_end = s->y1;
+	ty = MAX(s->next_row, s->y0);
+	ty += (s->step - (ty - s->y0) % s->step) % s->step;	// keep on the rows of the grid across row bands
+	for (; ty < row_end; ty += s->step)
+	for (tx = s->x0; tx < s->x1; tx += s->step)
+	{
+		i = ty*640 + tx;
+		//update  median evaluation structure
+	// left column
+		MediatorInsert(kmedian,t_gamma[depth[i-641]]);
+		MediatorInsert(kmedian,t_gamma[depth[i-1]]);
+		MediatorInsert(kmedian,t_gamma[depth[i+639]]);
+	// center column
+		MediatorInsert(kmedian,t_gamma[depth[i-640]]);
+		MediatorInsert(kmedian,t_gamma[depth[i]]);
+		MediatorInsert(kmedian,t_gamma[depth[i+640]]);
+	// right column
+		MediatorInsert(kmedian,t_gamma[depth[i-639]]);
+		MediatorInsert(kmedian,t_gamma[depth[i+1]]);
+		MediatorInsert(kmedian,t_gamma[depth[i+641]]);
+
+	    pval=MediatorMedian(kmedian);
+//		Near range pixels : red color
+
+// pval is the median of depth of 9 pixels centered at current pixel
+		if (pval < near_threshold )  // We found a NearPixel
+		{
+			if (preview)
+				paint(g, i, 255, 0, 0);
+			if (pval > s->pmax)  // new deeper pixel (i.e. near to screeen)
+			{
+				s->pmax=pval;
+				s->x=tx;
+				s->y=ty;
+				if (preview)
+					paint(g, i, 0, 255, 0);
+			}
+			if (pval < s->pmin)
+				s->pmin = pval;
+			s->count++;	// we accumulate number of near pixels
+			s->x_sum+=tx;  // we sum up x coordinates
+			s->y_sum+=ty;  // we sum up y coordinates
+			s->max_x=MAX(s->max_x,tx); // we save max x coordinate of nearpixel
+			s->min_x=MIN(s->min_x,tx); // we save min x coordinate of nearpixel
+			s->max_y=MAX(s->max_y,ty); // we save max y coordinate of nearpixel
+			s->min_y=MIN(s->min_y,ty); // we save min y coordinate of nearpixel
+		}
+		if (!preview)
+			continue;
+//		Default: mid range pixels : white color
+		if (pval >= near_threshold  && pval < far_threshold)
+			paint(g, i, 255, 255, 255);
+//		Default: far range pixels:  black color
+		if (pval >= far_threshold )
+			paint(g, i, 0, 0, 0);
+	}
+	if (row_end > s->next_row)
+		s->next_row = row_end;
+}
+
+void kinect_gesture_push_rows(kinect_gesture *g, const uint16_t *depth, int first_row, int num_rows)
+{
+	if (g->idle)		// idle frames are looked at as a whole in kinect_gesture_push_frame
+		return;
+	if (first_row == 0)
+		scan_reset(g);
+	scan_rows(g, depth, first_row + num_rows - 1);	// a pixel row needs the next row for its median
+}
+
+// Idle: does the frame show the hand? One pixel in idle_grid x idle_grid is enough to tell,
+// the count is scaled to the full frame and compared to the noise threshold
+static int idle_wakes(kinect_gesture *g, const uint16_t *depth)
+{
+	int grid = g->cfg.idle_grid;
+	long near = 0;
+	int tx, ty;
+
+	for (ty = grid/2; ty < FRAME_H; ty += grid)
+		for (tx = grid/2; tx < FRAME_W; tx += grid)
+			if (t_gamma[depth[ty*FRAME_W + tx]] < g->cfg.near_threshold)
+				near++;
+	return near * grid * grid > g->cfg.too_far_or_noise;
+}
+
+static void event_init(kinect_gesture *g, kinect_gesture_event *e, int status)
+{
+	memset(e, 0, sizeof(*e));
+	e->status = status;
+	e->frame = g->clock.index;
+	e->timestamp = g->clock.timestamp;
+	e->ms = g->clock.ms;
+}
+
+static void report_status(kinect_gesture *g, int status)
+{
+	kinect_gesture_event e;
+
+	g->frame.status = status;
+	if (!g->cb.status)
+		return;
+	event_init(g, &e, status);
+	g->cb.status(g->cb.user, &e);
+}
+
+static void report_click(kinect_gesture *g, int x, int y, double z_mm, int push)
+{
+	kinect_gesture_event e;
+
+	if (!g->cb.click)
+		return;
+	event_init(g, &e, KINECT_GESTURE_INRANGE);
+	e.x = x;
+	e.y = y;
+	e.z_mm = z_mm;
+	e.push = push;
+	g->cb.click(g->cb.user, &e);
+}
+
+static void report_swipe(kinect_gesture *g, const char *dir)
+{
+	kinect_gesture_event e;
+
+	if (!g->cb.swipe)
+		return;
+	event_init(g, &e, -1);
+	e.swipe = dir;
+	g->cb.swipe(g->cb.user, &e);
+}
+
+// Evaluate the points recorded since the last frame without the hand as a swipe
+static void evaluate_stroke(kinect_gesture *g)
+{
+	int debug = g->cfg.debug;
+	int current_pixel = g->stroke_points;
+	float h_mean, v_mean, h_variance = 0, v_variance = 0; // horizontal / vertical mean; horizontal / vertical variance
+	long left2rightmul, right2leftmul, up2downmul, down2upmul;
+	int j;
+
+// Begin of section: We have a sequence of points that are between the allowed paramenters set
+// The stroke lasts from its first point to the end of the frame of its last point
+	double stroke_ms = current_pixel ? g->stroke_last_ms - g->stroke_start_ms + kinect_clock_frame_ms(&g->clock) : 0;
+	if(debug && current_pixel) printf("Stroke of %d points in %.0f ms\n",current_pixel,stroke_ms);
+	if (stroke_ms>g->cfg.stroke_min_ms && stroke_ms<g->cfg.stroke_max_ms)
+	{
+		h_mean=g->h_sum/current_pixel;  //calculate statistics for euristic
+		v_mean=g->v_sum/current_pixel;
+		for (j=0;j<current_pixel;j++)
+		{
+			h_variance+=pow(g->stroke_x[j]-h_mean,2);
+			v_variance+=pow(g->stroke_y[j]-v_mean,2);
+			if(debug) printf("N X Y \t%3d\t%3d\t%4d\n",j, g->stroke_x[j],g->stroke_y[j]);
+		}
+		h_variance=sqrt(h_variance/current_pixel);
+		v_variance=sqrt(v_variance/current_pixel);
+		left2rightmul = g->left2right_count*g->left2right_sum;
+		right2leftmul = g->right2left_count*g->right2left_sum;
+		up2downmul = g->up2down_count*g->up2down_sum;
+		down2upmul = g->down2up_count*g->down2up_sum;
+		if(debug)
+		{
+			printf("____________________________________________\n");
+			printf("current_pixel, %i\n",current_pixel);
+			printf("left2rightcnt\tright2leftcnt\t%8i\t%8i\n",g->left2right_count, g->right2left_count);
+			printf("up2downcnt\tdown2upcnt\t%8i\t%8i\n\n",g->up2down_count,g->down2up_count);
+			printf("left2rightsum\tright2leftsum\t%8ld\t%8ld\n",g->left2right_sum, g->right2left_sum);
+			printf("up2downsum\tdown2up_sum\t%8ld\t%8ld\n\n",g->up2down_sum,g->down2up_sum);
+			printf("left2rightmul\tright2leftmul\t%20ld\t%20ld\n",left2rightmul,right2leftmul);
+			printf("up2downmul\tdown2upmul\t%20ld\t%20ld\n\n",up2downmul,down2upmul);
+			printf("h_mean\tv_mean\t%5.5f\t%5.5f\n",h_mean,v_mean);
+			printf("h_variance\tv_variance\t%5.5f\t%5.5f\n",h_variance,v_variance);
+			printf("____________________________________________\n");
+		}
+		if (h_variance<g->cfg.h_varmax || v_variance<g->cfg.v_varmax)  // Either Variance is belo variance threshold parameter
+		{
+			if (h_variance<g->cfg.h_varmax && v_variance<g->cfg.v_varmax)
+			{
+				if(debug) printf("Garbage ");
+			}
+			else
+			{
+				if(h_variance<v_variance)
+				{
+					if(debug) printf(up2downmul>down2upmul ? "Down \n" : "Up \n");
+					report_swipe(g, up2downmul>down2upmul ? "down" : "up");
+				}
+				else
+				{
+					if(debug) printf(left2rightmul>right2leftmul ? "right \n" : "left \n");
+					report_swipe(g, left2rightmul>right2leftmul ? "right" : "left");
+				}
+			}
+		}
+		else
+		{
+				if(debug) printf("No Swipe\n");
+		}
+	}  // End of section: We have a sequence of points that are between the allowed paramenters
+	if(g->cfg.debugstop) getchar();
+	g->stroke_eval=0;
+	g->stroke_points=0;
+}
+
+// The hand is in range: move the pointer, add the point to the stroke, look for clicks
+static void track_hand(kinect_gesture *g, int NearPixelX, int NearPixelY, int NearPixelMin, long NearPixelCount)
+{
+	int debug = g->cfg.debug;
+	int current_pixel = g->stroke_points;
+	int click_area = g->cfg.click_area;
+	double z_mm = kinect_gesture_gamma_to_mm(NearPixelMin);
+	float pointerx, pointery, mousex, mousey;
+	int mx , my;  // mouse x and y coordinates
+	kinect_gesture_event e;
+
+	pointerx = ((NearPixelX-640.0f) / -1); 		// get current x coordinates
+	pointery = (NearPixelY);					// get current y coordinates
+	mousex = ((pointerx / 630.0f) * g->cfg.screen_w);	// scale x coordinates to screen size
+	mousey = ((pointery / 470.0f) * g->cfg.screen_h);	// scale y coordinates to screen size
+	mx = mousex;
+	my = mousey;
+	if(debug)
+	{
+		printf("Subject within range\n");
+		printf("Mouse coordinates  %3d %4d\n",mx,my);
+		printf("Nearest point %4.0f mm\n",z_mm);
+		printf("Stroke Index  %d \n",current_pixel);
+	}
+	g->stroke_x[current_pixel]=mx; //save current x coord in array of stroke pints
+	g->stroke_y[current_pixel]=my; //save cuurent y coord in array of stroke pints
+	if (g->cb.pointer)
+	{
+		event_init(g, &e, KINECT_GESTURE_INRANGE);
+		e.x = mx;
+		e.y = my;
+		e.z_mm = z_mm;
+		e.near_pixels = NearPixelCount;
+		e.blob_x0 = g->roi_x0; e.blob_x1 = g->roi_x1;
+		e.blob_y0 = g->roi_y0; e.blob_y1 = g->roi_y1;
+		g->cb.pointer(g->cb.user, &e);
+	}
+// This is the first point between invalid or empty frames: reset swipe evaluation support variables
+	if(current_pixel==0)
+	{
+		if(debug)	printf("First Point in stroke - reset swipe variables\n");
+		g->stroke_start_ms=g->clock.ms;
+		g->left2right_count=0;
+		g->right2left_count=0;
+		g->up2down_count=0;
+		g->down2up_count=0;
+		g->left2right_sum=0;
+		g->right2left_sum=0;
+		g->up2down_sum=0;
+		g->down2up_sum=0;
+		g->h_sum=0;
+		g->v_sum=0;
+		g->stroke_eval=0;
+	}
+	else // this is an additional point in a stroke. Update swipe statistics variables
+	{
+		if(debug)	printf("Update  swipe variables\n");
+		if (g->stroke_x[current_pixel]>g->stroke_x[current_pixel-1])
+		{
+			g->left2right_count++;
+			g->left2right_sum += abs(g->stroke_x[current_pixel]-g->stroke_x[current_pixel-1]);
+		}
+		else
+		{
+			g->right2left_count++;
+			g->right2left_sum += abs(g->stroke_x[current_pixel-1]-g->stroke_x[current_pixel]);
+		}
+		if(g->stroke_y[current_pixel]>g->stroke_y[current_pixel-1])
+		{
+			g->up2down_count++;
+			g->up2down_sum+=abs(g->stroke_y[current_pixel-1]-g->stroke_y[current_pixel]);
+		}
+		else
+		{
+			g->down2up_count++;
+			g->down2up_sum+=abs(g->stroke_y[current_pixel]-g->stroke_y[current_pixel-1]);
+		}
+		if(debug)	printf("Deltas: \tH %4d \tV %4d\n",abs(g->stroke_x[current_pixel-1]-g->stroke_x[current_pixel]),abs(g->stroke_y[current_pixel-1]-g->stroke_y[current_pixel]));
+	}
+	g->stroke_last_ms=g->clock.ms;
+	g->h_sum+=g->stroke_x[current_pixel];
+	g->v_sum+=g->stroke_y[current_pixel];
+	if(debug)
+	{
+		printf("Counts: \tL2R %5d\tR2L %5d\tU2D %5d\tD2U %5d\n",g->left2right_count,g->right2left_count,g->up2down_count,g->down2up_count);
+		printf("StrokeSums: \tL2R %5ld\tR2L %5ld\tU2D %5ld\tD2U %5ld\n",g->left2right_sum,g->right2left_sum,g->up2down_sum,g->down2up_sum);
+		printf("HSUm VSUM: \tHsum %10ld\tVSum %10ld\n",g->h_sum,g->v_sum);
+	}
+
+// If current evaluated pixel coordinates are within square area defined by input parameter click_area
+// The pointer keeps hovering, the time it started is kept
+	if ((g->pointer_x <= (mx + click_area))  && (g->pointer_x >= (mx -click_area)) && (g->pointer_y <= (my + click_area))  && (g->pointer_y >= (my - click_area)))
+	{
+		g->hover_ms += g->pointer_ms >= 0 ? g->clock.ms - g->pointer_ms : kinect_clock_frame_ms(&g->clock);
+		if(debug)	printf("Mouse Hovering : %5.0f ms\n",g->hover_ms);
+	}
+	else
+// Current evaluated pixel coordinates are not within square area defined by input parameter click_area
+// Restart the hovering time and increment stroke pixel index
+	{
+		g->pointer_x = mx; //New initial position X
+		g->pointer_y = my; //New initial position Y
+		g->hover_ms = 0; // Restart hovering time
+	}
+	g->pointer_ms = g->clock.ms;
+	g->stroke_points++;
+	// A stroke this long is no swipe: start a new one rather than overflow
+	if (g->stroke_points == KINECT_GESTURE_MAX_STROKE)
+		g->stroke_points = 0;
+// Check if mouse was hovering for more then click_ms over the click area
+// Simulate click at the point
+// Debounce: the next click needs the pointer held still for three times as long
+	if((g->cfg.click_mode & KINECT_GESTURE_CLICK_DWELL) && g->hover_ms > g->cfg.click_ms)
+	{
+		g->hover_ms = -2*g->cfg.click_ms;  		// set debounce time
+		g->stroke_points=0;  //Reset Stroke Pixel Index
+		g->stroke_eval=0;
+		if(debug)	printf("Click at \tX %d\tY %d\n",mx,my);
+		report_click(g, mx, my, z_mm, 0);
+	}
+// Check if the hand was pushed towards the kinect and back within push_ms
+// Click where the pointer was before the push
+	if(g->cfg.click_mode & KINECT_GESTURE_CLICK_PUSH)
+	{
+		int cx = mx, cy = my;
+		if (kinect_push_update(&g->push, g->clock.ms, z_mm, &cx, &cy))
+		{
+			g->hover_ms = 0;
+			g->stroke_points=0;  //Reset Stroke Pixel Index: a push is no swipe
+			g->stroke_eval=0;
+			if(debug)	printf("Push Click at \tX %d\tY %d\n",cx,cy);
+			report_click(g, cx, cy, z_mm, 1);
+		}
+	}
+	if(debug)	printf("Coordinates \tX %3d\tY %3d\n",mx,my);
+}
+
+// Enter idle: few frames on a coarse grid
+static void power_sleep(kinect_gesture *g)
+{
+	g->idle = 1;
+	g->idle_frames = 0;
+	g->frame.slept = 1;
+	if (g->cfg.debug) printf("Idle\n");
+}
+
+// Back to full rate, from the frame that found the hand on
+static void power_wake(kinect_gesture *g)
+{
+	g->idle = 0;
+	g->toofar_since_ms = -1;
+	g->frame.woke = 1;
+	if (g->cfg.debug) printf("Active\n");
+}
+
+int kinect_gesture_push_frame(kinect_gesture *g, const uint16_t *depth, uint32_t timestamp, double host_ms)
+{
+	// In this part of the function we analyze the frame returned and look for a "blob" of NearPixels
+	// A NearPixel is a Pixel that is reported within the given range by Kinect
+	// We search in every frame returned by the kinect for a group of NearPixels.
+	// Hopefully this is the forearm of the subject facing the kinect
+	// We assume the direction the mouse pointer is the furthest point of the blob from screen center
+	// NOTE: Pixel variables are local to the function; Stroke variables persist across frames in the context
+
+	kinect_gesture_frame *f = &g->frame;
+	int debug = g->cfg.debug;
+	int NearPixelX , NearPixelY; // NearPixelFound : near pixel coordinates
+	long NearPixelCount; // count of red pixels (near)
+	int NearPixelMin; // depth of the nearest near pixel, for push clicks
+	double t_scan, t_end;
+
+	if (host_ms <= 0)
+		host_ms = now_ms();
+	memset(f, 0, sizeof(*f));
+	f->status = -1;
+	f->lost = kinect_clock_update(&g->clock, timestamp, host_ms);
+	f->late = g->clock.late;
+	if (debug && f->lost)
+		printf("Dropped %d frames before frame %ld\n", f->lost, g->clock.index);
+	if (debug && f->late)
+		printf("Late frame %ld: %.0f ms behind\n", g->clock.index, host_ms - g->clock.ms - g->clock.delay_min);
+
+// Idle: skip all frames but one in idle_every, look for the hand on a coarse grid in that one
+// The first frame that shows it is analysed in full below
+	if (g->idle)
+	{
+		int look = g->idle_frames++ % g->cfg.idle_every == 0;
+		if (!look || !idle_wakes(g, depth))
+		{
+			f->skipped = KINECT_GESTURE_SKIP_IDLE;
+			if (look)
+				report_status(g, KINECT_GESTURE_TOOFAR);
+			f->busy_ms = now_ms() - host_ms;
+			return -1;
+		}
+		power_wake(g);
+	}
+
+// Under heavy load the frames that arrive late are not analysed: catch up with the sensor (see kinect_load.h)
+	if (g->load.level >= KINECT_LOAD_SKIP && g->clock.late)
+	{
+		f->skipped = KINECT_GESTURE_SKIP_LOAD;
+		scan_reset(g);	// row bands may have scanned part of it
+		f->busy_ms = now_ms() - host_ms;
+		return -1;
+	}
+
+	if(debug) printf("___________________________BEGINOFRAME_________________________\n");
+	if(debug) printf("Got a Frame, Anlyzing it\n");
+//
+//Loop all pixels of current frame and search for at least one near pixel (see scan_rows)
+//
+	t_scan = now_ms();
+	scan_rows(g, depth, FRAME_H-1);	// whatever the row bands did not cover yet
+	NearPixelCount = g->scan.count * g->scan.step * g->scan.step;	// as if every pixel had been scanned
+	NearPixelX = g->scan.x;
+	NearPixelY = g->scan.y;
+	NearPixelMin = g->scan.pmin;
+	// The near pixels bound the area scanned at load level roi in the next frame
+	g->roi_x0 = g->scan.count ? g->scan.min_x : 0;
+	g->roi_x1 = g->scan.count ? g->scan.max_x + 1 : 0;
+	g->roi_y0 = g->scan.min_y;
+	g->roi_y1 = g->scan.max_y + 1;
+	scan_reset(g);
+	f->scan_ms = now_ms() - t_scan;
+
+	if(debug)	printf("Frame Analyzed: NearPixelCount %ld\n",NearPixelCount);
+
+//Current Frame evaluated: lets evaluate NearPixels found
+
+// Number of Pixels in Near Blobs is over the threshold too_close given in input
+// This means the subject is too close in current frame
+// Reset Pixel Count and restart swipe evaluation
+	if(NearPixelCount > g->cfg.too_close)
+	{
+		if(debug)	printf("Subject too close\n");
+		report_status(g, KINECT_GESTURE_TOOCLOSE);
+		g->stroke_eval=1;
+		g->pointer_ms=-1;
+	}
+
+// Number of Pixels in Near Blobs is less then threshold too_far_or_noise given in input but non zero
+// This means the subject is within reach but still too far
+// Reset Pixel Count and restart swipe evaluation
+	if(NearPixelCount > 0 && NearPixelCount < g->cfg.too_far_or_noise)
+	{
+		if(debug)	printf("Some pixels detected but subject too far\n");
+		report_status(g, KINECT_GESTURE_SOMEPIXELS);
+		g->stroke_eval=1;
+		g->pointer_ms=-1;
+		kinect_push_reset(&g->push);
+	}
+
+// No near Pixel found
+// This means the subject is out of range in current frame
+// Reset Pixel Count and restart swipe evaluation
+	if(NearPixelCount == 0)
+	{
+		if(debug)	printf("Subject too far - Out of reach\n");
+		report_status(g, KINECT_GESTURE_TOOFAR);
+		g->stroke_eval=1;
+		g->pointer_ms=-1;
+		kinect_push_reset(&g->push);
+		if (g->toofar_since_ms < 0)
+			g->toofar_since_ms = g->clock.ms;
+		else if (g->cfg.idle_s > 0 && g->clock.ms - g->toofar_since_ms >= g->cfg.idle_s * 1000)
+			power_sleep(g);
+	}
+	else
+		g->toofar_since_ms = -1;
+
+// Number of NearPixels in blobs found is neither to small nor too big: subject hand in range
+// a swipe is evaluated by evaluating subsequent pixels found between empty frames
+// that is : an empty frame (a frame with subject either too far or too close) is considered as a "break" between gestures
+// We record x and y coordinates of pixels found in an array
+	if (NearPixelCount !=0 && NearPixelCount < g->cfg.too_close && NearPixelCount > g->cfg.too_far_or_noise)
+	{
+		report_status(g, KINECT_GESTURE_INRANGE);
+		track_hand(g, NearPixelX, NearPixelY, NearPixelMin, NearPixelCount);
+	}
+
+// Evaluate Swipe if frame empty or not in threshold
+	if(g->stroke_eval)
+		evaluate_stroke(g);
+	if(debug) printf("___________________________ENDOFRAME_________________________\n\n");
+
+	// Latency from the sensor to now and processing time against the frame interval decide the load level
+	t_end = now_ms();
+	f->busy_ms = t_end - host_ms;
+	f->load_change = kinect_load_update(&g->load, t_end, t_end - g->clock.ms - g->clock.delay_min, f->busy_ms, kinect_clock_frame_ms(&g->clock));
+	return f->status;
+}
@@ -0,0 +1,188 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+ /* Gesture library (libkinectgesture)
+ The hand pointer, dwell and push clicks and swipes of kmouse_mm, without
+ libfreenect, X11 or stdout: depth frames are pushed in, events come out
+ through callbacks. kmouse_mm is one front end; anything that gets 11 bit
+ depth frames (a Node/Electron addon, a replay benchmark) can embed it.
+
+ A frame is 640x480 uint16 depth values as libfreenect delivers them
+ (FREENECT_DEPTH_11BIT) with its 60 MHz timestamp. For every frame the
+ nearest blob of pixels under near_threshold is found; depending on its size
+ the hand is out of reach (toofar), barely visible (somepixels), too close,
+ or in range, where its farthest point from the elbow drives the pointer.
+ Strokes of pointer positions between two frames without the hand are
+ evaluated as swipes.
+
+ The context holds all the state of the pipeline: the frame clock (see
+ kinect_clock.h), the push detector (kinect_push.h), the load controller
+ (kinect_load.h), the idle power state and the stroke being drawn. The
+ callbacks run on the thread that pushes the frame, before push returns.
+ One context is not thread safe, separate contexts are independent.
+ */
+
+#ifndef KINECT_GESTURE_H
+#define KINECT_GESTURE_H
+
+#include <stdint.h>
+
+#include "kinect_clock.h"
+#include "kinect_push.h"
+#include "kinect_load.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KINECT_GESTURE_FRAME_W 640
+#define KINECT_GESTURE_FRAME_H 480
+#define KINECT_GESTURE_MAX_STROKE 1000 // Pointer positions kept for a swipe
+
+// Click modes
+#define KINECT_GESTURE_CLICK_DWELL 1 // Pointer held still over the click area
+#define KINECT_GESTURE_CLICK_PUSH 2  // Hand pushed towards the sensor and back
+
+// Status of the hand in a frame
+enum {
+	KINECT_GESTURE_TOOFAR = 0,     // No near pixel
+	KINECT_GESTURE_SOMEPIXELS,     // Fewer near pixels than too_far_or_noise
+	KINECT_GESTURE_TOOCLOSE,       // More near pixels than too_close
+	KINECT_GESTURE_INRANGE,        // The hand drives the pointer
+	KINECT_GESTURE_STATUSES
+};
+
+// Why a frame was not analysed
+enum {
+	KINECT_GESTURE_ANALYSED = 0,
+	KINECT_GESTURE_SKIP_IDLE,      // Idle: not looked at, or on the coarse grid only (status toofar)
+	KINECT_GESTURE_SKIP_LOAD,      // Late frame at load level skip
+};
+
+typedef struct {
+	int near_threshold;    // Depth (gamma value) under which a pixel is near: the hand
+	int far_threshold;     // Depth from which a pixel is background, for the preview only
+	long too_close;        // More near pixels than this: too close
+	long too_far_or_noise; // Fewer near pixels than this: too far or noise
+	int screen_w, screen_h; // Pointer coordinates are scaled to this screen (default 1920x1080)
+	int click_mode;        // KINECT_GESTURE_CLICK_DWELL and/or _PUSH (default dwell)
+	int click_area;        // Pointer moves within +-click_area px count as still (default 15)
+	double click_ms;       // Still this long for a dwell click (default 500)
+	double stroke_min_ms, stroke_max_ms; // Duration of a swipe (default 517, 33317)
+	long h_varmax, v_varmax; // Largest spread across the direction of a swipe (default 100)
+	double late_ms;        // See kinect_clock.h, 0 = two frame intervals (default)
+	double idle_s;         // Idle after this long out of reach, 0 never (default 10)
+	int idle_every;        // While idle look at one frame in idle_every (default 5)
+	int idle_grid;         // on one pixel in idle_grid x idle_grid (default 8)
+	kinect_push_config push;
+	kinect_load_config load;
+	int debug;             // Print the analysis of every frame to stdout
+	int debugstop;         // and wait for enter after each swipe evaluation
+} kinect_gesture_config;
+
+typedef struct {
+	int status;            // KINECT_GESTURE_TOOFAR ...
+	int x, y;              // Pointer (or click) position in screen coordinates
+	double z_mm;           // Depth of the nearest point of the hand
+	const char *swipe;     // "left", "right", "up" or "down" for swipe events
+	int push;              // Click events: 1 for a push click, 0 for a dwell click
+	long near_pixels;      // Size of the near blob
+	int blob_x0, blob_y0, blob_x1, blob_y1; // Bounds of the near blob in depth pixels
+	long frame;            // Frame index, lost frames included
+	uint32_t timestamp;    // libfreenect timestamp of the frame
+	double ms;             // Frame time in ms, see kinect_clock.h
+} kinect_gesture_event;
+
+typedef void (*kinect_gesture_cb)(void *user, const kinect_gesture_event *e);
+
+typedef struct {
+	kinect_gesture_cb pointer; // Every frame with the hand in range
+	kinect_gesture_cb click;
+	kinect_gesture_cb swipe;
+	kinect_gesture_cb status;  // Every analysed frame
+	void *user;
+} kinect_gesture_callbacks;
+
+// What the last kinect_gesture_push_frame did, for metrics and logs
+typedef struct {
+	int skipped;           // KINECT_GESTURE_ANALYSED or the reason it was skipped
+	int status;            // Status of the hand, -1 if not looked at or on a threshold
+	int lost;              // Frames lost just before this one
+	int late;              // The frame arrived late
+	int slept, woke;       // The idle state was entered, left
+	int load_change;       // The load level went up (1) or down (-1)
+	double scan_ms;        // Time spent scanning the pixels, row bands excluded
+	double busy_ms;        // From the arrival of the frame to the end of its processing
+} kinect_gesture_frame;
+
+typedef struct {
+	int next_row;          // First pixel row not scanned yet
+	int x0, x1, y0, y1;    // Area scanned, all the frame but at load level roi
+	int step;              // One pixel in step x step is scanned, 2 at load level decimate
+	long count;            // Near pixels
+	long x_sum, y_sum;
+	int x, y;              // Deepest near pixel: the pointer
+	int min_x, min_y, max_x, max_y;
+	int pmax, pmin;        // Largest and smallest near depth
+} kinect_gesture_scan;
+
+struct kinect_gesture_median;
+
+typedef struct kinect_gesture {
+	kinect_gesture_config cfg;
+	kinect_gesture_callbacks cb;
+	uint8_t *preview;      // 640x480 RGB image painted with near/mid/far pixels, NULL for none
+	kinect_gesture_frame frame;
+
+	kinect_clock clock;
+	kinect_push push;
+	kinect_load load;
+	kinect_gesture_scan scan;
+	struct kinect_gesture_median *median;
+	int roi_x0, roi_x1, roi_y0, roi_y1; // Near blob of the previous frame, empty if there was none
+
+	int idle;              // Few frames analysed on a coarse grid
+	double toofar_since_ms; // Frame time of the first toofar frame in a row, -1 after the hand
+	long idle_frames;
+
+	int pointer_x, pointer_y; // Center of the current click area
+	double hover_ms;       // Time the pointer has been in the click area, negative while debouncing a click
+	double pointer_ms;     // Time of the previous frame with the pointer in range, -1 if it was not
+	int stroke_x[KINECT_GESTURE_MAX_STROKE], stroke_y[KINECT_GESTURE_MAX_STROKE];
+	int stroke_points;
+	int stroke_eval;       // Evaluate the stroke as a swipe at the end of the frame
+	double stroke_start_ms, stroke_last_ms;
+	int left2right_count, right2left_count, up2down_count, down2up_count;
+	long left2right_sum, right2left_sum, up2down_sum, down2up_sum;
+	long h_sum, v_sum;
+} kinect_gesture;
+
+void kinect_gesture_default_config(kinect_gesture_config *cfg);
+
+// cfg NULL uses the defaults, cb NULL has no callbacks. Returns -1 when out of memory
+int kinect_gesture_init(kinect_gesture *g, const kinect_gesture_config *cfg, const kinect_gesture_callbacks *cb);
+void kinect_gesture_destroy(kinect_gesture *g);
+
+// Analyse a frame that reached the host at host_ms (CLOCK_MONOTONIC ms, 0 for now).
+// Returns the status of the hand, -1 if the frame was not analysed (see g->frame)
+int kinect_gesture_push_frame(kinect_gesture *g, const uint16_t *depth, uint32_t timestamp, double host_ms);
+
+// Optional: scan rows of a frame still being received, [first_row, first_row + num_rows).
+// The frame must then be pushed whole with kinect_gesture_push_frame, which scans the rest
+void kinect_gesture_push_rows(kinect_gesture *g, const uint16_t *depth, int first_row, int num_rows);
+
+// Depth in mm of a gamma value as compared to near_threshold
+double kinect_gesture_gamma_to_mm(int gamma);
+
+extern const char *kinect_gesture_status_names[KINECT_GESTURE_STATUSES];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KINECT_GESTURE_H
@@ -0,0 +1,86 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+#include <string.h>
+
+#include "kinect_load.h"
+
+#define LOAD_ALPHA 0.2 // Weight of the newest frame in the averages
+
+static const char *level_names[KINECT_LOAD_LEVELS] = { "full", "no_preview", "roi", "decimate", "skip" };
+
+void kinect_load_default_config(kinect_load_config *cfg)
+{
+	cfg->budget_ms = 0;
+	cfg->up_hold_ms = 500;
+	cfg->down_hold_ms = 3000;
+	cfg->down_ratio = 0.5;
+	cfg->max_level = KINECT_LOAD_SKIP;
+}
+
+void kinect_load_init(kinect_load *l, const kinect_load_config *cfg)
+{
+	memset(l, 0, sizeof(*l));
+	if (cfg)
+		l->cfg = *cfg;
+	else
+		kinect_load_default_config(&l->cfg);
+	if (l->cfg.max_level >= KINECT_LOAD_LEVELS)
+		l->cfg.max_level = KINECT_LOAD_LEVELS - 1;
+	l->calm_since_ms = -1;
+}
+
+const char *kinect_load_level_name(int level)
+{
+	return level >= 0 && level < KINECT_LOAD_LEVELS ? level_names[level] : "unknown";
+}
+
+int kinect_load_update(kinect_load *l, double now_ms, double latency_ms, double busy_ms, double frame_ms)
+{
+	double busy = frame_ms > 0 ? busy_ms / frame_ms : 0;
+
+	if (l->latency_ms == 0 && l->busy == 0) {
+		l->latency_ms = latency_ms;
+		l->busy = busy;
+		l->last_change_ms = now_ms;
+	} else {
+		l->latency_ms += LOAD_ALPHA * (latency_ms - l->latency_ms);
+		l->busy += LOAD_ALPHA * (busy - l->busy);
+	}
+	if (l->cfg.budget_ms <= 0)
+		return 0;
+
+	// Behind: one more step of shedding, giving the last one time to show
+	if (l->latency_ms > l->cfg.budget_ms || l->busy > 1) {
+		l->calm_since_ms = -1;
+		if (l->level < l->cfg.max_level && now_ms - l->last_change_ms >= l->cfg.up_hold_ms) {
+			l->level++;
+			l->ups++;
+			l->last_change_ms = now_ms;
+			return 1;
+		}
+		return 0;
+	}
+
+	// Well ahead for a while: give back one step
+	if (l->latency_ms < l->cfg.down_ratio * l->cfg.budget_ms && l->busy < l->cfg.down_ratio) {
+		if (l->calm_since_ms < 0)
+			l->calm_since_ms = now_ms;
+		if (l->level > KINECT_LOAD_FULL && now_ms - l->calm_since_ms >= l->cfg.down_hold_ms
+		    && now_ms - l->last_change_ms >= l->cfg.down_hold_ms) {
+			l->level--;
+			l->downs++;
+			l->last_change_ms = now_ms;
+			l->calm_since_ms = now_ms;
+			return -1;
+		}
+	} else {
+		l->calm_since_ms = -1;
+	}
+	return 0;
+}
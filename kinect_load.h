@@ -0,0 +1,76 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+ /* Load controller
+ When processing falls behind the 30 fps stream (a throttled Pi, the debug
+ preview), frames queue up and the pointer lags behind the hand. The
+ controller watches the latency from the sensor to the end of the processing
+ of each frame and the processing time against the frame interval, and picks
+ how much work the pipeline does, cheapest quality loss first:
+
+   full        every frame, every pixel, preview on
+   no_preview  the preview window is not fed any more
+   roi         only the area around the hand of the previous frame is scanned
+   decimate    one pixel in 2x2 is scanned
+   skip        frames that arrive late are not analysed at all
+
+ Each level includes the ones before. The level goes up one step when the
+ latency is over budget or the frames take longer than the frame interval,
+ and down one step when both have stayed well under for a while.
+ */
+
+#ifndef KINECT_LOAD_H
+#define KINECT_LOAD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+	KINECT_LOAD_FULL = 0,
+	KINECT_LOAD_NO_PREVIEW,
+	KINECT_LOAD_ROI,
+	KINECT_LOAD_DECIMATE,
+	KINECT_LOAD_SKIP,
+	KINECT_LOAD_LEVELS
+};
+
+typedef struct {
+	double budget_ms;     // Latency budget from the sensor to the end of processing, 0 = no control (default)
+	double up_hold_ms;    // At least this long between two steps up (default 500)
+	double down_hold_ms;  // Under the budget this long before a step down (default 3000)
+	double down_ratio;    // Step down below this part of the budget and of the frame interval (default 0.5)
+	int max_level;        // Highest level the controller may choose (default KINECT_LOAD_SKIP)
+} kinect_load_config;
+
+typedef struct {
+	kinect_load_config cfg;
+	int level;
+	double latency_ms;    // Average latency of the last frames
+	double busy;          // Average processing time over frame interval of the last frames
+	double last_change_ms; // Host time of the last level change
+	double calm_since_ms; // Host time since which latency and load are low, -1 if they are not
+	unsigned long ups, downs;
+} kinect_load;
+
+void kinect_load_default_config(kinect_load_config *cfg);
+// cfg NULL uses the defaults
+void kinect_load_init(kinect_load *l, const kinect_load_config *cfg);
+
+// Account an analysed frame: host time, latency from the sensor to the end of its
+// processing, processing time and frame interval, all in ms.
+// Returns +1 when the level went up, -1 when it went down, 0 otherwise
+int kinect_load_update(kinect_load *l, double now_ms, double latency_ms, double busy_ms, double frame_ms);
+
+const char *kinect_load_level_name(int level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KINECT_LOAD_H
@@ -0,0 +1,538 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "kinect_metrics.h"
+
+static uint64_t double_bits(double v)
+{
+	uint64_t bits;
+	memcpy(&bits, &v, sizeof(bits));
+	return bits;
+}
+
+static double bits_double(uint64_t bits)
+{
+	double v;
+	memcpy(&v, &bits, sizeof(v));
+	return v;
+}
+
+void kinect_metrics_init(kinect_metrics *reg)
+{
+	memset(reg, 0, sizeof(*reg));
+	pthread_mutex_init(&reg->write_lock, NULL);
+}
+
+// The fields set after metric_new (bounds, sample function) are filled in before the
+// caller returns: expositions take the lock too, and see the slot only once it is complete
+static kinect_metric *metric_new(kinect_metrics *reg, kinect_metric_type type, const char *name, const char *labels, const char *help, const char *json_key)
+{
+	kinect_metric *m = NULL;
+	pthread_mutex_lock(&reg->write_lock);
+	if (reg->count < KINECT_METRICS_MAX) {
+		m = &reg->metrics[reg->count];
+		memset(m, 0, sizeof(*m));
+		m->type = type;
+		m->name = name;
+		m->labels = labels;
+		m->help = help;
+		m->json_key = json_key;
+	}
+	return m;
+}
+
+// Publishes the slot reserved by metric_new and releases the lock
+static kinect_metric *metric_done(kinect_metrics *reg, kinect_metric *m)
+{
+	if (m)
+		__atomic_fetch_add(&reg->count, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&reg->write_lock);
+	return m;
+}
+
+kinect_metric *kinect_metrics_counter(kinect_metrics *reg, const char *name, const char *labels, const char *help, const char *json_key)
+{
+	return metric_done(reg, metric_new(reg, KINECT_METRIC_COUNTER, name, labels, help, json_key));
+}
+
+static kinect_metric *gauge_new(kinect_metrics *reg, const char *name, const char *labels, const char *help, const char *json_key, kinect_metric_sample_fn fn, void *user)
+{
+	kinect_metric *m = metric_new(reg, KINECT_METRIC_GAUGE, name, labels, help, json_key);
+	if (m) {
+		m->value = double_bits(0.0);
+		m->sample = fn;
+		m->sample_user = user;
+	}
+	return metric_done(reg, m);
+}
+
+kinect_metric *kinect_metrics_gauge(kinect_metrics *reg, const char *name, const char *labels, const char *help, const char *json_key)
+{
+	return gauge_new(reg, name, labels, help, json_key, NULL, NULL);
+}
+
+kinect_metric *kinect_metrics_gauge_fn(kinect_metrics *reg, const char *name, const char *labels, const char *help, const char *json_key, kinect_metric_sample_fn fn, void *user)
+{
+	return gauge_new(reg, name, labels, help, json_key, fn, user);
+}
+
+kinect_metric *kinect_metrics_histogram(kinect_metrics *reg, const char *name, const char *labels, const char *help, const char *json_key, const double *bounds, int nbounds)
+{
+	kinect_metric *m = metric_new(reg, KINECT_METRIC_HISTOGRAM, name, labels, help, json_key);
+	if (m) {
+		if (nbounds > KINECT_METRICS_MAX_BUCKETS)
+			nbounds = KINECT_METRICS_MAX_BUCKETS;
+		memcpy(m->bounds, bounds, nbounds * sizeof(double));
+		m->nbuckets = nbounds;
+	}
+	return metric_done(reg, m);
+}
+
+kinect_metric *kinect_metrics_thread_cpu(kinect_metrics *reg, const char *thread_name)
+{
+	// labels must outlive the registry: build thread="<name>" once
+	size_t len = strlen(thread_name) + 16;
+	char *labels = malloc(len);
+	if (!labels)
+		return NULL;
+	snprintf(labels, len, "thread=\"%s\"", thread_name);
+	kinect_metric *m = metric_new(reg, KINECT_METRIC_THREAD_CPU, "kmouse_thread_cpu_seconds_total", labels, "CPU time consumed per thread", NULL);
+	if (!m)
+		free(labels);
+	return metric_done(reg, m);
+}
+
+void kinect_metrics_bind_thread(kinect_metric *m)
+{
+	clockid_t cid;
+	if (!m || pthread_getcpuclockid(pthread_self(), &cid))
+		return;
+	m->cpu_clock = cid;
+	__atomic_store_n(&m->cpu_bound, 1, __ATOMIC_RELEASE);
+}
+
+void kinect_metrics_add(kinect_metric *m, uint64_t n)
+{
+	if (m)
+		__atomic_fetch_add(&m->value, n, __ATOMIC_RELAXED);
+}
+
+void kinect_metrics_inc(kinect_metric *m)
+{
+	kinect_metrics_add(m, 1);
+}
+
+void kinect_metrics_set(kinect_metric *m, double v)
+{
+	if (m)
+		__atomic_store_n(&m->value, double_bits(v), __ATOMIC_RELAXED);
+}
+
+void kinect_metrics_observe(kinect_metric *m, double v)
+{
+	int b;
+	if (!m)
+		return;
+	for (b = 0; b < m->nbuckets; b++)
+		if (v <= m->bounds[b])
+			break;
+	__atomic_fetch_add(&m->buckets[b], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&m->sum_us, (uint64_t)(v > 0 ? v * 1000.0 : 0), __ATOMIC_RELAXED);
+	__atomic_fetch_add(&m->count, 1, __ATOMIC_RELAXED);
+}
+
+uint64_t kinect_metrics_counter_value(const kinect_metric *m)
+{
+	return m ? __atomic_load_n(&m->value, __ATOMIC_RELAXED) : 0;
+}
+
+double kinect_metrics_gauge_value(const kinect_metric *m)
+{
+	if (!m)
+		return 0;
+	if (m->sample)
+		return m->sample(m->sample_user);
+	return bits_double(__atomic_load_n(&m->value, __ATOMIC_RELAXED));
+}
+
+double kinect_metrics_histogram_quantile(const kinect_metric *m, double q)
+{
+	uint64_t total = 0, seen = 0;
+	int b;
+	if (!m)
+		return 0;
+	for (b = 0; b <= m->nbuckets; b++)
+		total += __atomic_load_n(&m->buckets[b], __ATOMIC_RELAXED);
+	if (!total)
+		return 0;
+	for (b = 0; b < m->nbuckets; b++) {
+		seen += __atomic_load_n(&m->buckets[b], __ATOMIC_RELAXED);
+		if (seen >= q * total)
+			return m->bounds[b];
+	}
+	// above the last bound: best we can say is the last bound
+	return m->nbuckets ? m->bounds[m->nbuckets-1] : 0;
+}
+
+double kinect_metrics_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static double thread_cpu_seconds(const kinect_metric *m)
+{
+	struct timespec ts;
+	if (!__atomic_load_n(&m->cpu_bound, __ATOMIC_ACQUIRE) || clock_gettime(m->cpu_clock, &ts))
+		return 0;
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char *type_name(kinect_metric_type type)
+{
+	switch (type) {
+		case KINECT_METRIC_COUNTER:
+		case KINECT_METRIC_THREAD_CPU:
+			return "counter";
+		case KINECT_METRIC_GAUGE:
+			return "gauge";
+		case KINECT_METRIC_HISTOGRAM:
+			return "histogram";
+	}
+	return "untyped";
+}
+
+// name{labels,extra} with the braces left out when there is nothing to print
+static void write_series(FILE *out, const char *name, const char *suffix, const char *labels, const char *extra)
+{
+	int has_labels = labels && *labels;
+	fprintf(out, "%s%s", name, suffix);
+	if (has_labels || extra) {
+		fprintf(out, "{");
+		if (has_labels)
+			fprintf(out, "%s%s", labels, extra ? "," : "");
+		if (extra)
+			fprintf(out, "%s", extra);
+		fprintf(out, "}");
+	}
+}
+
+static void write_metric(FILE *out, const kinect_metric *m)
+{
+	char le[48];
+	int b;
+
+	switch (m->type) {
+		case KINECT_METRIC_COUNTER:
+			write_series(out, m->name, "", m->labels, NULL);
+			fprintf(out, " %llu\n", (unsigned long long)kinect_metrics_counter_value(m));
+			break;
+		case KINECT_METRIC_GAUGE:
+			write_series(out, m->name, "", m->labels, NULL);
+			fprintf(out, " %g\n", kinect_metrics_gauge_value(m));
+			break;
+		case KINECT_METRIC_THREAD_CPU:
+			// not bound yet: the thread has not started
+			if (!__atomic_load_n(&m->cpu_bound, __ATOMIC_ACQUIRE))
+				break;
+			write_series(out, m->name, "", m->labels, NULL);
+			fprintf(out, " %.6f\n", thread_cpu_seconds(m));
+			break;
+		case KINECT_METRIC_HISTOGRAM: {
+			uint64_t cumulative = 0;
+			for (b = 0; b <= m->nbuckets; b++) {
+				cumulative += __atomic_load_n(&m->buckets[b], __ATOMIC_RELAXED);
+				if (b < m->nbuckets)
+					snprintf(le, sizeof(le), "le=\"%g\"", m->bounds[b]);
+				else
+					snprintf(le, sizeof(le), "le=\"+Inf\"");
+				write_series(out, m->name, "_bucket", m->labels, le);
+				fprintf(out, " %llu\n", (unsigned long long)cumulative);
+			}
+			write_series(out, m->name, "_sum", m->labels, NULL);
+			fprintf(out, " %.3f\n", __atomic_load_n(&m->sum_us, __ATOMIC_RELAXED) / 1000.0);
+			write_series(out, m->name, "_count", m->labels, NULL);
+			fprintf(out, " %llu\n", (unsigned long long)__atomic_load_n(&m->count, __ATOMIC_RELAXED));
+			break;
+		}
+	}
+}
+
+static void format_prometheus(kinect_metrics *reg, FILE *out)
+{
+	int i, j, count;
+
+	pthread_mutex_lock(&reg->write_lock);
+	count = __atomic_load_n(&reg->count, __ATOMIC_ACQUIRE);
+	// One HELP/TYPE and one group of lines per family, in the order the families first appear:
+	// a second TYPE line for a family fails the whole scrape
+	for (i = 0; i < count; i++) {
+		const kinect_metric *m = &reg->metrics[i];
+		for (j = 0; j < i; j++)
+			if (!strcmp(reg->metrics[j].name, m->name))
+				break;
+		if (j < i)
+			continue; // written with the first metric of its family
+		fprintf(out, "# HELP %s %s\n", m->name, m->help ? m->help : "");
+		fprintf(out, "# TYPE %s %s\n", m->name, type_name(m->type));
+		for (j = i; j < count; j++)
+			if (!strcmp(reg->metrics[j].name, m->name))
+				write_metric(out, &reg->metrics[j]);
+	}
+	pthread_mutex_unlock(&reg->write_lock);
+}
+
+static void format_stats_json(kinect_metrics *reg, FILE *out)
+{
+	int i;
+	int first = 1;
+	int count;
+
+	pthread_mutex_lock(&reg->write_lock);
+	count = __atomic_load_n(&reg->count, __ATOMIC_ACQUIRE);
+	fprintf(out, "{ \"stats\" : {");
+	for (i = 0; i < count; i++) {
+		kinect_metric *m = &reg->metrics[i];
+		if (!m->json_key)
+			continue;
+		fprintf(out, "%s \"%s\" : ", first ? "" : ",", m->json_key);
+		first = 0;
+		switch (m->type) {
+			case KINECT_METRIC_COUNTER:
+				fprintf(out, "%llu", (unsigned long long)kinect_metrics_counter_value(m));
+				break;
+			case KINECT_METRIC_GAUGE:
+				fprintf(out, "%.1f", kinect_metrics_gauge_value(m));
+				break;
+			case KINECT_METRIC_THREAD_CPU:
+				fprintf(out, "%.2f", thread_cpu_seconds(m));
+				break;
+			case KINECT_METRIC_HISTOGRAM: {
+				uint64_t n = __atomic_load_n(&m->count, __ATOMIC_RELAXED);
+				double mean = n ? __atomic_load_n(&m->sum_us, __ATOMIC_RELAXED) / 1000.0 / n : 0;
+				fprintf(out, "[ %.2f , %g ]", mean, kinect_metrics_histogram_quantile(m, 0.95));
+				break;
+			}
+		}
+	}
+	fprintf(out, " }}\n");
+	pthread_mutex_unlock(&reg->write_lock);
+}
+
+// The document is formatted in memory under the lock and written once it is released:
+// a slow reader must not hold up the registrations and the other expositions
+static char *format_document(kinect_metrics *reg, void (*format)(kinect_metrics*, FILE*), size_t *len)
+{
+	char *doc = NULL;
+	FILE *mem = open_memstream(&doc, len);
+
+	if (!mem)
+		return NULL;
+	format(reg, mem);
+	if (fclose(mem)) {
+		free(doc);
+		return NULL;
+	}
+	return doc;
+}
+
+static void write_document(kinect_metrics *reg, void (*format)(kinect_metrics*, FILE*), FILE *out)
+{
+	size_t len;
+	char *doc = format_document(reg, format, &len);
+
+	if (!doc)
+		return;
+	fwrite(doc, 1, len, out); // one write: the event line is not interleaved with other output
+	fflush(out);
+	free(doc);
+}
+
+void kinect_metrics_write_prometheus(kinect_metrics *reg, FILE *out)
+{
+	write_document(reg, format_prometheus, out);
+}
+
+void kinect_metrics_write_stats_json(kinect_metrics *reg, FILE *out)
+{
+	write_document(reg, format_stats_json, out);
+}
+
+//
+// HTTP listener
+//
+
+typedef struct {
+	kinect_metrics *reg;
+	int fd;
+	kinect_metric *cpu;
+} metrics_server;
+
+#define CLIENT_TIMEOUT_S 2 // A client that sends or reads nothing for this long is dropped
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // BSD and macOS: SO_NOSIGPIPE on the client socket instead
+#endif
+
+// MSG_NOSIGNAL: a client gone before the end of the response must not SIGPIPE the process
+static int send_all(int fd, const char *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t sent = send(fd, buf, len, MSG_NOSIGNAL);
+		if (sent <= 0)
+			return -1;
+		buf += sent;
+		len -= sent;
+	}
+	return 0;
+}
+
+static void *metrics_server_threadfunc(void *arg)
+{
+	metrics_server *srv = (metrics_server*)arg;
+	static const char header[] = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n";
+	struct timeval timeout = { CLIENT_TIMEOUT_S, 0 };
+	char req[1024];
+
+	kinect_metrics_bind_thread(srv->cpu);
+	while (1) {
+		int client = accept(srv->fd, NULL, NULL);
+		if (client < 0)
+			continue;
+		// The server is one thread: a client that stalls must not hold up the next scrapes
+		setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+		{
+			int one = 1;
+			setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+		}
+#endif
+		// We serve the same document whatever the request; just drain the headers
+		ssize_t got = 0, len;
+		while (got < (ssize_t)sizeof(req) - 1 && (len = read(client, req + got, sizeof(req) - 1 - got)) > 0) {
+			got += len;
+			req[got] = 0;
+			if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n"))
+				break;
+		}
+		size_t doc_len;
+		char *doc = format_document(srv->reg, format_prometheus, &doc_len);
+		if (doc && send_all(client, header, sizeof(header) - 1) == 0)
+			send_all(client, doc, doc_len);
+		free(doc);
+		close(client);
+	}
+	return NULL;
+}
+
+int kinect_metrics_serve(kinect_metrics *reg, const char *endpoint)
+{
+	int fd;
+	pthread_t thread;
+
+	if (!strncmp(endpoint, "unix:", 5)) {
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, endpoint + 5, sizeof(addr.sun_path) - 1);
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0)
+			return -1;
+		unlink(addr.sun_path); // stale socket from a previous run
+		if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+			close(fd);
+			return -1;
+		}
+	} else {
+		struct sockaddr_in addr;
+		int one = 1;
+		const char *port = strncmp(endpoint, "tcp:", 4) ? endpoint : endpoint + 4;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(atoi(port));
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+			return -1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+			close(fd);
+			return -1;
+		}
+	}
+	if (listen(fd, 4) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	metrics_server *srv = (metrics_server*)malloc(sizeof(metrics_server));
+	srv->reg = reg;
+	srv->fd = fd;
+	srv->cpu = kinect_metrics_thread_cpu(reg, "metrics");
+	if (pthread_create(&thread, NULL, metrics_server_threadfunc, srv)) {
+		close(fd);
+		free(srv);
+		return -1;
+	}
+	pthread_detach(thread);
+	return 0;
+}
+
+//
+// Periodic stats event
+//
+
+typedef struct {
+	kinect_metrics *reg;
+	int interval_ms;
+	FILE *out;
+} stats_printer;
+
+static void *stats_threadfunc(void *arg)
+{
+	stats_printer *sp = (stats_printer*)arg;
+	struct timespec ts;
+	ts.tv_sec = sp->interval_ms / 1000;
+	ts.tv_nsec = (sp->interval_ms % 1000) * 1000000L;
+	while (1) {
+		nanosleep(&ts, NULL);
+		kinect_metrics_write_stats_json(sp->reg, sp->out);
+	}
+	return NULL;
+}
+
+int kinect_metrics_start_stats(kinect_metrics *reg, int interval_ms, FILE *out)
+{
+	pthread_t thread;
+	if (interval_ms <= 0)
+		return -1;
+	stats_printer *sp = (stats_printer*)malloc(sizeof(stats_printer));
+	sp->reg = reg;
+	sp->interval_ms = interval_ms;
+	sp->out = out;
+	if (pthread_create(&thread, NULL, stats_threadfunc, sp)) {
+		free(sp);
+		return -1;
+	}
+	pthread_detach(thread);
+	return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+ /* Metrics registry
+ Lock-free counters, gauges and latency histograms updated by the capture
+ pipeline. Metrics are registered at startup, before the threads that update
+ them; registration takes the registry lock so a late one cannot lose a slot.
+ Updates afterwards are plain atomic operations and can be done from any
+ thread, including the libfreenect USB callback. The CPU time of a thread is
+ reserved at startup like the other metrics, then bound by the thread itself.
+
+ The registry can be exposed as Prometheus text exposition over a local HTTP
+ listener (TCP bound to 127.0.0.1 or a Unix socket) and as a periodic compact
+ { "stats" : {...} } JSON event on the same stdout stream as the other events.
+ */
+
+#ifndef KINECT_METRICS_H
+#define KINECT_METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KINECT_METRICS_MAX 96          // Maximum number of registered metrics
+#define KINECT_METRICS_MAX_BUCKETS 16  // Maximum number of histogram buckets (+Inf is implicit)
+
+typedef enum {
+	KINECT_METRIC_COUNTER = 0,
+	KINECT_METRIC_GAUGE = 1,
+	KINECT_METRIC_HISTOGRAM = 2,
+	KINECT_METRIC_THREAD_CPU = 3,
+} kinect_metric_type;
+
+typedef double (*kinect_metric_sample_fn)(void *user);
+
+typedef struct kinect_metric {
+	kinect_metric_type type;
+	const char *name;     // Prometheus family name, e.g. kmouse_frames_total
+	const char *labels;   // Optional label set without braces, e.g. stream="depth"
+	const char *help;     // One line description
+	const char *json_key; // Short key in the stats event, NULL to leave it out
+	uint64_t value;       // Counter value, or gauge value as double bits
+	kinect_metric_sample_fn sample; // Gauges sampled at exposition time
+	void *sample_user;
+	// Histograms
+	int nbuckets;
+	double bounds[KINECT_METRICS_MAX_BUCKETS];
+	uint64_t buckets[KINECT_METRICS_MAX_BUCKETS+1];
+	uint64_t count;
+	uint64_t sum_us;      // Sum of observations in micro units
+	// Thread CPU time, exposed once bound by its thread
+	clockid_t cpu_clock;
+	int cpu_bound;
+} kinect_metric;
+
+typedef struct kinect_metrics {
+	kinect_metric metrics[KINECT_METRICS_MAX];
+	int count;
+	pthread_mutex_t write_lock; // Serializes registrations and expositions, never taken on updates
+} kinect_metrics;
+
+void kinect_metrics_init(kinect_metrics *reg);
+
+// Registration, thread safe. The metrics of a family are exposed together whatever
+// the order they were registered in, with the help of the first one.
+// Returns NULL when the registry is full; every update function accepts NULL.
+kinect_metric *kinect_metrics_counter(kinect_metrics *reg, const char *name, const char *labels, const char *help, const char *json_key);
+kinect_metric *kinect_metrics_gauge(kinect_metrics *reg, const char *name, const char *labels, const char *help, const char *json_key);
+kinect_metric *kinect_metrics_gauge_fn(kinect_metrics *reg, const char *name, const char *labels, const char *help, const char *json_key, kinect_metric_sample_fn fn, void *user);
+// bounds: ascending bucket upper limits, in the unit of the observations (ms for latencies)
+kinect_metric *kinect_metrics_histogram(kinect_metrics *reg, const char *name, const char *labels, const char *help, const char *json_key, const double *bounds, int nbounds);
+// Reserves the CPU time series of a thread, kmouse_thread_cpu_seconds_total{thread="<name>"}
+kinect_metric *kinect_metrics_thread_cpu(kinect_metrics *reg, const char *thread_name);
+// Binds a reserved series to the calling thread, to be called from the thread itself
+void kinect_metrics_bind_thread(kinect_metric *m);
+
+// Lock-free updates
+void kinect_metrics_add(kinect_metric *m, uint64_t n);
+void kinect_metrics_inc(kinect_metric *m);
+void kinect_metrics_set(kinect_metric *m, double v);
+void kinect_metrics_observe(kinect_metric *m, double v);
+
+uint64_t kinect_metrics_counter_value(const kinect_metric *m);
+double kinect_metrics_gauge_value(const kinect_metric *m);
+// Approximate quantile (upper bound of the bucket holding it), 0 if empty
+double kinect_metrics_histogram_quantile(const kinect_metric *m, double q);
+
+// Monotonic clock in milliseconds, used for stage timings
+double kinect_metrics_now_ms(void);
+
+// Exposition
+void kinect_metrics_write_prometheus(kinect_metrics *reg, FILE *out);
+void kinect_metrics_write_stats_json(kinect_metrics *reg, FILE *out);
+
+// Start a background listener serving the Prometheus text exposition over HTTP.
+// endpoint: "unix:/path/to/socket", "tcp:PORT" or just "PORT" (bound to 127.0.0.1).
+// Returns 0 on success.
+int kinect_metrics_serve(kinect_metrics *reg, const char *endpoint);
+
+// Start a background thread printing the stats JSON event every interval_ms to out.
+int kinect_metrics_start_stats(kinect_metrics *reg, int interval_ms, FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KINECT_METRICS_H
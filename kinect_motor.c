@@ -0,0 +1,206 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "kinect_motor.h"
+
+#define MOTOR_NICE 10 // Motor thread priority, below the usb and analysis threads
+
+static double monotonic_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int poll_state(kinect_motor *m, kinect_motor_state *state)
+{
+	kinect_motor_state s;
+	freenect_raw_tilt_state *raw;
+
+	if (freenect_update_tilt_state(m->dev) < 0)
+		return -1;
+	raw = freenect_get_tilt_state(m->dev);
+	s.raw = *raw;
+	s.tilt_degs = freenect_get_tilt_degs(raw);
+	freenect_get_mks_accel(raw, &s.accel_x, &s.accel_y, &s.accel_z);
+	s.updated_ms = monotonic_ms();
+
+	pthread_mutex_lock(&m->lock);
+	s.updates = m->state.updates + 1;
+	m->state = s;
+	pthread_mutex_unlock(&m->lock);
+	if (state)
+		*state = s;
+	return 0;
+}
+
+static void *motor_threadfunc(void *arg)
+{
+	kinect_motor *m = (kinect_motor *)arg;
+	kinect_motor_command cmd;
+	struct timespec deadline;
+	double next_poll = monotonic_ms();
+
+#ifdef SYS_gettid
+	// On Linux the nice value is per thread
+	setpriority(PRIO_PROCESS, syscall(SYS_gettid), MOTOR_NICE);
+#endif
+
+	pthread_mutex_lock(&m->lock);
+	while (m->running || m->count) {
+		if (!m->count) {
+			if (m->poll_hz > 0) {
+				double wait_ms = next_poll - monotonic_ms();
+				if (wait_ms > 0) {
+					// pthread_cond_timedwait wants CLOCK_REALTIME
+					clock_gettime(CLOCK_REALTIME, &deadline);
+					deadline.tv_sec += (time_t)(wait_ms / 1000);
+					deadline.tv_nsec += (long)((wait_ms - (int)(wait_ms / 1000) * 1000) * 1000000);
+					if (deadline.tv_nsec >= 1000000000) {
+						deadline.tv_sec++;
+						deadline.tv_nsec -= 1000000000;
+					}
+					pthread_cond_timedwait(&m->cond, &m->lock, &deadline);
+				}
+			} else {
+				pthread_cond_wait(&m->cond, &m->lock);
+			}
+			if (!m->count) {
+				if (m->poll_hz > 0 && monotonic_ms() >= next_poll) {
+					pthread_mutex_unlock(&m->lock);
+					poll_state(m, NULL);
+					pthread_mutex_lock(&m->lock);
+					next_poll += 1000.0 / m->poll_hz;
+					if (next_poll < monotonic_ms())
+						next_poll = monotonic_ms() + 1000.0 / m->poll_hz;
+				}
+				continue;
+			}
+		}
+
+		cmd = m->queue[m->head];
+		m->head = (m->head + 1) % KINECT_MOTOR_QUEUE;
+		m->count--;
+		pthread_mutex_unlock(&m->lock);
+
+		// USB control transfers, outside of the lock
+		switch (cmd.type) {
+			case KINECT_MOTOR_TILT:
+				freenect_set_tilt_degs(m->dev, cmd.tilt_degs);
+				break;
+			case KINECT_MOTOR_LED:
+				freenect_set_led(m->dev, cmd.led);
+				break;
+			case KINECT_MOTOR_UPDATE:
+				{
+					kinect_motor_state s;
+					int ok = poll_state(m, &s) == 0;
+					if (cmd.done)
+						cmd.done(cmd.user, ok ? &s : NULL);
+				}
+				break;
+		}
+
+		pthread_mutex_lock(&m->lock);
+	}
+	pthread_mutex_unlock(&m->lock);
+	return NULL;
+}
+
+int kinect_motor_start(kinect_motor *m, freenect_device *dev, int poll_hz)
+{
+	memset(m, 0, sizeof(*m));
+	m->dev = dev;
+	m->poll_hz = poll_hz > 0 ? poll_hz : 0;
+	m->running = 1;
+	pthread_mutex_init(&m->lock, NULL);
+	pthread_cond_init(&m->cond, NULL);
+	if (pthread_create(&m->thread, NULL, motor_threadfunc, m)) {
+		m->running = 0;
+		return -1;
+	}
+	return 0;
+}
+
+void kinect_motor_stop(kinect_motor *m)
+{
+	pthread_mutex_lock(&m->lock);
+	if (!m->running) {
+		pthread_mutex_unlock(&m->lock);
+		return;
+	}
+	m->running = 0;
+	pthread_cond_signal(&m->cond);
+	pthread_mutex_unlock(&m->lock);
+	pthread_join(m->thread, NULL);
+}
+
+static void enqueue(kinect_motor *m, const kinect_motor_command *cmd)
+{
+	int i;
+
+	pthread_mutex_lock(&m->lock);
+	if (!m->running) {
+		pthread_mutex_unlock(&m->lock);
+		return;
+	}
+	// Only the last tilt/LED request matters, e.g. when a key is held down
+	for (i = 0; i < m->count; i++) {
+		kinect_motor_command *pending = &m->queue[(m->head + i) % KINECT_MOTOR_QUEUE];
+		if (pending->type == cmd->type) {
+			// A poll serves the requests pending for it, the last one that wants the state gets it
+			if (cmd->type == KINECT_MOTOR_UPDATE && !cmd->done) {
+				pthread_mutex_unlock(&m->lock);
+				return;
+			}
+			*pending = *cmd;
+			pthread_mutex_unlock(&m->lock);
+			return;
+		}
+	}
+	if (m->count < KINECT_MOTOR_QUEUE) {
+		m->queue[(m->head + m->count) % KINECT_MOTOR_QUEUE] = *cmd;
+		m->count++;
+		pthread_cond_signal(&m->cond);
+	}
+	pthread_mutex_unlock(&m->lock);
+}
+
+void kinect_motor_set_tilt(kinect_motor *m, double degs)
+{
+	kinect_motor_command cmd = { KINECT_MOTOR_TILT, degs, LED_OFF };
+	enqueue(m, &cmd);
+}
+
+void kinect_motor_set_led(kinect_motor *m, freenect_led_options led)
+{
+	kinect_motor_command cmd = { KINECT_MOTOR_LED, 0, led };
+	enqueue(m, &cmd);
+}
+
+void kinect_motor_request_update(kinect_motor *m, kinect_motor_state_cb done, void *user)
+{
+	kinect_motor_command cmd = { KINECT_MOTOR_UPDATE, 0, LED_OFF, done, user };
+	enqueue(m, &cmd);
+}
+
+int kinect_motor_get_state(kinect_motor *m, kinect_motor_state *state)
+{
+	pthread_mutex_lock(&m->lock);
+	*state = m->state;
+	pthread_mutex_unlock(&m->lock);
+	return state->updates != 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+ /* Motor and accelerometer subsystem
+ freenect_update_tilt_state, freenect_set_tilt_degs and freenect_set_led are
+ synchronous USB control transfers. Issued from the freenect_process_events
+ loop they delay the servicing of the isochronous depth and video streams.
+
+ This runs them on a low priority thread of their own: the tilt state is polled
+ at a configurable rate (or on demand) and cached for readers, and tilt/LED
+ commands are queued and executed in order. The libfreenect event loop is left
+ with nothing to do but pump USB events.
+ */
+
+#ifndef KINECT_MOTOR_H
+#define KINECT_MOTOR_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "libfreenect.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KINECT_MOTOR_QUEUE 16 // Pending tilt/LED commands
+
+typedef enum {
+	KINECT_MOTOR_TILT = 0,
+	KINECT_MOTOR_LED = 1,
+	KINECT_MOTOR_UPDATE = 2, // Poll the tilt state now
+} kinect_motor_command_type;
+
+typedef struct {
+	freenect_raw_tilt_state raw;
+	double tilt_degs;
+	double accel_x, accel_y, accel_z; // m/s^2
+	double updated_ms;                // CLOCK_MONOTONIC time of the poll in ms, 0 if never polled
+	uint32_t updates;
+} kinect_motor_state;
+
+// Called on the motor thread with the polled state, NULL if the poll failed
+typedef void (*kinect_motor_state_cb)(void *user, const kinect_motor_state *state);
+
+typedef struct {
+	kinect_motor_command_type type;
+	double tilt_degs;
+	freenect_led_options led;
+	kinect_motor_state_cb done;       // KINECT_MOTOR_UPDATE
+	void *user;
+} kinect_motor_command;
+
+typedef struct kinect_motor {
+	freenect_device *dev;
+	int poll_hz;                      // 0: only poll on demand
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	kinect_motor_command queue[KINECT_MOTOR_QUEUE];
+	int head, count;
+	int running;
+	kinect_motor_state state;         // Protected by lock
+} kinect_motor;
+
+// Start the motor thread. poll_hz: tilt state polls per second, 0 to poll only on request
+int kinect_motor_start(kinect_motor *m, freenect_device *dev, int poll_hz);
+// Drain the queue and stop the thread. Must be called before closing the device
+void kinect_motor_stop(kinect_motor *m);
+
+// Queue commands, they return immediately. A command replaces a pending one of the same type
+void kinect_motor_set_tilt(kinect_motor *m, double degs);
+void kinect_motor_set_led(kinect_motor *m, freenect_led_options led);
+// done, if not NULL, gets the state once this poll is over: kinect_motor_get_state
+// right after the request still returns the previous one
+void kinect_motor_request_update(kinect_motor *m, kinect_motor_state_cb done, void *user);
+
+// Copy of the last polled state. Returns 0 if the state was never polled
+int kinect_motor_get_state(kinect_motor *m, kinect_motor_state *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KINECT_MOTOR_H
@@ -32,6 +32,7 @@
 #include <string.h>
 #include <ncurses.h>
 #include "libfreenect.h"
+#include "kinect_motor.h"
 
 #include <assert.h>
 #include <X11/Xlib.h>
@@ -78,6 +79,9 @@ GLuint gl_rgb_tex;
 
 freenect_context *f_ctx;
 freenect_device *f_dev;
+kinect_motor motor;
+
+#define TILT_POLL_HZ 1
 
 int freenect_angle = 17;
 int freenect_led;
@@ -153,39 +157,39 @@ void keyPressed(unsigned char key, int x, int y)
 		break;
 		case 'w':
 			if (freenect_angle < 29) freenect_angle++;
-			freenect_set_tilt_degs(f_dev,freenect_angle);
+			kinect_motor_set_tilt(&motor,freenect_angle);
 			printf("\nAngle: %d degrees\n", freenect_angle);
 		break;
 		case 's':
 			freenect_angle = 0;
-			freenect_set_tilt_degs(f_dev,freenect_angle);
+			kinect_motor_set_tilt(&motor,freenect_angle);
 			printf("\nAngle: %d degrees\n", freenect_angle);
 		break;
 		case 'x':
 			if (freenect_angle > -30) freenect_angle--;
-			freenect_set_tilt_degs(f_dev,freenect_angle);
+			kinect_motor_set_tilt(&motor,freenect_angle);
 			printf("\nAngle: %d degrees\n", freenect_angle);
 		break;
 		case '1':
-			freenect_set_led(f_dev,LED_GREEN);
+			kinect_motor_set_led(&motor,LED_GREEN);
 		break;
 		case '2':
-			freenect_set_led(f_dev,LED_RED);
+			kinect_motor_set_led(&motor,LED_RED);
 		break;
 		case '3':
-			freenect_set_led(f_dev,LED_YELLOW);
+			kinect_motor_set_led(&motor,LED_YELLOW);
 		break;
 		case '4':
-			freenect_set_led(f_dev,LED_BLINK_YELLOW);
+			kinect_motor_set_led(&motor,LED_BLINK_YELLOW);
 		break;
 		case '5':
-			freenect_set_led(f_dev,LED_BLINK_GREEN);
+			kinect_motor_set_led(&motor,LED_BLINK_GREEN);
 		break;
 		case '6':
-			freenect_set_led(f_dev,LED_BLINK_RED_YELLOW);
+			kinect_motor_set_led(&motor,LED_BLINK_RED_YELLOW);
 		break;
 		case '0':
-			freenect_set_led(f_dev,LED_OFF);
+			kinect_motor_set_led(&motor,LED_OFF);
 		break;
 		case 'o':
 			tmprot+=0.1;
@@ -360,8 +364,10 @@ void rgb_cb(freenect_device *dev, void *rgb, uint32_t timestamp)
 
 void *freenect_threadfunc(void *arg)
 {
-	freenect_set_tilt_degs(f_dev,freenect_angle);
-	freenect_set_led(f_dev,LED_GREEN);
+	// Tilt, led and accelerometer live on the motor thread, this loop only pumps usb events
+	kinect_motor_start(&motor, f_dev, TILT_POLL_HZ);
+	kinect_motor_set_tilt(&motor,freenect_angle);
+	kinect_motor_set_led(&motor,LED_GREEN);
 	freenect_set_depth_callback(f_dev, depth_cb);
 	freenect_set_video_callback(f_dev, rgb_cb);
 	freenect_set_video_format(f_dev, FREENECT_VIDEO_RGB);
@@ -373,20 +379,13 @@ void *freenect_threadfunc(void *arg)
 	printf("'W'-Tilt Up, 'S'-Level, 'X'-Tilt Down, '0'-'6'-LED Mode\n");
 
 	while(!die && freenect_process_events(f_ctx) >= 0 )
-	{
-		freenect_raw_tilt_state* state;
-		freenect_update_tilt_state(f_dev);
-		state = freenect_get_tilt_state(f_dev);;
-		double dx,dy,dz;
-		freenect_get_mks_accel(state, &dx, &dy, &dz);
-		//printf("\r raw acceleration: %4d %4d %4d  mks acceleration: %4f %4f %4f\r", ax, ay, az, dx, dy, dz);
-		fflush(stdout);
-	}
+		;
 
 	printf("\nShutting Down Streams...\n");
 
 	freenect_stop_depth(f_dev);
 	freenect_stop_video(f_dev);
+	kinect_motor_stop(&motor);
 
 	freenect_close_device(f_dev);
 	freenect_shutdown(f_ctx);
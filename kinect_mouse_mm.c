@@ -38,6 +38,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <ncurses.h>
 #include "libfreenect.h"
 
@@ -54,33 +55,23 @@
 
 #include <math.h>
 #include <time.h>
+#include <sys/ioctl.h>
 //#include <gsl/gsl_math.h>
 
-// Median Calculation 
+#include "kinect_metrics.h"
+#include "kinect_motor.h"
+#include "kinect_load.h"
+#include "kinect_gesture.h"
+#include "kinect_sched.h"
+#include "kinect_state.h"
+
+// Row band streaming is only in recent libfreenect builds, see stream_rows
+#pragma weak freenect_set_depth_rows_callback
+
 #define SCREEN (DefaultScreen(display))
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
- 
-//Customize for your data Item type
-typedef int Item;
-#define ItemLess(a,b)  ((a)<(b))
-#define ItemMean(a,b)  (((a)+(b))/2)
- 
-typedef struct Mediator_t
-{
-   Item* data;  //circular queue of values
-   int*  pos;   //index into `heap` for each value
-   int*  heap;  //max/median/min heap holding indexes into `data`.
-   int   N;     //allocated size.
-   int   idx;   //position in circular queue
-   int   ct;    //count of items in queue
-} Mediator;
- 
-/*--- Helper Functions ---*/
- 
-#define minCt(m) (((m)->ct-1)/2) //count of items in minheap
-#define maxCt(m) (((m)->ct)/2)   //count of items in maxheap 
- 
+
 int depth;
 char *display_name;
 
@@ -111,9 +102,8 @@ GLuint gl_rgb_tex;
 
 freenect_context *f_ctx;
 freenect_device *f_dev;
+kinect_motor motor;		// tilt, led and accelerometer, see kinect_motor.h
 
-float pointerx = 0, pointery = 0;
-float mousex = 0, mousey = 0;  // mouse cordinates in screen coordinates
 // float tmousex = 0, tmousey = 0;
 int screenw = 0, screenh = 0;
 int NearPixel_TooClose;  // Kinect depth NearPixel_TooClose maximum number of pixels 
@@ -123,6 +113,7 @@ int freenect_angle = -30;  //kinect inclination -30,30
 int freenect_led = 1;   //kinect led LED_OF= 0,    LED_GREEN  = 1,    LED_RED    = 2,    LED_YELLOW = 3, (actually orange)   LED_BLINK_YELLOW = 4, (actually orange)   LED_BLINK_GREEN = 5,   LED_BLINK_RED_YELLOW = 6 (actually red/orange) 
 int gesture_click_area =15; // size of pause area
 int hovering_threshold=15; // How many  iterations to wait to determine a click
+double click_ms = 0; // click_ms=N : time to hold the pointer still for a click, 0 = hovering_threshold frames at 30 fps
 int near_threshold, far_threshold; // depth threshold that indicate object nearness/farness
 int MMM_Output_log = 1;  // Output program log info to stdout in json format
 int MMM_Output_status = 1;  // Output sensor status to stdout in json format
@@ -132,192 +123,187 @@ int MMM_Output_swipes = 1;  // Output swipe info to stdout in json format
 int jsonout = 1; // output status output in json format to stdout
 int debug = 1;  // print verbose variables and display screens
 int debugstop = 0;  // stop at each debug info
-int stroke_x[1000],stroke_y[1000]; //We store all coordinates between two empty or invalid frames in this array
-int h_stroke_left2right_count, h_stroke_right2left_count, v_stroke_up2down_count, v_stroke_down2up_count; //stroke monotonouneness count: number of subsequent move in same direction.
-long h_stroke_left2right_sum, h_stroke_right2left_sum, v_stroke_up2down_sum, v_stroke_down2up_sum; //stroke monotonouneness count: sum of coordinates displacements of subsequent move in same direction.
-long h_sum,v_sum; // sum of horizontal or vertical coordinates
-float h_mean,v_mean,h_variance,v_variance; // horizontal / vertical mean; horizontal / vertical variance 
-long left2rightmul, right2leftmul, up2downmul, down2upmul;
 long h_varmax=100,v_varmax=100; // Maximum horizontal or vertical Variance to assess a sequence of points as a horizontal or vertical strike 
 int minimum_stroke_points,maximum_stroke_points; // minimum number of coordinates to evaluate a stroke
+double stroke_min_ms = 0, stroke_max_ms = 0; // stroke_min_ms=N stroke_max_ms=N : duration of a swipe, 0 = stroke points at 30 fps
 // float ystretch = 1.4;  // y stretch factor (supposing kinect is above or below mirror)
 int ScreenCenterX=320, ScreenCenterY=240; // Point to measure distance from hand (elbow)
-float DistCen[640][480]; // Precalculated Distances from Screen Center		
-int current_hovering_cycles = 0; // The current number of subsequent frames we are hovering over an hovering area
-int PointerX = 0, PointerY = 0; // need we to say what this is?
 int ShowScreen; // Display Camera and Depth Camera if 1
 
 pthread_cond_t gl_frame_cond = PTHREAD_COND_INITIALIZER;
 int got_frames = 0;
- // Current number of points in stroke between invalid of blank frames; initialized at 0 at 
- // beginning of program and after blank or invalid screen or click
-int current_pixel=0;
- // Number of points in stroke between invalid of blank frames; initialized at 0 at 
- // beginning of program, end of stroke ( blank or invalid screen or click)
-int StrokeEval=0; // Flag: evaluate swipe if set to 1
-
-//Median Calculation Functions
 
-//returns 1 if heap[i] < heap[j]
-int mmless(Mediator* m, int i, int j)
-{
-   return ItemLess(m->data[m->heap[i]],m->data[m->heap[j]]);
-}
- 
-//swaps items i&j in heap, maintains indexes
-int mmexchange(Mediator* m, int i, int j)
-{
-   int t = m->heap[i];
-   m->heap[i]=m->heap[j];
-   m->heap[j]=t;
-   m->pos[m->heap[i]]=i;
-   m->pos[m->heap[j]]=j;
-   return 1;
-}
- 
-//swaps items i&j if i<j;  returns true if swapped
-int mmCmpExch(Mediator* m, int i, int j)
-{
-   return (mmless(m,i,j) && mmexchange(m,i,j));
-}
- 
-//maintains minheap property for all items below i/2.
-void minSortDown(Mediator* m, int i)
+// Optional settings, given as name=value after the positional parameters
+char *metrics_endpoint = NULL; // metrics=unix:/path or metrics=tcp:port : serve Prometheus metrics there
+int user_device_number = 0;	// device=N : open the N-th kinect (with fakenect, the N-th source of FAKENECT_PATH)
+int tilt_hz = 1;		// tilt state polls per second on the motor thread, 0 = only on request
+int stream_rows = 0;	// stream_rows=N : scan the depth frame in bands of N rows while it is received (0 = whole frames)
+int stats_interval = 0; // stats=N : print a { "stats" : ... } event every N seconds (0 = never)
+int headless = 0;		// headless=1 or headless=WxH : no X display, mouse or window, exit at the end of the stream (replays)
+int event_time = 0;		// event_time=1 : add the frame index and timestamp to swipe and click events
+int click_mode = KINECT_GESTURE_CLICK_DWELL; // click=dwell|push|both
+kinect_push_config push_config; // push_mm=N push_ms=N : travel and duration of a push
+double late_ms = 0;		// late_ms=N : see kinect_clock.h
+double idle_s = 10;		// idle_s=N : go idle after N seconds of toofar frames (0 = never)
+int idle_every = 5;		// idle_every=K : analyse every K-th depth frame while idle
+int idle_grid = 8;		// idle_grid=G : while idle, look at one pixel in GxG for the hand
+
+// Power state: while nobody is in front of the mirror the gesture library skips most
+// depth frames and looks for the hand on a coarse grid, the RGB stream is stopped
+int video_wanted = 1;	// RGB stream state the usb thread should set
+double active_frame_ms = 0, active_rgb_ms = 0; // average cost of an analysed depth frame and of a RGB frame
+double idle_saved_ms = 0;	// cpu time not spent thanks to idle mode, estimated from the averages above
+kinect_load_config load_config; // latency_ms=N load_max=LEVEL : latency budget and deepest shedding
+
+// The hand pointer, clicks and swipes, see kinect_gesture.h. Its callbacks print the events
+// and drive the X pointer, the preview image is painted in gl_depth_back
+kinect_gesture gesture;
+double output_ms = 0;	// time spent in X output by the callbacks of the current frame
+char *state_name = NULL;	// state=NAME : publish the latest pointer state in /dev/shm/NAME, see kinect_state.h
+kinect_state state;		// filled by the gesture callbacks, published once per analysed frame
+// Thread scheduling, see kinect_sched.h. Analysis and output run in the libfreenect
+// callbacks, so sched_usb covers the usb pump, the analysis and the events
+kinect_sched_config sched_usb, sched_gl, sched_motor; // sched_usb=fifo:50@2 sched_gl=... sched_motor=...
+int lock_memory = 0;	// mlockall=1 : lock the process memory, no page fault in the callbacks
+double sched_probe_ms = -1; // sched_probe_ms=N : scheduling latency probe period, 0 = no probes, default 100 with a sched_* setting
+kinect_sched_probe usb_probe, gl_probe, motor_probe;
+
+// Metrics registry and the metrics updated by the callbacks
+kinect_metrics metrics;
+kinect_metric *m_depth_received, *m_depth_processed, *m_depth_dropped, *m_depth_late;
+kinect_metric *m_rgb_received;
+kinect_metric *m_fps;
+kinect_metric *m_power_idle, *m_idle_skipped, *m_idle_wakes;
+kinect_metric *m_load_level, *m_load_up, *m_load_down, *m_load_latency, *m_load_busy, *m_load_shed;
+kinect_metric *m_stage_lock, *m_stage_scan, *m_stage_gesture, *m_stage_output, *m_stage_frame, *m_stage_rgb, *m_stage_band;
+kinect_metric *m_sched_usb, *m_sched_gl, *m_sched_motor, *m_sched_fallback;
+kinect_metric *m_cpu_usb, *m_cpu_gl;
+double fps_last_tick = 0; // frame rate is evaluated once per second as in ntk::RGBDGrabber
+int fps_frame_count = 0;
+
+//Metrics Functions
+
+// Bytes printed to stdout and not yet read by our consumer (pipe to the MagicMirror node helper)
+double stdout_queue_bytes(void *unused)
 {
-   for (; i <= minCt(m); i*=2)
-   {  if (i>1 && i < minCt(m) && mmless(m, i+1, i)) { ++i; }
-      if (!mmCmpExch(m,i,i/2)) { break; }
-   }
+	int n = 0;
+	if (ioctl(fileno(stdout), FIONREAD, &n) < 0)
+		return 0;
+	return n;
 }
- 
-//maintains maxheap property for all items below i/2. (negative indexes)
-void maxSortDown(Mediator* m, int i)
-{
-   for (; i >= -maxCt(m); i*=2)
-   {  if (i<-1 && i > -maxCt(m) && mmless(m, i, i-1)) { --i; }
-      if (!mmCmpExch(m,i/2,i)) { break; }
-   }
-}
- 
-//maintains minheap property for all items above i, including median
-//returns true if median changed
-int minSortUp(Mediator* m, int i)
-{
-   while (i>0 && mmCmpExch(m,i,i/2)) i/=2;
-   return (i==0);
-}
- 
-//maintains maxheap property for all items above i, including median
-//returns true if median changed
-int maxSortUp(Mediator* m, int i)
+
+// Frames handed to the preview thread and not yet drawn
+double preview_pending_frames(void *unused)
 {
-   while (i<0 && mmCmpExch(m,i/2,i))  i/=2;
-   return (i==0);
+	return got_frames;
 }
- 
-/*--- Public Interface ---*/
- 
- 
-//creates new Mediator: to calculate `nItems` running median. 
-//mallocs single block of memory, caller must free.
-Mediator* MediatorNew(int nItems)
+
+double idle_saved_cpu(void *user)
 {
-   int size = sizeof(Mediator)+nItems*(sizeof(Item)+sizeof(int)*2);
-   Mediator* m=  malloc(size);
-   m->data= (Item*)(m+1);
-   m->pos = (int*) (m->data+nItems);
-   m->heap = m->pos+nItems + (nItems/2); //points to middle of storage.
-   m->N=nItems;
-   m->ct = m->idx = 0;
-   while (nItems--)  //set up initial heap fill pattern: median,max,min,max,...
-   {  m->pos[nItems]= ((nItems+1)/2) * ((nItems&1)?-1:1);
-      m->heap[m->pos[nItems]]=nItems;
-   }
-   return m;
+	return idle_saved_ms;
 }
- 
- 
-//Inserts item, maintains median in O(lg nItems)
-void MediatorInsert(Mediator* m, Item v)
+
+void init_metrics()
 {
-   int isNew=(m->ct<m->N);
-   int p = m->pos[m->idx];
-   Item old = m->data[m->idx];
-   m->data[m->idx]=v;
-   m->idx = (m->idx+1) % m->N;
-   m->ct+=isNew;
-   if (p>0)         //new item is in minHeap
-   {  if (!isNew && ItemLess(old,v)) { minSortDown(m,p*2);  }
-      else if (minSortUp(m,p)) { maxSortDown(m,-1); }
-   }
-   else if (p<0)   //new item is in maxheap
-   {  if (!isNew && ItemLess(v,old)) { maxSortDown(m,p*2); }
-      else if (maxSortUp(m,p)) { minSortDown(m, 1); }
-   }
-   else            //new item is at median
-   {  if (maxCt(m)) { maxSortDown(m,-1); }
-      if (minCt(m)) { minSortDown(m, 1); }
-   }
+	static const double stage_bounds[] = { 0.25, 0.5, 1, 2, 4, 8, 16, 33, 66, 133, 250 };
+	static const double sched_bounds[] = { 0.05, 0.1, 0.25, 0.5, 1, 2, 4, 8, 16, 33 };
+	int nb = sizeof(stage_bounds)/sizeof(stage_bounds[0]);
+	int ns = sizeof(sched_bounds)/sizeof(sched_bounds[0]);
+
+	kinect_metrics_init(&metrics);
+	m_depth_received = kinect_metrics_counter(&metrics, "kmouse_frames_received_total", "stream=\"depth\"", "Frames delivered by libfreenect", "rx");
+	m_rgb_received = kinect_metrics_counter(&metrics, "kmouse_frames_received_total", "stream=\"rgb\"", "Frames delivered by libfreenect", "rgb_rx");
+	m_depth_processed = kinect_metrics_counter(&metrics, "kmouse_frames_processed_total", "stream=\"depth\"", "Depth frames fully analysed", "proc");
+	m_depth_dropped = kinect_metrics_counter(&metrics, "kmouse_frames_dropped_total", "stream=\"depth\"", "Depth frames missing according to the sensor timestamps", "drop");
+	m_depth_late = kinect_metrics_counter(&metrics, "kmouse_frames_late_total", "stream=\"depth\"", "Depth frames that reached the callback late according to the sensor timestamps", "late");
+	m_fps = kinect_metrics_gauge(&metrics, "kmouse_fps", "stream=\"depth\"", "Processed depth frames per second", "fps");
+	m_power_idle = kinect_metrics_gauge(&metrics, "kmouse_power_idle", NULL, "1 while idle: few depth frames analysed on a coarse grid, no RGB stream", "idle");
+	m_idle_skipped = kinect_metrics_counter(&metrics, "kmouse_frames_skipped_total", "reason=\"idle\"", "Depth frames not analysed", "skip");
+	m_load_shed = kinect_metrics_counter(&metrics, "kmouse_frames_skipped_total", "reason=\"load\"", "Depth frames not analysed", "shed");
+	m_idle_wakes = kinect_metrics_counter(&metrics, "kmouse_idle_wakes_total", NULL, "Returns from idle to full rate", "wakes");
+	kinect_metrics_gauge_fn(&metrics, "kmouse_idle_cpu_saved_ms", NULL, "Estimated processing time saved by idle mode in ms", "saved_ms", idle_saved_cpu, NULL);
+	m_load_level = kinect_metrics_gauge(&metrics, "kmouse_load_level", NULL, "Load shedding level: 0 full, 1 no preview, 2 roi, 3 decimate, 4 skip late frames", "load");
+	m_load_up = kinect_metrics_counter(&metrics, "kmouse_load_changes_total", "direction=\"up\"", "Load shedding level changes", "load_up");
+	m_load_down = kinect_metrics_counter(&metrics, "kmouse_load_changes_total", "direction=\"down\"", "Load shedding level changes", "load_down");
+	m_load_latency = kinect_metrics_gauge(&metrics, "kmouse_load_latency_ms", NULL, "Average latency from the sensor to the end of frame processing", "latency_ms");
+	m_load_busy = kinect_metrics_gauge(&metrics, "kmouse_load_busy", NULL, "Average processing time over the frame interval", "busy");
+	m_stage_lock = kinect_metrics_histogram(&metrics, "kmouse_stage_latency_ms", "stage=\"lock\"", "Time spent per pipeline stage in milliseconds", "lock_ms", stage_bounds, nb);
+	m_stage_scan = kinect_metrics_histogram(&metrics, "kmouse_stage_latency_ms", "stage=\"scan\"", "Time spent per pipeline stage in milliseconds", "scan_ms", stage_bounds, nb);
+	m_stage_gesture = kinect_metrics_histogram(&metrics, "kmouse_stage_latency_ms", "stage=\"gesture\"", "Time spent per pipeline stage in milliseconds", "gesture_ms", stage_bounds, nb);
+	m_stage_output = kinect_metrics_histogram(&metrics, "kmouse_stage_latency_ms", "stage=\"output\"", "Time spent per pipeline stage in milliseconds", "output_ms", stage_bounds, nb);
+	m_stage_frame = kinect_metrics_histogram(&metrics, "kmouse_stage_latency_ms", "stage=\"frame\"", "Time spent per pipeline stage in milliseconds", "frame_ms", stage_bounds, nb);
+	m_stage_rgb = kinect_metrics_histogram(&metrics, "kmouse_stage_latency_ms", "stage=\"rgb\"", "Time spent per pipeline stage in milliseconds", NULL, stage_bounds, nb);
+	m_stage_band = kinect_metrics_histogram(&metrics, "kmouse_stage_latency_ms", "stage=\"band\"", "Time spent per pipeline stage in milliseconds", NULL, stage_bounds, nb);
+	m_sched_usb = kinect_metrics_histogram(&metrics, "kmouse_sched_latency_ms", "thread=\"usb\"", "Wake up delay of a probe thread scheduled as the thread, in milliseconds", "sched_ms", sched_bounds, ns);
+	m_sched_gl = kinect_metrics_histogram(&metrics, "kmouse_sched_latency_ms", "thread=\"gl\"", "Wake up delay of a probe thread scheduled as the thread, in milliseconds", NULL, sched_bounds, ns);
+	m_sched_motor = kinect_metrics_histogram(&metrics, "kmouse_sched_latency_ms", "thread=\"motor\"", "Wake up delay of a probe thread scheduled as the thread, in milliseconds", NULL, sched_bounds, ns);
+	m_sched_fallback = kinect_metrics_counter(&metrics, "kmouse_sched_fallbacks_total", NULL, "Thread scheduling settings that could not be applied", "sched_fail");
+	kinect_metrics_gauge_fn(&metrics, "kmouse_queue_depth", "queue=\"stdout_bytes\"", "Output waiting to be consumed", "outq", stdout_queue_bytes, NULL);
+	kinect_metrics_gauge_fn(&metrics, "kmouse_queue_depth", "queue=\"preview_frames\"", "Output waiting to be consumed", NULL, preview_pending_frames, NULL);
+	// bound by the threads once they run
+	m_cpu_usb = kinect_metrics_thread_cpu(&metrics, "usb");
+	m_cpu_gl = kinect_metrics_thread_cpu(&metrics, "gl");
 }
- 
-//returns median item (or average of 2 when item count is even)
-Item MediatorMedian(Mediator* m)
+
+// Apply a sched_*= setting to one of our threads. What the permissions do not
+// allow is logged and counted, the thread then runs with the default scheduling
+void apply_sched(const char *name, pthread_t thread, const kinect_sched_config *cfg)
 {
-   Item v= m->data[m->heap[0]];
-   if ((m->ct&1)==0) { v= ItemMean(v,m->data[m->heap[-1]]); }
-   return v;
+	char desc[64];
+	int failed;
+
+	if (!cfg->set)
+		return;
+	kinect_sched_describe(cfg, desc, sizeof(desc));
+	failed = kinect_sched_apply(thread, cfg);
+	if (!failed) {
+		if (jsonout && MMM_Output_log) printf("{ \"log\" : \"Thread %s scheduled %s\"}\n", name, desc);
+		if (debug) printf("Thread %s scheduled %s\n", name, desc);
+		return;
+	}
+	kinect_metrics_inc(m_sched_fallback);
+	if (jsonout && MMM_Output_log) printf("{ \"log\" : \"Could not schedule thread %s %s: %s%s%s, keeping the default\"}\n", name, desc,
+		failed & KINECT_SCHED_POLICY_FAILED ? "policy " : "", failed & KINECT_SCHED_AFFINITY_FAILED ? "affinity " : "", strerror(errno));
+	if (debug) printf("Could not schedule thread %s %s: %s%s%s, keeping the default\n", name, desc,
+		failed & KINECT_SCHED_POLICY_FAILED ? "policy " : "", failed & KINECT_SCHED_AFFINITY_FAILED ? "affinity " : "", strerror(errno));
 }
- 
- 
-/*--- Test Code ---*/
-void PrintMaxHeap(Mediator* m)
+
+// Swipe and click events. With event_time they carry the frame that raised them,
+// so replays can be scored against the time of the gesture (see regress/)
+void print_swipe(const kinect_gesture_event *e)
 {
-   int i;
-   if(maxCt(m))
-      printf("Max: %3d",m->data[m->heap[-1]]);
-   for (i=2;i<=maxCt(m);++i)
-   {
-      printf("|%3d ",m->data[m->heap[-i]]);
-      if(++i<=maxCt(m)) printf("%3d",m->data[m->heap[-i]]);
-   }
-   printf("\n");
+	if (event_time)
+		printf("{ \"swipe\" : \"%s\", \"frame\" : %ld, \"ts\" : %u }\n", e->swipe, e->frame, e->timestamp);
+	else
+		printf("{ \"swipe\" : \"%s\" }\n", e->swipe);
 }
-void PrintMinHeap(Mediator* m)
+
+void print_click(const kinect_gesture_event *e)
 {
-   int i;
-   if(minCt(m))
-      printf("Min: %3d",m->data[m->heap[1]]);
-   for (i=2;i<=minCt(m);++i)
-   {
-      printf("|%3d ",m->data[m->heap[i]]);
-      if(++i<=minCt(m)) printf("%3d",m->data[m->heap[i]]);
-   }
-   printf("\n");
+	if (event_time)
+		printf("{ \"click\" : { \"xy\" : \"[ %d , %d]\" }, \"frame\" : %ld, \"ts\" : %u }\n", e->x, e->y, e->frame, e->timestamp);
+	else
+		printf("{ \"click\" : { \"xy\" : \"[ %d , %d]\" }}\n", e->x, e->y);
 }
- 
-void ShowTree(Mediator* m)
+
+// The tilt state the 'a' key asked for, on the motor thread once it is polled
+void print_tilt(void *user, const kinect_motor_state *s)
 {
-   PrintMaxHeap(m);
-   printf("Mid: %3d\n",m->data[m->heap[0]]);
-   PrintMinHeap(m);
-   printf("\n");
+	if (s)
+		printf("{ \"status\" : \"Tilt: %.1f degrees Accel: %.2f %.2f %.2f\"}\n", s->tilt_degs, s->accel_x, s->accel_y, s->accel_z);
+	else
+		printf("{ \"status\" : \"Tilt: could not read the tilt state\"}\n");
 }
- 
-int mediantest(int argc, char* argv[])
+
+void update_fps()
 {
-   int i,v;
-   Mediator* m = MediatorNew(5);
- 
-   for (i=0;i<20;i++)
-   {
-      v = rand()&127;
-//      v = i;
-      printf("Inserting %3d \n",v);
-      MediatorInsert(m,v);
-      v=MediatorMedian(m);
-      printf("Median = %3d.\n\n",v);
-      ShowTree(m);
-   }
+	double tick = kinect_metrics_now_ms();
+	++fps_frame_count;
+	if (tick - fps_last_tick > 1000) {
+		kinect_metrics_set(m_fps, 1000.0 * fps_frame_count / (tick - fps_last_tick));
+		fps_last_tick = tick;
+		fps_frame_count = 0;
+	}
 }
 
 //Kinect Functions
@@ -379,47 +365,50 @@ void keyPressed(unsigned char key, int x, int y)
 		break;
 		case 'w':
 			if (freenect_angle < 29) freenect_angle++;
-			freenect_set_tilt_degs(f_dev,freenect_angle);
+			kinect_motor_set_tilt(&motor,freenect_angle);
 			printf("{ \"status\" : \"Angle: %d degrees\"}\n", freenect_angle);
 		break;
 		case 's':
 			freenect_angle = 0;
-			freenect_set_tilt_degs(f_dev,freenect_angle);
+			kinect_motor_set_tilt(&motor,freenect_angle);
 			printf("{ \"status\" : \"Angle: %d degrees\"}\n", freenect_angle);
 		break;
 		case 'x':
 			if (freenect_angle > -30) freenect_angle--;
-			freenect_set_tilt_degs(f_dev,freenect_angle);
+			kinect_motor_set_tilt(&motor,freenect_angle);
 			printf("{ \"status\" : \"Angle: %d degrees\"}\n", freenect_angle);
 		break;
 		case '1':
-			freenect_set_led(f_dev,LED_GREEN);
+			kinect_motor_set_led(&motor,LED_GREEN);
 			printf("{ \"status\" : \"LED Green\"}\n");
 		break;
 		case '2':
-			freenect_set_led(f_dev,LED_RED);
+			kinect_motor_set_led(&motor,LED_RED);
 			printf("{ \"status\" : \"LED Red\"}\n");
 		break;
 		case '3':
-			freenect_set_led(f_dev,LED_YELLOW);
+			kinect_motor_set_led(&motor,LED_YELLOW);
 			printf("{ \"status\" : \"LED Yellow\"}\n");
 		break;
 		case '4':
-			freenect_set_led(f_dev,LED_BLINK_YELLOW);
+			kinect_motor_set_led(&motor,LED_BLINK_YELLOW);
 			printf("{ \"status\" : \"LED Blink Yellow\"}\n");
 		break;
 		case '5':
-			freenect_set_led(f_dev,LED_BLINK_GREEN);
+			kinect_motor_set_led(&motor,LED_BLINK_GREEN);
 			printf("{ \"status\" : \"LED Blink Green\"}\n");
 		break;
 		case '6':
-			freenect_set_led(f_dev,LED_BLINK_RED_YELLOW);
+			kinect_motor_set_led(&motor,LED_BLINK_RED_YELLOW);
 			printf("{ \"status\" : \"LED Blink Red Yellow\"}\n");
 		break;
 		case '0':
-			freenect_set_led(f_dev,LED_OFF);
+			kinect_motor_set_led(&motor,LED_OFF);
 			printf("{ \"status\" : \"LED Off\"}\n");
 		break;
+		case 'a':
+			kinect_motor_request_update(&motor, print_tilt, NULL);
+		break;
 		case 'o':
 			tmprot+=0.1;
 			printf("{ \"status\" : \"Rotation: %d degrees\"}\n", tmprot);
@@ -465,6 +454,8 @@ void *gl_threadfunc(void *arg)
 {
 	if(jsonout && MMM_Output_log) printf("{ \"log\" : \"OpenGL Window Opened\"} \n");
 	if(debug) printf("OpenGL Window Opened\n");
+	kinect_metrics_bind_thread(m_cpu_gl);
+	apply_sched("gl", pthread_self(), &sched_gl);
 	glutInit(&g_argc, g_argv);
 	
 	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_ALPHA | GLUT_DEPTH);
@@ -488,413 +479,251 @@ void *gl_threadfunc(void *arg)
 	return NULL;
 }
 
-uint16_t t_gamma[2048];
-
-void depth_cb(freenect_device *dev, void *v_depth, uint32_t timestamp)
+// Account the cost of a frame: averages while active, savings against them while idle
+void account_frame(int idle, double spent_ms)
 {
-	
-	// this is a callback function in the standard OpenKinect Framework returning a frame when ready
-	// In this section we search for the currently pointed screen pixel
-	
-	// In this part of the function we analyze the frame returned and look for a "blob" of NearPixels
-	// A NearPixel is a Pixel that is reported within the given range by Kinect
-	// We search in every frame returned by the kinect for a group of NearPixels.
-	// Hopefully this is the forearm of the subject facing the kinect
-	// We assume the direction the mouse pointer is the furthest point of the blob from screen center
-	// NOTE: Pixel variables are local to the function; Stroke variables are GLOBAL and persist across function call
-
-	int i,j;
-	long NearPixelXSum, NearPixelYSum; // Sum of X and Y coordinates of NearPixels. Used for Swipe evaluation
-	int NearPixelX , NearPixelY; // NearPixelFound : near pixel coordinates
-	int NearPixelMaxX  , NearPixelMaxY; // NearPixelFound near pixel MAX coordinates
-	int NearPixelMinX  , NearPixelMinY; // NearPixelFound near pixel min coordinates
-	int tx , ty;  // Pointer to current pixel analyzed in current frame
-	uint16_t *depth = v_depth;
-	float dpixel=0; 	// Distance of current pixel from the center of the screen
-	float dpixelmax=-1;  //Distance of the furthest Pixel of Current blob of NP frame from screen center
-	int mx , my;  // mouse x and y coordinates
-	long NearPixelCount; // count of red pixels (near)
-	int pval,pmax; // pval is current pixel depth according to kinect sensor. pmax is the maximun pval found
-	pthread_mutex_lock(&gl_backbuf_mutex);
+	if (idle) {
+		idle_saved_ms += active_frame_ms + active_rgb_ms - spent_ms;
+		return;
+	}
+	active_frame_ms = active_frame_ms ? 0.95 * active_frame_ms + 0.05 * spent_ms : spent_ms;
+}
 
-	if(debug) printf("___________________________BEGINOFRAME_________________________\n");
-	if(debug) printf("Got a Frame, Anlyzing it\n");
-//
-//Loop all pixels of current frame and search for at least one near pixel
-//
-	NearPixelCount=0;
-	tx=0;
-	ty=0;
-	NearPixelXSum=0;
-	NearPixelYSum=0;
-	NearPixelX = 0;
-	NearPixelY = 0; 
-	NearPixelMaxX = -2000;
-	NearPixelMaxY = -2000;
-	NearPixelMinX = 2000;
-	NearPixelMinY = 2000;
-	dpixel=0;
-	dpixelmax=-1;
-	pmax=0;
-	// Init median calculation Structure. We need the median of values in a 3x3 matrix around current pixel
-	Mediator* kmedian = MediatorNew(9);
-	
-//
-//Begin of : Loop all pixels of current frame and search for at least one near pixel
-// Remember this is a call back: one pixel per callback is evaluated. A stroke is evaluated in subsequent calls to the callaback
-// pixel 0,0		_____________
-// pixel 1,0		|0,0|0,1|0,2|
-// pixel 2,0		|___|___|___|
-// pixel 0,1		|1,0|1,1|1,2|
-// pixel 1,1		|___|CUR|___|
-// pixel 2,1		|2,0|2,1|2,2|
-// pixel 0,2		|___|___|___|
-// pixel 1,2
-// pixel 2,2
-
-// Initial load of median structure (pixel 1,1 of depth matrix)
-// left column
-	MediatorInsert(kmedian,t_gamma[depth[0]]);
-	MediatorInsert(kmedian,t_gamma[depth[640]]);
-	MediatorInsert(kmedian,t_gamma[depth[1280]]);
-// center column
-	MediatorInsert(kmedian,t_gamma[depth[1]]);
-	MediatorInsert(kmedian,t_gamma[depth[641]]);
-	MediatorInsert(kmedian,t_gamma[depth[1281]]);
-// right column
-	MediatorInsert(kmedian,t_gamma[depth[2]]);
-	MediatorInsert(kmedian,t_gamma[depth[642]]);
-	MediatorInsert(kmedian,t_gamma[depth[1282]]);
-
-	for (i=641; i<FREENECT_FRAME_PIX-640; i++)  // go over inner values od depth matrix (i.e. skip first and last rows and first and last columns)
-	{
-		if ((i % 640) == 639) i+=2; // if we are at column before last jump to column 1
-		//update  median evaluation structure
-	// left column
-		MediatorInsert(kmedian,t_gamma[depth[i-641]]);
-		MediatorInsert(kmedian,t_gamma[depth[i-1]]);
-		MediatorInsert(kmedian,t_gamma[depth[i+639]]);
-	// center column
-		MediatorInsert(kmedian,t_gamma[depth[i-640]]);
-		MediatorInsert(kmedian,t_gamma[depth[i]]);
-		MediatorInsert(kmedian,t_gamma[depth[i+640]]);
-	// right column
-		MediatorInsert(kmedian,t_gamma[depth[i-639]]);
-		MediatorInsert(kmedian,t_gamma[depth[i+1]]);
-		MediatorInsert(kmedian,t_gamma[depth[i+641]]);
-
-	    pval=MediatorMedian(kmedian);
-		tx++;
-		if(tx >= 640) // end of line reached
-		{
-			tx = 0;		
-			ty++;		// new line
-		}
-//		Near range pixels : red color
+// Gesture callbacks, called by kinect_gesture_push_frame from depth_cb with gl_backbuf_mutex held
 
-// pval is the median of depth of 9 pixels centered at current pixel
-		if (pval < near_threshold )  // We found a NearPixel
-		{
-			gl_depth_back[3*i+0] = 255;
-			gl_depth_back[3*i+1] = 0;
-			gl_depth_back[3*i+2] = 0;
-			if (pval > pmax)  // new deeper pixel (i.e. near to screeen)
-			{ 
-				pmax=pval;
-				NearPixelX=tx;
-				NearPixelY=ty;
-				gl_depth_back[3*i+0] = 0;
-				gl_depth_back[3*i+1] = 255;
-			}			
-//			if (DistCen[tx][ty]>dpixelmax)  // Current Pixel found is furthest from screen center: update
-//			{ 
-//				dpixelmax=DistCen[tx][ty];
-//				NearPixelX=tx;
-//				NearPixelY=ty;
-//				gl_depth_back[3*i+0] = 0;
-//				gl_depth_back[3*i+1] = 255;
-//			}
-			NearPixelCount++;	// we accumulate number of near pixels
-			NearPixelXSum+=tx;  // we sum up x coordinates
-			NearPixelYSum+=ty;  // we sum up y coordinates
-			NearPixelMaxX=MAX(NearPixelMaxX,tx); // we save max x coordinate of nearpixel
-			NearPixelMinX=MIN(NearPixelMinX,tx); // we save min x coordinate of nearpixel
-			NearPixelMaxY=MAX(NearPixelMaxY,ty); // we save max y coordinate of nearpixel
-			NearPixelMinY=MIN(NearPixelMinY,ty); // we save min y coordinate of nearpixel
-		}
-	
-//		Default: mid range pixels : white color
-		if (pval >= near_threshold  && pval < far_threshold)
-		{
-			gl_depth_back[3*i+0] = 255;
-			gl_depth_back[3*i+1] = 255;
-			gl_depth_back[3*i+2] = 255;
-		}	
-//		Default: far range pixels:  black color
-		if (pval >= far_threshold )
-		{
-			gl_depth_back[3*i+0] = 0;
-			gl_depth_back[3*i+1] = 0;
-			gl_depth_back[3*i+2] = 0;
-		}
+// Status of the hand in every analysed frame: only the frames without it are reported
+void gesture_status(void *user, const kinect_gesture_event *e)
+{
+	state.data.status = e->status;
+	if (!jsonout || !MMM_Output_status)
+		return;
+	if (e->status == KINECT_GESTURE_TOOCLOSE)
+		printf("{ \"status\" : \"tooclose\"}\n");
+	else if (e->status == KINECT_GESTURE_SOMEPIXELS)
+		printf("{ \"status\" : \"somepixels\" }\n" );
+	else if (e->status == KINECT_GESTURE_TOOFAR)
+		printf("{ \"status\" : \"toofar\"}\n" );
+}
+
+void gesture_pointer(void *user, const kinect_gesture_event *e)
+{
+	double t_out = kinect_metrics_now_ms();
+
+	state.data.x = e->x;
+	state.data.y = e->y;
+	state.data.z_mm = e->z_mm;
+	state.data.near_pixels = e->near_pixels;
+	state.data.blob_x0 = e->blob_x0;
+	state.data.blob_y0 = e->blob_y0;
+	state.data.blob_x1 = e->blob_x1;
+	state.data.blob_y1 = e->blob_y1;
+	if(jsonout && MMM_Output_clicks)	printf("{ \"coord\" : { \"xy\" : \"[ %d , %d]\" }}\n",e->x,e->y );
+//	if(jsonout && MMM_Output_coords)	printf("{ \"coords\" : { \"xy\" : \"[ %d , %d]\" }}\n",e->x,e->y );
+	if (!headless) {
+		XTestFakeMotionEvent(display, -1, e->x, e->y, CurrentTime);		// send mouse movement
+		XSync(display, 0);
 	}
+	output_ms += kinect_metrics_now_ms() - t_out;
+}
 
-	if(debug)	printf("Frame Analyzed: NearPixelCount %d\n",NearPixelCount);
-//
-//End of : Loop all pixels of current frame and search for at least one near pixel
-//
-
-//Current Frame evaluated: lets evaluate NearPixels found
-
-// Number of Pixels in Near Blobs is over the threshold NearPixel_TooClose given in input
-// This means the subject is too close in current frame
-// Reset Pixel Count and restart swipe evaluation
-	if(NearPixelCount > NearPixel_TooClose)   
-	{	 
-    	if(debug)	printf("Subject too close\n");
-		if(jsonout && MMM_Output_status)	printf("{ \"status\" : \"tooclose\"\n}"	);
-		StrokeEval=1;
+// Last gesture of the pointer state
+void state_gesture(int gesture, const kinect_gesture_event *e)
+{
+	state.data.gesture = gesture;
+	state.data.gesture_seq++;
+	state.data.gesture_x = e->x;
+	state.data.gesture_y = e->y;
+	state.data.gesture_frame = e->frame;
+	state.data.gesture_ms = e->ms;
+}
+
+// A push clicks where the pointer was before the push, the pointer is moved back there first
+void gesture_click(void *user, const kinect_gesture_event *e)
+{
+	double t_out = kinect_metrics_now_ms();
+
+	if (!headless) {
+		if (e->push)
+			XTestFakeMotionEvent(display, -1, e->x, e->y, CurrentTime);
+		XTestFakeButtonEvent(display, 1, TRUE, CurrentTime);  	// send mouse lmb down
+		XTestFakeButtonEvent(display, 1, FALSE, CurrentTime);	// send mouse lmb up
+		XSync(display, 0);
 	}
+	output_ms += kinect_metrics_now_ms() - t_out;
+	state_gesture(e->push ? KINECT_STATE_GESTURE_PUSH : KINECT_STATE_GESTURE_CLICK, e);
+	if(jsonout && MMM_Output_clicks)	print_click(e);
+}
+
+void gesture_swipe(void *user, const kinect_gesture_event *e)
+{
+	state_gesture(!strcmp(e->swipe, "left") ? KINECT_STATE_GESTURE_LEFT : !strcmp(e->swipe, "right") ? KINECT_STATE_GESTURE_RIGHT :
+		!strcmp(e->swipe, "up") ? KINECT_STATE_GESTURE_UP : KINECT_STATE_GESTURE_DOWN, e);
+	if(jsonout && MMM_Output_swipes) print_swipe(e);
+}
+
+// Row band callback (stream_rows option): scan the rows completed so far
+void depth_rows_cb(freenect_device *dev, void *v_depth, int first_row, int num_rows, uint32_t timestamp)
+{
+	double t_band = kinect_metrics_now_ms();
+
+	if (gesture.idle)		// idle frames are looked at as a whole in depth_cb
+		return;
+	pthread_mutex_lock(&gl_backbuf_mutex);
+	kinect_gesture_push_rows(&gesture, v_depth, first_row, num_rows);
+	pthread_mutex_unlock(&gl_backbuf_mutex);
+	kinect_metrics_observe(m_stage_band, kinect_metrics_now_ms() - t_band);
+}
+
+// this is a callback function in the standard OpenKinect Framework returning a frame when ready
+// The frame is analysed by the gesture library (see kinect_gesture.h), whose callbacks above
+// output the events. What it did with the frame is turned into metrics and logs here
+void depth_cb(freenect_device *dev, void *v_depth, uint32_t timestamp)
+{
+	kinect_gesture_frame *f = &gesture.frame;
+	kinect_load *load = &gesture.load;
+	double t_frame, t_locked, t_out; // stage timings for metrics
+
+	t_frame = kinect_metrics_now_ms();
+	kinect_metrics_inc(m_depth_received);
+	output_ms = 0;
 
-// Number of Pixels in Near Blobs is less then threshold NearPixel_TooFarOrNoise given in input but non zero
-// This means the subject is within reach but still too far
-// Reset Pixel Count and restart swipe evaluation 
-	if(NearPixelCount > 0 && NearPixelCount < NearPixel_TooFarOrNoise)  
+	pthread_mutex_lock(&gl_backbuf_mutex);
+	t_locked = kinect_metrics_now_ms();
+	kinect_gesture_push_frame(&gesture, v_depth, timestamp, t_frame);
+	if (f->skipped == KINECT_GESTURE_ANALYSED && load->level < KINECT_LOAD_NO_PREVIEW)
 	{
-    	if(debug)	printf("Some pixels detected but subject too far\n");
-		if(jsonout && MMM_Output_status) printf("{ \"status\" : \"somepixels\" }\n" );
-		StrokeEval=1;
+		got_frames++;
+		pthread_cond_signal(&gl_frame_cond);
 	}
-
-// No near Pixel found
-// This means the subject is out of range in current frame
-// Reset Pixel Count and restart swipe evaluation 
-	if(NearPixelCount == 0)  
+	pthread_mutex_unlock(&gl_backbuf_mutex);
+	// Pointer state of the frames the hand was looked for in, idle ones included
+	if (state.shm && (f->skipped == KINECT_GESTURE_ANALYSED || f->status >= 0))
 	{
-    	if(debug)	printf("Subject too far - Out of reach\n");
-		if(jsonout && MMM_Output_status)	printf("{ \"status\" : \"toofar\"}\n" );
-		StrokeEval=1;
+		t_out = kinect_metrics_now_ms();
+		state.data.idle = gesture.idle;
+		state.data.frame = gesture.clock.index;
+		state.data.timestamp = gesture.clock.timestamp;
+		state.data.frame_ms = gesture.clock.ms;
+		kinect_state_publish(&state);
+		output_ms += kinect_metrics_now_ms() - t_out;
 	}
+	t_out = kinect_metrics_now_ms();
 
-// Number of NearPixels in blobs found is neither to small nor too big: subject hand in range
-// a swipe is evaluated by evaluating subsequent pixels found between empty frames
-// that is : an empty frame (a frame with subject either too far or too close) is considered as a "break" between gestures
-// We record x and y coordinates of pixels found in an array
-// Begin of section: analyze blob of nearpixels
-	if (NearPixelCount !=0 && NearPixelCount < NearPixel_TooClose && NearPixelCount > NearPixel_TooFarOrNoise)  
-	{		
-		pointerx = ((NearPixelX-640.0f) / -1); 		// get current x coordinates
-		pointery = (NearPixelY);					// get current y coordinates
-		mousex = ((pointerx / 630.0f) * screenw);	// scale x coordinates to screen size
-		mousey = ((pointery / 470.0f) * screenh);	// scale y coordinates to screen size
-		mx = mousex;			
-		my = mousey;
-    	if(debug)
-    	{ 
-    		printf("Subject within range\n");
-    		printf("Mouse coordinates  %3d %4d\n",mx,my);
-    		printf("Stroke Index  %d \n",current_pixel);
-    	}
-		stroke_x[current_pixel]=mx; //save current x coord in array of stroke pints
-		stroke_y[current_pixel]=my; //save cuurent y coord in array of stroke pints
-		if(jsonout && MMM_Output_clicks)	printf("{ \"coord\" : { \"xy\" : \"[ %d , %d]\" }}\n",mx,my );
-// This is the first point between invalid or empty frames: reset swipe evaluation support variables
-		if(current_pixel==0) 
-		{  
-	    	if(debug)	printf("First Point in stroke - reset swipe variables\n");
-			h_stroke_left2right_count=0;
-			h_stroke_right2left_count=0;
-			v_stroke_up2down_count=0;
-			v_stroke_down2up_count=0;
-			h_stroke_left2right_sum=0;
-			h_stroke_right2left_sum=0;
-			v_stroke_up2down_sum=0;
-			v_stroke_down2up_sum=0;
-			h_sum=0;
-			v_sum=0;
-			h_mean=mx;
-			v_mean=my;
-			h_variance=0;
-			v_variance=0;
-			left2rightmul=0;
-			right2leftmul=0;
-			up2downmul=0;
-			down2upmul=0;
-			StrokeEval=0;
-		} 
-		else // this is an additional point in a stroke. Update swipe statistics variables
-		{  
-    		if(debug)	printf("Update  swipe variables\n");
-    		if (stroke_x[current_pixel]>stroke_x[current_pixel-1]) 
-    		{ 
-    			h_stroke_left2right_count++;
-    			h_stroke_left2right_sum += abs(stroke_x[current_pixel]-stroke_x[current_pixel-1]);
-    		}  
-    		else 
-    		{
-    			h_stroke_right2left_count++;
-    			h_stroke_right2left_sum += abs(stroke_x[current_pixel-1]-stroke_x[current_pixel]);
-    		}
-    		if(stroke_y[current_pixel]>stroke_y[current_pixel-1]) 
-    		{
-    			v_stroke_up2down_count++;
-    			v_stroke_up2down_sum+=abs(stroke_y[current_pixel-1]-stroke_y[current_pixel]);
-    		}  
-    		else 
-    		{	
-    			v_stroke_down2up_count++;
-    			v_stroke_down2up_sum+=abs(stroke_y[current_pixel]-stroke_y[current_pixel-1]);
-    		}
-		}
-    	h_sum+=stroke_x[current_pixel];
-   		v_sum+=stroke_y[current_pixel];
-   		if(debug)
-   		{ 
-   			printf("Deltas: \tH %4d \tV %4d\n",abs(stroke_x[current_pixel-1]-stroke_x[current_pixel]),abs(stroke_y[current_pixel-1]-stroke_y[current_pixel]));
-   			printf("Counts: \tL2R %5d\tR2L %5d\tU2D %5d\tD2U %5d\n",h_stroke_left2right_count,h_stroke_right2left_count,v_stroke_up2down_count,v_stroke_down2up_count);
-   			printf("StrokeSums: \tL2R %5d\tR2L %5d\tU2D %5d\tD2U %5d\n",h_stroke_left2right_sum,h_stroke_right2left_sum,v_stroke_up2down_sum,v_stroke_down2up_sum);
-   			printf("HSUm VSUM: \tHsum %10d\tVSum %10d\n",h_sum,v_sum);
-   		}
-
-// If current evaluated pixel coordinates are within square area defined by input parameter gesture_click_area
-// Increment the hovering counter and reset Stroke index  		StrokeSums
-		if ((PointerX <= (mx + gesture_click_area))  && (PointerX >= (mx -gesture_click_area)) && (PointerY <= (my + gesture_click_area))  && (PointerY >= (my - gesture_click_area))) 
-		{
-			current_hovering_cycles++;
-	    	if(debug)	printf("Mouse Hovering : Current hovering cycle %3d\n",current_hovering_cycles);
-		} 
-		else  
-// Current evaluated pixel coordinates are not within square area defined by input parameter gesture_click_area
-// Reset the hovering counter and increment stroke pixel index   			
-		{
-			PointerX = mx; //New initial position X
-			PointerY = my; //New initial position Y
-			current_hovering_cycles = 0; // Restart counting current_hovering_cycles
-		}		
-		current_pixel++;
-// Check if mouse was hovering for more then hovering_threshold subsequent frames over the click area
-// Simulate click at the point
-// Set debounce count to avoid double clicks    			
-		if(current_hovering_cycles > hovering_threshold) 
-		{
-			current_hovering_cycles = -hovering_threshold*2;  		// set debounce count
-			XTestFakeButtonEvent(display, 1, TRUE, CurrentTime);  	// send mouse lmb down 
-			XTestFakeButtonEvent(display, 1, FALSE, CurrentTime);	// send mouse lmb up
-			current_pixel=0;  //Reset Stroke Pixel Index 
-			StrokeEval=0;
-	    	if(debug)	printf("Click at \tX %d\tY %dn",mx,my);
-			if(jsonout && MMM_Output_clicks)	printf("{ \"click\" : { \"xy\" : \"[ %d , %d]\" }}\n",mx,my );
-		}
-		XTestFakeMotionEvent(display, -1, mx, my, CurrentTime);		// send mouse movement
-		if(debug)	printf("Coordinates \tX %3d\tY %3d\n",mx,my);
-//		if(jsonout && MMM_Output_coords)	printf("{ \"coords\" : { \"xy\" : \"[ %d , %d]\" }}\n",mx,my );
-		XSync(display, 0);
+	// Frames lost and late according to the sensor timestamps (see kinect_clock.h)
+	kinect_metrics_add(m_depth_dropped, f->lost);
+	if (f->late)
+		kinect_metrics_inc(m_depth_late);
+
+	// Power state: the RGB stream is stopped by the usb thread while idle
+	if (f->woke)
+	{
+		video_wanted = 1;
+		kinect_metrics_set(m_power_idle, 0);
+		kinect_metrics_inc(m_idle_wakes);
+		if (jsonout && MMM_Output_log) printf("{ \"log\" : \"Active\"}\n");
+	}
+	if (f->slept)
+	{
+		video_wanted = 0;
+		kinect_metrics_set(m_power_idle, 1);
+		if (jsonout && MMM_Output_log) printf("{ \"log\" : \"Idle after %.0f s out of reach\"}\n", idle_s);
+	}
+	if (f->skipped == KINECT_GESTURE_SKIP_IDLE)
+	{
+		if (f->status < 0)
+			kinect_metrics_inc(m_idle_skipped);
+		account_frame(1, t_out - t_frame);
+		return;
+	}
+	if (f->skipped == KINECT_GESTURE_SKIP_LOAD)
+	{
+		kinect_metrics_inc(m_load_shed);
+		return;
 	}
-	// End of section: analyze blob of nearpixels
 
-// begin of section: Evaluate Swipe if frame empty or not in threshold 
-	if(StrokeEval)
+	kinect_metrics_observe(m_stage_lock, t_locked - t_frame);
+	kinect_metrics_observe(m_stage_scan, f->scan_ms);
+	kinect_metrics_observe(m_stage_output, output_ms);
+	kinect_metrics_observe(m_stage_gesture, t_out - t_locked - f->scan_ms - output_ms);
+	kinect_metrics_observe(m_stage_frame, t_out - t_frame);
+	kinect_metrics_inc(m_depth_processed);
+	account_frame(0, t_out - t_frame);
+
+	// The load level follows the latency from the sensor and the processing time (see kinect_load.h)
+	kinect_metrics_set(m_load_latency, load->latency_ms);
+	kinect_metrics_set(m_load_busy, load->busy);
+	if (f->load_change)
 	{
-// Begin of section: We have a sequence of points that are between the allowed paramenters set
-		if (current_pixel>minimum_stroke_points && current_pixel<maximum_stroke_points) 
-		{
-			h_mean=h_sum/current_pixel;  //calculate statistics for euristic
-			v_mean=v_sum/current_pixel;
-			for (j=0;j<current_pixel;j++)	
-			{
-				h_variance+=pow(stroke_x[j]-h_mean,2);
-				v_variance+=pow(stroke_y[j]-v_mean,2);
-				if(debug) printf("N X Y \t%3d\t%3d\t%4d\n",j, stroke_x[j],stroke_y[j]);
-			}
-			h_variance=sqrt(h_variance/current_pixel);
-			v_variance=sqrt(v_variance/current_pixel);
-			left2rightmul = h_stroke_left2right_count*h_stroke_left2right_sum;
-			right2leftmul = h_stroke_right2left_count*h_stroke_right2left_sum;
-			up2downmul = v_stroke_up2down_count*v_stroke_up2down_sum;
-			down2upmul = v_stroke_down2up_count*v_stroke_down2up_sum;
-			if(debug)
-			{ 
-				printf("____________________________________________\n");
-				printf("current_pixel, %i\n",current_pixel);
-				printf("left2rightcnt\tright2leftcnt\t%8i\t%8i\n",h_stroke_left2right_count, h_stroke_right2left_count);
-				printf("up2downcnt\tdown2upcnt\t%8i\t%8i\n\n",v_stroke_up2down_count,v_stroke_down2up_count);
-				printf("left2rightsum\tright2leftsum\t%8i\t%8i\n",h_stroke_left2right_sum, h_stroke_right2left_sum);
-				printf("up2downsum\tdown2up_sum\t%8i\t%8i\n\n",v_stroke_up2down_sum,v_stroke_down2up_sum);
-				printf("left2rightmul\tright2leftmul\t%20d\t%20d\n",left2rightmul,right2leftmul);
-				printf("up2downmul\tdown2upmul\t%20d\t%20d\n\n",up2downmul,down2upmul);
-				printf("h_mean\tv_mean\t%5.5f\t%5.5f\n",h_mean,v_mean);
-				printf("h_variance\tv_variance\t%5.5f\t%5.5f\n",h_variance,v_variance);
-				printf("____________________________________________\n");
-			}
-			if (h_variance<h_varmax || v_variance<v_varmax)  // Either Variance is belo variance threshold parameter
-			{
-				if (h_variance<h_varmax && v_variance<v_varmax)
-				{ 
-					if(debug) printf("Garbage ");
-				}
-				else
-				{ 
-					if(h_variance<v_variance)
-				   	{ 
-						if(debug) if(up2downmul>down2upmul) printf("Down \n"); else printf("Up \n");				
-						if(jsonout && MMM_Output_swipes) if(up2downmul>down2upmul) printf("{ \"swipe\" : \"down\" }\n" ); else printf("{ \"swipe\" : \"up\" }\n" );				
-				   	}
-				   	else
-				   	{ 
-				   		if(debug) if(left2rightmul>right2leftmul) printf("right \n"); else printf("left \n");				
-						if(jsonout && MMM_Output_swipes) if(left2rightmul>right2leftmul)	printf("{ \"swipe\" : \"right\" }\n" ); else printf("{ \"swipe\" : \"left\" }\n" );				
-				   	}
-				}
-			}	
-			else
-			{
-					if(debug) printf("No Swipe\n");
-			}	
-		}  // End of section: We have a sequence of points that are between the allowed paramenters 
-		if(debugstop) getchar();
-		StrokeEval=0;
-		current_pixel=0;
+		kinect_metrics_set(m_load_level, load->level);
+		kinect_metrics_inc(f->load_change > 0 ? m_load_up : m_load_down);
+		if (jsonout && MMM_Output_log) printf("{ \"log\" : \"Load level %s: latency %.0f ms for a %.0f ms budget, busy %.2f\"}\n", kinect_load_level_name(load->level), load->latency_ms, load->cfg.budget_ms, load->busy);
+		if (debug) printf("Load level %s\n", kinect_load_level_name(load->level));
 	}
-	// end of section: Evaluate Swipe if frame empty or not in threshold 
-		
-	got_frames++;
-	pthread_cond_signal(&gl_frame_cond);
-	pthread_mutex_unlock(&gl_backbuf_mutex);
-	if(debug) printf("___________________________ENDOFRAME_________________________\n\n");
+	update_fps();
 }
 
 void rgb_cb(freenect_device *dev, void *rgb, uint32_t timestamp)
 {
+	double t_frame = kinect_metrics_now_ms();
+	kinect_metrics_inc(m_rgb_received);
 	pthread_mutex_lock(&gl_backbuf_mutex);
-	got_frames++;
-	memcpy(gl_rgb_back, rgb, FREENECT_VIDEO_RGB_SIZE);
-	pthread_cond_signal(&gl_frame_cond);
+	if (gesture.load.level < KINECT_LOAD_NO_PREVIEW)	// nobody looks at the preview under load
+	{
+		got_frames++;
+		memcpy(gl_rgb_back, rgb, FREENECT_VIDEO_RGB_SIZE);
+		pthread_cond_signal(&gl_frame_cond);
+	}
 	pthread_mutex_unlock(&gl_backbuf_mutex);
+	t_frame = kinect_metrics_now_ms() - t_frame;
+	kinect_metrics_observe(m_stage_rgb, t_frame);
+	active_rgb_ms = active_rgb_ms ? 0.95 * active_rgb_ms + 0.05 * t_frame : t_frame;
 }
 
 void *freenect_threadfunc(void *arg)
 {
-	freenect_set_tilt_degs(f_dev,freenect_angle);
-	freenect_set_led(f_dev,freenect_led);
+	int video_running;
+
+	kinect_metrics_bind_thread(m_cpu_usb);
+	// Tilt, led and accelerometer are handled on the motor thread, this loop only pumps usb events
+	if (kinect_motor_start(&motor, f_dev, tilt_hz) < 0) {
+		if (jsonout && MMM_Output_log) printf("{ \"log\" : \"Could not create motor thread\" }\n");
+		if (debug) printf("Error could not create motor thread.\n");
+	}
+	// After the motor thread was started, so that it does not inherit the usb thread scheduling
+	apply_sched("usb", pthread_self(), &sched_usb);
+	if (motor.running)
+		apply_sched("motor", motor.thread, &sched_motor);
+	kinect_motor_set_tilt(&motor,freenect_angle);
+	kinect_motor_set_led(&motor,freenect_led);
 	freenect_set_depth_callback(f_dev, depth_cb);
+	if (stream_rows > 0) {
+		// Older libfreenect builds lack row bands: fall back to scanning whole frames
+		if (!freenect_set_depth_rows_callback || freenect_set_depth_rows_callback(f_dev, depth_rows_cb, stream_rows) < 0) {
+			if (jsonout && MMM_Output_log) printf("{ \"log\" : \"Depth row streaming not available, scanning whole frames\" }\n");
+			stream_rows = 0;
+		}
+	}
 	freenect_set_video_callback(f_dev, rgb_cb);
 	freenect_set_video_buffer(f_dev, FREENECT_VIDEO_RGB);  
 	freenect_set_depth_buffer(f_dev, FREENECT_DEPTH_11BIT);
 
 	freenect_start_depth(f_dev);
 	freenect_start_video(f_dev);
+	video_running = 1;
 
 	//printf("'W'-Tilt Up, 'S'-Level, 'X'-Tilt Down, '0'-'6'-LED Mode\n");
 
 	while(!die && freenect_process_events(f_ctx) >= 0 )
 	{
-		freenect_raw_tilt_state* state;
-		freenect_update_tilt_state(f_dev);
-		state = freenect_get_tilt_state(f_dev);;
-		double dx,dy,dz;
-		freenect_get_mks_accel(state, &dx, &dy, &dz);
-		//printf("\r raw acceleration: %4d %4d %4d  mks acceleration: %4f %4f %4f\r", ax, ay, az, dx, dy, dz);
-		fflush(stdout);
+		// The RGB stream is started and stopped here, outside of the callbacks (idle mode)
+		if (video_wanted != video_running)
+		{
+			if (video_wanted)
+				freenect_start_video(f_dev);
+			else
+				freenect_stop_video(f_dev);
+			video_running = video_wanted;
+		}
 	}
 
 	
@@ -903,22 +732,113 @@ void *freenect_threadfunc(void *arg)
 
 	freenect_stop_depth(f_dev);
 	freenect_stop_video(f_dev);
+	kinect_motor_stop(&motor);
 
 	freenect_close_device(f_dev);
 	freenect_shutdown(f_ctx);
+	kinect_state_destroy(&state);
 	if(jsonout) printf("{ \"log\" : \"Done Shutting Down Streams\"}\n");
 	if(debug) printf("Done Shutting Down Streams");
 	return NULL;
 }
 
 
+// Parse an optional name=value setting. Returns -1 when the setting is unknown
+int parse_option(const char *arg)
+{
+	const char *value = strchr(arg, '=');
+	size_t len;
+
+	if (!value)
+		return -1;
+	len = value - arg;
+	value++;
+	if (len == 7 && !strncmp(arg, "metrics", len))
+		metrics_endpoint = (char *)value;
+	else if (len == 6 && !strncmp(arg, "device", len))
+		user_device_number = atoi(value);
+	else if (len == 5 && !strncmp(arg, "stats", len))
+		stats_interval = atoi(value);
+	else if (len == 5 && !strncmp(arg, "state", len))
+		state_name = (char *)value;
+	else if (len == 7 && !strncmp(arg, "tilt_hz", len))
+		tilt_hz = atoi(value);
+	else if (len == 11 && !strncmp(arg, "stream_rows", len))
+		stream_rows = atoi(value);
+	else if (len == 8 && !strncmp(arg, "headless", len)) {
+		// headless=1 scales the pointer to a 1920x1080 screen
+		headless = 1;
+		if (sscanf(value, "%dx%d", &screenw, &screenh) != 2) {
+			headless = atoi(value) != 0;
+			screenw = 1920;
+			screenh = 1080;
+		}
+	}
+	else if (len == 10 && !strncmp(arg, "event_time", len))
+		event_time = atoi(value);
+	else if (len == 5 && !strncmp(arg, "click", len)) {
+		if (!strcmp(value, "dwell"))
+			click_mode = KINECT_GESTURE_CLICK_DWELL;
+		else if (!strcmp(value, "push"))
+			click_mode = KINECT_GESTURE_CLICK_PUSH;
+		else if (!strcmp(value, "both"))
+			click_mode = KINECT_GESTURE_CLICK_DWELL | KINECT_GESTURE_CLICK_PUSH;
+		else
+			return -1;
+	}
+	else if (len == 7 && !strncmp(arg, "push_mm", len))
+		push_config.depth_mm = atof(value);
+	else if (len == 7 && !strncmp(arg, "push_ms", len))
+		push_config.max_ms = atof(value);
+	else if (len == 8 && !strncmp(arg, "click_ms", len))
+		click_ms = atof(value);
+	else if (len == 13 && !strncmp(arg, "stroke_min_ms", len))
+		stroke_min_ms = atof(value);
+	else if (len == 13 && !strncmp(arg, "stroke_max_ms", len))
+		stroke_max_ms = atof(value);
+	else if (len == 7 && !strncmp(arg, "late_ms", len))
+		late_ms = atof(value);
+	else if (len == 6 && !strncmp(arg, "idle_s", len))
+		idle_s = atof(value);
+	else if (len == 10 && !strncmp(arg, "idle_every", len))
+		idle_every = MAX(atoi(value), 1);
+	else if (len == 9 && !strncmp(arg, "idle_grid", len))
+		idle_grid = MAX(atoi(value), 1);
+	else if (len == 10 && !strncmp(arg, "latency_ms", len))
+		load_config.budget_ms = atof(value);
+	else if (len == 9 && !strncmp(arg, "sched_usb", len))
+		return kinect_sched_parse(&sched_usb, value);
+	else if (len == 8 && !strncmp(arg, "sched_gl", len))
+		return kinect_sched_parse(&sched_gl, value);
+	else if (len == 11 && !strncmp(arg, "sched_motor", len))
+		return kinect_sched_parse(&sched_motor, value);
+	else if (len == 14 && !strncmp(arg, "sched_probe_ms", len))
+		sched_probe_ms = atof(value);
+	else if (len == 8 && !strncmp(arg, "mlockall", len))
+		lock_memory = atoi(value);
+	else if (len == 8 && !strncmp(arg, "load_max", len)) {
+		for (load_config.max_level = KINECT_LOAD_FULL; load_config.max_level < KINECT_LOAD_LEVELS; load_config.max_level++)
+			if (!strcmp(value, kinect_load_level_name(load_config.max_level)))
+				break;
+		if (load_config.max_level == KINECT_LOAD_LEVELS)
+			return -1;
+	}
+	else
+		return -1;
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
 	int res;
+	int i;
+	char desc[3][64];
+	kinect_gesture_config gesture_config;
+	kinect_gesture_callbacks gesture_callbacks = { gesture_pointer, gesture_click, gesture_swipe, gesture_status, NULL };
 
-    if ((argc != 25) || ((argc == 1) && strcmp (argv[1],"--help")))
+    if ((argc < 25) || ((argc == 1) && strcmp (argv[1],"--help")))
 	{
-		if (argc!=25)
+		if (argc<25)
 			if (jsonout && MMM_Output_log) 	printf("{ \"log\" : \"Wrong Number of Parameters: %2d \"}\n",argc);
 		printf("Number of Parameters %2d \n",argc);
 		printf("- NearPixel_TooClose: Number of maximum near pixel to accept before sending a too close message\n");
@@ -945,6 +865,29 @@ int main(int argc, char **argv)
 		printf("- Output Swipe events\n");
 		printf("- Verbose debug to stdout\n");
 		printf("- Pause Verbose debug output at swipe evaluation\n");
+		printf("Optional settings, given as name=value after the parameters above:\n");
+		printf("- metrics=PORT|tcp:PORT|unix:/path: serve Prometheus metrics over http on 127.0.0.1 or a unix socket\n");
+		printf("- device=N: open the N-th kinect, one kmouse per kinect (default 0)\n");
+		printf("- stats=SECONDS: output a stats event every SECONDS seconds (requires JSon Output)\n");
+		printf("- state=NAME: keep the latest pointer state and gesture in the shared memory /dev/shm/NAME (see kinect_state.h)\n");
+		printf("- tilt_hz=N: tilt/accelerometer polls per second on the motor thread, 0 only on request (default 1)\n");
+		printf("- stream_rows=N: analyse the depth frame in bands of N rows while it arrives, 0 waits for whole frames (default 0)\n");
+		printf("- headless=1|WxH: no X display, mouse events or window, pointer scaled to a WxH (1920x1080) screen, exit at the end of the stream\n");
+		printf("- event_time=1: add the frame index and kinect timestamp to swipe and click events\n");
+		printf("- click=dwell|push|both: click by holding the pointer still, by pushing the hand towards the kinect and back, or both (default dwell)\n");
+		printf("- push_mm=N: how far a push goes towards the kinect in mm (default 40)\n");
+		printf("- push_ms=N: the push must be back within N ms (default 500)\n");
+		printf("- click_ms=N: hold the pointer still N ms for a click (default ClickPauseCount frames at 30 fps)\n");
+		printf("- stroke_min_ms=N, stroke_max_ms=N: duration of a swipe in ms (default minimum/maximum_stroke_points frames at 30 fps)\n");
+		printf("- late_ms=N: a frame reaching us N ms later than its timestamp says is counted late (default two frame intervals)\n");
+		printf("- idle_s=N: after N seconds out of reach analyse few frames on a coarse grid and stop the RGB stream, 0 never (default 10)\n");
+		printf("- idle_every=K, idle_grid=G: while idle analyse one depth frame in K, one pixel in GxG (default 5, 8)\n");
+		printf("- latency_ms=N: keep the latency from the sensor to the events under N ms by shedding load, 0 never sheds (default 0)\n");
+		printf("- load_max=no_preview|roi|decimate|skip: deepest load shedding allowed (default skip)\n");
+		printf("- sched_usb=S, sched_gl=S, sched_motor=S: scheduling of the usb (capture, analysis, events), preview and motor threads,\n");
+		printf("  S = fifo:PRIORITY or other, then @CPUS to pin them, e.g. fifo:50@2 or other@0-1 (default inherited)\n");
+		printf("- mlockall=1: lock the process memory so that no page fault stalls the threads (default 0)\n");
+		printf("- sched_probe_ms=N: measure the scheduling latency of each thread every N ms, 0 never (default 100 with a sched_* setting, else 0)\n");
 		return 1;
 	}
 	else	{
@@ -995,6 +938,29 @@ int main(int argc, char **argv)
 		debug = atoi(argv[23]); 
 		debugstop = atoi(argv[24]); 
 
+		kinect_push_default_config(&push_config);
+		kinect_load_default_config(&load_config);
+		kinect_sched_default_config(&sched_usb);
+		kinect_sched_default_config(&sched_gl);
+		kinect_sched_default_config(&sched_motor);
+		for (i=25; i<argc; i++)
+			if (parse_option(argv[i]) < 0) {
+				if (jsonout && MMM_Output_log) printf("{ \"log\" : \"Unknown option %s\"}\n", argv[i]);
+				if (debug) printf("Unknown option %s\n", argv[i]);
+				return 1;
+			}
+		// Gestures run on the frame timestamps: frame counts are taken at the nominal 30 fps,
+		// half a frame off so that the ms comparisons select the same frames as the counts did
+		if (click_ms <= 0)
+			click_ms = (hovering_threshold + 0.5) * KINECT_FRAME_MS;
+		if (stroke_min_ms <= 0)
+			stroke_min_ms = (minimum_stroke_points + 0.5) * KINECT_FRAME_MS;
+		if (stroke_max_ms <= 0)
+			stroke_max_ms = (maximum_stroke_points - 0.5) * KINECT_FRAME_MS;
+		// The probes wake up on their own: only when the scheduling is tuned, unless asked for
+		if (sched_probe_ms < 0)
+			sched_probe_ms = sched_usb.set || sched_gl.set || sched_motor.set ? 100 : 0;
+
 		if((jsonout && MMM_Output_log) || debug)	{
 			printf("{ \"log\" : \"Kinect Mouse and Swipe starting\"}\n");
 			printf("{ \"log\" : \"Parsing Args\"}\n");
@@ -1022,44 +988,85 @@ int main(int argc, char **argv)
 			printf("{ \"log\" : \"Output Swipe events to stdout %d \"}\n", MMM_Output_swipes);
 			printf("{ \"log\" : \"Verbose debug %d \"}\n", debug);
 			printf("{ \"log\" : \"Verbose debug stop at swipe eval %d \"}\n", debugstop);
+			printf("{ \"log\" : \"Metrics endpoint %s \"}\n", metrics_endpoint ? metrics_endpoint : "none");
+			printf("{ \"log\" : \"Stats interval %d \"}\n", stats_interval);
+			printf("{ \"log\" : \"Pointer state %s \"}\n", state_name ? state_name : "none");
+			printf("{ \"log\" : \"Tilt polling rate %d \"}\n", tilt_hz);
+			printf("{ \"log\" : \"Depth row streaming %d \"}\n", stream_rows);
+			printf("{ \"log\" : \"Headless %d \"}\n", headless);
+			printf("{ \"log\" : \"Event timing %d \"}\n", event_time);
+			printf("{ \"log\" : \"Click mode %s \"}\n", click_mode == KINECT_GESTURE_CLICK_DWELL ? "dwell" : click_mode == KINECT_GESTURE_CLICK_PUSH ? "push" : "both");
+			printf("{ \"log\" : \"Push %.0f mm within %.0f ms \"}\n", push_config.depth_mm, push_config.max_ms);
+			printf("{ \"log\" : \"Click after %.0f ms, swipes of %.0f to %.0f ms \"}\n", click_ms, stroke_min_ms, stroke_max_ms);
+			printf("{ \"log\" : \"Idle after %.0f s, one frame in %d, one pixel in %dx%d \"}\n", idle_s, idle_every, idle_grid, idle_grid);
+			printf("{ \"log\" : \"Latency budget %.0f ms, shedding up to %s \"}\n", load_config.budget_ms, kinect_load_level_name(load_config.max_level));
+			printf("{ \"log\" : \"Scheduling usb %s, gl %s, motor %s, mlockall %d, probe every %.0f ms \"}\n",
+				kinect_sched_describe(&sched_usb, desc[0], sizeof(desc[0])), kinect_sched_describe(&sched_gl, desc[1], sizeof(desc[1])),
+				kinect_sched_describe(&sched_motor, desc[2], sizeof(desc[2])), lock_memory, sched_probe_ms);
 		}
 	}
 	
 	
 	//mousemask(ALL_MOUSE_EVENTS, NULL);
-	if(jsonout && MMM_Output_log) printf("{ \"log\" : \"Opening Display\"}\n");
-	if(debug) printf("Opening display \n");
+	if (headless) {
+		// No X server needed: the pointer is only reported on stdout
+		if(jsonout && MMM_Output_log) printf("{ \"log\" : \"Headless, Display Size %d %d\"}\n", screenw, screenh);
+		if(debug) printf("Headless\nDisplay Size %d %d \n", screenw, screenh);
+	} else {
+		if(jsonout && MMM_Output_log) printf("{ \"log\" : \"Opening Display\"}\n");
+		if(debug) printf("Opening display \n");
 
-	display = XOpenDisplay(0);
+		display = XOpenDisplay(0);
 
-	// Careful: this will dump if not run from terminal directly on system running XServer 
-	root_window = (display);
+		// Careful: this will dump if not run from terminal directly on system running XServer 
+		root_window = (display);
 
-	screenw = XDisplayWidth(display, SCREEN);
-	screenh = XDisplayHeight(display, SCREEN);
+		screenw = XDisplayWidth(display, SCREEN);
+		screenh = XDisplayHeight(display, SCREEN);
 
-	if(jsonout && MMM_Output_log) printf("{ \"log\" : \"Default Display Found\"}\n{ \"log\" : \"Display Size %d %d }\n", screenw, screenh);
-	if(debug) printf("Default Display Found\nDisplay Size %d %d \n", screenw, screenh);
+		if(jsonout && MMM_Output_log) printf("{ \"log\" : \"Default Display Found\"}\n{ \"log\" : \"Display Size %d %d }\n", screenw, screenh);
+		if(debug) printf("Default Display Found\nDisplay Size %d %d \n", screenw, screenh);
+	}
 
 //	screenw += 200;
 //	screenh += 200;
 
-	int i,j;
-	for (i=0; i<2048; i++) {
-		float v = i/2048.0;
-		v = powf(v, 3)* 6;
-		t_gamma[i] = v*6*256;
+	kinect_gesture_default_config(&gesture_config);
+	gesture_config.near_threshold = near_threshold;
+	gesture_config.far_threshold = far_threshold;
+	gesture_config.too_close = NearPixel_TooClose;
+	gesture_config.too_far_or_noise = NearPixel_TooFarOrNoise;
+	gesture_config.screen_w = screenw;
+	gesture_config.screen_h = screenh;
+	gesture_config.click_mode = click_mode;
+	gesture_config.click_area = gesture_click_area;
+	gesture_config.click_ms = click_ms;
+	gesture_config.stroke_min_ms = stroke_min_ms;
+	gesture_config.stroke_max_ms = stroke_max_ms;
+	gesture_config.h_varmax = h_varmax;
+	gesture_config.v_varmax = v_varmax;
+	gesture_config.late_ms = late_ms;
+	gesture_config.idle_s = idle_s;
+	gesture_config.idle_every = idle_every;
+	gesture_config.idle_grid = idle_grid;
+	gesture_config.push = push_config;
+	gesture_config.load = load_config;
+	gesture_config.debug = debug;
+	gesture_config.debugstop = debugstop;
+	if (kinect_gesture_init(&gesture, &gesture_config, &gesture_callbacks) < 0) {
+		if (jsonout && MMM_Output_log) printf("{ \"log\" : \"Out of memory\" }\n");
+		if (debug) printf("Error out of memory\n");
+		return 1;
+	}
+	gesture.preview = gl_depth_back;
+	if (state_name && kinect_state_create(&state, state_name) < 0) {
+		if (jsonout && MMM_Output_log) printf("{ \"log\" : \"Could not create the pointer state /dev/shm/%s: %s\" }\n", state_name, strerror(errno));
+		if (debug) printf("Error could not create the pointer state /dev/shm/%s: %s\n", state_name, strerror(errno));
 	}
 
 	g_argc = argc;
 	g_argv = argv;
 
-	/* Precalculate all distances from Screen Center */
-	for (i=0; i<640;i++)
-			for (j=0; j<480;j++)
-				DistCen[i][j] = sqrt(pow(i-ScreenCenterX,2)+pow(j-ScreenCenterY,2));
-
-	
 	if (freenect_init(&f_ctx, NULL) < 0) {
 		if (jsonout && MMM_Output_log) printf("{ \"log\" : \"freenect_init() failed\" }\n");
 		if (debug) printf("Error freenect_init() failed\n");
@@ -1073,14 +1080,38 @@ int main(int argc, char **argv)
 		if (debug) printf("%d devices Found\n", nr_devices);
 	
 
-	int user_device_number = 0;
-
 	if (freenect_open_device(f_ctx, &f_dev, user_device_number) < 0) {
 		if (jsonout && MMM_Output_log) printf("{ \"log\" : \"No Kinect found\" \n}");
 		if (debug) printf("Error : No Kinect found\n");
 		return 1;
 	}
 
+	init_metrics();
+	if (metrics_endpoint) {
+		if (kinect_metrics_serve(&metrics, metrics_endpoint) < 0) {
+			if (jsonout && MMM_Output_log) printf("{ \"log\" : \"Could not serve metrics on %s\" }\n", metrics_endpoint);
+			if (debug) printf("Error could not serve metrics on %s\n", metrics_endpoint);
+		} else {
+			if (jsonout && MMM_Output_log) printf("{ \"log\" : \"Serving metrics on %s\" }\n", metrics_endpoint);
+			if (debug) printf("Serving metrics on %s\n", metrics_endpoint);
+		}
+	}
+	if (lock_memory && kinect_sched_lock_memory() < 0) {
+		kinect_metrics_inc(m_sched_fallback);
+		if (jsonout && MMM_Output_log) printf("{ \"log\" : \"Could not lock memory: %s (RLIMIT_MEMLOCK), continuing unlocked\" }\n", strerror(errno));
+		if (debug) printf("Could not lock memory: %s (RLIMIT_MEMLOCK), continuing unlocked\n", strerror(errno));
+	}
+	// Probes take the scheduling of the thread they stand for, see kinect_sched.h
+	if (sched_probe_ms > 0) {
+		kinect_sched_probe_start(&usb_probe, &sched_usb, sched_probe_ms, m_sched_usb);
+		if (sched_gl.set && !headless)
+			kinect_sched_probe_start(&gl_probe, &sched_gl, sched_probe_ms, m_sched_gl);
+		if (sched_motor.set)
+			kinect_sched_probe_start(&motor_probe, &sched_motor, sched_probe_ms, m_sched_motor);
+	}
+	if (jsonout && stats_interval > 0)
+		kinect_metrics_start_stats(&metrics, stats_interval*1000, stdout);
+
 	res = pthread_create(&freenect_thread, NULL, freenect_threadfunc, NULL);
 	if (res) {
 		if (jsonout && MMM_Output_log) printf("{ \"log\" : \"Could not create thread\" }\n");
@@ -1088,6 +1119,14 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
+	if (headless) {
+		// Nothing to draw: run until the stream ends, e.g. the end of a fakenect replay
+		pthread_join(freenect_thread, NULL);
+		if (jsonout)
+			kinect_metrics_write_stats_json(&metrics, stdout);
+		return 0;
+	}
+
 	gl_threadfunc(NULL);
 
 	return 0;
@@ -0,0 +1,97 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+#include <string.h>
+
+#include "kinect_push.h"
+
+void kinect_push_default_config(kinect_push_config *cfg)
+{
+	cfg->depth_mm = 40;
+	cfg->max_ms = 500;
+	cfg->return_ratio = 0.5;
+	cfg->refractory_ms = 300;
+}
+
+void kinect_push_init(kinect_push *p, const kinect_push_config *cfg)
+{
+	memset(p, 0, sizeof(*p));
+	if (cfg)
+		p->cfg = *cfg;
+	else
+		kinect_push_default_config(&p->cfg);
+	p->last_click_ms = -1e9;
+}
+
+void kinect_push_reset(kinect_push *p)
+{
+	p->count = 0;
+	p->pushing = 0;
+}
+
+int kinect_push_update(kinect_push *p, double t_ms, double z_mm, int *x, int *y)
+{
+	kinect_push_sample *s;
+	int i;
+
+	// Keep the samples of the last max_ms
+	s = &p->history[p->head];
+	s->t_ms = t_ms;
+	s->z_mm = z_mm;
+	s->x = *x;
+	s->y = *y;
+	p->head = (p->head + 1) % KINECT_PUSH_HISTORY;
+	if (p->count < KINECT_PUSH_HISTORY)
+		p->count++;
+	while (p->count > 1 && t_ms - p->history[(p->head - p->count + KINECT_PUSH_HISTORY) % KINECT_PUSH_HISTORY].t_ms > p->cfg.max_ms)
+		p->count--;
+
+	if (!p->pushing) {
+		const kinect_push_sample *far = NULL;
+		if (t_ms - p->last_click_ms < p->cfg.refractory_ms)
+			return 0;
+		// A push starts when the hand is depth_mm nearer than anywhere in the window
+		for (i = 0; i < p->count; i++) {
+			const kinect_push_sample *h = &p->history[(p->head - p->count + i + KINECT_PUSH_HISTORY) % KINECT_PUSH_HISTORY];
+			if (!far || h->z_mm > far->z_mm)
+				far = h;
+		}
+		if (far->z_mm - z_mm < p->cfg.depth_mm)
+			return 0;
+		// The push started when the hand last left the far depth, noise allowed
+		for (i = p->count - 1; i >= 0; i--) {
+			const kinect_push_sample *h = &p->history[(p->head - p->count + i + KINECT_PUSH_HISTORY) % KINECT_PUSH_HISTORY];
+			if (h->z_mm >= far->z_mm - p->cfg.depth_mm / 4) {
+				far = h;
+				break;
+			}
+		}
+		p->pushing = 1;
+		p->start = *far;
+		p->min_mm = z_mm;
+		return 0;
+	}
+
+	// Too slow: reaching out, not pushing
+	if (t_ms - p->start.t_ms > p->cfg.max_ms) {
+		p->pushing = 0;
+		return 0;
+	}
+	if (z_mm < p->min_mm)
+		p->min_mm = z_mm;
+	if (z_mm - p->min_mm < p->cfg.return_ratio * (p->start.z_mm - p->min_mm))
+		return 0;
+
+	// Back again: click where the pointer was before the push
+	*x = p->start.x;
+	*y = p->start.y;
+	p->pushing = 0;
+	p->count = 0;
+	p->last_click_ms = t_ms;
+	return 1;
+}
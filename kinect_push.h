@@ -0,0 +1,66 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+ /* Push to click
+ A dwell click needs the pointer to stay still for about half a second, and
+ fires by accident while the user is just reading. A push is a short move of
+ the hand towards the sensor and back: it clicks as soon as the hand comes
+ back, at the place the pointer was before the push.
+
+ The detector is fed the pointer depth of every frame with the frame time.
+ All thresholds are in mm and ms, so they do not depend on the frame rate
+ or on dropped frames.
+ */
+
+#ifndef KINECT_PUSH_H
+#define KINECT_PUSH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KINECT_PUSH_HISTORY 64 // Samples kept, enough for max_ms at 30 fps with margin
+
+typedef struct {
+	double depth_mm;      // Travel towards the sensor that makes a push (default 40)
+	double max_ms;        // Forward and back again within this time (default 500)
+	double return_ratio;  // Part of the travel to come back to click (default 0.5)
+	double refractory_ms; // No push for this long after a click (default 300)
+} kinect_push_config;
+
+typedef struct {
+	double t_ms, z_mm;
+	int x, y;
+} kinect_push_sample;
+
+typedef struct kinect_push {
+	kinect_push_config cfg;
+	kinect_push_sample history[KINECT_PUSH_HISTORY];
+	int head, count;
+	int pushing;          // The hand is on its way forward or back
+	kinect_push_sample start; // Farthest sample before the push: where to click
+	double min_mm;        // Nearest depth reached by the push
+	double last_click_ms;
+} kinect_push;
+
+// cfg NULL uses the defaults
+void kinect_push_init(kinect_push *p, const kinect_push_config *cfg);
+void kinect_push_default_config(kinect_push_config *cfg);
+
+// Feed the pointer of a frame: frame time, pointer depth and position.
+// Returns 1 when a push completed, x and y are then set to the pointer position before the push
+int kinect_push_update(kinect_push *p, double t_ms, double z_mm, int *x, int *y);
+
+// The hand is gone: forget the motion in progress
+void kinect_push_reset(kinect_push *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KINECT_PUSH_H
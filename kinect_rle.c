@@ -0,0 +1,622 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "kinect_rle.h"
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#define MAX(a,b) (((a)>(b))?(a):(b))
+
+int kinect_rle_init(kinect_rle *r, int w, int h)
+{
+	memset(r, 0, sizeof(*r));
+	r->w = w;
+	r->h = h;
+	r->capacity = (w / 2 + 1) * h;	// a row holds at most w / 2 + 1 runs
+	r->runs = malloc(r->capacity * sizeof(*r->runs));
+	r->parent = malloc(r->capacity * sizeof(*r->parent));
+	r->row_start = malloc((h + 1) * sizeof(*r->row_start));
+	if (!r->runs || !r->parent || !r->row_start) {
+		kinect_rle_free(r);
+		return -1;
+	}
+	return 0;
+}
+
+void kinect_rle_free(kinect_rle *r)
+{
+	free(r->runs);
+	free(r->parent);
+	free(r->row_start);
+	free(r->blobs);
+	free(r->contour);
+	free(r->approx);
+	free(r->hull);
+	memset(r, 0, sizeof(*r));
+}
+
+// Clips the ROI to the frame and starts an empty mask on it
+static void begin_mask(kinect_rle *r, int *x0, int *y0, int *w, int *h, int empty)
+{
+	if (*x0 < 0) { *w += *x0; *x0 = 0; }
+	if (*y0 < 0) { *h += *y0; *y0 = 0; }
+	if (*x0 + *w > r->w) *w = r->w - *x0;
+	if (*y0 + *h > r->h) *h = r->h - *y0;
+	if (*w < 0 || *h < 0 || empty)
+		*w = *h = 0;
+	r->x0 = *x0;
+	r->y0 = *y0;
+	r->rows = *h;
+	r->count = 0;
+}
+
+static void add_run(kinect_rle *r, int y, int x0, int x1)
+{
+	r->runs[r->count].y = y;
+	r->runs[r->count].x0 = x0;
+	r->runs[r->count].x1 = x1;
+	r->runs[r->count].label = -1;
+	r->count++;
+}
+
+// The outer ring of the ROI stays empty, as findContours of OpenCV 2 and 3 clears the border of its image
+void kinect_rle_threshold(kinect_rle *r, const uint16_t *depth, int stride, int x0, int y0, int w, int h, uint16_t lo, uint16_t hi)
+{
+	int x, y, start;
+	const uint16_t *row;
+	// One compare per pixel: lo <= v <= hi
+	unsigned range = hi - lo;
+
+	begin_mask(r, &x0, &y0, &w, &h, hi < lo);
+	for (y = 0; y < h; y++) {
+		r->row_start[y] = r->count;
+		if (y == 0 || y == h - 1)
+			continue;
+		row = depth + (y0 + y) * stride + x0;
+		x = 1;
+		while (x < w - 1) {
+			while (x < w - 1 && (unsigned)(row[x] - lo) > range)
+				x++;
+			if (x == w - 1)
+				break;
+			start = x;
+			while (x < w - 1 && (unsigned)(row[x] - lo) <= range)
+				x++;
+			add_run(r, y0 + y, x0 + start, x0 + x);
+		}
+	}
+	r->row_start[h] = r->count;
+}
+
+void kinect_rle_threshold8(kinect_rle *r, const uint8_t *image, int stride, int x0, int y0, int w, int h, uint8_t lo, uint8_t hi)
+{
+	int x, y, start;
+	const uint8_t *row;
+	unsigned range = hi - lo;
+
+	begin_mask(r, &x0, &y0, &w, &h, hi < lo);
+	for (y = 0; y < h; y++) {
+		r->row_start[y] = r->count;
+		if (y == 0 || y == h - 1)
+			continue;
+		row = image + (y0 + y) * stride + x0;
+		x = 1;
+		while (x < w - 1) {
+			while (x < w - 1 && (unsigned)(row[x] - lo) > range)
+				x++;
+			if (x == w - 1)
+				break;
+			start = x;
+			while (x < w - 1 && (unsigned)(row[x] - lo) <= range)
+				x++;
+			add_run(r, y0 + y, x0 + start, x0 + x);
+		}
+	}
+	r->row_start[h] = r->count;
+}
+
+static int find(int *parent, int i)
+{
+	int root = i, next;
+
+	while (parent[root] != root)
+		root = parent[root];
+	while (parent[i] != root) {
+		next = parent[i];
+		parent[i] = root;
+		i = next;
+	}
+	return root;
+}
+
+// The root of a component is its first run in raster order
+static void unite(int *parent, int a, int b)
+{
+	a = find(parent, a);
+	b = find(parent, b);
+	if (a < b)
+		parent[b] = a;
+	else if (b < a)
+		parent[a] = b;
+}
+
+int kinect_rle_label(kinect_rle *r, kinect_rle_blob *blobs, int max_blobs)
+{
+	int i, y, a, b, a_end, b_end, root, labels = 0;
+	kinect_rle_run *run;
+	kinect_rle_blob *blob;
+
+	for (i = 0; i < r->count; i++)
+		r->parent[i] = i;
+	// Runs of two rows touch, diagonals included, when each starts at most one pixel after the other ends
+	for (y = 1; y < r->rows; y++) {
+		a = r->row_start[y - 1];
+		a_end = r->row_start[y];
+		b = a_end;
+		b_end = r->row_start[y + 1];
+		while (a < a_end && b < b_end) {
+			if (r->runs[b].x0 <= r->runs[a].x1 && r->runs[a].x0 <= r->runs[b].x1)
+				unite(r->parent, a, b);
+			if (r->runs[a].x1 < r->runs[b].x1)
+				a++;
+			else
+				b++;
+		}
+	}
+	for (i = 0; i < r->count; i++) {
+		run = &r->runs[i];
+		root = find(r->parent, i);
+		if (root == i) {
+			run->label = labels++;
+			if (run->label < max_blobs) {
+				blob = &blobs[run->label];
+				blob->label = run->label;
+				blob->area = 0;
+				blob->x0 = run->x0;
+				blob->x1 = run->x1;
+				blob->y0 = run->y;
+				blob->y1 = run->y + 1;
+				blob->first_run = i;
+			}
+		} else
+			run->label = r->runs[root].label;
+		if (run->label < max_blobs) {
+			blob = &blobs[run->label];
+			blob->area += run->x1 - run->x0;
+			if (run->x0 < blob->x0)
+				blob->x0 = run->x0;
+			if (run->x1 > blob->x1)
+				blob->x1 = run->x1;
+			blob->y1 = run->y + 1;
+		}
+	}
+	return labels;
+}
+
+int kinect_rle_get(const kinect_rle *r, int x, int y)
+{
+	int lo, hi, mid;
+
+	y -= r->y0;
+	if (y < 0 || y >= r->rows)
+		return 0;
+	lo = r->row_start[y];
+	hi = r->row_start[y + 1];
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (x >= r->runs[mid].x1)
+			lo = mid + 1;
+		else if (x < r->runs[mid].x0)
+			hi = mid;
+		else
+			return 1;
+	}
+	return 0;
+}
+
+// Chain codes of findContours: 0 is +x, counter clockwise on screen (y down)
+static const int code_dx[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+static const int code_dy[8] = { 0, -1, -1, -1, 0, 1, 1, 1 };
+
+int kinect_rle_trace(const kinect_rle *r, const kinect_rle_blob *b, kinect_point *pts, int max_pts)
+{
+	int x0 = r->runs[b->first_run].x0, y0 = r->runs[b->first_run].y;
+	int x1, y1, x3, y3, x4 = 0, y4 = 0;
+	int s, s_end, prev_s, n = 0;
+
+	// Suzuki's border following as findContours does it, from the top left pixel: the left
+	// neighbour is the background, look clockwise from there for the first neighbour set
+	s_end = s = 4;
+	do {
+		s = (s - 1) & 7;
+		x1 = x0 + code_dx[s];
+		y1 = y0 + code_dy[s];
+	} while (!kinect_rle_get(r, x1, y1) && s != s_end);
+	if (s == s_end) {	// a single pixel
+		if (max_pts > 0) {
+			pts[0].x = x0;
+			pts[0].y = y0;
+		}
+		return 1;
+	}
+	x3 = x0;
+	y3 = y0;
+	prev_s = s ^ 4;
+	for (;;) {
+		// Counter clockwise from the pixel we came from to the next pixel set
+		while (s < 15) {
+			s++;
+			x4 = x3 + code_dx[s & 7];
+			y4 = y3 + code_dy[s & 7];
+			if (kinect_rle_get(r, x4, y4))
+				break;
+		}
+		s &= 7;
+		// CHAIN_APPROX_SIMPLE: only the points where the direction changes
+		if (s != prev_s) {
+			if (n < max_pts) {
+				pts[n].x = x3;
+				pts[n].y = y3;
+			}
+			n++;
+			prev_s = s;
+		}
+		if (x4 == x0 && y4 == y0 && x3 == x1 && y3 == y1)
+			break;
+		x3 = x4;
+		y3 = y4;
+		s = (s + 4) & 7;
+	}
+	return n;
+}
+
+double kinect_rle_area(const kinect_point *pts, int n)
+{
+	double a = 0;
+	int i;
+
+	if (n < 3)
+		return 0;
+	for (i = 0; i < n; i++) {
+		const kinect_point *p = &pts[i ? i - 1 : n - 1];
+		a += (double)p->x * pts[i].y - (double)p->y * pts[i].x;
+	}
+	return fabs(a * 0.5);
+}
+
+typedef struct {
+	int start, end;
+} slice;
+
+int kinect_rle_approx(const kinect_point *src, int n, double eps, kinect_point *dst)
+{
+	slice *stack, s, right = { 0, 0 };
+	kinect_point start = { -1000000, -1000000 }, end, pt;
+	int i, j, pos = 0, wpos, count = n, new_count = 0, top = 0;
+	int le_eps = 0;
+	double dx, dy, dist, max_dist;
+
+	if (n == 0)
+		return 0;
+	// Pending slices partition the polygon: at most n of them
+	stack = malloc((n + 1) * sizeof(*stack));
+	if (!stack)
+		return -1;
+	eps *= eps;
+
+	// Start from two points about the farthest apart, as approxPolyDP
+	for (i = 0; i < 3; i++) {
+		max_dist = 0;
+		pos = (pos + right.start) % count;
+		start = src[pos];
+		if (++pos >= count)
+			pos = 0;
+		for (j = 1; j < count; j++) {
+			pt = src[pos];
+			if (++pos >= count)
+				pos = 0;
+			dx = pt.x - start.x;
+			dy = pt.y - start.y;
+			dist = dx * dx + dy * dy;
+			if (dist > max_dist) {
+				max_dist = dist;
+				right.start = j;
+			}
+		}
+		le_eps = max_dist <= eps;
+	}
+	if (!le_eps) {
+		right.end = s.start = pos % count;
+		s.end = right.start = (right.start + s.start) % count;
+		stack[top++] = right;
+		stack[top++] = s;
+	} else
+		dst[new_count++] = start;
+
+	// Split each slice at its point farthest from its chord until all are within eps
+	while (top > 0) {
+		s = stack[--top];
+		end = src[s.end];
+		pos = s.start;
+		start = src[pos];
+		if (++pos >= count)
+			pos = 0;
+		if (pos != s.end) {
+			max_dist = 0;
+			dx = end.x - start.x;
+			dy = end.y - start.y;
+			while (pos != s.end) {
+				pt = src[pos];
+				if (++pos >= count)
+					pos = 0;
+				dist = fabs((pt.y - start.y) * dx - (pt.x - start.x) * dy);
+				if (dist > max_dist) {
+					max_dist = dist;
+					right.start = (pos + count - 1) % count;
+				}
+			}
+			le_eps = max_dist * max_dist <= eps * (dx * dx + dy * dy);
+		} else {
+			le_eps = 1;
+			start = src[s.start];
+		}
+		if (le_eps)
+			dst[new_count++] = start;
+		else {
+			right.end = s.end;
+			s.end = right.start;
+			stack[top++] = right;
+			stack[top++] = s;
+		}
+	}
+	free(stack);
+
+	// Drop the points left on nearly straight lines
+	count = new_count;
+	pos = count - 1;
+	start = dst[pos];
+	if (++pos >= count)
+		pos = 0;
+	wpos = pos;
+	pt = dst[pos];
+	if (++pos >= count)
+		pos = 0;
+	for (i = 0; i < count && new_count > 2; i++) {
+		double inner;
+
+		end = dst[pos];
+		if (++pos >= count)
+			pos = 0;
+		dx = end.x - start.x;
+		dy = end.y - start.y;
+		dist = fabs((pt.x - start.x) * dy - (pt.y - start.y) * dx);
+		inner = (double)(pt.x - start.x) * (end.x - pt.x) + (double)(pt.y - start.y) * (end.y - pt.y);
+		if (dist * dist <= 0.5 * eps * (dx * dx + dy * dy) && dx != 0 && dy != 0 && inner >= 0) {
+			new_count--;
+			dst[wpos] = start = end;
+			if (++wpos >= count)
+				wpos = 0;
+			pt = dst[pos];
+			if (++pos >= count)
+				pos = 0;
+			i++;
+			continue;
+		}
+		dst[wpos] = start = pt;
+		if (++wpos >= count)
+			wpos = 0;
+		pt = end;
+	}
+	return new_count;
+}
+
+static const kinect_point *sort_pts;
+
+static int cmp_points(const void *a, const void *b)
+{
+	const kinect_point *p = &sort_pts[*(const int *)a], *q = &sort_pts[*(const int *)b];
+
+	if (p->x != q->x)
+		return p->x < q->x ? -1 : 1;
+	if (p->y != q->y)
+		return p->y < q->y ? -1 : 1;
+	return *(const int *)a - *(const int *)b;
+}
+
+static long cross(const kinect_point *o, const kinect_point *a, const kinect_point *b)
+{
+	return (long)(a->x - o->x) * (b->y - o->y) - (long)(a->y - o->y) * (b->x - o->x);
+}
+
+int kinect_rle_hull(const kinect_point *pts, int n, int *hull)
+{
+	int *order, *chain;
+	int i, k = 0, lower, min_i, max_i, asc, desc, start;
+
+	if (n <= 0)
+		return 0;
+	order = malloc(2 * (n + 1) * sizeof(int));
+	if (!order)
+		return -1;
+	chain = order + n;
+	for (i = 0; i < n; i++)
+		order[i] = i;
+	sort_pts = pts;
+	qsort(order, n, sizeof(int), cmp_points);
+	// Monotone chain, collinear points left out as convexHull does
+	for (i = 0; i < n; i++) {
+		while (k >= 2 && cross(&pts[chain[k - 2]], &pts[chain[k - 1]], &pts[order[i]]) <= 0)
+			k--;
+		chain[k++] = order[i];
+	}
+	lower = k + 1;
+	for (i = n - 2; i >= 0; i--) {
+		while (k >= lower && cross(&pts[chain[k - 2]], &pts[chain[k - 1]], &pts[order[i]]) <= 0)
+			k--;
+		chain[k++] = order[i];
+	}
+	if (k > 1)
+		k--;	// the first point closes the chain
+	if (k == 2 && pts[chain[0]].x == pts[chain[1]].x && pts[chain[0]].y == pts[chain[1]].y)
+		k = 1;
+	// The chain turns counter clockwise on screen, as convexHull with clockwise false
+	memcpy(hull, chain, k * sizeof(int));
+	// and starts from the lowest or the highest index when they follow each other around the hull
+	min_i = max_i = 0;
+	for (i = 1; i < k; i++) {
+		if (hull[i] < hull[min_i])
+			min_i = i;
+		if (hull[i] > hull[max_i])
+			max_i = i;
+	}
+	asc = desc = 0;
+	for (i = 0; i < k; i++) {
+		int a = hull[(min_i + i) % k], b = hull[(min_i + i + 1) % k];
+		int c = hull[(max_i + i) % k], d = hull[(max_i + i + 1) % k];
+
+		asc += i == k - 1 || a < b;
+		desc += i == k - 1 || c > d;
+	}
+	start = asc == k ? min_i : desc == k ? max_i : 0;
+	for (i = 0; i < k; i++)
+		chain[i] = hull[(start + i) % k];
+	memcpy(hull, chain, k * sizeof(int));
+	free(order);
+	return k;
+}
+
+int kinect_rle_defects(const kinect_point *pts, int n, const int *hull, int nh, double min_depth, kinect_rle_defect *defects, int max_defects)
+{
+	int i, j, a, b, count = 0, ascending;
+	double dx, dy, len, depth;
+
+	if (nh < 3)
+		return 0;
+	// Walk the polygon forward from each hull point to the next one
+	ascending = hull[0] < hull[1] ? hull[1] < hull[2] || hull[2] < hull[0] : hull[1] < hull[2] && hull[2] < hull[0];
+	for (i = 0; i < nh && count < max_defects; i++) {
+		a = ascending ? hull[i] : hull[(nh - i) % nh];
+		b = ascending ? hull[(i + 1) % nh] : hull[nh - 1 - i];
+		dx = pts[b].x - pts[a].x;
+		dy = pts[b].y - pts[a].y;
+		len = sqrt(dx * dx + dy * dy);
+		if (len == 0)
+			continue;
+		defects[count].depth = 0;
+		defects[count].far = -1;
+		for (j = (a + 1) % n; j != b; j = (j + 1) % n) {
+			depth = fabs((pts[j].x - pts[a].x) * dy - (pts[j].y - pts[a].y) * dx) / len;
+			if (depth > defects[count].depth) {
+				defects[count].depth = depth;
+				defects[count].far = j;
+			}
+		}
+		if (defects[count].far >= 0 && defects[count].depth > min_depth) {
+			defects[count].start = a;
+			defects[count].end = b;
+			count++;
+		}
+	}
+	return count;
+}
+
+// Make room for the border of a component and its approximation
+static int reserve(kinect_rle *r, int n)
+{
+	int cap = r->contour_capacity ? r->contour_capacity : 1024;
+	void *c, *a, *h;
+
+	if (n <= r->contour_capacity)
+		return 0;
+	while (cap < n)
+		cap *= 2;
+	c = realloc(r->contour, cap * sizeof(*r->contour));
+	if (c)
+		r->contour = c;
+	a = realloc(r->approx, cap * sizeof(*r->approx));
+	if (a)
+		r->approx = a;
+	h = realloc(r->hull, cap * sizeof(*r->hull));
+	if (h)
+		r->hull = h;
+	if (!c || !a || !h)
+		return -1;
+	r->contour_capacity = cap;
+	return 0;
+}
+
+int kinect_rle_tips(const kinect_point *poly, int n, const int *hull, int nh, double max_angle, float *cutoff, kinect_point *tips, int max_tips)
+{
+	int j, idx, pdx, sdx, v1x, v1y, v2x, v2y, upper = 640, lower = 0, count = 0;
+	float cut, angle;
+
+	// Lower hull points are not fingers: only the upper 90% of the hand counts
+	for (j = 0; j < nh; j++) {
+		idx = hull[j];
+		if (poly[idx].y < upper) upper = poly[idx].y;
+		if (poly[idx].y > lower) lower = poly[idx].y;
+	}
+	cut = lower - (lower - upper) * 0.1f;
+	if (cutoff)
+		*cutoff = cut;
+	// A finger is a hull point with a low interior angle
+	for (j = 0; j < nh; j++) {
+		idx = hull[j];
+		pdx = idx == 0 ? n - 1 : idx - 1;
+		sdx = idx == n - 1 ? 0 : idx + 1;
+		v1x = poly[sdx].x - poly[idx].x;
+		v1y = poly[sdx].y - poly[idx].y;
+		v2x = poly[pdx].x - poly[idx].x;
+		v2y = poly[pdx].y - poly[idx].y;
+		angle = acos((v1x * v2x + v1y * v2y) / (sqrt((double)v1x * v1x + (double)v1y * v1y) * sqrt((double)v2x * v2x + (double)v2y * v2y)));
+		if (angle < max_angle && poly[idx].y < cut) {
+			if (count < max_tips)
+				tips[count] = poly[idx];
+			count++;
+		}
+	}
+	return count;
+}
+
+int kinect_rle_fingertips(kinect_rle *r, double min_area, double eps, double max_angle, kinect_point *tips, int max_tips)
+{
+	int blobs, b, n, na, nh, count = 0;
+
+	blobs = kinect_rle_label(r, r->blobs, r->max_blobs);
+	if (blobs > r->max_blobs) {
+		kinect_rle_blob *more = realloc(r->blobs, blobs * 2 * sizeof(*more));
+
+		if (!more)
+			return 0;
+		r->blobs = more;
+		r->max_blobs = blobs * 2;
+		kinect_rle_label(r, r->blobs, r->max_blobs);
+	}
+	for (b = 0; b < blobs; b++) {
+		// The border goes through pixel centres: it cannot enclose more than the bounds minus half a pixel all round
+		if ((double)(r->blobs[b].x1 - r->blobs[b].x0 - 1) * (r->blobs[b].y1 - r->blobs[b].y0 - 1) <= min_area)
+			continue;
+		n = kinect_rle_trace(r, &r->blobs[b], r->contour, r->contour_capacity);
+		if (n > r->contour_capacity) {
+			if (reserve(r, n) < 0)
+				return count;
+			kinect_rle_trace(r, &r->blobs[b], r->contour, r->contour_capacity);
+		}
+		if (kinect_rle_area(r->contour, n) <= min_area)
+			continue;
+		na = kinect_rle_approx(r->contour, n, eps, r->approx);
+		if (na < 3)
+			continue;
+		nh = kinect_rle_hull(r->approx, na, r->hull);
+		count += kinect_rle_tips(r->approx, na, r->hull, nh, max_angle, NULL, tips + MIN(count, max_tips), MAX(max_tips - count, 0));
+	}
+	return count;
+}
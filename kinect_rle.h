@@ -0,0 +1,128 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+ /* Run-length encoded hand masks
+ The fingertip detector of finger.cpp thresholds the depth into a full 8 bit
+ mask, clones it for findContours, copies every contour into a vector and a
+ Mat and approximates each one. Here the mask is built as runs of pixels
+ straight from the raw depth, and everything after works on the runs:
+
+   kinect_rle_threshold   runs of the pixels with lo <= depth <= hi in a ROI
+                          (kinect_rle_threshold8 on an 8 bit image)
+   kinect_rle_label       8-connected components of the runs (union-find)
+   kinect_rle_trace       outer border of a component, by asking the runs of
+                          a row whether a pixel is set
+   kinect_rle_approx      polygon approximation (Douglas-Peucker)
+   kinect_rle_hull        convex hull, kinect_rle_defects its defects
+   kinect_rle_tips        fingertips: sharp hull corners
+   kinect_rle_fingertips  all of the above for every component
+
+ The border, the approximation and the hull follow findContours
+ (CHAIN_APPROX_SIMPLE), approxPolyDP and convexHull of OpenCV 2.4 and 3 point
+ for point, so the tips are those of the OpenCV detector (rle_bench.out
+ compares the two, and lists what differs with other OpenCV versions).
+ As findContours, the outer ring of pixels of the ROI is left out of the mask.
+ Holes are not traced: a hole is never a hand.
+
+ Coordinates are frame pixels, the ROI only limits what is thresholded.
+ */
+
+#ifndef KINECT_RLE_H
+#define KINECT_RLE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	int x, y;
+} kinect_point;
+
+typedef struct {
+	int16_t y, x0, x1;     // Pixels x0 to x1 - 1 of row y
+	int16_t pad;
+	int32_t label;         // Component, after kinect_rle_label
+} kinect_rle_run;
+
+typedef struct {
+	int label;
+	long area;             // Pixels
+	int x0, y0, x1, y1;    // Bounds, x1 and y1 excluded
+	int first_run;         // Its top left run: where its border starts
+} kinect_rle_blob;
+
+typedef struct {
+	int start, end;        // Hull points, indices in the polygon
+	int far;               // Polygon point between them farthest from the hull
+	double depth;          // and its distance to the hull edge
+} kinect_rle_defect;
+
+typedef struct {
+	int w, h;              // Largest frame
+	int x0, y0, rows;      // ROI of the current mask
+	kinect_rle_run *runs;
+	int count, capacity;
+	int *row_start;        // Runs of row y0 + i are runs[row_start[i]] to runs[row_start[i+1] - 1]
+	int *parent;           // Union-find over the runs
+	// Scratch of kinect_rle_fingertips
+	kinect_rle_blob *blobs;
+	int max_blobs;
+	kinect_point *contour, *approx;
+	int *hull;
+	int contour_capacity;
+} kinect_rle;
+
+// Masks of frames up to w x h. Returns -1 when out of memory
+int kinect_rle_init(kinect_rle *r, int w, int h);
+void kinect_rle_free(kinect_rle *r);
+
+// Runs of the pixels of the ROI x0, y0, w, h of depth (stride pixels a row) with lo <= value <= hi
+void kinect_rle_threshold(kinect_rle *r, const uint16_t *depth, int stride, int x0, int y0, int w, int h, uint16_t lo, uint16_t hi);
+// The same on an 8 bit image, e.g. the set pixels of a mask with lo = 1, hi = 255
+void kinect_rle_threshold8(kinect_rle *r, const uint8_t *image, int stride, int x0, int y0, int w, int h, uint8_t lo, uint8_t hi);
+
+// Label the 8-connected components, in raster order of their top left pixel, and describe
+// up to max_blobs of them. Returns the number of components
+int kinect_rle_label(kinect_rle *r, kinect_rle_blob *blobs, int max_blobs);
+
+// Is the pixel set
+int kinect_rle_get(const kinect_rle *r, int x, int y);
+
+// Outer border of a component: its corners as findContours CHAIN_APPROX_SIMPLE gives them.
+// Returns the number of points, at most max_pts are written
+int kinect_rle_trace(const kinect_rle *r, const kinect_rle_blob *b, kinect_point *pts, int max_pts);
+
+// Area of a closed polygon
+double kinect_rle_area(const kinect_point *pts, int n);
+
+// Douglas-Peucker approximation of a closed polygon within eps, as approxPolyDP. dst holds n points.
+// Returns the number of points
+int kinect_rle_approx(const kinect_point *src, int n, double eps, kinect_point *dst);
+
+// Convex hull as indices in pts, as convexHull. hull holds n indices. Returns the number of points
+int kinect_rle_hull(const kinect_point *pts, int n, int *hull);
+
+// Convexity defects of a polygon and its hull deeper than min_depth. Returns the number written
+int kinect_rle_defects(const kinect_point *pts, int n, const int *hull, int nh, double min_depth, kinect_rle_defect *defects, int max_defects);
+
+// Fingertips of a hand: hull points of its polygon with an interior angle under max_angle, above
+// the lowest 10% of the hull (cutoff, the y below which points are not fingers, can be NULL).
+// Returns the number of tips, at most max_tips are written
+int kinect_rle_tips(const kinect_point *poly, int n, const int *hull, int nh, double max_angle, float *cutoff, kinect_point *tips, int max_tips);
+
+// Fingertips of the components larger than min_area (border polygon area): kinect_rle_tips of their
+// border approximated within eps. Returns the number of tips, at most max_tips are written
+int kinect_rle_fingertips(kinect_rle *r, double min_area, double eps, double max_angle, kinect_point *tips, int max_tips);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KINECT_RLE_H
@@ -0,0 +1,205 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+ /* Fingertips on run-length encoded masks against the OpenCV detector
+ Renders FRAMES synthetic depth frames of a hand (palm, arm, up to five
+ fingers, sensor dropouts and speckles), finds the fingertips of each with the
+ mask image, findContours, approxPolyDP and convexHull path finger.cpp used
+ and with kinect_rle (see kinect_rle.h), and reports the time per frame of
+ both and every frame where the tips differ. The same tips in another order
+ are only counted: the order follows the point approxPolyDP starts from.
+
+   rle_bench.out [FRAMES [SEED]]    (default 2000 frames, seed 1)
+
+ kinect_rle follows OpenCV 2.4 and 3. Against other versions:
+ - OpenCV 2.2, which nestk bundles, starts approxPolyDP from another point
+   and keeps fewer points on nearly straight lines: most tips come in another
+   order, about one frame in a thousand has one more tip with kinect_rle.
+ - OpenCV 4 traces contours up to the border of the image instead of
+   clearing it, and OpenCV 5 measures the approxPolyDP distances to the chord
+   segment instead of its line: hands touching the border of the frame differ.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "kinect_rle.h"
+
+#define W 640
+#define H 480
+#define HAND_RAW_MIN 0 // raw depths with 0 < z < 0.75 m, as finger.cpp
+#define HAND_RAW_MAX 650
+#define HAND_MARGIN 8
+
+static unsigned seed;
+
+static double uniform(double a, double b)
+{
+  seed = seed * 1103515245 + 12345;
+  return a + (b - a) * ((seed >> 8) & 0xffffff) / 16777216.0;
+}
+
+// A hand reaching up into the picture, at 500-640 in front of a background at 750-1000
+static void render(uint16_t *depth)
+{
+  cv::Mat hand = cv::Mat::zeros(H, W, CV_8UC1);
+  int cx = uniform(120, 520), cy = uniform(150, 400), r = uniform(35, 70);
+
+  cv::circle(hand, cv::Point(cx, cy), r, cv::Scalar(255), -1);
+  cv::line(hand, cv::Point(cx, cy), cv::Point(cx + uniform(-80, 80), H), cv::Scalar(255), uniform(40, 80));
+  int fingers = uniform(0, 6);
+  for (int i=0; i<fingers; i++) {
+    double a = uniform(-170, -10) * M_PI / 180, len = uniform(r + 30, r + 100);
+    cv::line(hand, cv::Point(cx, cy), cv::Point(cx + len * cos(a), cy + len * sin(a)), cv::Scalar(255), uniform(10, 22));
+  }
+  uint16_t background = uniform(750, 1000);
+  double dropouts = uniform(0, 0.03), speckles = uniform(0, 0.002);
+  for (int i=0; i<W*H; i++) {
+    depth[i] = hand.data[i] ? uniform(500, 640) : background;
+    if (uniform(0, 1) < dropouts)
+      depth[i] = 2047;
+    else if (uniform(0, 1) < speckles)
+      depth[i] = uniform(HAND_RAW_MIN, HAND_RAW_MAX);
+  }
+}
+
+// findHandRoi of finger.cpp
+static cv::Rect handRoi(const uint16_t *depth)
+{
+  int u0 = W, u1 = -1, v0 = H, v1 = -1;
+
+  for (int v=0; v<H; v++)
+    for (int u=0; u<W; u++)
+      if (depth[v*W + u] >= HAND_RAW_MIN && depth[v*W + u] <= HAND_RAW_MAX) {
+	if (v0 == H) v0 = v;
+	v1 = v;
+	if (u < u0) u0 = u;
+	if (u > u1) u1 = u;
+      }
+  if (v1 < 0)
+    return cv::Rect();
+  return cv::Rect(cv::Point(std::max(u0 - HAND_MARGIN, 0), std::max(v0 - HAND_MARGIN, 0)),
+		  cv::Point(std::min(u1 + HAND_MARGIN + 1, W), std::min(v1 + HAND_MARGIN + 1, H)));
+}
+
+// The OpenCV detector of finger.cpp, without the debug drawing
+static std::vector<cv::Point> opencvTips(const uint16_t *depth, cv::Rect roi)
+{
+  using namespace cv;
+  using namespace std;
+  vector<Point> tips;
+
+  Mat raw(H, W, CV_16UC1, (void*)depth);
+  Mat handMask;
+  inRange(raw(roi), Scalar(HAND_RAW_MIN), Scalar(HAND_RAW_MAX), handMask);
+  vector<vector<Point> > contours;
+  findContours(handMask, contours, RETR_LIST, CHAIN_APPROX_SIMPLE, roi.tl());
+  for (size_t i=0; i<contours.size(); i++) {
+    if (contourArea(Mat(contours[i])) <= 3000)
+      continue;
+    vector<Point> approxCurve;
+    approxPolyDP(Mat(contours[i]), approxCurve, 20, true);
+    vector<int> hull;
+    convexHull(Mat(approxCurve), hull);
+    int upper = 640, lower = 0;
+    for (size_t j=0; j<hull.size(); j++) {
+      if (approxCurve[hull[j]].y < upper) upper = approxCurve[hull[j]].y;
+      if (approxCurve[hull[j]].y > lower) lower = approxCurve[hull[j]].y;
+    }
+    float cutoff = lower - (lower - upper) * 0.1f;
+    for (size_t j=0; j<hull.size(); j++) {
+      int idx = hull[j];
+      int pdx = idx == 0 ? approxCurve.size() - 1 : idx - 1;
+      int sdx = idx == (int)approxCurve.size() - 1 ? 0 : idx + 1;
+      Point v1 = approxCurve[sdx] - approxCurve[idx];
+      Point v2 = approxCurve[pdx] - approxCurve[idx];
+      float angle = acos( (v1.x*v2.x + v1.y*v2.y) / (norm(v1) * norm(v2)) );
+      if (angle < 1 && approxCurve[idx].y < cutoff)
+	tips.push_back(approxCurve[idx]);
+    }
+  }
+  return tips;
+}
+
+static double now_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+int main(int argc, char **argv)
+{
+  int frames = argc > 1 ? atoi(argv[1]) : 2000;
+  seed = argc > 2 ? atoi(argv[2]) : 1;
+  std::vector<uint16_t> depth(W*H);
+  kinect_rle rle;
+  kinect_point tips[64];
+  double opencv_us = 0, rle_us = 0, t;
+  long total_tips = 0;
+  int differ = 0, reordered = 0;
+
+  if (kinect_rle_init(&rle, W, H) < 0) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+  for (int f=0; f<frames; f++) {
+    render(&depth[0]);
+    cv::Rect roi = handRoi(&depth[0]);
+
+    t = now_us();
+    std::vector<cv::Point> expected = opencvTips(&depth[0], roi);
+    opencv_us += now_us() - t;
+
+    t = now_us();
+    kinect_rle_threshold(&rle, &depth[0], W, roi.x, roi.y, roi.width, roi.height, HAND_RAW_MIN, HAND_RAW_MAX);
+    int n = kinect_rle_fingertips(&rle, 3000, 20, 1, tips, 64);
+    rle_us += now_us() - t;
+
+    total_tips += expected.size();
+    bool same = n == (int)expected.size();
+    for (int i=0; same && i<n; i++)
+      same = tips[i].x == expected[i].x && tips[i].y == expected[i].y;
+    if (!same && n == (int)expected.size()) {
+      std::vector<bool> matched(n, false);
+      int found = 0;
+      for (int i=0; i<n; i++)
+	for (int j=0; j<n; j++)
+	  if (!matched[j] && tips[i].x == expected[j].x && tips[i].y == expected[j].y) {
+	    matched[j] = true;
+	    found++;
+	    break;
+	  }
+      if (found == n) {
+	reordered++;
+	continue;
+      }
+    }
+    if (!same) {
+      differ++;
+      printf("frame %d: opencv", f);
+      for (size_t i=0; i<expected.size(); i++)
+	printf(" %d,%d", expected[i].x, expected[i].y);
+      printf(" rle");
+      for (int i=0; i<n && i<64; i++)
+	printf(" %d,%d", tips[i].x, tips[i].y);
+      printf("\n");
+    }
+  }
+  printf("%d frames, %ld tips, %d frames with other tips, %d with the same tips in another order\n",
+	 frames, total_tips, differ, reordered);
+  printf("opencv %.1f us/frame, rle %.1f us/frame, %.1fx\n", opencv_us / frames, rle_us / frames, rle_us > 0 ? opencv_us / rle_us : 0);
+  kinect_rle_free(&rle);
+  return differ ? 1 : 0;
+}
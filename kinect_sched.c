@@ -0,0 +1,202 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "kinect_sched.h"
+
+#define MAX_CPUS (8 * (int)sizeof(unsigned long))
+
+void kinect_sched_default_config(kinect_sched_config *cfg)
+{
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->policy = -1;
+}
+
+// "2", "0-1,3": cpu list to affinity mask
+static int parse_cpus(const char *s, unsigned long *cpus)
+{
+	char *end;
+	long a, b;
+
+	*cpus = 0;
+	while (*s) {
+		a = strtol(s, &end, 10);
+		if (end == s || a < 0 || a >= MAX_CPUS)
+			return -1;
+		b = a;
+		if (*end == '-') {
+			s = end + 1;
+			b = strtol(s, &end, 10);
+			if (end == s || b < a || b >= MAX_CPUS)
+				return -1;
+		}
+		for (; a <= b; a++)
+			*cpus |= 1UL << a;
+		if (*end == ',')
+			end++;
+		else if (*end)
+			return -1;
+		s = end;
+	}
+	return *cpus ? 0 : -1;
+}
+
+int kinect_sched_parse(kinect_sched_config *cfg, const char *spec)
+{
+	const char *at = strchr(spec, '@');
+	size_t len = at ? (size_t)(at - spec) : strlen(spec);
+	char *end;
+
+	kinect_sched_default_config(cfg);
+	if (len == 0)
+		;
+	else if (len == 5 && !strncmp(spec, "other", len))
+		cfg->policy = SCHED_OTHER;
+	else if (len > 5 && !strncmp(spec, "fifo:", 5)) {
+		cfg->policy = SCHED_FIFO;
+		cfg->priority = strtol(spec + 5, &end, 10);
+		if (end != spec + len || cfg->priority < sched_get_priority_min(SCHED_FIFO) || cfg->priority > sched_get_priority_max(SCHED_FIFO))
+			return -1;
+	}
+	else
+		return -1;
+	if (at && parse_cpus(at + 1, &cfg->cpus) < 0)
+		return -1;
+	cfg->set = cfg->policy >= 0 || cfg->cpus;
+	return cfg->set ? 0 : -1;
+}
+
+const char *kinect_sched_describe(const kinect_sched_config *cfg, char *buf, int size)
+{
+	int n = 0, cpu, last;
+	char sep = '@';
+
+	if (!cfg->set) {
+		snprintf(buf, size, "default");
+		return buf;
+	}
+	if (cfg->policy == SCHED_FIFO)
+		n = snprintf(buf, size, "fifo:%d", cfg->priority);
+	else if (cfg->policy == SCHED_OTHER)
+		n = snprintf(buf, size, "other");
+	else
+		buf[0] = 0;
+	for (cpu = 0; cpu < MAX_CPUS && n < size; cpu++) {
+		if (!(cfg->cpus & (1UL << cpu)))
+			continue;
+		for (last = cpu; last + 1 < MAX_CPUS && (cfg->cpus & (1UL << (last + 1))); last++)
+			;
+		if (last > cpu)
+			n += snprintf(buf + n, size - n, "%c%d-%d", sep, cpu, last);
+		else
+			n += snprintf(buf + n, size - n, "%c%d", sep, cpu);
+		sep = ',';
+		cpu = last;
+	}
+	return buf;
+}
+
+int kinect_sched_apply(pthread_t thread, const kinect_sched_config *cfg)
+{
+	int failed = 0, err = 0, cpu;
+	struct sched_param param;
+	cpu_set_t set;
+
+	if (!cfg || !cfg->set)
+		return 0;
+	if (cfg->cpus) {
+		CPU_ZERO(&set);
+		for (cpu = 0; cpu < MAX_CPUS; cpu++)
+			if (cfg->cpus & (1UL << cpu))
+				CPU_SET(cpu, &set);
+		// EINVAL: none of the cpus is online
+		if ((err = pthread_setaffinity_np(thread, sizeof(set), &set)))
+			failed |= KINECT_SCHED_AFFINITY_FAILED;
+	}
+	if (cfg->policy >= 0) {
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = cfg->policy == SCHED_FIFO ? cfg->priority : 0;
+		// EPERM without CAP_SYS_NICE or a large enough RLIMIT_RTPRIO: the thread keeps its policy
+		if ((err = pthread_setschedparam(thread, cfg->policy, &param)))
+			failed |= KINECT_SCHED_POLICY_FAILED;
+	}
+	if (failed)
+		errno = err;
+	return failed;
+}
+
+int kinect_sched_lock_memory(void)
+{
+	return mlockall(MCL_CURRENT | MCL_FUTURE);
+}
+
+static void *probe_threadfunc(void *arg)
+{
+	kinect_sched_probe *p = arg;
+	struct timespec deadline, now;
+	long period_ns = (long)(p->period_ms * 1e6);
+	double late;
+
+	kinect_sched_apply(pthread_self(), &p->cfg);
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	while (p->running) {
+		deadline.tv_nsec += period_ns;
+		while (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_nsec -= 1000000000L;
+			deadline.tv_sec++;
+		}
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+			;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		late = (now.tv_sec - deadline.tv_sec) * 1e3 + (now.tv_nsec - deadline.tv_nsec) / 1e6;
+		p->last_ms = late;
+		if (late > p->max_ms)
+			p->max_ms = late;
+		p->wakeups++;
+		kinect_metrics_observe(p->latency, late);
+		// Stopped for longer than a period (suspend, debugger): start over from now
+		if (late > p->period_ms)
+			deadline = now;
+	}
+	return NULL;
+}
+
+int kinect_sched_probe_start(kinect_sched_probe *p, const kinect_sched_config *cfg, double period_ms, kinect_metric *latency)
+{
+	memset(p, 0, sizeof(*p));
+	if (cfg)
+		p->cfg = *cfg;
+	else
+		kinect_sched_default_config(&p->cfg);
+	if (period_ms <= 0)
+		return -1;
+	p->period_ms = period_ms;
+	p->latency = latency;
+	p->running = 1;
+	if (pthread_create(&p->thread, NULL, probe_threadfunc, p)) {
+		p->running = 0;
+		return -1;
+	}
+	return 0;
+}
+
+void kinect_sched_probe_stop(kinect_sched_probe *p)
+{
+	if (!p->running)
+		return;
+	p->running = 0;
+	pthread_join(p->thread, NULL);
+}
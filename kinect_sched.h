@@ -0,0 +1,85 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+ /* Thread scheduling
+ On a Pi shared with the MagicMirror browser the usb thread gets preempted:
+ isochronous packets are lost and the pointer stutters. Each thread can be
+ given a cpu affinity and a policy, SCHED_FIFO with a priority or the default
+ SCHED_OTHER, and the process memory can be locked so that no page fault
+ stalls a callback. Settings are written
+
+   fifo:50@2        SCHED_FIFO priority 50, on cpu 2
+   other@0-1,3      SCHED_OTHER, on cpus 0, 1 and 3
+   fifo:10          SCHED_FIFO priority 10, on any cpu
+   @3               keep the policy, run on cpu 3
+
+ Real-time priorities need CAP_SYS_NICE or an RLIMIT_RTPRIO (e.g. a
+ "@video - rtprio 60" line in /etc/security/limits.conf), locking memory
+ needs RLIMIT_MEMLOCK. What cannot be applied is reported and the thread runs
+ on with the default scheduling.
+
+ A probe thread running with the same settings sleeps to fixed deadlines and
+ measures how late it wakes up: the scheduling latency a thread of that class
+ sees, as cyclictest measures it.
+ */
+
+#ifndef KINECT_SCHED_H
+#define KINECT_SCHED_H
+
+#include <pthread.h>
+
+#include "kinect_metrics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// What kinect_sched_apply could not do, the rest is applied
+#define KINECT_SCHED_AFFINITY_FAILED 1
+#define KINECT_SCHED_POLICY_FAILED 2
+
+typedef struct {
+	int set;               // 0: leave the thread as created (it inherits from its creator)
+	int policy;            // SCHED_OTHER or SCHED_FIFO, -1 to keep the current one
+	int priority;          // SCHED_FIFO priority, 1 to 99
+	unsigned long cpus;    // Affinity, bit n for cpu n, 0 for any cpu
+} kinect_sched_config;
+
+typedef struct {
+	kinect_sched_config cfg;
+	double period_ms;      // Time between two wake ups
+	kinect_metric *latency; // Histogram of the wake up delays in ms, may be NULL
+	pthread_t thread;
+	volatile int running;
+	double last_ms, max_ms; // Latest and worst wake up delays
+	unsigned long wakeups;
+} kinect_sched_probe;
+
+void kinect_sched_default_config(kinect_sched_config *cfg);
+
+// Parse a setting as described above. Returns -1 when it is malformed
+int kinect_sched_parse(kinect_sched_config *cfg, const char *spec);
+
+// Describe a setting in the syntax above, "default" when not set
+const char *kinect_sched_describe(const kinect_sched_config *cfg, char *buf, int size);
+
+// Apply to a running thread. Returns 0 or the KINECT_SCHED_*_FAILED bits, errno tells why
+int kinect_sched_apply(pthread_t thread, const kinect_sched_config *cfg);
+
+// mlockall the current and future pages of the process. Returns -1 on failure, errno tells why
+int kinect_sched_lock_memory(void);
+
+// Start a probe with the scheduling of cfg, waking up every period_ms. Returns 0 on success
+int kinect_sched_probe_start(kinect_sched_probe *p, const kinect_sched_config *cfg, double period_ms, kinect_metric *latency);
+void kinect_sched_probe_stop(kinect_sched_probe *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KINECT_SCHED_H
@@ -0,0 +1,149 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "kinect_state.h"
+
+static const char *gesture_names[] = { "none", "click", "push", "left", "right", "up", "down" };
+
+const char *kinect_state_gesture_name(int gesture)
+{
+	if (gesture < 0 || gesture > KINECT_STATE_GESTURE_DOWN)
+		return "?";
+	return gesture_names[gesture];
+}
+
+// shm_open wants a leading slash
+static void shm_path(char *buf, size_t size, const char *name)
+{
+	snprintf(buf, size, "%s%s", name[0] == '/' ? "" : "/", name);
+}
+
+int kinect_state_create(kinect_state *s, const char *name)
+{
+	int fd;
+	void *p;
+
+	memset(s, 0, sizeof(*s));
+	shm_path(s->name, sizeof(s->name), name);
+	fd = shm_open(s->name, O_CREAT | O_RDWR, 0644);
+	if (fd < 0)
+		return -1;
+	if (ftruncate(fd, sizeof(kinect_state_shm)) < 0) {
+		close(fd);
+		return -1;
+	}
+	p = mmap(NULL, sizeof(kinect_state_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return -1;
+	s->shm = p;
+	// A segment left by a previous run: readers see it as being written until it is set up again
+	__atomic_store_n(&s->shm->seq, 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memset(&s->shm->data, 0, sizeof(s->shm->data));
+	s->shm->version = KINECT_STATE_VERSION;
+	s->shm->size = sizeof(kinect_state_data);
+	s->shm->magic = KINECT_STATE_MAGIC;
+	__atomic_store_n(&s->shm->seq, 0, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void kinect_state_publish(kinect_state *s)
+{
+	struct timespec ts;
+	uint32_t seq;
+
+	if (!s->shm)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	s->data.host_ms = ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+	s->data.updates++;
+	// Single writer: seq only changes here
+	seq = s->shm->seq;
+	__atomic_store_n(&s->shm->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);	// odd seq is visible before any of the data
+	memcpy(&s->shm->data, &s->data, sizeof(s->data));
+	__atomic_store_n(&s->shm->seq, seq + 2, __ATOMIC_RELEASE);	// and the data before the even one
+}
+
+void kinect_state_destroy(kinect_state *s)
+{
+	if (!s->shm)
+		return;
+	munmap(s->shm, sizeof(kinect_state_shm));
+	shm_unlink(s->name);
+	s->shm = NULL;
+}
+
+const kinect_state_shm *kinect_state_attach(const char *name)
+{
+	char path[64];
+	struct stat st;
+	const kinect_state_shm *shm;
+	void *p;
+	int fd;
+
+	shm_path(path, sizeof(path), name);
+	fd = shm_open(path, O_RDONLY, 0);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(kinect_state_shm)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	p = mmap(NULL, sizeof(kinect_state_shm), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return NULL;
+	shm = p;
+	if (shm->magic != KINECT_STATE_MAGIC || shm->version != KINECT_STATE_VERSION || shm->size != sizeof(kinect_state_data)) {
+		munmap(p, sizeof(kinect_state_shm));
+		errno = EINVAL;
+		return NULL;
+	}
+	return shm;
+}
+
+void kinect_state_detach(const kinect_state_shm *shm)
+{
+	munmap((void *)shm, sizeof(kinect_state_shm));
+}
+
+uint32_t kinect_state_read(const kinect_state_shm *shm, kinect_state_data *out)
+{
+	uint32_t seq, again;
+	int tries = 0;
+
+	for (;;) {
+		seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+		if (!(seq & 1)) {
+			memcpy(out, (const void *)&shm->data, sizeof(*out));
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);	// the copy is done before seq is read again
+			again = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED);
+			if (again == seq)
+				return seq;
+		}
+		// The writer holds the segment for a copy of 120 bytes: let it run if it was preempted,
+		// give up if it died in the middle of an update
+		if (++tries % 64 == 0)
+			sched_yield();
+		if (tries == 100000)
+			return seq | 1;
+	}
+}
@@ -0,0 +1,109 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+ /* Latest pointer state in shared memory
+ A consumer drawing at its display rate only needs the latest pointer and the
+ last gesture, not every JSON line. kmouse_mm (state=NAME) keeps them in a POSIX
+ shared memory segment /dev/shm/NAME, rewritten once per analysed frame.
+
+ The segment is a seqlock: the writer makes seq odd, writes, makes it even
+ again. A reader copies the state between two reads of seq and retries when
+ they differ or are odd, so any number of readers poll at their own rate
+ without locks and without ever slowing the writer down. A new gesture bumps
+ gesture_seq: readers tell a new swipe from the one they saw last by it.
+
+ All fields have fixed sizes, a reader in another language can mmap the file
+ and follow the same protocol; see kinect_state_reader.c for one in C.
+ */
+
+#ifndef KINECT_STATE_H
+#define KINECT_STATE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KINECT_STATE_MAGIC 0x4b4d5354 // "KMST"
+#define KINECT_STATE_VERSION 1
+
+// Status, as kinect_gesture_event.status (see kinect_gesture.h)
+enum {
+	KINECT_STATE_TOOFAR = 0,
+	KINECT_STATE_SOMEPIXELS,
+	KINECT_STATE_TOOCLOSE,
+	KINECT_STATE_INRANGE
+};
+
+// Last gesture
+enum {
+	KINECT_STATE_GESTURE_NONE = 0,
+	KINECT_STATE_GESTURE_CLICK,    // Dwell click
+	KINECT_STATE_GESTURE_PUSH,     // Push click
+	KINECT_STATE_GESTURE_LEFT,     // Swipes
+	KINECT_STATE_GESTURE_RIGHT,
+	KINECT_STATE_GESTURE_UP,
+	KINECT_STATE_GESTURE_DOWN
+};
+
+typedef struct {
+	int32_t status;        // KINECT_STATE_TOOFAR ...
+	int32_t idle;          // 1 while kmouse is idle (see the idle_s option)
+	int32_t x, y;          // Pointer in screen coordinates, kept from the last frame in range
+	double z_mm;           // Depth of the nearest point of the hand
+	int64_t near_pixels;   // Size of the near blob in the last frame in range
+	int32_t blob_x0, blob_y0, blob_x1, blob_y1; // Its bounds in depth pixels
+	int32_t gesture;       // KINECT_STATE_GESTURE_*
+	uint32_t gesture_seq;  // Incremented by every gesture, 0 before the first
+	int32_t gesture_x, gesture_y; // Click position
+	int64_t gesture_frame; // Frame of the gesture
+	double gesture_ms;     // Its frame time
+	int64_t frame;         // Index of the latest analysed frame, lost frames included
+	uint32_t timestamp;    // libfreenect timestamp of that frame
+	uint32_t pad;
+	double frame_ms;       // Its frame time, see kinect_clock.h
+	double host_ms;        // CLOCK_MONOTONIC ms when it was published
+	uint64_t updates;      // Frames published
+} kinect_state_data;
+
+typedef struct {
+	uint32_t magic;        // KINECT_STATE_MAGIC once the writer has set the segment up
+	uint32_t version;      // KINECT_STATE_VERSION
+	uint32_t size;         // sizeof(kinect_state_data)
+	volatile uint32_t seq; // Odd while the writer is in the middle of an update
+	kinect_state_data data;
+} kinect_state_shm;
+
+typedef struct {
+	char name[64];
+	kinect_state_shm *shm;
+	kinect_state_data data; // Next state to publish, filled by the writer in between
+} kinect_state;
+
+// Writer: create /dev/shm/name ("kmouse" or "/kmouse"). Returns -1 on failure, errno tells why
+int kinect_state_create(kinect_state *s, const char *name);
+// Copy s->data to the segment
+void kinect_state_publish(kinect_state *s);
+// Unmap and remove the segment
+void kinect_state_destroy(kinect_state *s);
+
+// Reader: map the segment read only. Returns NULL on failure or when it is not a state segment
+const kinect_state_shm *kinect_state_attach(const char *name);
+void kinect_state_detach(const kinect_state_shm *shm);
+// Copy a consistent state. Returns its seq, twice the number of updates since the segment was created,
+// or an odd value if the writer never finished its update (it died): out is then not consistent
+uint32_t kinect_state_read(const kinect_state_shm *shm, kinect_state_data *out);
+
+const char *kinect_state_gesture_name(int gesture);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KINECT_STATE_H
@@ -0,0 +1,70 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+ /* Example reader of the pointer state segment (see kinect_state.h)
+ Polls the state of a kmouse_mm started with state=NAME at HZ times a second,
+ as a display would, and prints the pointer and every new gesture.
+
+   kstate_reader.out [NAME [HZ]]    (default kmouse at 60 Hz)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "kinect_state.h"
+
+static const char *status_names[] = { "toofar", "somepixels", "tooclose", "inrange" };
+
+int main(int argc, char **argv)
+{
+	const char *name = argc > 1 ? argv[1] : "kmouse";
+	int hz = argc > 2 ? atoi(argv[2]) : 60;
+	const kinect_state_shm *shm;
+	kinect_state_data st;
+	struct timespec period, now;
+	uint32_t seq, last_seq = 0, last_gesture = 0;
+	double age_ms;
+
+	if (hz <= 0)
+		hz = 60;
+	shm = kinect_state_attach(name);
+	if (!shm) {
+		fprintf(stderr, "Cannot attach /dev/shm/%s: %s (is kmouse_mm running with state=%s?)\n", name, strerror(errno), name);
+		return 1;
+	}
+	period.tv_sec = 0;
+	period.tv_nsec = 1000000000L / hz;
+	for (;;) {
+		nanosleep(&period, NULL);
+		seq = kinect_state_read(shm, &st);
+		if (seq & 1) {
+			fprintf(stderr, "Writer stopped in the middle of an update\n");
+			break;
+		}
+		if (seq == last_seq)	// nothing new since the last poll
+			continue;
+		last_seq = seq;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		age_ms = now.tv_sec * 1000.0 + now.tv_nsec / 1e6 - st.host_ms;
+		if (st.gesture_seq != last_gesture) {
+			// Several gestures between two polls: only the last one is kept, gesture_seq tells how many were missed
+			printf("gesture %s at %d,%d frame %lld (%u since the last poll)\n", kinect_state_gesture_name(st.gesture),
+				st.gesture_x, st.gesture_y, (long long)st.gesture_frame, st.gesture_seq - last_gesture);
+			last_gesture = st.gesture_seq;
+		}
+		printf("frame %lld %s%s pointer %d,%d %.0f mm blob %lld px, published %.1f ms ago\n", (long long)st.frame,
+			st.status >= 0 && st.status <= KINECT_STATE_INRANGE ? status_names[st.status] : "?", st.idle ? " idle" : "",
+			st.x, st.y, st.z_mm, (long long)st.near_pixels, age_ms);
+		fflush(stdout);
+	}
+	kinect_state_detach(shm);
+	return 1;
+}
@@ -0,0 +1,547 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "kinect_surface.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define MIN_POINTS 50          // Fewest depths a tile is fitted on
+#define FILE_MAGIC "KSURF"
+#define FILE_VERSION 1
+
+typedef struct {
+	float x, y, z;
+} point;
+
+void kinect_surface_default_config(kinect_surface_config *cfg)
+{
+	cfg->fx = 575.8;
+	cfg->fy = 575.8;
+	cfg->cx = 319.5;
+	cfg->cy = 239.5;
+	cfg->tiles_x = 1;
+	cfg->tiles_y = 1;
+	cfg->step = 4;
+	cfg->iterations = 200;
+	cfg->inlier_mm = 8;
+	cfg->min_inliers = 0.5;
+	cfg->tile_mm = 30;
+	cfg->touch_min_mm = 10;
+	cfg->touch_band_mm = 10;
+}
+
+int kinect_surface_init(kinect_surface *s, int w, int h, const kinect_surface_config *cfg)
+{
+	int i;
+
+	memset(s, 0, sizeof(*s));
+	if (cfg)
+		s->cfg = *cfg;
+	else
+		kinect_surface_default_config(&s->cfg);
+	if (s->cfg.tiles_x < 1)
+		s->cfg.tiles_x = 1;
+	if (s->cfg.tiles_y < 1)
+		s->cfg.tiles_y = 1;
+	while (s->cfg.tiles_x * s->cfg.tiles_y > KINECT_SURFACE_MAX_TILES)
+		s->cfg.tiles_x > s->cfg.tiles_y ? s->cfg.tiles_x-- : s->cfg.tiles_y--;
+	if (s->cfg.step < 1)
+		s->cfg.step = 1;
+	s->w = w;
+	s->h = h;
+	s->expected = calloc(w * h, sizeof(*s->expected));
+	s->near = malloc(w * h * sizeof(*s->near));
+	s->width = calloc(w * h, sizeof(*s->width));
+	if (!s->expected || !s->near || !s->width) {
+		kinect_surface_free(s);
+		return -1;
+	}
+	for (i = 0; i < w * h; i++)
+		s->near[i] = 0xffff;
+	kinect_surface_set_roi(s, 0, 0, w, h);
+	return 0;
+}
+
+void kinect_surface_free(kinect_surface *s)
+{
+	free(s->expected);
+	free(s->near);
+	free(s->width);
+	s->expected = s->near = s->width = NULL;
+}
+
+void kinect_surface_set_roi(kinect_surface *s, int x, int y, int w, int h)
+{
+	s->x0 = x < 0 ? 0 : x > s->w ? s->w : x;
+	s->y0 = y < 0 ? 0 : y > s->h ? s->h : y;
+	s->x1 = x + w > s->w ? s->w : x + w < s->x0 ? s->x0 : x + w;
+	s->y1 = y + h > s->h ? s->h : y + h < s->y0 ? s->y0 : y + h;
+}
+
+static double distance(const kinect_plane *p, const point *q)
+{
+	return p->a * q->x + p->b * q->y + p->c * q->z + p->d;
+}
+
+// Unit normal, camera on the positive side; 0 for a degenerate plane
+static int normalize(kinect_plane *p)
+{
+	double n = sqrt(p->a * p->a + p->b * p->b + p->c * p->c);
+	if (n < 1e-9)
+		return 0;
+	if (p->d < 0)
+		n = -n;
+	p->a /= n;
+	p->b /= n;
+	p->c /= n;
+	p->d /= n;
+	return p->d > 0;
+}
+
+static unsigned next(unsigned *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 8;
+}
+
+// Normal of the least squares plane through the points: the eigenvector of the
+// smallest eigenvalue of their covariance (closed form for symmetric 3x3)
+static int refine(kinect_plane *p, const point *pts, int n)
+{
+	double mx = 0, my = 0, mz = 0, c[3][3] = {{0}}, r[3][3], v[3][3];
+	double q, p1, p2, pp, det, phi, l;
+	kinect_plane fitted;
+	int i, j, best = -1;
+	double best_n = 0;
+
+	if (n < 3)
+		return 0;
+	for (i = 0; i < n; i++) {
+		mx += pts[i].x;
+		my += pts[i].y;
+		mz += pts[i].z;
+	}
+	mx /= n;
+	my /= n;
+	mz /= n;
+	for (i = 0; i < n; i++) {
+		double dx = pts[i].x - mx, dy = pts[i].y - my, dz = pts[i].z - mz;
+		c[0][0] += dx * dx;
+		c[0][1] += dx * dy;
+		c[0][2] += dx * dz;
+		c[1][1] += dy * dy;
+		c[1][2] += dy * dz;
+		c[2][2] += dz * dz;
+	}
+	c[1][0] = c[0][1];
+	c[2][0] = c[0][2];
+	c[2][1] = c[1][2];
+
+	q = (c[0][0] + c[1][1] + c[2][2]) / 3;
+	p1 = c[0][1] * c[0][1] + c[0][2] * c[0][2] + c[1][2] * c[1][2];
+	p2 = (c[0][0] - q) * (c[0][0] - q) + (c[1][1] - q) * (c[1][1] - q) + (c[2][2] - q) * (c[2][2] - q) + 2 * p1;
+	pp = sqrt(p2 / 6);
+	if (pp < 1e-12)
+		return 0;
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 3; j++)
+			r[i][j] = (c[i][j] - (i == j ? q : 0)) / pp;
+	det = r[0][0] * (r[1][1] * r[2][2] - r[1][2] * r[2][1]) - r[0][1] * (r[1][0] * r[2][2] - r[1][2] * r[2][0]) +
+	      r[0][2] * (r[1][0] * r[2][1] - r[1][1] * r[2][0]);
+	det /= 2;
+	phi = acos(det < -1 ? -1 : det > 1 ? 1 : det) / 3;
+	l = q + 2 * pp * cos(phi + 2 * M_PI / 3); // smallest
+
+	// the null space of c - l I: the longest cross product of two of its rows
+	for (i = 0; i < 3; i++)
+		c[i][i] -= l;
+	for (i = 0; i < 3; i++) {
+		const double *a = c[i], *b = c[(i + 1) % 3];
+		double len;
+		v[i][0] = a[1] * b[2] - a[2] * b[1];
+		v[i][1] = a[2] * b[0] - a[0] * b[2];
+		v[i][2] = a[0] * b[1] - a[1] * b[0];
+		len = v[i][0] * v[i][0] + v[i][1] * v[i][1] + v[i][2] * v[i][2];
+		if (len > best_n) {
+			best_n = len;
+			best = i;
+		}
+	}
+	if (best < 0)
+		return 0;
+	fitted.a = v[best][0];
+	fitted.b = v[best][1];
+	fitted.c = v[best][2];
+	fitted.d = -(fitted.a * mx + fitted.b * my + fitted.c * mz);
+	if (!normalize(&fitted))
+		return 0;
+	*p = fitted;
+	return 1;
+}
+
+// RANSAC on the points, then least squares on the inliers (moved to the front).
+// Returns the number of inliers, 0 if no plane has min_inliers of them
+static int fit(const kinect_surface *s, point *pts, int n, unsigned *seed, kinect_plane *best, double *rms)
+{
+	const double in = s->cfg.inlier_mm;
+	int it, i, k, most = 0;
+	double sum = 0;
+
+	if (n < MIN_POINTS)
+		return 0;
+	for (it = 0; it < s->cfg.iterations; it++) {
+		const point *a = &pts[next(seed) % n], *b = &pts[next(seed) % n], *c = &pts[next(seed) % n];
+		double ux = b->x - a->x, uy = b->y - a->y, uz = b->z - a->z;
+		double vx = c->x - a->x, vy = c->y - a->y, vz = c->z - a->z;
+		kinect_plane p;
+		int count = 0;
+		p.a = uy * vz - uz * vy;
+		p.b = uz * vx - ux * vz;
+		p.c = ux * vy - uy * vx;
+		p.d = -(p.a * a->x + p.b * a->y + p.c * a->z);
+		if (!normalize(&p))
+			continue;
+		for (i = 0; i < n; i++)
+			count += fabs(distance(&p, &pts[i])) <= in;
+		if (count > most) {
+			most = count;
+			*best = p;
+		}
+	}
+	if (most < s->cfg.min_inliers * n)
+		return 0;
+
+	for (i = k = 0; i < n; i++)
+		if (fabs(distance(best, &pts[i])) <= in) {
+			point t = pts[k];
+			pts[k++] = pts[i];
+			pts[i] = t;
+		}
+	refine(best, pts, k);
+	for (i = k = 0; i < n; i++) {
+		double d = distance(best, &pts[i]);
+		if (fabs(d) <= in) {
+			sum += d * d;
+			k++;
+		}
+	}
+	*rms = k ? sqrt(sum / k) : 0;
+	return k;
+}
+
+// Depth of the plane on the ray of pixel x, y and the depth per mm of height above it there; 0 if the ray misses it
+static double expected(const kinect_surface *s, const kinect_plane *p, int x, int y, double *scale)
+{
+	double rx = (x - s->cfg.cx) / s->cfg.fx, ry = (y - s->cfg.cy) / s->cfg.fy;
+	double nr = p->a * rx + p->b * ry + p->c;
+	double z;
+
+	// the point at depth z of the ray is z (n.r) + d above the plane: 0 at z = -d / (n.r)
+	if (nr >= 0 || p->d <= 0)
+		return 0;
+	z = -p->d / nr;
+	*scale = z / p->d;
+	return z;
+}
+
+// The tile planes blended from the 4 nearest tile centres
+static double blend(const kinect_surface *s, int x, int y, double *scale)
+{
+	const int tx = s->cfg.tiles_x, ty = s->cfg.tiles_y;
+	double fx = (x - s->fit_x0 + 0.5) * tx / (double)(s->fit_x1 - s->fit_x0) - 0.5;
+	double fy = (y - s->fit_y0 + 0.5) * ty / (double)(s->fit_y1 - s->fit_y0) - 0.5;
+	double z = 0, sc = 0;
+	int i0, j0, i, j;
+
+	if (tx == 1 && ty == 1)
+		return expected(s, &s->tiles[0], x, y, scale);
+	fx = fx < 0 ? 0 : fx > tx - 1 ? tx - 1 : fx;
+	fy = fy < 0 ? 0 : fy > ty - 1 ? ty - 1 : fy;
+	i0 = (int)fx < tx - 1 ? (int)fx : tx > 1 ? tx - 2 : 0;
+	j0 = (int)fy < ty - 1 ? (int)fy : ty > 1 ? ty - 2 : 0;
+	fx -= i0;
+	fy -= j0;
+	for (j = 0; j < 2 && j0 + j < ty; j++)
+		for (i = 0; i < 2 && i0 + i < tx; i++) {
+			double wx = tx > 1 ? (i ? fx : 1 - fx) : 1, wy = ty > 1 ? (j ? fy : 1 - fy) : 1, k;
+			double e = expected(s, &s->tiles[(j0 + j) * tx + i0 + i], x, y, &k);
+			if (e <= 0)
+				return 0;
+			z += wx * wy * e;
+			sc += wx * wy * k;
+		}
+	*scale = sc;
+	return z;
+}
+
+static void build(kinect_surface *s)
+{
+	const double lo = s->cfg.touch_min_mm, hi = s->cfg.touch_min_mm + s->cfg.touch_band_mm;
+	int x, y;
+
+	for (y = 0; y < s->h; y++)
+		for (x = 0; x < s->w; x++) {
+			int i = y * s->w + x;
+			double scale, z = blend(s, x, y, &scale);
+			long near = lround(z - hi * scale), far = lround(z - lo * scale);
+			if (z <= 0 || z >= 0xffff || near < 1 || far < near) {
+				// no touch, not even on a missing depth (0)
+				s->expected[i] = 0;
+				s->near[i] = 0xffff;
+				s->width[i] = 0;
+				continue;
+			}
+			s->expected[i] = (uint16_t)lround(z);
+			s->near[i] = (uint16_t)near;
+			s->width[i] = (uint16_t)(far - near);
+		}
+}
+
+int kinect_surface_fit(kinect_surface *s, const uint16_t *depth)
+{
+	const int step = s->cfg.step, tx = s->cfg.tiles_x, ty = s->cfg.tiles_y;
+	const int rw = s->x1 - s->x0, rh = s->y1 - s->y0;
+	unsigned seed = 1;
+	point *pts, *tile;
+	int n = 0, x, y, i, j;
+
+	if (rw < tx || rh < ty)
+		return -1;
+	pts = malloc(2 * ((rw + step - 1) / step) * ((rh + step - 1) / step) * sizeof(*pts));
+	if (!pts)
+		return -1;
+	tile = pts + ((rw + step - 1) / step) * ((rh + step - 1) / step);
+	for (y = s->y0; y < s->y1; y += step)
+		for (x = s->x0; x < s->x1; x += step) {
+			uint16_t z = depth[y * s->w + x];
+			if (!z)
+				continue;
+			pts[n].x = (float)((x - s->cfg.cx) / s->cfg.fx * z);
+			pts[n].y = (float)((y - s->cfg.cy) / s->cfg.fy * z);
+			pts[n].z = z;
+			n++;
+		}
+
+	// the whole ROI first, for the tiles without a plane of their own
+	{
+		kinect_plane p;
+		double rms;
+		int in = fit(s, pts, n, &seed, &p, &rms);
+		if (!in) {
+			free(pts);
+			return -1;
+		}
+		s->plane = p;
+		s->inliers = (double)in / n;
+		s->rms_mm = rms;
+	}
+	s->fit_x0 = s->x0;
+	s->fit_y0 = s->y0;
+	s->fit_x1 = s->x1;
+	s->fit_y1 = s->y1;
+	for (j = 0; j < ty; j++)
+		for (i = 0; i < tx; i++) {
+			int ax = s->x0 + rw * i / tx, bx = s->x0 + rw * (i + 1) / tx;
+			int ay = s->y0 + rh * j / ty, by = s->y0 + rh * (j + 1) / ty;
+			kinect_plane p;
+			double rms;
+			int m = 0;
+			s->tiles[j * tx + i] = s->plane;
+			if (tx * ty == 1)
+				continue;
+			for (y = s->y0; y < s->y1; y += step)
+				for (x = s->x0; x < s->x1; x += step) {
+					uint16_t z = depth[y * s->w + x];
+					if (!z || x < ax || x >= bx || y < ay || y >= by)
+						continue;
+					tile[m].x = (float)((x - s->cfg.cx) / s->cfg.fx * z);
+					tile[m].y = (float)((y - s->cfg.cy) / s->cfg.fy * z);
+					tile[m].z = z;
+					if (fabs(distance(&s->plane, &tile[m])) <= s->cfg.tile_mm)
+						m++;
+				}
+			if (fit(s, tile, m, &seed, &p, &rms))
+				s->tiles[j * tx + i] = p;
+		}
+	free(pts);
+	build(s);
+	return 0;
+}
+
+void kinect_surface_set_plane(kinect_surface *s, const kinect_plane *p)
+{
+	int i;
+
+	s->plane = *p;
+	normalize(&s->plane);
+	s->inliers = 0;
+	s->rms_mm = 0;
+	s->fit_x0 = s->x0;
+	s->fit_y0 = s->y0;
+	s->fit_x1 = s->x1;
+	s->fit_y1 = s->y1;
+	for (i = 0; i < s->cfg.tiles_x * s->cfg.tiles_y; i++)
+		s->tiles[i] = s->plane;
+	build(s);
+}
+
+double kinect_surface_height(const kinect_surface *s, int x, int y, int depth)
+{
+	double scale, z = blend(s, x, y, &scale);
+	return z > 0 && scale > 0 ? (z - depth) / scale : 0;
+}
+
+// The rows above and below the ROI and the columns left and right of it are no touch
+static void clear_outside(const kinect_surface *s, uint8_t *mask)
+{
+	int y;
+
+	memset(mask, 0, s->y0 * s->w);
+	for (y = s->y0; y < s->y1; y++) {
+		memset(mask + y * s->w, 0, s->x0);
+		memset(mask + y * s->w + s->x1, 0, s->w - s->x1);
+	}
+	memset(mask + s->y1 * s->w, 0, (s->h - s->y1) * s->w);
+}
+
+int kinect_surface_touch_ref(const kinect_surface *s, const uint16_t *depth, uint8_t *mask)
+{
+	int x, y, touches = 0;
+
+	clear_outside(s, mask);
+	for (y = s->y0; y < s->y1; y++)
+		for (x = s->x0; x < s->x1; x++) {
+			int i = y * s->w + x;
+			int touch = (uint16_t)(depth[i] - s->near[i]) <= s->width[i];
+			mask[i] = touch ? 255 : 0;
+			touches += touch;
+		}
+	return touches;
+}
+
+int kinect_surface_touch(const kinect_surface *s, const uint16_t *depth, uint8_t *mask)
+{
+	int x, y, touches = 0;
+
+	clear_outside(s, mask);
+	for (y = s->y0; y < s->y1; y++) {
+		const uint16_t *d = depth + y * s->w, *lo = s->near + y * s->w, *wd = s->width + y * s->w;
+		uint8_t *m = mask + y * s->w;
+		x = s->x0;
+#if defined(__SSE2__)
+		{
+			// a - b saturates to 0 exactly when a <= b, unsigned
+			const __m128i zero = _mm_setzero_si128();
+			__m128i count = _mm_setzero_si128();
+			for (; x + 16 <= s->x1; x += 16) {
+				__m128i t0 = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(d + x)), _mm_loadu_si128((const __m128i*)(lo + x)));
+				__m128i t1 = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(d + x + 8)), _mm_loadu_si128((const __m128i*)(lo + x + 8)));
+				t0 = _mm_cmpeq_epi16(_mm_subs_epu16(t0, _mm_loadu_si128((const __m128i*)(wd + x))), zero);
+				t1 = _mm_cmpeq_epi16(_mm_subs_epu16(t1, _mm_loadu_si128((const __m128i*)(wd + x + 8))), zero);
+				t0 = _mm_packs_epi16(t0, t1); // 0 or -1 per pixel
+				_mm_storeu_si128((__m128i*)(m + x), t0);
+				count = _mm_sub_epi8(count, t0);
+				if ((x - s->x0) % (16 * 255) == 16 * 254) { // before a byte can wrap
+					__m128i sad = _mm_sad_epu8(count, zero);
+					touches += _mm_cvtsi128_si32(sad) + _mm_cvtsi128_si32(_mm_srli_si128(sad, 8));
+					count = zero;
+				}
+			}
+			{
+				__m128i sad = _mm_sad_epu8(count, zero);
+				touches += _mm_cvtsi128_si32(sad) + _mm_cvtsi128_si32(_mm_srli_si128(sad, 8));
+			}
+		}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+		for (; x + 16 <= s->x1; x += 16) {
+			uint16x8_t t0 = vcleq_u16(vsubq_u16(vld1q_u16(d + x), vld1q_u16(lo + x)), vld1q_u16(wd + x));
+			uint16x8_t t1 = vcleq_u16(vsubq_u16(vld1q_u16(d + x + 8), vld1q_u16(lo + x + 8)), vld1q_u16(wd + x + 8));
+			uint8x16_t t = vcombine_u8(vmovn_u16(t0), vmovn_u16(t1));
+			vst1q_u8(m + x, t);
+			touches += vaddvq_u8(vshrq_n_u8(t, 7)); // 16 at most, no wrap
+		}
+#endif
+		for (; x < s->x1; x++) {
+			int touch = (uint16_t)(d[x] - lo[x]) <= wd[x];
+			m[x] = touch ? 255 : 0;
+			touches += touch;
+		}
+	}
+	return touches;
+}
+
+int kinect_surface_save(const kinect_surface *s, const char *path)
+{
+	const int version = FILE_VERSION, n = s->w * s->h;
+	FILE *f = fopen(path, "wb");
+	int ok;
+
+	if (!f)
+		return -1;
+	ok = fwrite(FILE_MAGIC, sizeof(FILE_MAGIC), 1, f) == 1 &&
+	     fwrite(&version, sizeof(version), 1, f) == 1 &&
+	     fwrite(&s->w, sizeof(s->w), 1, f) == 1 &&
+	     fwrite(&s->h, sizeof(s->h), 1, f) == 1 &&
+	     fwrite(&s->cfg, sizeof(s->cfg), 1, f) == 1 &&
+	     fwrite(&s->fit_x0, sizeof(s->fit_x0), 1, f) == 1 &&
+	     fwrite(&s->fit_y0, sizeof(s->fit_y0), 1, f) == 1 &&
+	     fwrite(&s->fit_x1, sizeof(s->fit_x1), 1, f) == 1 &&
+	     fwrite(&s->fit_y1, sizeof(s->fit_y1), 1, f) == 1 &&
+	     fwrite(&s->plane, sizeof(s->plane), 1, f) == 1 &&
+	     fwrite(s->tiles, sizeof(s->tiles), 1, f) == 1 &&
+	     fwrite(&s->inliers, sizeof(s->inliers), 1, f) == 1 &&
+	     fwrite(&s->rms_mm, sizeof(s->rms_mm), 1, f) == 1 &&
+	     fwrite(s->expected, sizeof(*s->expected), n, f) == (size_t)n &&
+	     fwrite(s->near, sizeof(*s->near), n, f) == (size_t)n &&
+	     fwrite(s->width, sizeof(*s->width), n, f) == (size_t)n;
+	return fclose(f) == 0 && ok ? 0 : -1;
+}
+
+int kinect_surface_load(kinect_surface *s, const char *path)
+{
+	const int n = s->w * s->h;
+	char magic[sizeof(FILE_MAGIC)];
+	int version, w, h, fit_roi[4], ok;
+	kinect_surface_config cfg;
+	FILE *f = fopen(path, "rb");
+
+	if (!f)
+		return -1;
+	ok = fread(magic, sizeof(magic), 1, f) == 1 && !memcmp(magic, FILE_MAGIC, sizeof(magic)) &&
+	     fread(&version, sizeof(version), 1, f) == 1 && version == FILE_VERSION &&
+	     fread(&w, sizeof(w), 1, f) == 1 && w == s->w &&
+	     fread(&h, sizeof(h), 1, f) == 1 && h == s->h &&
+	     fread(&cfg, sizeof(cfg), 1, f) == 1 &&
+	     fread(fit_roi, sizeof(int), 4, f) == 4 &&
+	     fread(&s->plane, sizeof(s->plane), 1, f) == 1 &&
+	     fread(s->tiles, sizeof(s->tiles), 1, f) == 1 &&
+	     fread(&s->inliers, sizeof(s->inliers), 1, f) == 1 &&
+	     fread(&s->rms_mm, sizeof(s->rms_mm), 1, f) == 1 &&
+	     fread(s->expected, sizeof(*s->expected), n, f) == (size_t)n &&
+	     fread(s->near, sizeof(*s->near), n, f) == (size_t)n &&
+	     fread(s->width, sizeof(*s->width), n, f) == (size_t)n;
+	fclose(f);
+	if (!ok)
+		return -1;
+	// the table was built with these
+	s->cfg = cfg;
+	s->fit_x0 = fit_roi[0];
+	s->fit_y0 = fit_roi[1];
+	s->fit_x1 = fit_roi[2];
+	s->fit_y1 = fit_roi[3];
+	return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+ /* Touch surface fitted with planes
+ A table or a wall is a plane, so it can be found in a single depth frame
+ instead of being learnt over many (kinect_bg.h). The depths of the surface
+ ROI are unprojected with the depth camera intrinsics and a plane is fitted
+ by RANSAC: planes through 3 random points, the one most points lie within
+ inlier_mm of wins, then it is refined by least squares on those points. A
+ surface that is not flat (a warped table, a bulging screen) can be cut into
+ tiles_x x tiles_y tiles with a plane each, fitted on the depths within
+ tile_mm of the plane of the whole ROI, so a hand filling a tile is not taken
+ for the surface; a tile without enough inliers takes the plane of the ROI.
+
+ From the planes a lookup table holds, for each pixel of the frame, the depth
+ the surface is expected at and the range of depths that are touch_min_mm to
+ touch_min_mm + touch_band_mm above it, measured along the plane normal. The
+ planes of neighbouring tiles are blended bilinearly from the tile centres,
+ so there is no step at the tile borders. Touch detection is then one
+ subtraction and one unsigned compare per pixel (depth - near <= width), 16
+ pixels at a time with SSE2 or NEON (AArch64). The lookup table is saved to
+ a file so the next start needs neither the fit nor the table.
+
+ Depths are the sensor's: uint16 mm, 0 for no reading (OpenNI depth maps).
+ A plane is a x + b y + c z + d = 0 in mm in the depth camera frame, as the
+ coefficients of ntk::Plane, with a unit normal and d > 0.
+ */
+
+#ifndef KINECT_SURFACE_H
+#define KINECT_SURFACE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KINECT_SURFACE_MAX_TILES 64
+
+typedef struct {
+	double a, b, c, d;
+} kinect_plane;
+
+typedef struct {
+	double fx, fy, cx, cy; // Depth camera intrinsics in pixels (default 575.8 575.8 319.5 239.5)
+	int tiles_x, tiles_y;  // Planes across and down the fit ROI, at most KINECT_SURFACE_MAX_TILES (default 1 1)
+	int step;              // Fit on every step-th pixel in both directions (default 4)
+	int iterations;        // RANSAC planes tried per tile (default 200)
+	double inlier_mm;      // Farthest an inlier is from the plane (default 8)
+	double min_inliers;    // Fraction of a tile's depths that must be inliers (default 0.5)
+	double tile_mm;        // Tiles are fitted on the depths this close to the plane of the whole ROI (default 30)
+	double touch_min_mm;   // Touch band above the surface (default 10)
+	double touch_band_mm;  // (default 10)
+} kinect_surface_config;
+
+typedef struct {
+	kinect_surface_config cfg;
+	int w, h;
+	int x0, y0, x1, y1;    // Touch ROI, x1 and y1 excluded
+	int fit_x0, fit_y0, fit_x1, fit_y1; // ROI the planes were fitted on
+	kinect_plane plane;    // The whole fit ROI
+	kinect_plane tiles[KINECT_SURFACE_MAX_TILES];
+	double inliers;        // Fraction of the depths within inlier_mm of plane
+	double rms_mm;         // Their distance to it
+	uint16_t *expected;    // Per pixel depth of the surface, 0 where a ray misses it
+	uint16_t *near, *width; // A touch when depth - near <= width in 16 bit unsigned (0xffff and 0 off the surface)
+} kinect_surface;
+
+// Returns -1 when out of memory; cfg NULL uses the defaults. The ROI is the whole frame
+int kinect_surface_init(kinect_surface *s, int w, int h, const kinect_surface_config *cfg);
+void kinect_surface_free(kinect_surface *s);
+void kinect_surface_default_config(kinect_surface_config *cfg);
+
+// Clipped to the frame. The ROI of the touches, and of the next fit
+void kinect_surface_set_roi(kinect_surface *s, int x, int y, int w, int h);
+
+// Fit the planes on the ROI of a w x h depth frame and build the lookup table
+// of the whole frame. Returns -1 when the ROI has too few depths on a plane
+int kinect_surface_fit(kinect_surface *s, const uint16_t *depth);
+
+// A plane found elsewhere, for the whole ROI: builds the lookup table
+void kinect_surface_set_plane(kinect_surface *s, const kinect_plane *p);
+
+// Touch mask of a w x h depth frame: 255 for touch pixels, 0 elsewhere (outside the ROI too).
+// Returns the number of touch pixels
+int kinect_surface_touch(const kinect_surface *s, const uint16_t *depth, uint8_t *mask);
+
+// The same, one pixel at a time: the reference of the vectorized version
+int kinect_surface_touch_ref(const kinect_surface *s, const uint16_t *depth, uint8_t *mask);
+
+// Height of a depth above the surface in mm along the normal, 0 where a ray misses it
+double kinect_surface_height(const kinect_surface *s, int x, int y, int depth);
+
+// The planes and the lookup table. Both return -1 on errors; load also when
+// the file is from another frame size or version, and then the table must be fitted again
+int kinect_surface_save(const kinect_surface *s, const char *path);
+int kinect_surface_load(kinect_surface *s, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KINECT_SURFACE_H
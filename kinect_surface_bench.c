@@ -0,0 +1,183 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+ /* Plane fitted touch surface
+ A 640x480 depth stream of a table 1.1 m from the sensor, seen 25 degrees
+ from its normal, 1.5 mm of noise, 2% of the pixels without a depth. A hand
+ hovers 120 mm above it and five fingertips touch it, 16 mm high. The table
+ is flat, then bowed: up to 15 mm higher in the middle.
+
+ Each surface is fitted on the first frame, hand and fingers included, with
+ a single plane and with 4x3 planes. For each fit it reports the fit time,
+ the error of the plane (flat table), the time to load the saved lookup
+ table, and over FRAMES frames (default 300) the touch pixels that are not
+ on a finger, the finger pixels missed and the time per frame of the touch
+ mask, checked against its scalar version on every frame.
+
+   surface_bench.out [FRAMES [SEED]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "kinect_surface.h"
+
+#define W 640
+#define H 480
+#define ROI_X 110
+#define ROI_Y 120
+#define ROI_W 450
+#define ROI_H 200
+#define NOISE 65536
+#define FINGERS 5
+#define FINGER_R 6
+#define FINGER_MM 16
+#define FILE "/tmp/surface_bench.lut"
+
+static unsigned seed;
+static double noise[NOISE]; // Standard normal
+
+static unsigned next(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static double uniform(double a, double b)
+{
+	return a + (b - a) * (next() & 0xffffff) / 16777216.0;
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Depth frame f of the table; finger[i] set to 1 on the pixels a finger touches
+static void scene(const kinect_plane *table, int bow, uint16_t *depth, uint8_t *finger, int f)
+{
+	int x, y, k;
+
+	for (y = 0; y < H; y++)
+		for (x = 0; x < W; x++) {
+			int i = y * W + x;
+			double rx = (x - 319.5) / 575.8, ry = (y - 239.5) / 575.8;
+			double z = -table->d / (table->a * rx + table->b * ry + table->c), h = 0;
+			if (bow)
+				h = 15 * (1 - (x - 320) * (x - 320) / (320.0 * 320.0));
+			finger[i] = 0;
+			for (k = 0; k < FINGERS; k++) {
+				double fx = 160 + 60 * k + 20 * cos(2 * M_PI * (k / (double)FINGERS + f / 100.0));
+				double fy = 200 + 15 * sin(2 * M_PI * (k / (double)FINGERS + f / 100.0));
+				if ((x - fx) * (x - fx) + (y - fy) * (y - fy) <= FINGER_R * FINGER_R) {
+					h += FINGER_MM;
+					finger[i] = 1;
+				}
+			}
+			if ((x - 420) * (x - 420) / 4900.0 + (y - 270) * (y - 270) / 1600.0 <= 1)
+				h += 120;
+			// h above the surface along the normal: z (1 - h / d)
+			z = z * (1 - h / table->d) + 1.5 * noise[next() % NOISE];
+			depth[i] = next() % 50 == 0 ? 0 : (uint16_t)(z + 0.5);
+		}
+}
+
+static int run(const char *name, const kinect_plane *table, int bow, int tiles_x, int tiles_y, int frames,
+               uint16_t *depth, uint8_t *finger, uint8_t *mask, uint8_t *ref)
+{
+	kinect_surface_config cfg;
+	kinect_surface s, loaded;
+	long false_pixels = 0, missed = 0, mismatches = 0;
+	double t0, fit_us, load_us, touch_us = 0, ref_us = 0;
+	int f, i;
+
+	kinect_surface_default_config(&cfg);
+	cfg.tiles_x = tiles_x;
+	cfg.tiles_y = tiles_y;
+	if (kinect_surface_init(&s, W, H, &cfg) < 0 || kinect_surface_init(&loaded, W, H, &cfg) < 0) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	kinect_surface_set_roi(&s, ROI_X, ROI_Y, ROI_W, ROI_H);
+	scene(table, bow, depth, finger, 0);
+	t0 = now_us();
+	if (kinect_surface_fit(&s, depth) < 0) {
+		printf("%s %dx%d: no plane found\n", name, tiles_x, tiles_y);
+		return 1;
+	}
+	fit_us = now_us() - t0;
+	if (kinect_surface_save(&s, FILE) < 0) {
+		perror(FILE);
+		return 1;
+	}
+	t0 = now_us();
+	if (kinect_surface_load(&loaded, FILE) < 0 || memcmp(loaded.near, s.near, W * H * sizeof(*s.near)) ||
+	    memcmp(loaded.width, s.width, W * H * sizeof(*s.width))) {
+		printf("%s %dx%d: the loaded table differs\n", name, tiles_x, tiles_y);
+		return 1;
+	}
+	load_us = now_us() - t0;
+	kinect_surface_set_roi(&loaded, ROI_X, ROI_Y, ROI_W, ROI_H);
+	remove(FILE);
+
+	for (f = 1; f <= frames; f++) {
+		scene(table, bow, depth, finger, f);
+		t0 = now_us();
+		kinect_surface_touch(&loaded, depth, mask);
+		touch_us += now_us() - t0;
+		t0 = now_us();
+		kinect_surface_touch_ref(&loaded, depth, ref);
+		ref_us += now_us() - t0;
+		if (memcmp(mask, ref, W * H))
+			mismatches++;
+		for (i = 0; i < W * H; i++) {
+			false_pixels += mask[i] && !finger[i];
+			missed += !mask[i] && finger[i] && i % W >= ROI_X && i % W < ROI_X + ROI_W;
+		}
+	}
+
+	printf("%s %dx%d: fit %.1f ms, %.0f%% inliers, rms %.2f mm, normal off by %.3f deg, d by %.2f mm, load %.2f ms\n",
+	       name, tiles_x, tiles_y, fit_us / 1000, 100 * s.inliers, s.rms_mm,
+	       acos(fmin(1, s.plane.a * table->a + s.plane.b * table->b + s.plane.c * table->c)) * 180 / M_PI,
+	       s.plane.d - table->d, load_us / 1000);
+	printf("    %.1f false, %.1f missed touch pixels/frame, %.1f us/frame (scalar %.1f), %ld frames differ\n",
+	       (double)false_pixels / frames, (double)missed / frames, touch_us / frames, ref_us / frames, mismatches);
+	kinect_surface_free(&s);
+	kinect_surface_free(&loaded);
+	return mismatches ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	int frames = argc > 1 ? atoi(argv[1]) : 300;
+	uint16_t *depth = malloc(W * H * sizeof(*depth));
+	uint8_t *finger = malloc(W * H), *mask = malloc(W * H), *ref = malloc(W * H);
+	double tilt = 25 * M_PI / 180;
+	kinect_plane table = {0, -sin(tilt), -cos(tilt), 1100};
+	int i, failed = 0;
+
+	seed = argc > 2 ? atoi(argv[2]) : 1;
+	if (frames < 1 || !depth || !finger || !mask || !ref) {
+		fprintf(stderr, "usage: %s [FRAMES [SEED]]\n", argv[0]);
+		return 2;
+	}
+	for (i = 0; i < NOISE; i++) {
+		double u = uniform(1e-9, 1), v = uniform(0, 1);
+		noise[i] = sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+	}
+	failed |= run("flat", &table, 0, 1, 1, frames, depth, finger, mask, ref);
+	failed |= run("flat", &table, 0, 4, 3, frames, depth, finger, mask, ref);
+	failed |= run("bowed", &table, 1, 1, 1, frames, depth, finger, mask, ref);
+	failed |= run("bowed", &table, 1, 4, 3, frames, depth, finger, mask, ref);
+	return failed;
+}
@@ -38,6 +38,13 @@ using namespace xn;
 #include "TuioServer.h"
 using namespace TUIO;
 
+// touch point tracking
+#include "kinect_track.h"
+
+// touch surface background
+#include "kinect_bg.h"
+#include "kinect_surface.h"
+
 // TODO smoothing using kalman filter
 
 //---------------------------------------------------------------------------
@@ -73,31 +80,15 @@ int initOpenNI(const XnChar* fname) {
 	return 0;
 }
 
-void average(vector<Mat1s>& frames, Mat1s& mean) {
-	Mat1d acc(mean.size());
-	Mat1d frame(mean.size());
-
-	for (unsigned int i=0; i<frames.size(); i++) {
-		frames[i].convertTo(frame, CV_64FC1);
-		acc = acc + frame;
-	}
-
-	acc = acc / frames.size();
-
-	acc.convertTo(mean, CV_16SC1);
-}
-
-
-
 int main() {
 
-	const unsigned int nBackgroundTrain = 30;
-	const unsigned short touchDepthMin = 10;
-	const unsigned short touchDepthMax = 20;
 	const unsigned int touchMinArea = 50;
 
 	const bool localClientMode = true; 					// connect to a local client
 
+	const bool planeSurface = true;						// touch above planes fitted to the surface, else above a learnt background
+	const char* surfaceFile = "surface.lut";			// the fitted surface, fitted again when missing (delete it after moving the Kinect)
+
 	const double debugFrameMaxDepth = 4000; // maximal distance (in millimeters) for 8 bit debug depth frame quantization
 	const char* windowName = "Debug";
 	const Scalar debugColor0(0,0,128);
@@ -115,16 +106,19 @@ int main() {
 
 	Mat3b debug(480, 640); // debug visualization
 
-	Mat1s foreground(640, 480);
-	Mat1b foreground8(640, 480);
-
-	Mat1b touch(640, 480); // touch mask
-
-	Mat1s background(480, 640);
-	vector<Mat1s> buffer(nBackgroundTrain);
+	Mat1b touch(480, 640); // touch mask
 
 	initOpenNI("niConfig.xml");
 
+	// per pixel depth of the surface and its noise, learnt in the surface ROI (touch band 10-20 mm at least)
+	kinect_bg background;
+	// or the surface as a plane, touch band 10-20 mm above it
+	kinect_surface surface;
+	if (kinect_bg_init(&background, 640, 480, NULL) < 0 || kinect_surface_init(&surface, 640, 480, NULL) < 0) {
+		printf("Out of memory\n");
+		return 1;
+	}
+
 	// TUIO server object
 	TuioServer* tuio;
 	if (localClientMode) {
@@ -134,6 +128,11 @@ int main() {
 	}
 	TuioTime time;
 
+	// touch points from frame to frame: each confirmed track holds its TUIO cursor in user
+	kinect_tracker tracker;
+	kinect_track_init(&tracker, NULL);
+	kinect_track_point trackPoints[KINECT_TRACK_MAX];
+
 	// create some sliders
 	namedWindow(windowName);
 	createTrackbar("xMin", windowName, &xMin, 640);
@@ -141,13 +140,28 @@ int main() {
 	createTrackbar("yMin", windowName, &yMin, 480);
 	createTrackbar("yMax", windowName, &yMax, 480);
 
-	// create background model (average depth)
-	for (unsigned int i=0; i<nBackgroundTrain; i++) {
-		xnContext.WaitAndUpdateAll();
-		depth.data = (uchar*) xnDepthGenerator.GetDepthMap();
-		buffer[i] = depth;
+	if (planeSurface) {
+		// load the surface planes, or fit them on the ROI of the first frame
+		kinect_surface_set_roi(&surface, xMin, yMin, xMax - xMin, yMax - yMin);
+		if (kinect_surface_load(&surface, surfaceFile) < 0) {
+			xnContext.WaitAndUpdateAll();
+			if (kinect_surface_fit(&surface, (const uint16_t*) xnDepthGenerator.GetDepthMap()) < 0) {
+				printf("No surface plane in the ROI\n");
+				return 1;
+			}
+			printf("Surface plane %.3f %.3f %.3f %.1f, %.0f%% inliers, rms %.1f mm\n", surface.plane.a, surface.plane.b,
+				surface.plane.c, surface.plane.d, 100 * surface.inliers, surface.rms_mm);
+			if (kinect_surface_save(&surface, surfaceFile) < 0)
+				printf("Could not save %s\n", surfaceFile);
+		}
+	} else {
+		// create background model (average depth of the first frames)
+		kinect_bg_set_roi(&background, xMin, yMin, xMax - xMin, yMax - yMin);
+		for (int i=0; i<background.cfg.train_frames; i++) {
+			xnContext.WaitAndUpdateAll();
+			kinect_bg_update(&background, (const uint16_t*) xnDepthGenerator.GetDepthMap(), NULL);
+		}
 	}
-	average(buffer, background);
 
 	while ( waitKey(1) != 27 ) {
 		// read available data
@@ -163,16 +177,21 @@ int main() {
 		//rgb.data = (uchar*) xnImgeGenertor.GetRGB24ImageMap(); // segmentation fault here
 		//cvtColor(rgb, rgb, CV_RGB2BGR);
 
-		// extract foreground by simple subtraction of very basic background model
-		foreground = background - depth;
-
-		// find touch mask by thresholding (points that are close to background = touch points)
-		touch = (foreground > touchDepthMin) & (foreground < touchDepthMax);
-
 		// extract ROI
 		Rect roi(xMin, yMin, xMax - xMin, yMax - yMin);
 		Mat touchRoi = touch(roi);
 
+		// find touch mask in the ROI (points in the touch band just in front of the surface = touch points)
+		if (planeSurface) {
+			kinect_surface_set_roi(&surface, roi.x, roi.y, roi.width, roi.height);
+			kinect_surface_touch(&surface, (const uint16_t*) depth.data, touch.data);
+		} else {
+			// then let the background follow the surface where nothing touches it
+			kinect_bg_set_roi(&background, roi.x, roi.y, roi.width, roi.height);
+			kinect_bg_touch(&background, (const uint16_t*) depth.data, touch.data);
+			kinect_bg_update(&background, (const uint16_t*) depth.data, touch.data);
+		}
+
 		// find touch points
 		vector< vector<Point2i> > contours;
 		vector<Point2f> touchPoints;
@@ -187,24 +206,35 @@ int main() {
 			}
 		}
 
-		// send TUIO cursors
+		// track touch points (all of them at once, so that no cursor is moved away from a closer touch point)
 		time = TuioTime::getSessionTime();
+		unsigned int nTrackPoints = touchPoints.size() < KINECT_TRACK_MAX ? touchPoints.size() : KINECT_TRACK_MAX;
+		for (unsigned int i=0; i<nTrackPoints; i++) {
+			trackPoints[i].x = touchPoints[i].x;
+			trackPoints[i].y = touchPoints[i].y;
+			trackPoints[i].z = 0;
+		}
+		kinect_track_update(&tracker, time.getTotalMilliseconds(), trackPoints, nTrackPoints);
+
+		// send TUIO cursors: new tracks add one, lost ones remove it, tracks without a touch point coast
 		tuio->initFrame(time);
 
-		for (unsigned int i=0; i<touchPoints.size(); i++) { // touch points
-			float cursorX = (touchPoints[i].x - xMin) / (xMax - xMin);
-			float cursorY = 1 - (touchPoints[i].y - yMin)/(yMax - yMin);
-			TuioCursor* cursor = tuio->getClosestTuioCursor(cursorX,cursorY);
-			// TODO improve tracking (don't move cursors away, that might be closer to another touch point)
-			if (cursor == NULL || cursor->getTuioTime() == time) {
-				tuio->addTuioCursor(cursorX,cursorY);
-			} else {
-				tuio->updateTuioCursor(cursor, cursorX, cursorY);
+		for (int i=0; i<tracker.count; i++) {
+			kinect_track* track = &tracker.tracks[i];
+			if (track->state == KINECT_TRACK_DEAD) {
+				tuio->removeTuioCursor((TuioCursor*) track->user);
+			} else if (track->state == KINECT_TRACK_CONFIRMED && track->point >= 0) {
+				float cursorX = (track->pos.x - xMin) / (xMax - xMin);
+				float cursorY = 1 - (track->pos.y - yMin) / (yMax - yMin);
+				if (track->born) {
+					track->user = tuio->addTuioCursor(cursorX, cursorY);
+				} else {
+					tuio->updateTuioCursor((TuioCursor*) track->user, cursorX, cursorY);
+				}
 			}
 		}
 
 		tuio->stopUntouchedMovingCursors();
-		tuio->removeUntouchedStoppedCursors();
 		tuio->commitFrame();
 
 		// draw debug frame
@@ -221,5 +251,7 @@ int main() {
 		//imshow("image", rgb);
 	}
 
+	kinect_bg_free(&background);
+	kinect_surface_free(&surface);
 	return 0;
 }
@@ -0,0 +1,279 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "kinect_track.h"
+
+void kinect_track_default_config(kinect_track_config *cfg)
+{
+	cfg->gate = 40;
+	cfg->confirm_hits = 2;
+	cfg->lost_ms = 100;
+	cfg->velocity_gain = 0.5;
+	cfg->max_predict_ms = 100;
+}
+
+void kinect_track_init(kinect_tracker *t, const kinect_track_config *cfg)
+{
+	memset(t, 0, sizeof(*t));
+	if (cfg)
+		t->cfg = *cfg;
+	else
+		kinect_track_default_config(&t->cfg);
+	t->next_id = 1;
+}
+
+void kinect_track_reset(kinect_tracker *t)
+{
+	t->count = 0;
+}
+
+double kinect_track_assign(const double *cost, int n, int stride, int *col)
+{
+	// Shortest augmenting paths with row and column potentials, O(n^3); 1-based, row 0 and column 0 are sentinels
+	double u[KINECT_TRACK_MAX + 1], v[KINECT_TRACK_MAX + 1], minv[KINECT_TRACK_MAX + 1];
+	int p[KINECT_TRACK_MAX + 1], way[KINECT_TRACK_MAX + 1];
+	char used[KINECT_TRACK_MAX + 1];
+	double total = 0;
+	int i, j;
+
+	for (j = 0; j <= n; j++) {
+		u[j] = v[j] = 0;
+		p[j] = way[j] = 0;
+	}
+	for (i = 1; i <= n; i++) {
+		int j0 = 0;
+		p[0] = i;
+		for (j = 0; j <= n; j++) {
+			minv[j] = HUGE_VAL;
+			used[j] = 0;
+		}
+		do {
+			int i0 = p[j0], j1 = 0;
+			double delta = HUGE_VAL;
+			used[j0] = 1;
+			for (j = 1; j <= n; j++) {
+				if (used[j])
+					continue;
+				double cur = cost[(i0 - 1) * stride + j - 1] - u[i0] - v[j];
+				if (cur < minv[j]) {
+					minv[j] = cur;
+					way[j] = j0;
+				}
+				if (minv[j] < delta) {
+					delta = minv[j];
+					j1 = j;
+				}
+			}
+			for (j = 0; j <= n; j++) {
+				if (used[j]) {
+					u[p[j]] += delta;
+					v[j] -= delta;
+				} else {
+					minv[j] -= delta;
+				}
+			}
+			j0 = j1;
+		} while (p[j0] != 0);
+		do {
+			int j1 = way[j0];
+			p[j0] = p[j1];
+			j0 = j1;
+		} while (j0);
+	}
+	for (j = 1; j <= n; j++) {
+		col[p[j] - 1] = j - 1;
+		total += cost[(p[j] - 1) * stride + j - 1];
+	}
+	return total;
+}
+
+static int find(int *group, int i)
+{
+	while (group[i] != i)
+		i = group[i] = group[group[i]];
+	return i;
+}
+
+static unsigned bucket_of(int cx, int cy)
+{
+	return ((unsigned)cx * 73856093u ^ (unsigned)cy * 19349663u) & (KINECT_TRACK_BUCKETS - 1);
+}
+
+static void match(kinect_tracker *t, int i, int j, double t_ms, const kinect_track_point *p)
+{
+	kinect_track *tr = &t->tracks[i];
+	double dt = t_ms - tr->seen_ms;
+
+	if (dt > 0) {
+		// the second point of a track gives its first velocity
+		double g = tr->state == KINECT_TRACK_TENTATIVE && tr->hits == 1 ? 1 : t->cfg.velocity_gain;
+		tr->vel.x += g * ((p->x - tr->pos.x) / dt - tr->vel.x);
+		tr->vel.y += g * ((p->y - tr->pos.y) / dt - tr->vel.y);
+		tr->vel.z += g * ((p->z - tr->pos.z) / dt - tr->vel.z);
+	}
+	tr->pos = *p;
+	tr->seen_ms = t_ms;
+	tr->point = j;
+	tr->hits++;
+	if (tr->state == KINECT_TRACK_TENTATIVE && tr->hits >= t->cfg.confirm_hits) {
+		tr->state = KINECT_TRACK_CONFIRMED;
+		tr->born = 1;
+	}
+}
+
+int kinect_track_update(kinect_tracker *t, double t_ms, const kinect_track_point *points, int n)
+{
+	const double gate = t->cfg.gate;
+	const double unmatched = gate * 2 * KINECT_TRACK_MAX + 1; // More than any sum of distances in the gate
+	int *group = t->group;
+	int i, j, k, nt;
+
+	if (n > KINECT_TRACK_MAX)
+		n = KINECT_TRACK_MAX;
+
+	// Forget the tracks that died in the previous update, predict the others
+	for (i = k = 0; i < t->count; i++) {
+		kinect_track *tr = &t->tracks[i];
+		double dt;
+		if (tr->state == KINECT_TRACK_DEAD)
+			continue;
+		dt = t_ms - tr->seen_ms;
+		if (dt > t->cfg.max_predict_ms)
+			dt = t->cfg.max_predict_ms;
+		tr->pred.x = tr->pos.x + tr->vel.x * dt;
+		tr->pred.y = tr->pos.y + tr->vel.y * dt;
+		tr->pred.z = tr->pos.z + tr->vel.z * dt;
+		tr->born = 0;
+		tr->point = -1;
+		t->tracks[k++] = *tr;
+	}
+	nt = t->count = k;
+	t->t_ms = t_ms;
+
+	// Predictions into the grid
+	for (i = 0; i < KINECT_TRACK_BUCKETS; i++)
+		t->bucket[i] = -1;
+	for (i = 0; i < nt; i++) {
+		unsigned b;
+		t->cell[i][0] = (int)floor(t->tracks[i].pred.x / gate);
+		t->cell[i][1] = (int)floor(t->tracks[i].pred.y / gate);
+		b = bucket_of(t->cell[i][0], t->cell[i][1]);
+		t->next[i] = t->bucket[b];
+		t->bucket[b] = i;
+	}
+
+	// Candidate pairs from the 3x3 cells around each point; tracks 0..nt-1 and
+	// points nt..nt+n-1 linked by a pair end up in the same group
+	for (i = 0; i < nt + n; i++)
+		group[i] = i;
+	for (i = 0; i < nt * n; i++)
+		t->dist[i] = -1;
+	for (j = 0; j < n; j++) {
+		const kinect_track_point *p = &points[j];
+		int cx = (int)floor(p->x / gate), cy = (int)floor(p->y / gate), dx, dy;
+		for (dy = -1; dy <= 1; dy++)
+			for (dx = -1; dx <= 1; dx++)
+				for (i = t->bucket[bucket_of(cx + dx, cy + dy)]; i >= 0; i = t->next[i]) {
+					const kinect_track_point *q = &t->tracks[i].pred;
+					double d;
+					// another cell hashed to the same bucket
+					if (t->cell[i][0] != cx + dx || t->cell[i][1] != cy + dy)
+						continue;
+					d = sqrt((p->x - q->x) * (p->x - q->x) + (p->y - q->y) * (p->y - q->y) + (p->z - q->z) * (p->z - q->z));
+					if (d > gate)
+						continue;
+					t->dist[i * n + j] = d;
+					group[find(group, i)] = find(group, nt + j);
+				}
+	}
+
+	// Each group with pairs: one pair is a match, more are assigned together
+	for (j = 0; j < n; j++)
+		t->track_of[j] = -1;
+	for (k = nt; k < nt + n; k++) {
+		int root = find(group, k), rows[KINECT_TRACK_MAX], cols[KINECT_TRACK_MAX], col[KINECT_TRACK_MAX];
+		int nr = 0, nc = 0, m, r, c;
+		if (t->track_of[k - nt] != -1)
+			continue;
+		for (i = 0; i < nt; i++)
+			if (find(group, i) == root)
+				rows[nr++] = i;
+		for (j = 0; j < n; j++)
+			if (find(group, nt + j) == root)
+				cols[nc++] = j;
+		// mark the group done
+		for (j = 0; j < nc; j++)
+			t->track_of[cols[j]] = -2;
+		if (nr == 0)
+			continue;
+		if (nr == 1 && nc == 1) {
+			match(t, rows[0], cols[0], t_ms, &points[cols[0]]);
+			t->track_of[cols[0]] = rows[0];
+			continue;
+		}
+		m = nr > nc ? nr : nc;
+		for (r = 0; r < m; r++)
+			for (c = 0; c < m; c++) {
+				double d = r < nr && c < nc ? t->dist[rows[r] * n + cols[c]] : -1;
+				t->cost[r * m + c] = d >= 0 ? d : unmatched;
+			}
+		kinect_track_assign(t->cost, m, m, col);
+		for (r = 0; r < nr; r++) {
+			c = col[r];
+			if (c >= nc || t->dist[rows[r] * n + cols[c]] < 0)
+				continue;
+			match(t, rows[r], cols[c], t_ms, &points[cols[c]]);
+			t->track_of[cols[c]] = rows[r];
+		}
+	}
+
+	// Tracks without a point: tentative ones are dropped, confirmed ones coast until lost_ms
+	for (i = k = 0; i < nt; i++) {
+		kinect_track *tr = &t->tracks[i];
+		if (tr->point < 0) {
+			tr->hits = 0;
+			if (tr->state == KINECT_TRACK_TENTATIVE)
+				continue;
+			if (t_ms - tr->seen_ms > t->cfg.lost_ms)
+				tr->state = KINECT_TRACK_DEAD;
+		} else {
+			t->track_of[tr->point] = k;
+		}
+		if (k != i)
+			t->tracks[k] = *tr;
+		k++;
+	}
+	t->count = k;
+
+	// Points without a track start one
+	for (j = 0; j < n; j++) {
+		kinect_track *tr;
+		if (t->track_of[j] >= 0)
+			continue;
+		t->track_of[j] = -1;
+		if (t->count == KINECT_TRACK_MAX)
+			continue;
+		tr = &t->tracks[t->count];
+		memset(tr, 0, sizeof(*tr));
+		tr->id = t->next_id++;
+		tr->state = KINECT_TRACK_TENTATIVE;
+		tr->pos = tr->pred = points[j];
+		tr->seen_ms = t_ms;
+		tr->point = j;
+		tr->hits = 1;
+		if (tr->hits >= t->cfg.confirm_hits) {
+			tr->state = KINECT_TRACK_CONFIRMED;
+			tr->born = 1;
+		}
+		t->track_of[j] = t->count++;
+	}
+	return t->count;
+}
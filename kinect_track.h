@@ -0,0 +1,107 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+ /* Multi-target tracker
+ Follows points from frame to frame: touch points, fingertips, hand centres.
+ Matching each point to the closest track in turn lets a point take the track
+ of another one that was closer to it; the tracker instead assigns all points
+ of a frame at once, with the smallest total distance.
+
+ Each track predicts where it is at the frame time from its velocity. The
+ predicted positions are put in a uniform grid of cells as large as the gate,
+ so each point only looks at the tracks of its 3x3 cells and only pairs
+ closer than the gate are candidates. Points and tracks linked by candidate
+ pairs form independent groups, mostly of one track and one point; each
+ larger group is solved by the Hungarian method, matching as many pairs as
+ possible, then with the smallest sum of distances.
+
+ A point no track takes starts a tentative track, confirmed once it was seen
+ in confirm_hits frames in a row; a tentative track that misses a frame is
+ dropped without ever being reported. A confirmed track without a point
+ coasts on its prediction and dies lost_ms after its last point. Time is in
+ ms of frame time, so a dropped frame is not a missed detection.
+
+ Nothing is allocated: up to KINECT_TRACK_MAX tracks and points per frame.
+ */
+
+#ifndef KINECT_TRACK_H
+#define KINECT_TRACK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KINECT_TRACK_MAX 64    // Tracks, and points per frame
+#define KINECT_TRACK_BUCKETS 256 // Grid cells are hashed into this many buckets
+
+#define KINECT_TRACK_TENTATIVE 0 // Seen in fewer than confirm_hits frames, not reported
+#define KINECT_TRACK_CONFIRMED 1
+#define KINECT_TRACK_DEAD 2      // Gone in this update, dropped at the next one
+
+typedef struct {
+	double gate;           // Farthest a point can be from a track's prediction, in the units of the points (default 40)
+	int confirm_hits;      // Frames in a row a new track must be seen to be confirmed (default 2)
+	double lost_ms;        // A confirmed track dies this long after its last point (default 100)
+	double velocity_gain;  // Weight of the last move in the velocity estimate, 0 to 1 (default 0.5)
+	double max_predict_ms; // Predict at most this far ahead of the last point (default 100)
+} kinect_track_config;
+
+typedef struct {
+	double x, y, z;        // z may stay 0 for 2D points
+} kinect_track_point;
+
+typedef struct {
+	int id;                // Unique, from 1
+	int state;             // KINECT_TRACK_TENTATIVE, _CONFIRMED or _DEAD
+	int born;              // Confirmed in this update
+	int point;             // Index of its point in this update, -1 while coasting
+	int hits;              // Frames in a row with a point
+	kinect_track_point pos; // Last point
+	kinect_track_point vel; // Velocity, per ms
+	kinect_track_point pred; // Prediction at the time of the update
+	double seen_ms;        // Time of the last point
+	void *user;            // For the caller: its cursor or hand, kept with the track
+} kinect_track;
+
+typedef struct {
+	kinect_track_config cfg;
+	kinect_track tracks[KINECT_TRACK_MAX];
+	int count;
+	int next_id;
+	double t_ms;           // Time of the last update
+	int track_of[KINECT_TRACK_MAX]; // For each point of the last update, the index of its track, -1 if none was free
+
+	// Work space of an update
+	int bucket[KINECT_TRACK_BUCKETS], next[KINECT_TRACK_MAX], cell[KINECT_TRACK_MAX][2];
+	int group[2 * KINECT_TRACK_MAX];
+	double dist[KINECT_TRACK_MAX * KINECT_TRACK_MAX]; // Track to point, -1 outside the gate
+	double cost[KINECT_TRACK_MAX * KINECT_TRACK_MAX]; // Matrix of a group
+} kinect_tracker;
+
+// cfg NULL uses the defaults
+void kinect_track_init(kinect_tracker *t, const kinect_track_config *cfg);
+void kinect_track_default_config(kinect_track_config *cfg);
+
+// Track the n points of the frame at t_ms (n is clipped to KINECT_TRACK_MAX).
+// Afterwards tracks[0..count) holds the live tracks and the ones that died in
+// this update, track_of maps the points to them. Returns count
+int kinect_track_update(kinect_tracker *t, double t_ms, const kinect_track_point *points, int n);
+
+// Forget all tracks, without reporting them dead
+void kinect_track_reset(kinect_tracker *t);
+
+// Hungarian method on the n x n cost matrix (row stride stride, n up to
+// KINECT_TRACK_MAX): sets col[row] for the assignment with the smallest
+// total cost and returns that cost
+double kinect_track_assign(const double *cost, int n, int stride, int *col);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KINECT_TRACK_H
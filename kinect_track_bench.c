@@ -0,0 +1,258 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+ /* Tracker against greedy closest point matching
+ First checks kinect_track_assign against all permutations of random cost
+ matrices up to 7x7. Then moves TARGETS points (default 24) over a 640x480
+ surface for FRAMES frames (default 20000) at 30 fps, with 1.5 px of noise,
+ 3% missed detections, 5% dropped frames and a false detection every other
+ frame. The points move up to 15 px per frame and their paths cross.
+
+ Each frame goes through kinect_track and through the greedy matching
+ kinect_touch.cpp did: the closest cursor, a new one if that one was already
+ taken in this frame, cursors without a point removed after two frames.
+ For both it reports the identity switches (a point reported under another
+ id than in its previous frame), the time per frame and the 99th percentile.
+
+   track_bench.out [FRAMES [TARGETS [SEED]]]    (TARGETS up to 64)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "kinect_track.h"
+
+#define W 640
+#define H 480
+#define FRAME_MS (1000.0 / 30)
+#define MAX_POINTS (KINECT_TRACK_MAX + 4)
+#define PERCENTILE 0.99
+
+static unsigned seed;
+
+static double uniform(double a, double b)
+{
+	seed = seed * 1103515245 + 12345;
+	return a + (b - a) * ((seed >> 8) & 0xffffff) / 16777216.0;
+}
+
+static double gauss(double sigma)
+{
+	double u = uniform(1e-9, 1), v = uniform(0, 1);
+	return sigma * sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int compare(const void *a, const void *b)
+{
+	double d = *(const double*)a - *(const double*)b;
+	return d < 0 ? -1 : d > 0;
+}
+
+static double percentile(double *us, long n)
+{
+	qsort(us, n, sizeof(*us), compare);
+	return us[(long)(PERCENTILE * (n - 1))];
+}
+
+// Smallest total cost over all permutations
+static double brute(const double *cost, int n, int row, int used)
+{
+	double best = HUGE_VAL;
+	int c;
+	if (row == n)
+		return 0;
+	for (c = 0; c < n; c++)
+		if (!(used & (1 << c))) {
+			double s = cost[row * n + c] + brute(cost, n, row + 1, used | (1 << c));
+			if (s < best)
+				best = s;
+		}
+	return best;
+}
+
+static int check_assign(int cases)
+{
+	double cost[7 * 7];
+	int col[7], wrong = 0, i, k;
+
+	for (k = 0; k < cases; k++) {
+		int n = 1 + k % 7, seen = 0;
+		double total = 0;
+		for (i = 0; i < n * n; i++)
+			cost[i] = uniform(0, 1) < 0.3 ? 1000 : floor(uniform(0, 50));
+		double got = kinect_track_assign(cost, n, n, col);
+		for (i = 0; i < n; i++) {
+			seen |= 1 << col[i];
+			total += cost[i * n + col[i]];
+		}
+		if (seen != (1 << n) - 1 || fabs(total - got) > 1e-9 || fabs(got - brute(cost, n, 0, 0)) > 1e-9)
+			wrong++;
+	}
+	printf("assign: %d of %d random matrices not optimal\n", wrong, cases);
+	return wrong;
+}
+
+// The matching of kinect_touch.cpp before the tracker
+typedef struct {
+	double x, y, t_ms;
+	int id;
+} greedy_cursor;
+
+typedef struct {
+	greedy_cursor c[256];
+	int count, next_id;
+} greedy;
+
+static void greedy_update(greedy *g, double t_ms, const kinect_track_point *p, int n, int *id_of)
+{
+	int i, j, k;
+	for (j = 0; j < n; j++) {
+		int best = -1;
+		double bd = HUGE_VAL;
+		for (i = 0; i < g->count; i++) {
+			double d = hypot(g->c[i].x - p[j].x, g->c[i].y - p[j].y);
+			if (d < bd) {
+				bd = d;
+				best = i;
+			}
+		}
+		if (best < 0 || g->c[best].t_ms == t_ms) {
+			if (g->count == 256) {
+				id_of[j] = 0;
+				continue;
+			}
+			best = g->count++;
+			g->c[best].id = g->next_id++;
+		}
+		g->c[best].x = p[j].x;
+		g->c[best].y = p[j].y;
+		g->c[best].t_ms = t_ms;
+		id_of[j] = g->c[best].id;
+	}
+	// stopped, then removed: gone after two frames without a point
+	for (i = k = 0; i < g->count; i++)
+		if (t_ms - g->c[i].t_ms < 1.5 * FRAME_MS)
+			g->c[k++] = g->c[i];
+	g->count = k;
+}
+
+int main(int argc, char **argv)
+{
+	int frames = argc > 1 ? atoi(argv[1]) : 20000;
+	int targets = argc > 2 ? atoi(argv[2]) : 24;
+	double x[KINECT_TRACK_MAX], y[KINECT_TRACK_MAX], vx[KINECT_TRACK_MAX], vy[KINECT_TRACK_MAX];
+	int track_id[KINECT_TRACK_MAX], greedy_id[KINECT_TRACK_MAX];
+	long track_switches = 0, greedy_switches = 0, updates = 0, reported = 0, detections = 0;
+	double track_us = 0, greedy_us = 0, *track_frame_us, *greedy_frame_us;
+	static kinect_tracker tracker;
+	static greedy g;
+	int f, i, wrong;
+
+	seed = argc > 3 ? atoi(argv[3]) : 1;
+	if (targets < 1 || targets > KINECT_TRACK_MAX) {
+		fprintf(stderr, "usage: %s [FRAMES [TARGETS<=%d [SEED]]]\n", argv[0], KINECT_TRACK_MAX);
+		return 2;
+	}
+	track_frame_us = malloc(frames * sizeof(double));
+	greedy_frame_us = malloc(frames * sizeof(double));
+	if (!track_frame_us || !greedy_frame_us) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	wrong = check_assign(7000);
+
+	kinect_track_init(&tracker, NULL);
+	for (i = 0; i < targets; i++) {
+		x[i] = uniform(20, W - 20);
+		y[i] = uniform(20, H - 20);
+		vx[i] = uniform(-15, 15);
+		vy[i] = uniform(-15, 15);
+		track_id[i] = greedy_id[i] = 0;
+	}
+
+	for (f = 0; f < frames; f++) {
+		kinect_track_point p[MAX_POINTS];
+		int target[MAX_POINTS], id_of[MAX_POINTS], n = 0;
+		double t_ms = f * FRAME_MS, t0, us;
+
+		// move, bouncing off the edges, and turn a little
+		for (i = 0; i < targets; i++) {
+			double a = uniform(-0.1, 0.1), c = cos(a), s = sin(a), v = vx[i];
+			vx[i] = c * v - s * vy[i];
+			vy[i] = s * v + c * vy[i];
+			x[i] += vx[i];
+			y[i] += vy[i];
+			if (x[i] < 0 || x[i] >= W) { vx[i] = -vx[i]; x[i] += 2 * vx[i]; }
+			if (y[i] < 0 || y[i] >= H) { vy[i] = -vy[i]; y[i] += 2 * vy[i]; }
+		}
+		if (uniform(0, 1) < 0.05)
+			continue; // dropped frame
+
+		for (i = 0; i < targets; i++)
+			if (uniform(0, 1) >= 0.03) {
+				p[n].x = x[i] + gauss(1.5);
+				p[n].y = y[i] + gauss(1.5);
+				p[n].z = 0;
+				target[n++] = i;
+			}
+		if (uniform(0, 1) < 0.5) {
+			p[n].x = uniform(0, W);
+			p[n].y = uniform(0, H);
+			p[n].z = 0;
+			target[n++] = -1;
+		}
+		detections += n;
+
+		t0 = now_us();
+		kinect_track_update(&tracker, t_ms, p, n);
+		us = now_us() - t0;
+		track_us += us;
+		track_frame_us[updates] = us;
+		for (i = 0; i < n; i++) {
+			const kinect_track *tr;
+			if (target[i] < 0 || tracker.track_of[i] < 0)
+				continue;
+			tr = &tracker.tracks[tracker.track_of[i]];
+			if (tr->state != KINECT_TRACK_CONFIRMED)
+				continue;
+			reported++;
+			if (track_id[target[i]] && track_id[target[i]] != tr->id)
+				track_switches++;
+			track_id[target[i]] = tr->id;
+		}
+
+		t0 = now_us();
+		greedy_update(&g, t_ms, p, n, id_of);
+		us = now_us() - t0;
+		greedy_us += us;
+		greedy_frame_us[updates++] = us;
+		for (i = 0; i < n; i++) {
+			if (target[i] < 0 || !id_of[i])
+				continue;
+			if (greedy_id[target[i]] && greedy_id[target[i]] != id_of[i])
+				greedy_switches++;
+			greedy_id[target[i]] = id_of[i];
+		}
+	}
+
+	printf("%ld frames, %d targets, %.1f points/frame\n", updates, targets, (double)detections / updates);
+	printf("kinect_track: %ld id switches, %.1f%% of the points reported, %.1f us/frame, p99 %.1f us\n",
+	       track_switches, 100.0 * reported / detections, track_us / updates, percentile(track_frame_us, updates));
+	printf("greedy:       %ld id switches, %.1f us/frame, p99 %.1f us\n",
+	       greedy_switches, greedy_us / updates, percentile(greedy_frame_us, updates));
+	return wrong ? 1 : 0;
+}
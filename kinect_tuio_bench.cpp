@@ -0,0 +1,331 @@
+/*
+ * This file is part of the Kinect Mouse and Swipe module for MagicMirror.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0, like the OpenKinect code it is built upon.
+ */
+
+ /* TUIO server against the vendored TuioClient
+ Moves CURSORS fingertips (default 20) over FRAMES frames (default 10000), as
+ kinect_touch.cpp feeds the TuioServer: closest cursor or a new one, then the
+ untouched ones stop and go. Every 100 frames one finger lifts for 3 frames, so
+ cursors are removed and added again. For the 2Dcur and the 3Dcur profile:
+
+ - encode: the time per frame and per commitFrame with a sender that drops the
+   bundles, and the heap allocations per frame once all cursors are there (0)
+ - udp: bundles to a TuioClient on 127.0.0.1, OSC messages per second
+ - unix: the same over a unix datagram socket, its receive thread handing the
+   packets to TuioClient::ProcessPacket
+
+ Both loopback tests keep at most a few bundles in flight, so none is dropped,
+ and check the client ends up with the cursors of the server, same session
+ IDs, same positions. The exit status is 1 if a check fails.
+
+   tuio_bench.out [FRAMES [CURSORS]]    (CURSORS up to 64)
+
+ 64 cursors in 3D do not fit one 4096 byte datagram: the frames go out as a
+ partial bundle with fseq -1 and the rest.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <new>
+
+#include "TuioServer.h"
+#include "TuioClient.h"
+#include "osc/OscReceivedElements.h"
+
+using namespace TUIO;
+
+#define UDP_PORT 3339
+#define UNIX_CLIENT_PORT 3340 // TuioClient binds a UDP port even when fed by hand
+#define IN_FLIGHT 4 // bundles sent and not yet seen by the client
+#define WAIT_US 1000000
+
+// Counts the heap allocations of the whole process while counting is set
+static volatile bool counting;
+static volatile long allocations;
+
+void *operator new(size_t size)
+{
+  if (counting)
+    allocations++;
+  void *p = malloc(size ? size : 1);
+  if (p == NULL)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+  free(p);
+}
+
+static double now_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Passes the bundles on, if there is a transport, and counts them and their messages
+class CountingSender : public OscSender {
+public:
+  OscSender *transport;
+  volatile long packets;
+  long messages, bytes;
+
+  CountingSender(OscSender *t) : transport(t), packets(0), messages(0), bytes(0) {}
+  ~CountingSender() { delete transport; }
+
+  bool sendOscPacket(osc::OutboundPacketStream *bundle) {
+    osc::ReceivedBundle b(osc::ReceivedPacket(bundle->Data(), bundle->Size()));
+    messages += b.ElementCount();
+    bytes += bundle->Size();
+    packets++;
+    return transport ? transport->sendOscPacket(bundle) : true;
+  }
+  bool isConnected() { return true; }
+  bool isLocal() { return transport ? transport->isLocal() : true; }
+  int getBufferSize() { return transport ? transport->getBufferSize() : MAX_UDP_SIZE; }
+};
+
+// Counts the client callbacks; refresh comes once per bundle
+class CountingListener : public TuioListener {
+public:
+  volatile long refreshes;
+  long added, updated, removed;
+
+  CountingListener() : refreshes(0), added(0), updated(0), removed(0) {}
+
+  void addTuioObject(TuioObject *) {}
+  void updateTuioObject(TuioObject *) {}
+  void removeTuioObject(TuioObject *) {}
+  void addTuioCursor(TuioCursor *) { added++; }
+  void updateTuioCursor(TuioCursor *) { updated++; }
+  void removeTuioCursor(TuioCursor *) { removed++; }
+  void refresh(TuioTime) { __sync_fetch_and_add(&refreshes, 1); }
+};
+
+// Fingertip i circles around its own cell of an 8x8 grid, so the closest cursor is always its own
+static void fingertip(int i, int frame, float *x, float *y, float *z)
+{
+  double a = frame * 0.05 + i;
+  *x = (i % 8 + 0.5) / 8 + 0.02 * cos(a);
+  *y = (i / 8 + 0.5) / 8 + 0.02 * sin(a);
+  *z = 0.5 + 0.1 * sin(a * 0.5);
+}
+
+// One frame of kinect_touch.cpp; returns the time spent in commitFrame
+static double frame(TuioServer *tuio, int f, int cursors, bool mode3d)
+{
+  TuioTime time((long)f * 33);
+  int lifted = (f / 100) % cursors;
+
+  tuio->initFrame(time);
+  for (int i=0; i<cursors; i++) {
+    if (i == lifted && f % 100 < 3)
+      continue;
+    float x, y, z;
+    fingertip(i, f, &x, &y, &z);
+    TuioCursor *cursor = mode3d ? tuio->getClosestTuioCursor(x, y, z) : tuio->getClosestTuioCursor(x, y);
+    if (cursor == NULL || cursor->getTuioTime() == time)
+      tuio->addTuioCursor(x, y, z);
+    else
+      tuio->updateTuioCursor(cursor, x, y, z);
+  }
+  tuio->stopUntouchedMovingCursors();
+  tuio->removeUntouchedStoppedCursors();
+
+  double t0 = now_us();
+  tuio->commitFrame();
+  return now_us() - t0;
+}
+
+static bool encode(int frames, int cursors, bool mode3d)
+{
+  CountingSender *sender = new CountingSender(NULL);
+  TuioServer *tuio = new TuioServer(sender, mode3d);
+  double commit_us = 0, t0 = 0;
+
+  for (int f=0; f<frames; f++) {
+    if (f == 100) { // past the first lift, every cursor and the id pool have been used
+      allocations = 0;
+      counting = true;
+      t0 = now_us();
+    }
+    double us = frame(tuio, f, cursors, mode3d);
+    if (counting)
+      commit_us += us;
+  }
+  counting = false;
+  double frame_us = now_us() - t0;
+  long steady = frames - 100;
+
+  printf("%s encode: %.2f us/frame, commitFrame %.2f us, %.1f bytes %.2f bundles/frame, %ld allocations in %ld frames\n",
+	 mode3d ? "3Dcur" : "2Dcur", frame_us / steady, commit_us / steady,
+	 (double)sender->bytes / frames, (double)sender->packets / frames, allocations, steady);
+  delete tuio;
+  return allocations == 0;
+}
+
+// Sends at most IN_FLIGHT bundles ahead of the client; false if one got lost
+static bool run(TuioServer *tuio, CountingSender *sender, CountingListener *listener, int frames, int cursors, bool mode3d)
+{
+  for (int f=0; f<frames; f++) {
+    frame(tuio, f, cursors, mode3d);
+    double t0 = now_us();
+    while (listener->refreshes < sender->packets - IN_FLIGHT)
+      if (now_us() - t0 > WAIT_US) return false;
+      else sched_yield();
+  }
+  double t0 = now_us();
+  while (listener->refreshes < sender->packets)
+    if (now_us() - t0 > WAIT_US) return false;
+    else sched_yield();
+  return true;
+}
+
+// The client has the cursors of the server, at the same positions
+static bool same(TuioServer *tuio, TuioClient *client)
+{
+  std::list<TuioCursor*> expected = tuio->getTuioCursors();
+  std::list<TuioCursor*> got = client->getTuioCursors();
+  if (expected.size() != got.size()) {
+    printf("  client has %d cursors, server %d\n", (int)got.size(), (int)expected.size());
+    return false;
+  }
+  for (std::list<TuioCursor*>::iterator i=expected.begin(); i!=expected.end(); i++) {
+    TuioCursor *c = client->getTuioCursor((*i)->getSessionID());
+    if (c == NULL || c->getX() != (*i)->getX() || c->getY() != (*i)->getY() || c->getZ() != (*i)->getZ()) {
+      printf("  cursor %ld differs\n", (*i)->getSessionID());
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool report(const char *transport, bool mode3d, bool delivered, bool ok, double us,
+		   CountingSender *sender, CountingListener *listener)
+{
+  printf("%s %s: %.0f msgs/s, %.0f bundles/s, %ld bytes, %ld added %ld updated %ld removed%s%s\n",
+	 mode3d ? "3Dcur" : "2Dcur", transport, sender->messages / us * 1e6, sender->packets / us * 1e6,
+	 sender->bytes, listener->added, listener->updated, listener->removed,
+	 delivered ? "" : ", BUNDLES LOST", ok ? "" : ", CURSORS DIFFER");
+  return delivered && ok;
+}
+
+static bool udp(int frames, int cursors, bool mode3d)
+{
+  CountingListener listener;
+  TuioClient *client = new TuioClient(UDP_PORT, mode3d);
+  client->addTuioListener(&listener);
+  client->connect(false);
+  if (!client->isConnected()) {
+    printf("%s udp: no client on port %d\n", mode3d ? "3Dcur" : "2Dcur", UDP_PORT);
+    return false;
+  }
+
+  CountingSender *sender = new CountingSender(new UdpSender("127.0.0.1", UDP_PORT));
+  TuioServer *tuio = new TuioServer(sender, mode3d);
+  double t0 = now_us();
+  bool delivered = run(tuio, sender, &listener, frames, cursors, mode3d);
+  double us = now_us() - t0;
+  usleep(10000);
+  bool ok = report("udp", mode3d, delivered, same(tuio, client), us, sender, &listener);
+
+  client->disconnect();
+  usleep(10000);
+  delete client;
+  delete tuio;
+  return ok;
+}
+
+struct UnixReceiver {
+  int fd;
+  TuioClient *client;
+};
+
+// Hands the datagrams to the client until an empty one
+static void *receive(void *arg)
+{
+  UnixReceiver *r = (UnixReceiver*)arg;
+  static char buffer[MAX_UNIX_SIZE];
+  ssize_t size;
+
+  while ((size = recv(r->fd, buffer, sizeof(buffer), 0)) > 0)
+    r->client->ProcessPacket(buffer, size, IpEndpointName());
+  return NULL;
+}
+
+static bool unixgram(int frames, int cursors, bool mode3d)
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/tuio_bench.%d", (int)getpid());
+  unlink(path);
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+  int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+  if (fd < 0 || bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+    perror(path);
+    return false;
+  }
+
+  // not connected: the client does not lock, only the receive thread touches it until the join
+  CountingListener listener;
+  TuioClient *client = new TuioClient(UNIX_CLIENT_PORT, mode3d);
+  client->addTuioListener(&listener);
+  UnixReceiver receiver = { fd, client };
+  pthread_t thread;
+  pthread_create(&thread, NULL, receive, &receiver);
+
+  CountingSender *sender = new CountingSender(new UnixSender(path));
+  TuioServer *tuio = new TuioServer(sender, mode3d);
+  double t0 = now_us();
+  bool delivered = run(tuio, sender, &listener, frames, cursors, mode3d);
+  double us = now_us() - t0;
+
+  sendto(fd, "", 0, 0, (struct sockaddr*)&address, sizeof(address));
+  pthread_join(thread, NULL);
+  bool ok = report("unix", mode3d, delivered, same(tuio, client), us, sender, &listener);
+
+  delete tuio;
+  delete client;
+  close(fd);
+  unlink(path);
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  int frames = argc > 1 ? atoi(argv[1]) : 10000;
+  int cursors = argc > 2 ? atoi(argv[2]) : 20;
+  bool ok = true;
+
+  if (frames <= 100 || cursors < 1 || cursors > TUIO_MAX_CURSORS) {
+    fprintf(stderr, "usage: %s [FRAMES>100 [CURSORS<=%d]]\n", argv[0], TUIO_MAX_CURSORS);
+    return 2;
+  }
+  printf("%d frames, %d cursors\n", frames, cursors);
+  for (int mode3d=0; mode3d<2; mode3d++) {
+    ok &= encode(frames, cursors, mode3d);
+    ok &= udp(frames, cursors, mode3d);
+    ok &= unixgram(frames, cursors, mode3d);
+  }
+  return ok ? 0 : 1;
+}
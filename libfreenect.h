@@ -37,11 +37,16 @@ extern "C" {
 #define FREENECT_FRAME_H 480
 #define FREENECT_FRAME_PIX (FREENECT_FRAME_H*FREENECT_FRAME_W)
 
+#define FREENECT_HALF_FRAME_W 320
+#define FREENECT_HALF_FRAME_H 240
+#define FREENECT_HALF_FRAME_PIX (FREENECT_HALF_FRAME_H*FREENECT_HALF_FRAME_W)
+
 #define FREENECT_IR_FRAME_W 640
 #define FREENECT_IR_FRAME_H 488
 #define FREENECT_IR_FRAME_PIX (FREENECT_IR_FRAME_H*FREENECT_IR_FRAME_W)
 
 #define FREENECT_VIDEO_RGB_SIZE (FREENECT_FRAME_PIX*3)
+#define FREENECT_VIDEO_RGB_HALF_SIZE (FREENECT_HALF_FRAME_PIX*3)
 #define FREENECT_VIDEO_BAYER_SIZE (FREENECT_FRAME_PIX)
 #define FREENECT_VIDEO_YUV_RGB_SIZE (FREENECT_VIDEO_RGB_SIZE)
 #define FREENECT_VIDEO_YUV_RAW_SIZE (FREENECT_FRAME_PIX*2)
@@ -64,6 +69,7 @@ typedef enum {
 	FREENECT_VIDEO_IR_10BIT_PACKED = 4,
 	FREENECT_VIDEO_YUV_RGB = 5,
 	FREENECT_VIDEO_YUV_RAW = 6,
+	FREENECT_VIDEO_RGB_HALF = 7,
 } freenect_video_format;
 
 typedef enum {
@@ -142,6 +148,10 @@ typedef void (*freenect_video_cb)(freenect_device *dev, void *video, uint32_t ti
 void freenect_set_depth_callback(freenect_device *dev, freenect_depth_cb cb);
 void freenect_set_video_callback(freenect_device *dev, freenect_video_cb cb);
 
+typedef void (*freenect_depth_rows_cb)(freenect_device *dev, void *depth, int first_row, int num_rows, uint32_t timestamp);
+int freenect_set_depth_streaming(freenect_device *dev, int enable);
+int freenect_set_depth_rows_callback(freenect_device *dev, freenect_depth_rows_cb cb, int rows_per_band);
+
 int freenect_set_depth_format(freenect_device *dev, freenect_depth_format fmt);
 int freenect_set_video_format(freenect_device *dev, freenect_video_format fmt);
 
@@ -0,0 +1,153 @@
+/*
+ TUIO C++ Library - TUIO 1.1 cursor server for the Kinect Mouse and Swipe
+ module, compatible with the reacTIVision TuioClient
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef INCLUDED_OSCSENDER_H
+#define INCLUDED_OSCSENDER_H
+
+#include <iostream>
+#include <cstring>
+
+#ifndef WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "osc/OscOutboundPacketStream.h"
+#include "ip/UdpSocket.h"
+
+#define MAX_UDP_SIZE 4096	// a whole frame in one datagram on the loopback
+#define IP_MTU_SIZE 1472	// 1500 byte ethernet MTU minus the IP and UDP headers
+#define MAX_UNIX_SIZE 4096
+
+namespace TUIO {
+
+	/**
+	 * Where the TuioServer sends its bundles. getBufferSize is the largest packet the
+	 * transport takes in one piece: the server allocates its buffer once with that size
+	 * and splits a frame over several bundles if it does not fit.
+	 */
+	class OscSender {
+
+	public:
+		virtual ~OscSender(){};
+
+		/**
+		 * Sends a complete packet, never blocks; a packet nobody listens to is dropped
+		 * @return false if the transport refused it
+		 */
+		virtual bool sendOscPacket(osc::OutboundPacketStream *bundle) = 0;
+
+		virtual bool isConnected() = 0;
+
+		virtual bool isLocal() = 0;
+
+		virtual int getBufferSize() = 0;
+	};
+
+	/**
+	 * UDP to host:port, the usual TUIO transport
+	 */
+	class UdpSender : public OscSender {
+
+	public:
+		UdpSender(const char *host="127.0.0.1", int port=3333) {
+			local = (strcmp(host,"127.0.0.1")==0) || (strcmp(host,"localhost")==0);
+			buffer_size = local ? MAX_UDP_SIZE : IP_MTU_SIZE;
+			try {
+				socket = new UdpTransmitSocket(IpEndpointName(host, port));
+			} catch (std::exception &e) {
+				std::cout << "could not create UDP socket to " << host << ":" << port << std::endl;
+				socket = NULL;
+			}
+		};
+
+		virtual ~UdpSender() {
+			delete socket;
+		};
+
+		bool sendOscPacket(osc::OutboundPacketStream *bundle) {
+			if (socket == NULL || bundle->Size() > (unsigned int)buffer_size) return false;
+			socket->Send(bundle->Data(), bundle->Size());
+			return true;
+		};
+
+		bool isConnected() {
+			return socket != NULL;
+		};
+
+		bool isLocal() {
+			return local;
+		};
+
+		int getBufferSize() {
+			return buffer_size;
+		};
+
+	private:
+		UdpTransmitSocket *socket;
+		bool local;
+		int buffer_size;
+	};
+
+#ifndef WIN32
+	/**
+	 * Unix datagram socket to a path, for a client on the same machine: no IP stack
+	 * and no port to configure. The client binds the path, until then packets are dropped.
+	 */
+	class UnixSender : public OscSender {
+
+	public:
+		UnixSender(const char *path) {
+			memset(&address, 0, sizeof(address));
+			address.sun_family = AF_UNIX;
+			strncpy(address.sun_path, path, sizeof(address.sun_path)-1);
+			socket_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+			if (socket_fd < 0) std::cout << "could not create unix socket for " << path << std::endl;
+		};
+
+		virtual ~UnixSender() {
+			if (socket_fd >= 0) close(socket_fd);
+		};
+
+		bool sendOscPacket(osc::OutboundPacketStream *bundle) {
+			if (socket_fd < 0 || bundle->Size() > MAX_UNIX_SIZE) return false;
+			return sendto(socket_fd, bundle->Data(), bundle->Size(), MSG_DONTWAIT,
+				(struct sockaddr*)&address, sizeof(address)) == (ssize_t)bundle->Size();
+		};
+
+		bool isConnected() {
+			return socket_fd >= 0;
+		};
+
+		bool isLocal() {
+			return true;
+		};
+
+		int getBufferSize() {
+			return MAX_UNIX_SIZE;
+		};
+
+	private:
+		int socket_fd;
+		struct sockaddr_un address;
+	};
+#endif
+};
+#endif /* INCLUDED_OSCSENDER_H */
@@ -0,0 +1,61 @@
+/*
+ TUIO C++ Library - TUIO 1.1 cursor server for the Kinect Mouse and Swipe
+ module, compatible with the reacTIVision TuioClient
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef INCLUDED_TUIOCURSOR_H
+#define INCLUDED_TUIOCURSOR_H
+
+#include "TuioContainer.h"
+
+namespace TUIO {
+
+	class TuioServer;
+
+	/**
+	 * A touch (2Dcur) or a fingertip in space (3Dcur). The cursor ID is the lowest ID
+	 * free when it appeared, the session ID is unique for the whole session.
+	 */
+	class TuioCursor: public TuioContainer {
+
+		// The server moves its pooled cursors itself, without growing their path
+		friend class TuioServer;
+
+	protected:
+		int cursor_id;
+
+	public:
+		TuioCursor (TuioTime ttime, long si, int ci, float xp, float yp, float zp=0):TuioContainer(ttime,si,xp,yp,zp) {
+			cursor_id = ci;
+		};
+
+		TuioCursor (long si, int ci, float xp, float yp, float zp=0):TuioContainer(si,xp,yp,zp) {
+			cursor_id = ci;
+		};
+
+		TuioCursor (TuioCursor *tcur):TuioContainer(tcur) {
+			cursor_id = tcur->getCursorID();
+		};
+
+		virtual ~TuioCursor(){};
+
+		virtual int getCursorID() {
+			return cursor_id;
+		};
+	};
+};
+#endif /* INCLUDED_TUIOCURSOR_H */
@@ -0,0 +1,47 @@
+/*
+ TUIO C++ Library - TUIO 1.1 cursor server for the Kinect Mouse and Swipe
+ module, compatible with the reacTIVision TuioClient
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef INCLUDED_TUIOLISTENER_H
+#define INCLUDED_TUIOLISTENER_H
+
+#include "TuioObject.h"
+#include "TuioCursor.h"
+
+namespace TUIO {
+
+	/**
+	 * Callbacks of a TuioClient, called from its receive thread. refresh ends each frame.
+	 */
+	class TuioListener {
+
+	public:
+		virtual ~TuioListener(){};
+
+		virtual void addTuioObject(TuioObject *tobj) = 0;
+		virtual void updateTuioObject(TuioObject *tobj) = 0;
+		virtual void removeTuioObject(TuioObject *tobj) = 0;
+
+		virtual void addTuioCursor(TuioCursor *tcur) = 0;
+		virtual void updateTuioCursor(TuioCursor *tcur) = 0;
+		virtual void removeTuioCursor(TuioCursor *tcur) = 0;
+
+		virtual void refresh(TuioTime ftime) = 0;
+	};
+};
+#endif /* INCLUDED_TUIOLISTENER_H */
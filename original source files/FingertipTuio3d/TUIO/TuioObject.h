@@ -0,0 +1,138 @@
+/*
+ TUIO C++ Library - TUIO 1.1 cursor server for the Kinect Mouse and Swipe
+ module, compatible with the reacTIVision TuioClient
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef INCLUDED_TUIOOBJECT_H
+#define INCLUDED_TUIOOBJECT_H
+
+#include "TuioContainer.h"
+
+#define TUIO_ROTATING 5
+
+namespace TUIO {
+
+	/**
+	 * A tagged object (2Dobj): a symbol ID and an angle on top of the container.
+	 * The server does not send objects, the client decodes them.
+	 */
+	class TuioObject: public TuioContainer {
+
+	protected:
+		int symbol_id;
+		float angle;
+		float rotation_speed;
+		float rotation_accel;
+
+	public:
+		TuioObject (TuioTime ttime, long si, int sym, float xp, float yp, float a):TuioContainer(ttime, si, xp, yp) {
+			symbol_id = sym;
+			angle = a;
+			rotation_speed = 0.0f;
+			rotation_accel = 0.0f;
+		};
+
+		TuioObject (long si, int sym, float xp, float yp, float a):TuioContainer(si, xp, yp) {
+			symbol_id = sym;
+			angle = a;
+			rotation_speed = 0.0f;
+			rotation_accel = 0.0f;
+		};
+
+		TuioObject (TuioObject *tobj):TuioContainer(tobj) {
+			symbol_id = tobj->getSymbolID();
+			angle = tobj->getAngle();
+			rotation_speed = 0.0f;
+			rotation_accel = 0.0f;
+		};
+
+		virtual ~TuioObject(){};
+
+		void update (TuioTime ttime, float xp, float yp, float a, float xs, float ys, float rs, float ma, float ra) {
+			TuioContainer::update(ttime,xp,yp,xs,ys,ma);
+			angle = a;
+			rotation_speed = rs;
+			rotation_accel = ra;
+			if ((rotation_accel!=0) && (state==TUIO_STOPPED)) state = TUIO_ROTATING;
+		};
+
+		void update (float xp, float yp, float a, float xs, float ys, float rs, float ma, float ra) {
+			TuioContainer::update(xp,yp,xs,ys,ma);
+			angle = a;
+			rotation_speed = rs;
+			rotation_accel = ra;
+			if ((rotation_accel!=0) && (state==TUIO_STOPPED)) state = TUIO_ROTATING;
+		};
+
+		void update (TuioTime ttime, float xp, float yp, float a) {
+			TuioPoint lastPoint = path.back();
+			TuioContainer::update(ttime,xp,yp);
+
+			TuioTime diffTime = currentTime - lastPoint.getTuioTime();
+			float dt = diffTime.getTotalMilliseconds()/1000.0f;
+			float last_angle = angle;
+			float last_rotation_speed = rotation_speed;
+			angle = a;
+
+			// a turn, wrapped to the shortest way round
+			double da = (angle-last_angle)/(2*M_PI);
+			if (da > 0.5) da -= 1.0;
+			else if (da < -0.5) da += 1.0;
+
+			rotation_speed = (float)da/dt;
+			rotation_accel = (rotation_speed - last_rotation_speed)/dt;
+			if ((rotation_accel!=0) && (state==TUIO_STOPPED)) state = TUIO_ROTATING;
+		};
+
+		void update (TuioObject *tobj) {
+			TuioContainer::update(tobj);
+			angle = tobj->getAngle();
+			rotation_speed = tobj->getRotationSpeed();
+			rotation_accel = tobj->getRotationAccel();
+			if ((rotation_accel!=0) && (state==TUIO_STOPPED)) state = TUIO_ROTATING;
+		};
+
+		void stop (TuioTime ttime) {
+			update(ttime,xpos,ypos,angle);
+		};
+
+		int getSymbolID() {
+			return symbol_id;
+		};
+
+		float getAngle() {
+			return angle;
+		};
+
+		float getAngleDegrees() {
+			return (float)(angle/M_PI*180);
+		};
+
+		float getRotationSpeed() {
+			return rotation_speed;
+		};
+
+		float getRotationAccel() {
+			return rotation_accel;
+		};
+
+		bool isMoving() {
+			return (state==TUIO_ACCELERATING) || (state==TUIO_DECELERATING) || (state==TUIO_ROTATING);
+		};
+	};
+};
+#endif /* INCLUDED_TUIOOBJECT_H */
@@ -0,0 +1,167 @@
+/*
+ TUIO C++ Library - TUIO 1.1 cursor server for the Kinect Mouse and Swipe
+ module, compatible with the reacTIVision TuioClient
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef INCLUDED_TUIOPOINT_H
+#define INCLUDED_TUIOPOINT_H
+
+#include <math.h>
+#include "TuioTime.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+namespace TUIO {
+
+	/**
+	 * A point in normalized coordinates (0 to 1; z is 0 in the 2D profiles) and the time it was last updated.
+	 */
+	class TuioPoint {
+
+	protected:
+		float xpos;
+		float ypos;
+		float zpos;
+		TuioTime currentTime;
+		TuioTime startTime;
+
+	public:
+		TuioPoint (float xp, float yp, float zp=0) {
+			xpos = xp;
+			ypos = yp;
+			zpos = zp;
+			currentTime = TuioTime::getSessionTime();
+			startTime = currentTime;
+		};
+
+		TuioPoint (TuioTime ttime, float xp, float yp, float zp=0) {
+			xpos = xp;
+			ypos = yp;
+			zpos = zp;
+			currentTime = ttime;
+			startTime = currentTime;
+		};
+
+		TuioPoint (TuioPoint *tpoint) {
+			xpos = tpoint->getX();
+			ypos = tpoint->getY();
+			zpos = tpoint->getZ();
+			currentTime = TuioTime::getSessionTime();
+			startTime = currentTime;
+		};
+
+		virtual ~TuioPoint(){};
+
+		void update (TuioPoint *tpoint) {
+			xpos = tpoint->getX();
+			ypos = tpoint->getY();
+			zpos = tpoint->getZ();
+		};
+
+		void update (float xp, float yp) {
+			xpos = xp;
+			ypos = yp;
+		};
+
+		void update (float xp, float yp, float zp) {
+			xpos = xp;
+			ypos = yp;
+			zpos = zp;
+		};
+
+		void update (TuioTime ttime, float xp, float yp) {
+			xpos = xp;
+			ypos = yp;
+			currentTime = ttime;
+		};
+
+		void update (TuioTime ttime, float xp, float yp, float zp) {
+			xpos = xp;
+			ypos = yp;
+			zpos = zp;
+			currentTime = ttime;
+		};
+
+		float getX() {
+			return xpos;
+		};
+
+		float getY() {
+			return ypos;
+		};
+
+		float getZ() {
+			return zpos;
+		};
+
+		float getDistance(float xp, float yp) {
+			float dx = xpos-xp;
+			float dy = ypos-yp;
+			return sqrtf(dx*dx+dy*dy);
+		};
+
+		float getDistance(float xp, float yp, float zp) {
+			float dx = xpos-xp;
+			float dy = ypos-yp;
+			float dz = zpos-zp;
+			return sqrtf(dx*dx+dy*dy+dz*dz);
+		};
+
+		float getDistance(TuioPoint *tpoint) {
+			return getDistance(tpoint->getX(),tpoint->getY(),tpoint->getZ());
+		};
+
+		/**
+		 * @return the angle in radians from this point to the given one, 0 to 2 pi
+		 */
+		float getAngle(float xp, float yp) {
+			float side = xp-xpos;
+			float height = ypos-yp;
+			float distance = getDistance(xp,yp);
+			float angle = (float)(asin(side/distance)+M_PI/2);
+			if (height<0) angle = 2.0f*(float)M_PI-angle;
+			return angle;
+		};
+
+		float getAngle(TuioPoint *tpoint) {
+			return getAngle(tpoint->getX(),tpoint->getY());
+		};
+
+		float getAngleDegrees(float xp, float yp) {
+			return (getAngle(xp,yp)/(float)M_PI)*180.0f;
+		};
+
+		int getScreenX(int width) {
+			return (int)floor(xpos*width+0.5f);
+		};
+
+		int getScreenY(int height) {
+			return (int)floor(ypos*height+0.5f);
+		};
+
+		TuioTime getTuioTime() {
+			return currentTime;
+		};
+
+		TuioTime getStartTime() {
+			return startTime;
+		};
+	};
+};
+#endif /* INCLUDED_TUIOPOINT_H */
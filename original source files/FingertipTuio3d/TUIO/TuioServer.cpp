@@ -0,0 +1,265 @@
+/*
+ TUIO C++ Library - TUIO 1.1 cursor server for the Kinect Mouse and Swipe
+ module, compatible with the reacTIVision TuioClient
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "TuioServer.h"
+
+using namespace TUIO;
+using namespace osc;
+
+// Encoded sizes in a bundle, 4 byte size slot included: the address and the
+// type tags are padded to 4 bytes, "set" and "alive" are strings, the rest int32 or float
+#define BUNDLE_HEADER_SIZE 16	// "#bundle" and the time tag
+#define SET_2D_SIZE 56		// /tuio/2Dcur ,sifffff set s x y X Y m
+#define SET_3D_SIZE 64		// /tuio/3Dcur ,sifffffff set s x y z X Y Z m
+#define FSEQ_SIZE 32		// /tuio/2Dcur ,si fseq n
+#define PAD4(n) (((n)+3) & ~3)
+
+TuioServer::TuioServer(bool mode3d) {
+	initialize(new UdpSender(), mode3d);
+}
+
+TuioServer::TuioServer(const char *host, int port, bool mode3d) {
+	initialize(new UdpSender(host, port), mode3d);
+}
+
+TuioServer::TuioServer(OscSender *sender, bool mode3d) {
+	initialize(sender, mode3d);
+}
+
+void TuioServer::initialize(OscSender *oscsender, bool mode) {
+	sender = oscsender;
+	mode3d = mode;
+	cursor_address = mode3d ? "/tuio/3Dcur" : "/tuio/2Dcur";
+	source_name = NULL;
+	full_update = false;
+
+	osc_buffer = new char[sender->getBufferSize()];
+	osc_packet = new OutboundPacketStream(osc_buffer, sender->getBufferSize());
+
+	// the cursor with ID i is always cursor_pool[i]
+	for (int i=0; i<TUIO_MAX_CURSORS; i++)
+		cursor_pool[i] = new TuioCursor(TuioTime(), -1, i, 0, 0, 0);
+	cursor_count = 0;
+	used_ids = 0;
+
+	TuioTime::initSession();
+	current_time = TuioTime::getSessionTime();
+	current_frame = 0;
+	session_id = -1;
+}
+
+TuioServer::~TuioServer() {
+	// an empty alive tells the clients all cursors are gone
+	cursor_count = 0;
+	initFrame(TuioTime::getSessionTime());
+	commitFrame();
+
+	for (int i=0; i<TUIO_MAX_CURSORS; i++)
+		delete cursor_pool[i];
+	delete osc_packet;
+	delete []osc_buffer;
+	delete sender;
+}
+
+void TuioServer::initFrame(TuioTime ttime) {
+	current_time = ttime;
+	current_frame++;
+}
+
+TuioCursor* TuioServer::addTuioCursor(float x, float y, float z) {
+	if (cursor_count == TUIO_MAX_CURSORS) return NULL;
+
+	// the lowest free cursor ID, as the client assigns them
+	int id = 0;
+	while (used_ids & (1ULL << id)) id++;
+	used_ids |= 1ULL << id;
+
+	TuioCursor *tcur = cursor_pool[id];
+	tcur->session_id = ++session_id;
+	tcur->xpos = x;
+	tcur->ypos = y;
+	tcur->zpos = mode3d ? z : 0;
+	tcur->currentTime = current_time;
+	tcur->startTime = current_time;
+	tcur->x_speed = tcur->y_speed = tcur->z_speed = 0.0f;
+	tcur->motion_speed = tcur->motion_accel = 0.0f;
+	tcur->state = TUIO_ADDED;
+	tcur->path.back() = TuioPoint(current_time, tcur->xpos, tcur->ypos, tcur->zpos);
+
+	cursors[cursor_count++] = tcur;
+	return tcur;
+}
+
+void TuioServer::moveCursor(TuioCursor *tcur, float x, float y, float z) {
+	// as TuioContainer::update, without growing the path
+	float dt = (current_time - tcur->currentTime).getTotalMilliseconds()/1000.0f;
+	float dx = x - tcur->xpos;
+	float dy = y - tcur->ypos;
+	float dz = z - tcur->zpos;
+
+	tcur->xpos = x;
+	tcur->ypos = y;
+	tcur->zpos = z;
+	tcur->currentTime = current_time;
+	tcur->path.back() = TuioPoint(current_time, x, y, z);
+	if (dt <= 0) return;
+
+	float last_motion_speed = tcur->motion_speed;
+	tcur->x_speed = dx/dt;
+	tcur->y_speed = dy/dt;
+	tcur->z_speed = dz/dt;
+	tcur->motion_speed = sqrtf(dx*dx+dy*dy+dz*dz)/dt;
+	tcur->motion_accel = (tcur->motion_speed - last_motion_speed)/dt;
+
+	if (tcur->motion_accel>0) tcur->state = TUIO_ACCELERATING;
+	else if (tcur->motion_accel<0) tcur->state = TUIO_DECELERATING;
+	else tcur->state = TUIO_STOPPED;
+}
+
+void TuioServer::updateTuioCursor(TuioCursor *tcur, float x, float y) {
+	if (tcur == NULL || tcur->getTuioTime() == current_time) return;
+	moveCursor(tcur, x, y, tcur->zpos);
+}
+
+void TuioServer::updateTuioCursor(TuioCursor *tcur, float x, float y, float z) {
+	if (tcur == NULL || tcur->getTuioTime() == current_time) return;
+	moveCursor(tcur, x, y, mode3d ? z : 0);
+}
+
+void TuioServer::removeTuioCursor(TuioCursor *tcur) {
+	if (tcur == NULL) return;
+	for (int i=0; i<cursor_count; i++) {
+		if (cursors[i] != tcur) continue;
+		// shift down so the alive list stays in order of appearance
+		for (int j=i+1; j<cursor_count; j++) cursors[j-1] = cursors[j];
+		cursor_count--;
+		used_ids &= ~(1ULL << tcur->cursor_id);
+		tcur->remove(current_time);
+		return;
+	}
+}
+
+void TuioServer::stopUntouchedMovingCursors() {
+	for (int i=0; i<cursor_count; i++) {
+		TuioCursor *tcur = cursors[i];
+		if (tcur->getTuioTime() != current_time && tcur->isMoving())
+			moveCursor(tcur, tcur->xpos, tcur->ypos, tcur->zpos);
+	}
+}
+
+void TuioServer::removeUntouchedStoppedCursors() {
+	for (int i=0; i<cursor_count; ) {
+		TuioCursor *tcur = cursors[i];
+		if (tcur->getTuioTime() != current_time && !tcur->isMoving())
+			removeTuioCursor(tcur);
+		else
+			i++;
+	}
+}
+
+int TuioServer::aliveMessageSize() {
+	return 4 + 12 + PAD4(3 + cursor_count) + 8 + 4*cursor_count;
+}
+
+void TuioServer::startBundle() {
+	osc_packet->Clear();
+	(*osc_packet) << BeginBundleImmediate;
+
+	if (source_name != NULL)
+		(*osc_packet) << BeginMessage(cursor_address) << "source" << source_name << EndMessage;
+
+	(*osc_packet) << BeginMessage(cursor_address) << "alive";
+	for (int i=0; i<cursor_count; i++)
+		(*osc_packet) << (int32)cursors[i]->session_id;
+	(*osc_packet) << EndMessage;
+}
+
+void TuioServer::addCursorSetMessage(TuioCursor *tcur) {
+	(*osc_packet) << BeginMessage(cursor_address) << "set" << (int32)tcur->session_id << tcur->xpos << tcur->ypos;
+	if (mode3d)
+		(*osc_packet) << tcur->zpos << tcur->x_speed << tcur->y_speed << tcur->z_speed << tcur->motion_accel;
+	else
+		(*osc_packet) << tcur->x_speed << tcur->y_speed << tcur->motion_accel;
+	(*osc_packet) << EndMessage;
+}
+
+void TuioServer::sendBundle(int32 fseq) {
+	(*osc_packet) << BeginMessage(cursor_address) << "fseq" << fseq << EndMessage;
+	(*osc_packet) << EndBundle;
+	sender->sendOscPacket(osc_packet);
+}
+
+void TuioServer::commitFrame() {
+	int set_size = mode3d ? SET_3D_SIZE : SET_2D_SIZE;
+	int header_size = BUNDLE_HEADER_SIZE + aliveMessageSize() + FSEQ_SIZE;
+	if (source_name != NULL) header_size += 4 + 12 + 4 + 8 + PAD4((int)strlen(source_name)+1);
+	if (header_size + set_size > (int)osc_packet->Capacity()) return;	// more cursors than a packet can name
+
+	startBundle();
+	for (int i=0; i<cursor_count; i++) {
+		TuioCursor *tcur = cursors[i];
+		if (!full_update && tcur->getTuioTime() != current_time) continue;
+
+		// full: send what we have as a partial frame and go on in a new bundle
+		if ((int)osc_packet->Size() + set_size + FSEQ_SIZE > (int)osc_packet->Capacity()) {
+			sendBundle(-1);
+			startBundle();
+		}
+		addCursorSetMessage(tcur);
+	}
+	sendBundle((int32)current_frame);
+}
+
+TuioCursor* TuioServer::getClosestTuioCursor(float x, float y) {
+	TuioCursor *closest = NULL;
+	float closest_distance = 1.0f;
+	for (int i=0; i<cursor_count; i++) {
+		float distance = cursors[i]->getDistance(x,y);
+		if (closest == NULL || distance < closest_distance) {
+			closest = cursors[i];
+			closest_distance = distance;
+		}
+	}
+	return closest;
+}
+
+TuioCursor* TuioServer::getClosestTuioCursor(float x, float y, float z) {
+	TuioCursor *closest = NULL;
+	float closest_distance = 1.0f;
+	for (int i=0; i<cursor_count; i++) {
+		float distance = cursors[i]->getDistance(x,y,z);
+		if (closest == NULL || distance < closest_distance) {
+			closest = cursors[i];
+			closest_distance = distance;
+		}
+	}
+	return closest;
+}
+
+TuioCursor* TuioServer::getTuioCursor(long s_id) {
+	for (int i=0; i<cursor_count; i++)
+		if (cursors[i]->session_id == s_id) return cursors[i];
+	return NULL;
+}
+
+std::list<TuioCursor*> TuioServer::getTuioCursors() {
+	std::list<TuioCursor*> list;
+	for (int i=0; i<cursor_count; i++) list.push_back(cursors[i]);
+	return list;
+}
@@ -0,0 +1,157 @@
+/*
+ TUIO C++ Library - TUIO 1.1 cursor server for the Kinect Mouse and Swipe
+ module, compatible with the reacTIVision TuioClient
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef INCLUDED_TUIOSERVER_H
+#define INCLUDED_TUIOSERVER_H
+
+#include <list>
+
+#include "osc/OscOutboundPacketStream.h"
+#include "OscSender.h"
+#include "TuioCursor.h"
+
+#define TUIO_MAX_CURSORS 64	// cursor pool size, cursor IDs are 0 to TUIO_MAX_CURSORS-1
+
+namespace TUIO {
+
+	/**
+	 * Sends the cursors of a frame as TUIO 1.1 /tuio/2Dcur, or /tuio/3Dcur in 3D mode.
+	 *
+	 * Every commitFrame sends one bundle: alive with all session IDs, set for the cursors
+	 * touched in this frame and fseq. A frame too big for one packet of the transport goes
+	 * out as several bundles, each with the full alive list, all but the last one with fseq -1.
+	 *
+	 * Nothing is allocated after the constructor: the cursors come from a fixed pool and the
+	 * bundles are written over the same buffer. The cursors' path keeps only the last point.
+	 */
+	class TuioServer {
+
+	public:
+		/**
+		 * UDP to localhost:3333
+		 */
+		TuioServer(bool mode3d=false);
+
+		/**
+		 * UDP to host:port
+		 */
+		TuioServer(const char *host, int port, bool mode3d=false);
+
+		/**
+		 * Any transport, for instance a UnixSender. The server deletes the sender.
+		 */
+		TuioServer(OscSender *sender, bool mode3d=false);
+
+		~TuioServer();
+
+		/**
+		 * Starts a frame, all the updates until commitFrame get this time
+		 */
+		void initFrame(TuioTime ttime);
+
+		/**
+		 * @return the new cursor, NULL if all TUIO_MAX_CURSORS are in use
+		 */
+		TuioCursor* addTuioCursor(float x, float y, float z=0);
+
+		/**
+		 * Moves a cursor, once per frame: a second update in the same frame is ignored
+		 */
+		void updateTuioCursor(TuioCursor *tcur, float x, float y);
+		void updateTuioCursor(TuioCursor *tcur, float x, float y, float z);
+
+		void removeTuioCursor(TuioCursor *tcur);
+
+		/**
+		 * Cursors not updated in this frame stop: speed and acceleration go to 0
+		 */
+		void stopUntouchedMovingCursors();
+
+		/**
+		 * Cursors not updated in this frame and already stopped are removed
+		 */
+		void removeUntouchedStoppedCursors();
+
+		/**
+		 * Sends the frame
+		 */
+		void commitFrame();
+
+		/**
+		 * Sends the set message of every cursor in each frame, not only the ones updated
+		 */
+		void enableFullUpdate() { full_update = true; };
+		void disableFullUpdate() { full_update = false; };
+
+		/**
+		 * TUIO 1.1 source message, sent first in every bundle. The name is not copied.
+		 */
+		void setSourceName(const char *name) { source_name = name; };
+
+		TuioCursor* getClosestTuioCursor(float x, float y);
+		TuioCursor* getClosestTuioCursor(float x, float y, float z);
+
+		TuioCursor* getTuioCursor(long s_id);
+
+		/**
+		 * A copy of the active cursors; allocates, use getTuioCursorCount in the frame loop
+		 */
+		std::list<TuioCursor*> getTuioCursors();
+
+		int getTuioCursorCount() { return cursor_count; };
+
+		long getSessionID() { return session_id; };
+
+		long getFrameID() { return current_frame; };
+
+		TuioTime getFrameTime() { return current_time; };
+
+		bool isMode3d() { return mode3d; };
+
+		bool isConnected() { return sender->isConnected(); };
+
+	private:
+		void initialize(OscSender *sender, bool mode3d);
+
+		void moveCursor(TuioCursor *tcur, float x, float y, float z);
+
+		void startBundle();
+		void addCursorSetMessage(TuioCursor *tcur);
+		void sendBundle(osc::int32 fseq);
+		int aliveMessageSize();
+
+		OscSender *sender;
+		char *osc_buffer;
+		osc::OutboundPacketStream *osc_packet;
+		const char *cursor_address;
+		const char *source_name;
+
+		TuioCursor *cursor_pool[TUIO_MAX_CURSORS];
+		TuioCursor *cursors[TUIO_MAX_CURSORS];	// active cursors, oldest first
+		int cursor_count;
+		unsigned long long used_ids;			// bit i set while cursor ID i is taken
+
+		TuioTime current_time;
+		long current_frame;
+		long session_id;
+		bool mode3d;
+		bool full_update;
+	};
+};
+#endif /* INCLUDED_TUIOSERVER_H */
@@ -0,0 +1,53 @@
+/*
+ TUIO C++ Library - TUIO 1.1 cursor server for the Kinect Mouse and Swipe
+ module, compatible with the reacTIVision TuioClient
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stddef.h>
+#include "TuioTime.h"
+
+using namespace TUIO;
+
+long TuioTime::start_seconds = 0;
+long TuioTime::start_micro_seconds = 0;
+
+void TuioTime::initSession() {
+	TuioTime startTime = getSystemTime();
+	start_seconds = startTime.getSeconds();
+	start_micro_seconds = startTime.getMicroseconds();
+}
+
+TuioTime TuioTime::getSessionTime() {
+	if (start_seconds == 0 && start_micro_seconds == 0)
+		initSession();
+	return getSystemTime() - getStartTime();
+}
+
+TuioTime TuioTime::getStartTime() {
+	return TuioTime(start_seconds, start_micro_seconds);
+}
+
+TuioTime TuioTime::getSystemTime() {
+#ifndef WIN32
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return TuioTime(tv.tv_sec, tv.tv_usec);
+#else
+	DWORD ms = GetTickCount();
+	return TuioTime(ms/MSEC_SECOND, USEC_MILLISECOND*(ms%MSEC_SECOND));
+#endif
+}
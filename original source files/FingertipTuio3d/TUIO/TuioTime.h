@@ -0,0 +1,136 @@
+/*
+ TUIO C++ Library - TUIO 1.1 cursor server for the Kinect Mouse and Swipe
+ module, compatible with the reacTIVision TuioClient
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef INCLUDED_TUIOTIME_H
+#define INCLUDED_TUIOTIME_H
+
+#ifndef WIN32
+#include <sys/time.h>
+#else
+#include <windows.h>
+#endif
+
+#define MSEC_SECOND 1000
+#define USEC_SECOND 1000000
+#define USEC_MILLISECOND 1000
+
+namespace TUIO {
+
+	/**
+	 * A time in seconds and microseconds, relative to the start of the TUIO session
+	 * (initSession, done by the first TuioServer or getSessionTime).
+	 * TuioTime values are copied around freely, they never allocate.
+	 */
+	class TuioTime {
+
+	private:
+		long seconds, micro_seconds;
+		static long start_seconds, start_micro_seconds;
+
+	public:
+		TuioTime () : seconds(0), micro_seconds(0) {};
+
+		/**
+		 * @param msec a time in milliseconds
+		 */
+		explicit TuioTime (long msec) {
+			seconds = msec/MSEC_SECOND;
+			micro_seconds = USEC_MILLISECOND*(msec%MSEC_SECOND);
+		};
+
+		TuioTime (long sec, long usec) {
+			seconds = sec;
+			micro_seconds = usec;
+		};
+
+		TuioTime operator+(long us) const {
+			long sec = seconds + us/USEC_SECOND;
+			long usec = micro_seconds + us%USEC_SECOND;
+			if (usec >= USEC_SECOND) { usec -= USEC_SECOND; sec++; }
+			return TuioTime(sec,usec);
+		};
+
+		TuioTime operator+(const TuioTime &ttime) const {
+			long sec = seconds + ttime.getSeconds();
+			long usec = micro_seconds + ttime.getMicroseconds();
+			if (usec >= USEC_SECOND) { usec -= USEC_SECOND; sec++; }
+			return TuioTime(sec,usec);
+		};
+
+		TuioTime operator-(long us) const {
+			long sec = seconds - us/USEC_SECOND;
+			long usec = micro_seconds - us%USEC_SECOND;
+			if (usec < 0) { usec += USEC_SECOND; sec--; }
+			return TuioTime(sec,usec);
+		};
+
+		TuioTime operator-(const TuioTime &ttime) const {
+			long sec = seconds - ttime.getSeconds();
+			long usec = micro_seconds - ttime.getMicroseconds();
+			if (usec < 0) { usec += USEC_SECOND; sec--; }
+			return TuioTime(sec,usec);
+		};
+
+		bool operator==(const TuioTime &ttime) const {
+			return seconds == ttime.getSeconds() && micro_seconds == ttime.getMicroseconds();
+		};
+
+		bool operator!=(const TuioTime &ttime) const {
+			return !(*this == ttime);
+		};
+
+		void reset() {
+			seconds = 0;
+			micro_seconds = 0;
+		};
+
+		long getSeconds() const {
+			return seconds;
+		};
+
+		long getMicroseconds() const {
+			return micro_seconds;
+		};
+
+		long getTotalMilliseconds() const {
+			return seconds*MSEC_SECOND + micro_seconds/USEC_MILLISECOND;
+		};
+
+		/**
+		 * Starts a new session: session times count from now
+		 */
+		static void initSession();
+
+		/**
+		 * @return the time since the start of the session
+		 */
+		static TuioTime getSessionTime();
+
+		/**
+		 * @return the system time the session started at
+		 */
+		static TuioTime getStartTime();
+
+		/**
+		 * @return the current system time
+		 */
+		static TuioTime getSystemTime();
+	};
+};
+#endif /* INCLUDED_TUIOTIME_H */
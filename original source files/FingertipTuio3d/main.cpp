@@ -14,6 +14,9 @@
 #include <CLNUIDevice.h>
 #pragma comment(lib, "CLNUIDevice.lib")
 
+// fingertips on run-length encoded hand masks
+#include "kinect_rle.h"
+
 void unproject(unsigned short* depth, float* x, float* y, float* z) {
 	int u,v;
 	const float f = 500.0f;
@@ -39,89 +42,106 @@ void unproject(unsigned short* depth, float* x, float* y, float* z) {
 	}
 }
 
-std::vector<cv::Point2i> detectFingertips(cv::Mat1f z, float zMin = 0.0f, float zMax = 0.75f, cv::Mat1f& debugFrame = cv::Mat1f()) {
+// Raw depths with zMin < z < zMax, as unproject computes z
+void rawDepthRange(float zMin, float zMax, unsigned short* rawMin, unsigned short* rawMax) {
+	*rawMin = 2047;
+	*rawMax = 0;
+	for (int i=0; i<2047; i++) {
+		float d = -0.00307110156374373f * i + 3.33094951605675f;
+		float zCurrent = d > 0 ? 1.0f / d : 0.0f;
+		if (zCurrent > zMin && zCurrent < zMax) {
+			if (i < *rawMin) *rawMin = i;
+			*rawMax = i;
+		}
+	}
+}
+
+cv::Point toPoint(const kinect_point& p) {
+	return cv::Point(p.x, p.y);
+}
+
+// The hand pixels are thresholded from the raw depth into runs and their contours traced on the runs
+// (kinect_rle.h): the same tips as findContours, approxPolyDP and convexHull on a mask image would give
+std::vector<cv::Point2i> detectFingertips(unsigned short* depth, float zMin = 0.0f, float zMax = 0.75f, cv::Mat1f& debugFrame = cv::Mat1f()) {
 	using namespace cv;
 	using namespace std;
 	bool debug = !debugFrame.empty();
+	static kinect_rle rle;
+	static vector<kinect_rle_blob> blobs(16);
+	static vector<kinect_point> contour(4096), approxCurve(4096), tips(64);
+	static vector<int> hull(4096);
 
 	vector<Point2i> fingerTips;
 
-	Mat handMask = z < zMax & z > zMin;
-
-	std::vector<std::vector<cv::Point> > contours;
-	findContours(handMask.clone(), contours, CV_RETR_LIST, CV_CHAIN_APPROX_SIMPLE); // we are cloning here since method will destruct the image
-
-	if (contours.size()) {
-		for (int i=0; i<contours.size(); i++) {
-			vector<Point> contour = contours[i];
-			Mat contourMat = Mat(contour);
-			double area = cv::contourArea(contourMat);
-
-			if (area > 3000)  { // possible hand
-				Scalar center = mean(contourMat);
-				Point centerPoint = Point(center.val[0], center.val[1]);
+	if (rle.w == 0 && kinect_rle_init(&rle, 640, 480) < 0)
+		return fingerTips;
+	unsigned short rawMin, rawMax;
+	rawDepthRange(zMin, zMax, &rawMin, &rawMax);
+	kinect_rle_threshold(&rle, depth, 640, 0, 0, 640, 480, rawMin, rawMax);
+	int nblobs = kinect_rle_label(&rle, &blobs[0], blobs.size());
+	if (nblobs > (int)blobs.size()) {
+		blobs.resize(nblobs * 2);
+		kinect_rle_label(&rle, &blobs[0], blobs.size());
+	}
 
-				vector<Point> approxCurve;
-				cv::approxPolyDP(contourMat, approxCurve, 20, true);
+	for (int i=0; i<nblobs; i++) {
+		int n = kinect_rle_trace(&rle, &blobs[i], &contour[0], contour.size());
+		if (n > (int)contour.size()) {
+			contour.resize(n * 2);
+			approxCurve.resize(n * 2);
+			hull.resize(n * 2);
+			kinect_rle_trace(&rle, &blobs[i], &contour[0], contour.size());
+		}
+		double area = kinect_rle_area(&contour[0], n);
 
-				vector<int> hull;
-				cv::convexHull(Mat(approxCurve), hull);
+		if (area > 3000)  { // possible hand
+			double sx = 0, sy = 0;
+			for (int j=0; j<n; j++) {
+				sx += contour[j].x;
+				sy += contour[j].y;
+			}
+			Scalar center = Scalar(sx / n, sy / n);
+
+			int na = kinect_rle_approx(&contour[0], n, 20, &approxCurve[0]);
+			if (na < 3)
+				continue;
+			int nh = kinect_rle_hull(&approxCurve[0], na, &hull[0]);
+
+			// low interior angle + within upper 90% of region -> we got a finger
+			// (lower vertices are not considered as fingers)
+			float cutoff;
+			if ((int)tips.size() < nh)
+				tips.resize(nh);
+			int nt = kinect_rle_tips(&approxCurve[0], na, &hull[0], nh, 1, &cutoff, &tips[0], nh);
+			for (int j=0; j<nt; j++) {
+				fingerTips.push_back(Point2i(tips[j].x, tips[j].y));
 
-				// find upper and lower bounds of the hand and define cutoff threshold (don't consider lower vertices as fingers)
-				int upper = 640, lower = 0;
-				for (int j=0; j<hull.size(); j++) {
-					int idx = hull[j]; // corner index
-					if (approxCurve[idx].y < upper) upper = approxCurve[idx].y;
-					if (approxCurve[idx].y > lower) lower = approxCurve[idx].y;
+				if (debug) {
+					cv::circle(debugFrame, toPoint(tips[j]), 10, Scalar(1), -1);
 				}
-				float cutoff = lower - (lower - upper) * 0.1f;
-
-				// find interior angles of hull corners
-				for (int j=0; j<hull.size(); j++) {
-					int idx = hull[j]; // corner index
-					int pdx = idx == 0 ? approxCurve.size() - 1 : idx - 1; //  predecessor of idx
-					int sdx = idx == approxCurve.size() - 1 ? 0 : idx + 1; // successor of idx
-
-					Point v1 = approxCurve[sdx] - approxCurve[idx];
-					Point v2 = approxCurve[pdx] - approxCurve[idx];
-
-					float angle = acos( (v1.x*v2.x + v1.y*v2.y) / (norm(v1) * norm(v2)) );
-
-					// low interior angle + within upper 90% of region -> we got a finger
-					if (angle < 1 && approxCurve[idx].y < cutoff) {
-						int u = approxCurve[idx].x;
-						int v = approxCurve[idx].y;
+			}
 
-						fingerTips.push_back(Point2i(u,v));
-						
-						if (debug) {
-							cv::circle(debugFrame, approxCurve[idx], 10, Scalar(1), -1);
-						}
+			if (debug) {
+				// draw cutoff threshold
+				cv::line(debugFrame, Point(center.val[0]-100, cutoff), Point(center.val[0]+100, cutoff), Scalar(1.0f));
+
+				// draw approxCurve
+				for (int j=0; j<na; j++) {
+					cv::circle(debugFrame, toPoint(approxCurve[j]), 10, Scalar(1.0f));
+					if (j != 0) {
+						cv::line(debugFrame, toPoint(approxCurve[j]), toPoint(approxCurve[j-1]), Scalar(1.0f));
+					} else {
+						cv::line(debugFrame, toPoint(approxCurve[0]), toPoint(approxCurve[na-1]), Scalar(1.0f));
 					}
 				}
 
-				if (debug) {
-					// draw cutoff threshold
-					cv::line(debugFrame, Point(center.val[0]-100, cutoff), Point(center.val[0]+100, cutoff), Scalar(1.0f));
-
-					// draw approxCurve
-					for (int j=0; j<approxCurve.size(); j++) {
-						cv::circle(debugFrame, approxCurve[j], 10, Scalar(1.0f));
-						if (j != 0) {
-							cv::line(debugFrame, approxCurve[j], approxCurve[j-1], Scalar(1.0f));
-						} else {
-							cv::line(debugFrame, approxCurve[0], approxCurve[approxCurve.size()-1], Scalar(1.0f));
-						}
-					}
-
-					// draw approxCurve hull
-					for (int j=0; j<hull.size(); j++) {
-						cv::circle(debugFrame, approxCurve[hull[j]], 10, Scalar(1.0f), 3);
-						if(j == 0) {
-							cv::line(debugFrame, approxCurve[hull[j]], approxCurve[hull[hull.size()-1]], Scalar(1.0f));
-						} else {
-							cv::line(debugFrame, approxCurve[hull[j]], approxCurve[hull[j-1]], Scalar(1.0f));
-						}
+				// draw approxCurve hull
+				for (int j=0; j<nh; j++) {
+					cv::circle(debugFrame, toPoint(approxCurve[hull[j]]), 10, Scalar(1.0f), 3);
+					if(j == 0) {
+						cv::line(debugFrame, toPoint(approxCurve[hull[j]]), toPoint(approxCurve[hull[nh-1]]), Scalar(1.0f));
+					} else {
+						cv::line(debugFrame, toPoint(approxCurve[hull[j]]), toPoint(approxCurve[hull[j-1]]), Scalar(1.0f));
 					}
 				}
 			}
@@ -175,10 +195,10 @@ void main() {
 				std::vector<cv::Point2i> fingerTips;
 
 				if (debug) {					
-					fingerTips = detectFingertips(z, 0, 0.75, debugFrame);
+					fingerTips = detectFingertips(depthFrameRawData, 0, 0.75, debugFrame);
 				} else {
 					// find fingertips
-					fingerTips = detectFingertips(z);
+					fingerTips = detectFingertips(depthFrameRawData);
 
 					// draw fingetips
 					for(vector<Point2i>::iterator it = fingerTips.begin(); it != fingerTips.end(); it++) {
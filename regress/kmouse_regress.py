@@ -0,0 +1,442 @@
+#!/usr/bin/env python3
+"""Gesture regression suite for kmouse_mm.
+
+Runs kmouse_mm headless (headless=1 event_time=1) over every replay of the
+corpus through fakenect, as fast as the pipeline goes (FAKENECT_CLOCK=virtual),
+and scores the swipe and click events against the ground truth:
+
+- precision and recall per gesture (swipe_left, swipe_right, swipe_up,
+  swipe_down, click, push: click events count for dwell and push gestures)
+- time to event: frames and ms from the start of the gesture to the event
+- throughput: depth frames analysed per second
+
+Corpus entries are synthetic scenes (*.txt, see fakenect/synth.h), whose
+ground truth fakenect writes while playing them, and recordings (*.fkn files
+or record directories) labelled by hand in <recording>.truth with the same
+JSON lines.
+
+The settings of baseline.json apply to every entry, its entry_settings to
+the entry of that name only (e.g. click=push for the push scene, the default
+click=dwell would not exercise the push detector), --set and --param on top
+of both.
+
+Commands:
+  check     score the corpus and fail when a metric regressed from the
+            baseline by more than its tolerance
+  baseline  score the corpus and write the baseline
+  sweep     score every combination of the --param values, in parallel,
+            best settings first
+
+e.g.
+  kmouse_regress.py --fakenect build/lib/fakenect check
+  kmouse_regress.py sweep --param h_varmax=50:200:50 --param hovering_threshold=10,15,20
+"""
+
+import argparse
+import concurrent.futures
+import csv
+import itertools
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+KINECT_TS_HZ = 60000000.  # camera clock of the libfreenect timestamps
+
+# Positional parameters of kmouse_mm, in order, with the values used here
+PARAMS = [
+    ('NearPixel_TooClose', 10000),
+    ('NearPixel_TooFarOrNoise', 1500),
+    ('freenect_log_level', 0),
+    ('ShowScreen', 0),
+    ('freenect_angle', -20),
+    ('freenect_led', 0),
+    ('gesture_click_area', 15),
+    ('hovering_threshold', 15),
+    ('minimum_stroke_points', 15),
+    ('maximum_stroke_points', 1000),
+    ('h_varmax', 100),
+    ('v_varmax', 100),
+    ('near_threshold', 550),
+    ('far_threshold', 800),
+    ('ScreenCenterX', 320),
+    ('ScreenCenterY', 240),
+    ('jsonout', 1),
+    ('MMM_Output_status', 0),
+    ('MMM_Output_log', 0),
+    ('MMM_Output_clicks', 1),
+    ('MMM_Output_coords', 0),
+    ('MMM_Output_swipes', 1),
+    ('debug', 0),
+    ('debugstop', 0),
+]
+PARAM_NAMES = [name for name, _ in PARAMS]
+
+GESTURES = ['swipe_left', 'swipe_right', 'swipe_up', 'swipe_down', 'click', 'push']
+
+# Gestures an event may stand for: a click event is a dwell or a push click
+MATCHES = {'click': ('click', 'push')}
+
+DEFAULT_TOLERANCE = {
+    'accuracy': 0.05,        # absolute drop of precision or recall
+    'latency_frames': 3.0,   # increase of the mean time to event in frames
+    'throughput': 0.5,       # relative drop of frames per second (machines differ)
+}
+
+
+def parse_values(spec):
+    """name=v1,v2,... or name=start:stop:step (stop included)"""
+    name, _, values = spec.partition('=')
+    if not values:
+        raise argparse.ArgumentTypeError('expected name=values: %s' % spec)
+    if ':' in values:
+        start, stop, step = (float(v) for v in values.split(':'))
+        out = []
+        v = start
+        while v <= stop + 1e-9:
+            out.append(int(v) if float(v).is_integer() else v)
+            v += step
+        return name, out
+    return name, [int(v) if v.lstrip('-').isdigit() else v for v in values.split(',')]
+
+
+def corpus_entries(corpus):
+    entries = []
+    for name in sorted(os.listdir(corpus)):
+        path = os.path.join(corpus, name)
+        if name.endswith('.truth') or name.startswith('.'):
+            continue
+        if name.endswith('.txt'):
+            entries.append(('synth', path))
+        elif name.endswith('.fkn') or os.path.isdir(path):
+            if os.path.exists(path + '.truth'):
+                entries.append(('recording', path))
+            else:
+                print('Skipping %s: no %s.truth labels' % (path, name), file=sys.stderr)
+    return entries
+
+
+def command_line(kmouse, settings):
+    args = [kmouse]
+    for name, default in PARAMS:
+        args.append(str(settings.get(name, default)))
+    # Everything else is a name=value option of kmouse_mm
+    for name, value in settings.items():
+        if name not in PARAM_NAMES:
+            args.append('%s=%s' % (name, value))
+    args += ['headless=1', 'event_time=1']
+    return args
+
+
+def read_events(lines):
+    events, stats = [], {}
+    for line in lines:
+        line = line.strip()
+        if not line.startswith('{'):
+            continue
+        try:
+            ev = json.loads(line)
+        except ValueError:
+            continue
+        if 'stats' in ev:
+            stats = ev['stats']
+        elif 'frame' in ev and 'swipe' in ev:
+            events.append(('swipe_' + ev['swipe'], ev['frame'], ev['ts']))
+        elif 'frame' in ev and 'click' in ev:
+            events.append(('click', ev['frame'], ev['ts']))
+    return events, stats
+
+
+def read_truth(path):
+    truth = []
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith('{'):
+                continue
+            t = json.loads(line)
+            label = t['truth'] + ('_' + t['dir'] if 'dir' in t else '')
+            truth.append(dict(t, label=label))
+    return truth
+
+
+def run_entry(kmouse, fakenect, settings, entry, timeout, window):
+    kind, path = entry
+    tmp = tempfile.mkdtemp(prefix='kmouse_regress')
+    try:
+        env = dict(os.environ)
+        env['FAKENECT_CLOCK'] = 'virtual'
+        env['FAKENECT_LOOP'] = '1'
+        env['LD_LIBRARY_PATH'] = fakenect + (':' + env['LD_LIBRARY_PATH'] if env.get('LD_LIBRARY_PATH') else '')
+        if kind == 'synth':
+            truth_path = os.path.join(tmp, 'truth')
+            env['FAKENECT_PATH'] = 'synth:' + os.path.abspath(path)
+            env['FAKENECT_TRUTH'] = truth_path
+        else:
+            truth_path = path + '.truth'
+            env['FAKENECT_PATH'] = os.path.abspath(path)
+        t0 = time.time()
+        proc = subprocess.run(command_line(kmouse, settings), env=env, cwd=tmp, timeout=timeout,
+                              stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, universal_newlines=True)
+        wall = time.time() - t0
+        events, stats = read_events(proc.stdout.splitlines())
+        if not os.path.exists(truth_path):
+            raise RuntimeError('%s: no ground truth, is %s the fakenect library?' % (path, fakenect))
+        truth = read_truth(truth_path)
+    finally:
+        shutil.rmtree(tmp, ignore_errors=True)
+    return score(truth, events, stats, wall, window)
+
+
+def frame_ms(t):
+    """Frame period around a gesture, from its timestamps (they wrap every 71s)"""
+    frames = t['end_frame'] - t['start_frame']
+    if frames <= 0:
+        return 1000. / 30
+    return ((t['end_ts'] - t['start_ts']) % 2**32) * 1000. / KINECT_TS_HZ / frames
+
+
+def score(truth, events, stats, wall, window):
+    """Matches each event to the earliest unmatched gesture it can stand for:
+    between the gesture start and window seconds after its end. Matched events
+    count for the gesture, the others as false positives of the event"""
+    res = {g: dict(truth=0, tp=0, fp=0, fn=0, frames=[], ms=[]) for g in GESTURES}
+    for t in truth:
+        res.setdefault(t['label'], dict(truth=0, tp=0, fp=0, fn=0, frames=[], ms=[]))['truth'] += 1
+    matched = set()
+    for label, frame, ts in sorted(events, key=lambda e: e[1]):
+        best = None
+        for i, t in enumerate(truth):
+            if i in matched or t['label'] not in MATCHES.get(label, (label,)):
+                continue
+            if t['start_frame'] <= frame <= t['end_frame'] + window * 1000. / frame_ms(t):
+                best = i
+                break
+        if best is None:
+            res.setdefault(label, dict(truth=0, tp=0, fp=0, fn=0, frames=[], ms=[]))['fp'] += 1
+            continue
+        matched.add(best)
+        r = res[truth[best]['label']]
+        r['tp'] += 1
+        r['frames'].append(frame - truth[best]['start_frame'])
+        r['ms'].append((frame - truth[best]['start_frame']) * frame_ms(truth[best]))
+    for i, t in enumerate(truth):
+        if i not in matched:
+            res[t['label']]['fn'] += 1
+    return dict(gestures=res, frames=int(stats.get('proc', 0)), wall=wall,
+                frame_ms=stats.get('frame_ms', [0, 0])[0])
+
+
+def merge(results):
+    total = dict(gestures={}, frames=0, wall=0., frame_ms=0.)
+    for r in results:
+        for g, v in r['gestures'].items():
+            t = total['gestures'].setdefault(g, dict(truth=0, tp=0, fp=0, fn=0, frames=[], ms=[]))
+            for k in v:
+                t[k] += v[k]
+        total['frame_ms'] += r['frame_ms'] * r['frames']
+        total['frames'] += r['frames']
+        total['wall'] += r['wall']
+    if total['frames']:
+        total['frame_ms'] /= total['frames']
+    return total
+
+
+def ratio(a, b):
+    return float(a) / b if b else None
+
+
+def mean(values):
+    return sum(values) / len(values) if values else None
+
+
+def metrics(total):
+    out = {}
+    tp = fp = fn = 0
+    for g, v in total['gestures'].items():
+        if not (v['truth'] or v['tp'] or v['fp']):
+            continue
+        out[g] = dict(truth=v['truth'], tp=v['tp'], fp=v['fp'], fn=v['fn'],
+                      precision=ratio(v['tp'], v['tp'] + v['fp']),
+                      recall=ratio(v['tp'], v['tp'] + v['fn']),
+                      latency_frames=mean(v['frames']), latency_ms=mean(v['ms']))
+        tp, fp, fn = tp + v['tp'], fp + v['fp'], fn + v['fn']
+    precision, recall = ratio(tp, tp + fp), ratio(tp, tp + fn)
+    f1 = 2 * precision * recall / (precision + recall) if precision and recall else 0.
+    all_frames = [f for v in total['gestures'].values() for f in v['frames']]
+    all_ms = [m for v in total['gestures'].values() for m in v['ms']]
+    out['all'] = dict(truth=tp + fn, tp=tp, fp=fp, fn=fn, precision=precision, recall=recall, f1=f1,
+                      latency_frames=mean(all_frames), latency_ms=mean(all_ms))
+    out['throughput_fps'] = ratio(total['frames'], total['wall']) or 0.
+    out['frame_ms'] = total['frame_ms']
+    return out
+
+
+def rounded(v):
+    if isinstance(v, dict):
+        return {k: rounded(x) for k, x in v.items()}
+    return round(v, 4) if isinstance(v, float) else v
+
+
+def fmt(v, spec='%.3f'):
+    return '-' if v is None else spec % v
+
+
+def print_metrics(m, out=sys.stdout):
+    print('%-12s %5s %4s %4s %4s %9s %7s %7s %8s' % ('gesture', 'truth', 'tp', 'fp', 'fn', 'precision', 'recall', 'frames', 'ms'), file=out)
+    for g in GESTURES + sorted(k for k in m if k not in GESTURES and isinstance(m[k], dict)):
+        if g not in m:
+            continue
+        v = m[g]
+        print('%-12s %5d %4d %4d %4d %9s %7s %7s %8s' % (g, v['truth'], v['tp'], v['fp'], v['fn'], fmt(v['precision']),
+              fmt(v['recall']), fmt(v['latency_frames'], '%.1f'), fmt(v['latency_ms'], '%.0f')), file=out)
+    print('f1 %s, throughput %.1f frames/s, %.2f ms/frame' % (fmt(m['all']['f1']), m['throughput_fps'], m['frame_ms']), file=out)
+
+
+def compare(base, cur, tol):
+    """Returns the regressions of cur against the baseline metrics"""
+    failures = []
+    for g, b in base.items():
+        if not isinstance(b, dict):
+            continue
+        c = cur.get(g)
+        for k in ('precision', 'recall'):
+            if b.get(k) is None:
+                continue
+            v = c.get(k) if c else None
+            if v is None or v < b[k] - tol['accuracy']:
+                failures.append('%s %s %s < %.3f - %.3f' % (g, k, fmt(v), b[k], tol['accuracy']))
+        if b.get('latency_frames') is not None and c and c.get('latency_frames') is not None:
+            if c['latency_frames'] > b['latency_frames'] + tol['latency_frames']:
+                failures.append('%s time to event %.1f > %.1f + %.1f frames' % (g, c['latency_frames'], b['latency_frames'], tol['latency_frames']))
+    if base.get('throughput_fps') and cur['throughput_fps'] < base['throughput_fps'] * (1 - tol['throughput']):
+        failures.append('throughput %.1f < %.1f frames/s - %d%%' % (cur['throughput_fps'], base['throughput_fps'], tol['throughput'] * 100))
+    return failures
+
+
+def entry_settings(settings, per_entry, overrides, entry):
+    """Settings of one corpus entry: the common ones, the entry's own, then the command line ones"""
+    s = dict(settings)
+    s.update(per_entry.get(os.path.basename(entry[1]), {}))
+    s.update(overrides)
+    return s
+
+
+def run_corpus(args, settings_list, entries):
+    """Runs every settings x entry pair on args.jobs workers, returns the merged results per settings"""
+    results = [[] for _ in settings_list]
+    with concurrent.futures.ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        futures = {}
+        for i, overrides in enumerate(settings_list):
+            for entry in entries:
+                settings = entry_settings(args.settings, args.entry_settings, overrides, entry)
+                f = pool.submit(run_entry, args.kmouse, args.fakenect, settings, entry, args.timeout, args.window)
+                futures[f] = (i, entry)
+        for f in concurrent.futures.as_completed(futures):
+            i, entry = futures[f]
+            r = f.result()
+            results[i].append(r)
+            if args.verbose:
+                print('%s: %d frames in %.1fs %s' % (os.path.basename(entry[1]), r['frames'], r['wall'], describe(settings_list[i], args.params)), file=sys.stderr)
+    return [merge(r) for r in results]
+
+
+def describe(settings, names):
+    return ' '.join('%s=%s' % (n, settings[n]) for n in names)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('command', choices=['check', 'baseline', 'sweep'])
+    parser.add_argument('--kmouse', default='./kmouse_mm.out', help='kmouse_mm binary (default %(default)s)')
+    parser.add_argument('--fakenect', default='/usr/local/lib/fakenect', help='directory of the fakenect libfreenect.so (default %(default)s)')
+    parser.add_argument('--corpus', default=os.path.join(HERE, 'corpus'), help='replays and scenes (default %(default)s)')
+    parser.add_argument('--baseline', default=os.path.join(HERE, 'baseline.json'), help='baseline metrics (default %(default)s)')
+    parser.add_argument('--set', action='append', default=[], metavar='NAME=VALUE', help='kmouse_mm parameter or option to use')
+    parser.add_argument('--param', action='append', default=[], type=parse_values, metavar='NAME=V1,V2|START:STOP:STEP', help='sweep values of a parameter')
+    parser.add_argument('--tolerance', action='append', default=[], metavar='NAME=VALUE', help='override a tolerance: %s' % ', '.join(DEFAULT_TOLERANCE))
+    parser.add_argument('--window', type=float, default=1.0, help='seconds after the end of a gesture its event may come (default %(default)s)')
+    parser.add_argument('--csv', help='write the sweep results to this file')
+    parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count() or 1, help='parallel kmouse_mm runs (default %(default)s)')
+    parser.add_argument('--timeout', type=float, default=600, help='seconds allowed per replay (default %(default)s)')
+    parser.add_argument('-v', '--verbose', action='store_true')
+    args = parser.parse_args()
+
+    entries = corpus_entries(args.corpus)
+    if not entries:
+        parser.error('no scenes or labelled recordings in %s' % args.corpus)
+    if not os.path.exists(args.kmouse):
+        parser.error('%s not found, run make first' % args.kmouse)
+
+    baseline = {}
+    if os.path.exists(args.baseline):
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+    args.settings = baseline.get('settings', {})
+    args.entry_settings = baseline.get('entry_settings', {})
+    for name in args.entry_settings:
+        if not os.path.exists(os.path.join(args.corpus, name)):
+            print('entry_settings: no %s in %s' % (name, args.corpus), file=sys.stderr)
+    settings = {}
+    for s in args.set:
+        name, _, value = s.partition('=')
+        settings[name] = value
+    tol = dict(DEFAULT_TOLERANCE, **baseline.get('tolerance', {}))
+    for s in args.tolerance:
+        name, _, value = s.partition('=')
+        tol[name] = float(value)
+
+    if args.command == 'sweep':
+        if not args.param:
+            parser.error('sweep needs at least one --param')
+        names = [n for n, _ in args.param]
+        args.params = names
+        combos = [dict(settings, **dict(zip(names, values))) for values in itertools.product(*[v for _, v in args.param])]
+        print('%d settings x %d replays on %d jobs' % (len(combos), len(entries), args.jobs), file=sys.stderr)
+        totals = run_corpus(args, combos, entries)
+        rows = sorted(((metrics(t), c) for t, c in zip(totals, combos)),
+                      key=lambda r: (-r[0]['all']['f1'], r[0]['all']['latency_ms'] or 0))
+        print('%-40s %6s %9s %7s %8s %7s' % ('settings', 'f1', 'precision', 'recall', 'ms', 'fps'))
+        for m, c in rows:
+            a = m['all']
+            print('%-40s %6s %9s %7s %8s %7.1f' % (describe(c, names), fmt(a['f1']), fmt(a['precision']), fmt(a['recall']),
+                  fmt(a['latency_ms'], '%.0f'), m['throughput_fps']))
+        if args.csv:
+            with open(args.csv, 'w', newline='') as f:
+                w = csv.writer(f)
+                w.writerow(names + ['gesture', 'truth', 'tp', 'fp', 'fn', 'precision', 'recall', 'latency_frames', 'latency_ms', 'throughput_fps'])
+                for m, c in rows:
+                    for g, v in m.items():
+                        if isinstance(v, dict):
+                            w.writerow([c[n] for n in names] + [g] + [v[k] for k in ('truth', 'tp', 'fp', 'fn', 'precision', 'recall', 'latency_frames', 'latency_ms')] + [m['throughput_fps']])
+        return 0
+
+    args.params = []
+    m = metrics(run_corpus(args, [settings], entries)[0])
+    print_metrics(m)
+
+    if args.command == 'baseline':
+        with open(args.baseline, 'w') as f:
+            json.dump(dict(settings=dict(args.settings, **settings), entry_settings=args.entry_settings,
+                           tolerance=tol, metrics=rounded(m)), f, indent=2, sort_keys=True)
+            f.write('\n')
+        print('Baseline written to %s' % args.baseline)
+        return 0
+
+    if 'metrics' not in baseline:
+        print('No baseline in %s, run the baseline command first' % args.baseline)
+        return 1
+    failures = compare(baseline['metrics'], m, tol)
+    for f in failures:
+        print('REGRESSION %s' % f)
+    print('FAILED' if failures else 'OK')
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())